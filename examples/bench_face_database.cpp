@@ -0,0 +1,655 @@
+#include "FaceDatabase.h"
+#include "kernels/SimilarityKernels.h"
+#include "kernels/QuantizedKernels.h"
+
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace mirror;
+
+static int query_num = 1000;
+static std::vector<int> gallery_sizes = {1000, 10000, 50000, 100000};
+
+static void RandomFeature(std::mt19937 &rng, std::vector<float> &feat, int dim = kFaceFeatureDim) {
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    feat.resize(dim);
+    for (auto &v : feat) {
+        v = dist(rng);
+    }
+}
+
+static void BuildGallery(std::mt19937 &rng, int gallery_size, FaceDatabase &database) {
+    database.Clear();
+    std::vector<float> feat;
+    for (int i = 0; i < gallery_size; ++i) {
+        RandomFeature(rng, feat);
+        database.Insert(feat, "face" + std::to_string(i));
+    }
+}
+
+int BenchQueryTop(int argc, char **argv) {
+    std::cout << "FaceDatabase QueryTop Benchmark......" << std::endl;
+    std::cout << "similarity kernel: " << GetSimilarityKernelName() << std::endl;
+
+    std::mt19937 rng(2021);
+    std::vector<std::vector<float>> probes(query_num);
+    for (auto &probe : probes) {
+        RandomFeature(rng, probe);
+    }
+
+    FaceDatabase database;
+    for (int gallery_size : gallery_sizes) {
+        BuildGallery(rng, gallery_size, database);
+
+        QueryResult query_result;
+        double start = static_cast<double>(cv::getTickCount());
+        for (const auto &probe : probes) {
+            database.QueryTop(probe, query_result);
+        }
+        double end = static_cast<double>(cv::getTickCount());
+        double time_cost = (end - start) / cv::getTickFrequency();
+
+        std::cout << "gallery size: " << gallery_size
+                  << " queries/sec: " << query_num / time_cost
+                  << " latency: " << time_cost * 1000 / query_num << "ms" << std::endl;
+    }
+
+    return 0;
+}
+
+int BenchQueryBatch(int argc, char **argv) {
+    std::cout << "FaceDatabase QueryBatch Benchmark......" << std::endl;
+
+    const int top_k = 5;
+    const int frame_num = 50;
+    const std::vector<int> faces_per_frame = {1, 4, 16, 32, 64};
+
+    std::mt19937 rng(2021);
+    FaceDatabase database;
+    for (int gallery_size : gallery_sizes) {
+        BuildGallery(rng, gallery_size, database);
+
+        for (int face_num : faces_per_frame) {
+            std::vector<std::vector<float>> probes(face_num);
+            std::vector<float> batch;
+            for (auto &probe : probes) {
+                RandomFeature(rng, probe);
+                batch.insert(batch.end(), probe.begin(), probe.end());
+            }
+
+            std::vector<QueryResult> query_results;
+            double start = static_cast<double>(cv::getTickCount());
+            for (int frame = 0; frame < frame_num; ++frame) {
+                for (const auto &probe : probes) {
+                    database.QueryTopK(probe, top_k, -1.0f, query_results);
+                }
+            }
+            double end = static_cast<double>(cv::getTickCount());
+            double single_cost = (end - start) / cv::getTickFrequency() * 1000 / frame_num;
+
+            std::vector<std::vector<QueryResult>> batch_results;
+            start = static_cast<double>(cv::getTickCount());
+            for (int frame = 0; frame < frame_num; ++frame) {
+                database.QueryBatch(batch.data(), face_num, top_k, -1.0f, batch_results);
+            }
+            end = static_cast<double>(cv::getTickCount());
+            double batch_cost = (end - start) / cv::getTickFrequency() * 1000 / frame_num;
+
+            std::cout << "gallery size: " << gallery_size
+                      << " faces/frame: " << face_num
+                      << " QueryTopK x N: " << single_cost << "ms"
+                      << " QueryBatch: " << batch_cost << "ms" << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+int BenchHnsw(int argc, char **argv) {
+    std::cout << "FaceDatabase HNSW Benchmark......" << std::endl;
+
+    const std::vector<int> ef_searches = {16, 32, 64, 128, 256};
+    const float noise_level = 0.5f;
+
+    std::mt19937 rng(2021);
+    FaceDatabaseParams params;
+    params.indexType = FaceIndexType::HNSW_INDEX;
+    FaceDatabase flat_database;
+    FaceDatabase hnsw_database(params);
+    for (int gallery_size : gallery_sizes) {
+        flat_database.Clear();
+        hnsw_database.Clear();
+        std::vector<std::vector<float>> gallery(gallery_size);
+        double start = static_cast<double>(cv::getTickCount());
+        for (int i = 0; i < gallery_size; ++i) {
+            RandomFeature(rng, gallery[i]);
+            flat_database.Insert(gallery[i], "face" + std::to_string(i));
+            hnsw_database.Insert(gallery[i], "face" + std::to_string(i));
+        }
+        double end = static_cast<double>(cv::getTickCount());
+        std::cout << "gallery size: " << gallery_size << " build cost: "
+                  << (end - start) / cv::getTickFrequency() << "s" << std::endl;
+
+        // probes are noisy copies of enrolled faces, the exact scan gives the ground truth
+        std::normal_distribution<float> noise(0.0f, noise_level);
+        std::uniform_int_distribution<int> pick(0, gallery_size - 1);
+        std::vector<std::vector<float>> probes(query_num);
+        std::vector<std::string> truth(query_num);
+        double flat_cost = 0;
+        for (int i = 0; i < query_num; ++i) {
+            probes[i] = gallery[pick(rng)];
+            for (auto &v : probes[i]) {
+                v += noise(rng);
+            }
+            QueryResult query_result;
+            start = static_cast<double>(cv::getTickCount());
+            flat_database.QueryTop(probes[i], query_result);
+            end = static_cast<double>(cv::getTickCount());
+            flat_cost += (end - start) / cv::getTickFrequency();
+            truth[i] = query_result.name_;
+        }
+        std::cout << "exact scan latency: " << flat_cost * 1000 / query_num << "ms" << std::endl;
+
+        for (int ef_search : ef_searches) {
+            params.hnswEfSearch = ef_search;
+            hnsw_database.Update(params);
+
+            int hits = 0;
+            QueryResult query_result;
+            start = static_cast<double>(cv::getTickCount());
+            for (int i = 0; i < query_num; ++i) {
+                hnsw_database.QueryTop(probes[i], query_result);
+                hits += query_result.name_ == truth[i];
+            }
+            end = static_cast<double>(cv::getTickCount());
+            double time_cost = (end - start) / cv::getTickFrequency();
+
+            std::cout << "efSearch: " << ef_search
+                      << " recall@1: " << static_cast<double>(hits) / query_num
+                      << " latency: " << time_cost * 1000 / query_num << "ms" << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+int BenchIvfPq(int argc, char **argv) {
+    std::cout << "FaceDatabase IVFPQ Benchmark......" << std::endl;
+
+    const std::vector<int> code_sizes = {16, 32};
+    const std::vector<int> nprobes = {8, 16, 32};
+    const std::vector<int> reranks = {0, 64};
+    const float noise_level = 0.5f;
+
+    std::mt19937 rng(2021);
+    for (int gallery_size : gallery_sizes) {
+        FaceDatabase database;
+        std::vector<std::vector<float>> gallery(gallery_size);
+        for (int i = 0; i < gallery_size; ++i) {
+            RandomFeature(rng, gallery[i]);
+            database.Insert(gallery[i], "face" + std::to_string(i));
+        }
+
+        // probes are noisy copies of enrolled faces, the exact scan gives the ground truth
+        std::normal_distribution<float> noise(0.0f, noise_level);
+        std::uniform_int_distribution<int> pick(0, gallery_size - 1);
+        std::vector<std::vector<float>> probes(query_num);
+        std::vector<std::string> truth(query_num);
+        for (int i = 0; i < query_num; ++i) {
+            probes[i] = gallery[pick(rng)];
+            for (auto &v : probes[i]) {
+                v += noise(rng);
+            }
+            QueryResult query_result;
+            database.QueryTop(probes[i], query_result);
+            truth[i] = query_result.name_;
+        }
+
+        FaceDatabaseParams params;
+        params.indexType = FaceIndexType::IVFPQ_INDEX;
+        params.ivfNlist = std::max(16, static_cast<int>(4 * std::sqrt(static_cast<double>(gallery_size))));
+        for (int code_size : code_sizes) {
+            params.ivfPqCodeSize = code_size;
+            double start = static_cast<double>(cv::getTickCount());
+            database.Update(params);
+            double end = static_cast<double>(cv::getTickCount());
+            std::cout << "gallery size: " << gallery_size << " nlist: " << params.ivfNlist
+                      << " code size: " << code_size << " bytes (float: "
+                      << kFaceFeatureDim * sizeof(float) << " bytes)"
+                      << " train + encode cost: " << (end - start) / cv::getTickFrequency() << "s" << std::endl;
+
+            for (int rerank : reranks) {
+                for (int nprobe : nprobes) {
+                    params.ivfNprobe = nprobe;
+                    params.ivfRerank = rerank;
+                    database.Update(params);
+
+                    int hits = 0;
+                    QueryResult query_result;
+                    start = static_cast<double>(cv::getTickCount());
+                    for (int i = 0; i < query_num; ++i) {
+                        database.QueryTop(probes[i], query_result);
+                        hits += query_result.name_ == truth[i];
+                    }
+                    end = static_cast<double>(cv::getTickCount());
+                    double time_cost = (end - start) / cv::getTickFrequency();
+
+                    std::cout << "nprobe: " << nprobe << " rerank: " << rerank
+                              << " recall@1: " << static_cast<double>(hits) / query_num
+                              << " latency: " << time_cost * 1000 / query_num << "ms" << std::endl;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+int BenchStorage(int argc, char **argv) {
+    std::cout << "FaceDatabase Storage Benchmark......" << std::endl;
+    std::cout << "quantized kernel: " << GetQuantizedKernelName() << std::endl;
+
+    struct StorageConfig {
+        FaceStorageType type;
+        int rerank;
+        size_t bytes_per_face;
+    };
+    const size_t float_bytes = AlignedFeatureDim(kFaceFeatureDim) * sizeof(float);
+    const std::vector<StorageConfig> configs = {
+            {FaceStorageType::FLOAT32_STORAGE, 0, float_bytes},
+            {FaceStorageType::FP16_STORAGE,    0, kFaceFeatureDim * sizeof(uint16_t)},
+            {FaceStorageType::INT8_STORAGE,    0, kFaceFeatureDim + sizeof(float)},
+            {FaceStorageType::INT8_STORAGE,    16, kFaceFeatureDim + sizeof(float) + float_bytes},
+    };
+    const float noise_level = 0.5f;
+
+    std::mt19937 rng(2021);
+    for (int gallery_size : gallery_sizes) {
+        std::vector<std::vector<float>> gallery(gallery_size);
+        for (auto &feat : gallery) {
+            RandomFeature(rng, feat);
+        }
+
+        // probes are noisy copies of enrolled faces, the float32 database gives the ground truth
+        std::normal_distribution<float> noise(0.0f, noise_level);
+        std::uniform_int_distribution<int> pick(0, gallery_size - 1);
+        std::vector<std::vector<float>> probes(query_num);
+        for (auto &probe : probes) {
+            probe = gallery[pick(rng)];
+            for (auto &v : probe) {
+                v += noise(rng);
+            }
+        }
+
+        std::vector<QueryResult> truth(query_num);
+        for (const StorageConfig &config : configs) {
+            FaceDatabaseParams params;
+            params.storageType = config.type;
+            params.storageRerank = config.rerank;
+            FaceDatabase database(params);
+            for (int i = 0; i < gallery_size; ++i) {
+                database.Insert(gallery[i], "face" + std::to_string(i));
+            }
+
+            std::vector<QueryResult> results(query_num);
+            double start = static_cast<double>(cv::getTickCount());
+            for (int i = 0; i < query_num; ++i) {
+                database.QueryTop(probes[i], results[i]);
+            }
+            double end = static_cast<double>(cv::getTickCount());
+            double time_cost = (end - start) / cv::getTickFrequency();
+            if (config.type == FaceStorageType::FLOAT32_STORAGE) {
+                truth = results;
+            }
+
+            int hits = 0;
+            double sim_error = 0;
+            for (int i = 0; i < query_num; ++i) {
+                hits += results[i].name_ == truth[i].name_;
+                sim_error += std::fabs(results[i].sim_ - truth[i].sim_);
+            }
+
+            std::cout << "gallery size: " << gallery_size
+                      << " storage: " << GetFaceStorageTypeName(config.type)
+                      << " rerank: " << config.rerank
+                      << " bytes/face: " << config.bytes_per_face
+                      << " recall@1: " << static_cast<double>(hits) / query_num
+                      << " mean |sim error|: " << sim_error / query_num
+                      << " queries/sec: " << query_num / time_cost << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+int BenchLoad(int argc, char **argv) {
+    std::cout << "FaceDatabase Load Benchmark......" << std::endl;
+
+    const std::string path = argc >= 4 ? argv[3] : ".";
+    std::mt19937 rng(2021);
+    std::vector<float> probe;
+    RandomFeature(rng, probe);
+    for (int gallery_size : gallery_sizes) {
+        {
+            FaceDatabase database;
+            BuildGallery(rng, gallery_size, database);
+            database.Save(path.c_str());
+        }
+
+        // the features are mapped, not read, so loading costs the names table only
+        FaceDatabase database;
+        double start = static_cast<double>(cv::getTickCount());
+        database.Load(path.c_str());
+        double end = static_cast<double>(cv::getTickCount());
+        QueryResult query_result;
+        database.QueryTop(probe, query_result);
+        double first = static_cast<double>(cv::getTickCount());
+
+        std::cout << "gallery size: " << gallery_size
+                  << " load: " << (end - start) * 1000 / cv::getTickFrequency() << "ms"
+                  << " first query: " << (first - end) * 1000 / cv::getTickFrequency() << "ms" << std::endl;
+    }
+
+    return 0;
+}
+
+int BenchConcurrent(int argc, char **argv) {
+    std::cout << "FaceDatabase Concurrent Query Benchmark......" << std::endl;
+
+    const int reader_num = std::max(1u, std::thread::hardware_concurrency() / 2);
+    const std::vector<int> writer_nums = {0, 1, 2};
+
+    std::mt19937 rng(2021);
+    std::vector<std::vector<float>> probes(query_num);
+    for (auto &probe : probes) {
+        RandomFeature(rng, probe);
+    }
+
+    FaceDatabase database;
+    for (int gallery_size : gallery_sizes) {
+        BuildGallery(rng, gallery_size, database);
+
+        for (int writer_num : writer_nums) {
+            // queries read a snapshot of the gallery, writers never block them
+            std::atomic<bool> stop(false);
+            std::atomic<long> writes(0);
+            std::vector<std::thread> writers;
+            for (int w = 0; w < writer_num; ++w) {
+                writers.emplace_back([&, w]() {
+                    std::mt19937 writer_rng(w);
+                    std::vector<float> feat;
+                    for (long i = 0; !stop.load(); ++i) {
+                        const std::string name = "writer" + std::to_string(w) + "_" + std::to_string(i % 1000);
+                        if (i % 4 == 3) {
+                            database.Delete(name);
+                        } else {
+                            RandomFeature(writer_rng, feat);
+                            database.Insert(feat, name);
+                        }
+                        writes.fetch_add(1);
+                    }
+                });
+            }
+
+            std::vector<std::thread> readers;
+            double start = static_cast<double>(cv::getTickCount());
+            for (int r = 0; r < reader_num; ++r) {
+                readers.emplace_back([&]() {
+                    QueryResult query_result;
+                    for (const auto &probe : probes) {
+                        database.QueryTop(probe, query_result);
+                    }
+                });
+            }
+            for (auto &reader : readers) {
+                reader.join();
+            }
+            double end = static_cast<double>(cv::getTickCount());
+            stop.store(true);
+            for (auto &writer : writers) {
+                writer.join();
+            }
+            double time_cost = (end - start) / cv::getTickFrequency();
+
+            std::cout << "gallery size: " << gallery_size
+                      << " readers: " << reader_num
+                      << " writers: " << writer_num
+                      << " queries/sec: " << reader_num * query_num / time_cost
+                      << " writes/sec: " << writes.load() / time_cost << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+int BenchTemplates(int argc, char **argv) {
+    std::cout << "FaceDatabase Multiple Templates Benchmark......" << std::endl;
+
+    const int template_num = 4;
+    const float template_noise = 1.5f;
+    const float probe_noise = 1.5f;
+
+    std::mt19937 rng(2021);
+    for (int gallery_size : gallery_sizes) {
+        // every identity is enrolled from several noisy captures, probes are other captures of it
+        std::normal_distribution<float> noise(0.0f, 1.0f);
+        std::vector<std::vector<float>> identities(gallery_size);
+        std::vector<std::vector<std::vector<float>>> templates(gallery_size);
+        for (int i = 0; i < gallery_size; ++i) {
+            RandomFeature(rng, identities[i]);
+            templates[i].resize(template_num, identities[i]);
+            for (auto &feat : templates[i]) {
+                for (auto &v : feat) {
+                    v += template_noise * noise(rng);
+                }
+            }
+        }
+        std::uniform_int_distribution<int> pick(0, gallery_size - 1);
+        std::vector<std::vector<float>> probes(query_num);
+        std::vector<int> truth(query_num);
+        for (int i = 0; i < query_num; ++i) {
+            truth[i] = pick(rng);
+            probes[i] = identities[truth[i]];
+            for (auto &v : probes[i]) {
+                v += probe_noise * noise(rng);
+            }
+        }
+
+        for (int max_templates : {1, template_num}) {
+            FaceDatabaseParams params;
+            params.maxTemplates = max_templates;
+            FaceDatabase database(params);
+            for (int t = 0; t < max_templates; ++t) {
+                for (int i = 0; i < gallery_size; ++i) {
+                    database.Insert(templates[i][t], "face" + std::to_string(i));
+                }
+            }
+            // every identity is listed once, whatever its number of templates
+            std::vector<std::string> names;
+            database.Find(names);
+            if (names.size() != static_cast<size_t>(gallery_size)) {
+                std::cout << "find listed " << names.size() << " names for " << gallery_size << " faces."
+                          << std::endl;
+                return -1;
+            }
+
+            for (auto aggregation : {MAX_AGGREGATION, MEAN_AGGREGATION}) {
+                if (max_templates == 1 && aggregation != MAX_AGGREGATION) {
+                    continue;
+                }
+                params.templateAggregation = aggregation;
+                database.Update(params);
+
+                int hits = 0;
+                QueryResult query_result;
+                double start = static_cast<double>(cv::getTickCount());
+                for (int i = 0; i < query_num; ++i) {
+                    database.QueryTop(probes[i], query_result);
+                    hits += query_result.name_ == "face" + std::to_string(truth[i]);
+                }
+                double end = static_cast<double>(cv::getTickCount());
+                double time_cost = (end - start) / cv::getTickFrequency();
+
+                std::cout << "gallery size: " << gallery_size
+                          << " templates: " << max_templates
+                          << " aggregation: " << GetFaceTemplateAggregationName(aggregation)
+                          << " recall@1: " << static_cast<double>(hits) / query_num
+                          << " latency: " << time_cost * 1000 / query_num << "ms" << std::endl;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int BenchParallelScan(int argc, char **argv) {
+    std::cout << "FaceDatabase Parallel Scan Benchmark......" << std::endl;
+
+    const int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> thread_nums;
+    for (int threads = 1; threads < max_threads; threads *= 2) {
+        thread_nums.push_back(threads);
+    }
+    thread_nums.push_back(max_threads);
+
+    std::mt19937 rng(2021);
+    std::vector<std::vector<float>> probes(query_num);
+    for (auto &probe : probes) {
+        RandomFeature(rng, probe);
+    }
+
+    FaceDatabase database;
+    for (int gallery_size : gallery_sizes) {
+        BuildGallery(rng, gallery_size, database);
+
+        double single_latency = 0.0;
+        for (int threads : thread_nums) {
+            FaceDatabaseParams params;
+            params.scanThreads = threads;
+            database.Update(params);
+
+            QueryResult query_result;
+            double start = static_cast<double>(cv::getTickCount());
+            for (const auto &probe : probes) {
+                database.QueryTop(probe, query_result);
+            }
+            double end = static_cast<double>(cv::getTickCount());
+            double latency = (end - start) * 1000 / cv::getTickFrequency() / query_num;
+            if (threads == 1) {
+                single_latency = latency;
+            }
+
+            std::cout << "gallery size: " << gallery_size
+                      << " scan threads: " << threads
+                      << " latency: " << latency << "ms"
+                      << " speedup: " << single_latency / latency << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+int BenchFeatureDim(int argc, char **argv) {
+    std::cout << "FaceDatabase Feature Dimension Benchmark......" << std::endl;
+
+    // 384 has no unrolled kernel and shows the generic one
+    const std::vector<int> dims = {128, 256, 384, 512};
+
+    std::mt19937 rng(2021);
+    for (int gallery_size : gallery_sizes) {
+        for (int dim : dims) {
+            FaceDatabaseParams params;
+            params.featureDim = dim;
+            FaceDatabase database(params);
+            std::vector<float> feat;
+            for (int i = 0; i < gallery_size; ++i) {
+                RandomFeature(rng, feat, dim);
+                database.Insert(feat, "face" + std::to_string(i));
+            }
+            std::vector<std::vector<float>> probes(query_num);
+            for (auto &probe : probes) {
+                RandomFeature(rng, probe, dim);
+            }
+
+            QueryResult query_result;
+            double start = static_cast<double>(cv::getTickCount());
+            for (const auto &probe : probes) {
+                database.QueryTop(probe, query_result);
+            }
+            double end = static_cast<double>(cv::getTickCount());
+            double time_cost = (end - start) / cv::getTickFrequency();
+
+            std::cout << "gallery size: " << gallery_size
+                      << " feature dim: " << dim
+                      << " latency: " << time_cost * 1000 / query_num << "ms"
+                      << " ns/float: " << time_cost * 1e9 / query_num / gallery_size / dim << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+int BenchPartitions(int argc, char **argv) {
+    std::cout << "FaceDatabase Partitions Benchmark......" << std::endl;
+
+    // the gallery is spread over a growing number of sites, a query only scans the faces of its site
+    const std::vector<int> partition_nums = {1, 4, 16};
+
+    std::mt19937 rng(2021);
+    std::vector<std::vector<float>> probes(query_num);
+    for (auto &probe : probes) {
+        RandomFeature(rng, probe);
+    }
+
+    for (int gallery_size : gallery_sizes) {
+        for (int partition_num : partition_nums) {
+            FaceDatabase database;
+            std::vector<float> feat;
+            for (int i = 0; i < gallery_size; ++i) {
+                RandomFeature(rng, feat);
+                database.Insert("site" + std::to_string(i % partition_num), feat, "face" + std::to_string(i));
+            }
+
+            QueryResult query_result;
+            double start = static_cast<double>(cv::getTickCount());
+            for (const auto &probe : probes) {
+                database.QueryTop("site0", probe, query_result);
+            }
+            double end = static_cast<double>(cv::getTickCount());
+            double time_cost = (end - start) / cv::getTickFrequency();
+
+            std::cout << "gallery size: " << gallery_size
+                      << " partitions: " << partition_num
+                      << " latency: " << time_cost * 1000 / query_num << "ms" << std::endl;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 2) {
+        query_num = std::stoi(argv[1]);
+    }
+    if (argc >= 3) {
+        gallery_sizes = {std::stoi(argv[2])};
+    }
+
+    BenchQueryTop(argc, argv);
+    BenchQueryBatch(argc, argv);
+    BenchHnsw(argc, argv);
+    BenchIvfPq(argc, argv);
+    BenchStorage(argc, argv);
+    BenchLoad(argc, argv);
+    BenchConcurrent(argc, argv);
+    BenchTemplates(argc, argv);
+    BenchParallelScan(argc, argv);
+    BenchFeatureDim(argc, argv);
+    BenchPartitions(argc, argv);
+    return 0;
+}
@@ -0,0 +1,99 @@
+#define FACE_EXPORTS
+
+#include "FaceEngine.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+using namespace mirror;
+
+static std::string img_path = "../../data/images/4.jpg";
+static std::string model_path = "../../data/models";
+static int round_num = 20;
+static std::vector<int> batch_sizes = {1, 2, 4, 8, 16, 32};
+
+int BenchExtractFeatures(int argc, char **argv) {
+    std::cout << "FaceRecognizer extractFeatures Benchmark......" << std::endl;
+
+    cv::Mat img_src = cv::imread(img_path);
+    if (img_src.empty()) {
+        std::cout << "load image failed: " << img_path << std::endl;
+        return -1;
+    }
+
+    FaceEngine *face_engine = FaceEngine::GetInstancePtr();
+    FaceEngineParams params;
+    params.modelPath = model_path;
+    params.threadNum = 4;
+    params.faceDetectorEnabled = true;
+    params.faceRecognizerEnabled = true;
+    if (face_engine->loadModel(params) != 0) {
+        std::cout << "load model failed." << std::endl;
+        return -1;
+    }
+
+    // the batches are made of the aligned faces of the image, repeated
+    std::vector<FaceInfo> faces;
+    face_engine->detectFace(img_src, faces);
+    if (faces.empty()) {
+        std::cout << "Cannot detect any face!" << std::endl;
+        return -1;
+    }
+    std::vector<cv::Mat> faces_aligned(faces.size());
+    std::vector<cv::Point2f> keypoints;
+    for (size_t i = 0; i < faces.size(); ++i) {
+        ConvertKeyPoints(faces[i].keypoints_, 5, keypoints);
+        face_engine->alignFace(img_src, keypoints, faces_aligned[i]);
+    }
+
+    for (int batch_size : batch_sizes) {
+        std::vector<cv::Mat> batch(batch_size);
+        for (int i = 0; i < batch_size; ++i) {
+            batch[i] = faces_aligned[i % faces_aligned.size()];
+        }
+
+        std::vector<float> feat;
+        double start = static_cast<double>(cv::getTickCount());
+        for (int round = 0; round < round_num; ++round) {
+            for (const auto &face : batch) {
+                face_engine->extractFeature(face, feat);
+            }
+        }
+        double end = static_cast<double>(cv::getTickCount());
+        double single_cost = (end - start) / cv::getTickFrequency();
+
+        std::vector<std::vector<float>> feats;
+        start = static_cast<double>(cv::getTickCount());
+        for (int round = 0; round < round_num; ++round) {
+            face_engine->extractFeatures(batch, feats);
+        }
+        end = static_cast<double>(cv::getTickCount());
+        double batch_cost = (end - start) / cv::getTickFrequency();
+
+        const int face_num = batch_size * round_num;
+        std::cout << "batch size: " << batch_size
+                  << " extractFeature faces/sec: " << face_num / single_cost
+                  << " extractFeatures faces/sec: " << face_num / batch_cost << std::endl;
+    }
+
+    face_engine->destroyEngine();
+    return 0;
+}
+
+// bench_face_recognizer [image_path] [model_path] [rounds]
+int main(int argc, char *argv[]) {
+    if (argc >= 2) {
+        img_path = argv[1];
+    }
+    if (argc >= 3) {
+        model_path = argv[2];
+    }
+    if (argc >= 4) {
+        round_num = std::stoi(argv[3]);
+    }
+
+    BenchExtractFeatures(argc, argv);
+    return 0;
+}
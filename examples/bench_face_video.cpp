@@ -0,0 +1,118 @@
+#define FACE_EXPORTS
+
+#include "FaceEngine.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+using namespace mirror;
+
+static std::string video_path = "../../data/videos/face.mp4";
+static std::string model_path = "../../data/models";
+static int frame_num = 300;
+static int keyframe_interval = 10;
+
+// the frames are decoded before timing, from a video file or a directory of images in their name order
+static int LoadFrames(const std::string &path, std::vector<cv::Mat> &frames) {
+    frames.clear();
+    std::vector<cv::String> names;
+    cv::glob(path + "/*.jpg", names, false);
+    if (!names.empty()) {
+        for (size_t i = 0; i < names.size() && static_cast<int>(frames.size()) < frame_num; ++i) {
+            cv::Mat frame = cv::imread(names[i]);
+            if (!frame.empty()) frames.push_back(frame);
+        }
+        return 0;
+    }
+#if MIRROR_BUILD_WITH_FULL_OPENCV
+    cv::VideoCapture capture(path);
+    cv::Mat frame;
+    while (static_cast<int>(frames.size()) < frame_num && capture.read(frame)) {
+        frames.push_back(frame.clone());
+    }
+#else
+    std::cout << "Inorder to read videos, please rebuild with full opencv support!" << std::endl;
+#endif
+    return 0;
+}
+
+int BenchTrackFaces(int argc, char **argv) {
+    std::cout << "FaceEngine trackFaces Benchmark......" << std::endl;
+
+    std::vector<cv::Mat> frames;
+    LoadFrames(video_path, frames);
+    if (frames.empty()) {
+        std::cout << "load frames failed: " << video_path << std::endl;
+        return -1;
+    }
+
+    FaceEngine *face_engine = FaceEngine::GetInstancePtr();
+    FaceEngineParams params;
+    params.modelPath = model_path;
+    params.threadNum = 4;
+    params.faceDetectorEnabled = true;
+    params.faceRecognizerEnabled = false;
+    params.videoKeyframeInterval = keyframe_interval;
+    if (face_engine->loadModel(params) != 0) {
+        std::cout << "load model failed." << std::endl;
+        return -1;
+    }
+
+    // every frame detected, then tracked
+    std::vector<FaceInfo> faces;
+    std::vector<TrackedFaceInfo> tracked_faces;
+    size_t detect_faces = 0;
+    double start = static_cast<double>(cv::getTickCount());
+    for (const auto &frame : frames) {
+        face_engine->detectFace(frame, faces);
+        face_engine->track(faces, tracked_faces);
+        detect_faces += tracked_faces.size();
+    }
+    double end = static_cast<double>(cv::getTickCount());
+    const double detect_cost = (end - start) / cv::getTickFrequency();
+
+    // keyframes detected, the faces followed in between
+    if (face_engine->loadModel(params) != 0) {
+        std::cout << "load model failed." << std::endl;
+        return -1;
+    }
+    size_t keyframe_faces = 0;
+    start = static_cast<double>(cv::getTickCount());
+    for (const auto &frame : frames) {
+        face_engine->trackFaces(frame, tracked_faces);
+        keyframe_faces += tracked_faces.size();
+    }
+    end = static_cast<double>(cv::getTickCount());
+    const double keyframe_cost = (end - start) / cv::getTickFrequency();
+
+    const double frame_count = static_cast<double>(frames.size());
+    std::cout << "frames: " << frames.size() << " keyframe interval: " << keyframe_interval << std::endl;
+    std::cout << "detect every frame fps: " << frame_count / detect_cost
+              << " tracked faces/frame: " << detect_faces / frame_count << std::endl;
+    std::cout << "trackFaces fps: " << frame_count / keyframe_cost
+              << " tracked faces/frame: " << keyframe_faces / frame_count << std::endl;
+
+    face_engine->destroyEngine();
+    return 0;
+}
+
+// bench_face_video [video_path|image_dir] [model_path] [frames] [keyframe_interval]
+int main(int argc, char *argv[]) {
+    if (argc >= 2) {
+        video_path = argv[1];
+    }
+    if (argc >= 3) {
+        model_path = argv[2];
+    }
+    if (argc >= 4) {
+        frame_num = std::stoi(argv[3]);
+    }
+    if (argc >= 5) {
+        keyframe_interval = std::stoi(argv[4]);
+    }
+
+    BenchTrackFaces(argc, argv);
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include "FaceDatabase.h"
+
+#include <iostream>
+#include <string>
+
+using namespace mirror;
+
+// Convert a face database directory written by older versions (or any version) to the
+// current memory mappable format: convert_face_database <src_dir> [dst_dir]
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cout << "usage: " << argv[0] << " <src_dir> [dst_dir]" << std::endl;
+        return -1;
+    }
+    const std::string src_dir = argv[1];
+    const std::string dst_dir = argc >= 3 ? argv[2] : src_dir;
+
+    FaceDatabase database;
+    int flag = database.Load(src_dir.c_str());
+    if (flag != 0) {
+        std::cout << "load face database failed: " << src_dir << std::endl;
+        return flag;
+    }
+    flag = database.Save(dst_dir.c_str());
+    if (flag != 0) {
+        std::cout << "save face database failed: " << dst_dir << std::endl;
+        return flag;
+    }
+    std::cout << "face database converted to " << dst_dir << std::endl;
+    return 0;
+}
@@ -0,0 +1,107 @@
+#define FACE_EXPORTS
+
+#include "FaceEngine.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+using namespace mirror;
+
+//! File name without directory and extension, the face name of an image listed without one
+static std::string FileStem(const std::string &path) {
+    const size_t slash = path.find_last_of("/\\");
+    const std::string file = slash == std::string::npos ? path : path.substr(slash + 1);
+    const size_t dot = file.find_last_of('.');
+    return dot == std::string::npos ? file : file.substr(0, dot);
+}
+
+//! Every image of 'dir' named after its file, or the lines "image_path [name]" of a list file
+static int ListImages(const std::string &source, std::vector<std::string> &paths, std::vector<std::string> &names) {
+    std::ifstream list(source.c_str());
+    std::string line;
+    if (list.is_open() && std::getline(list, line)) {
+        do {
+            std::istringstream fields(line);
+            std::string path, name;
+            if (!(fields >> path)) continue;
+            if (!(fields >> name)) {
+                name = FileStem(path);
+            }
+            paths.push_back(path);
+            names.push_back(name);
+        } while (std::getline(list, line));
+        return 0;
+    }
+
+    std::vector<cv::String> files;
+    cv::glob(source + "/*", files, false);
+    for (const auto &file : files) {
+        const std::string path = file;
+        const std::string ext = path.substr(path.find_last_of('.') + 1);
+        if (ext != "jpg" && ext != "jpeg" && ext != "png" && ext != "bmp" &&
+            ext != "JPG" && ext != "JPEG" && ext != "PNG" && ext != "BMP") {
+            continue;
+        }
+        paths.push_back(path);
+        names.push_back(FileStem(path));
+    }
+    return 0;
+}
+
+// Enrol a directory or a list of ID photos into the face database:
+// enrol_faces <model_path> <database_path> <image_dir | image_list> [partition] [enrol_threads]
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        std::cout << "usage: " << argv[0]
+                  << " <model_path> <database_path> <image_dir | image_list> [partition] [enrol_threads]" << std::endl;
+        return -1;
+    }
+    const std::string partition = argc >= 5 ? argv[4] : "";
+
+    std::vector<std::string> paths, names;
+    ListImages(argv[3], paths, names);
+    if (paths.empty()) {
+        std::cout << "no image found in " << argv[3] << std::endl;
+        return -1;
+    }
+
+    FaceEngine *face_engine = FaceEngine::GetInstancePtr();
+    FaceEngineParams params;
+    params.modelPath = argv[1];
+    params.faceFeaturePath = argv[2];
+    params.faceDetectorEnabled = true;
+    params.faceRecognizerEnabled = true;
+    if (argc >= 6) {
+        params.enrolThreads = std::stoi(argv[5]);
+    }
+    int flag = face_engine->loadModel(params);
+    if (flag != 0) {
+        std::cout << "load model failed: " << flag << std::endl;
+        return flag;
+    }
+
+    std::vector<int> flags;
+    double start = static_cast<double>(cv::getTickCount());
+    flag = face_engine->registerFaces(partition, paths, names, flags);
+    double end = static_cast<double>(cv::getTickCount());
+    double time_cost = (end - start) / cv::getTickFrequency();
+
+    int num_registered = 0;
+    for (size_t i = 0; i < flags.size(); ++i) {
+        if (flags[i] == 0) {
+            ++num_registered;
+        } else {
+            std::cout << "skip " << paths[i] << ": " << flags[i] << std::endl;
+        }
+    }
+    std::cout << "registered " << num_registered << " of " << paths.size() << " images"
+              << " time cost: " << time_cost << "s"
+              << " images/sec: " << paths.size() / time_cost << std::endl;
+
+    face_engine->destroyEngine();
+    return flag;
+}
@@ -0,0 +1,72 @@
+#include "FaceDatabase.h"
+
+#include <iostream>
+#include <string>
+
+using namespace mirror;
+
+// Replicate a face database between hosts:
+//   replicate_face_database export <db_dir> <stream_file> [epoch version]
+//   replicate_face_database import <db_dir> <stream_file>
+// export writes the changes since the version an earlier import printed, or the whole gallery;
+// import applies the stream to <db_dir> and prints the version to export from next time.
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        std::cout << "usage: " << argv[0] << " export <db_dir> <stream_file> [epoch version]" << std::endl;
+        std::cout << "       " << argv[0] << " import <db_dir> <stream_file>" << std::endl;
+        return -1;
+    }
+    const std::string command = argv[1];
+    const std::string db_dir = argv[2];
+    const std::string stream_path = argv[3];
+
+    FaceDatabase database;
+    int flag = database.Load(db_dir.c_str());
+    if (command == "export") {
+        if (flag != 0) {
+            std::cout << "load face database failed: " << db_dir << std::endl;
+            return flag;
+        }
+        FaceDatabaseVersion since, exported;
+        if (argc >= 6) {
+            since.epoch = std::stoull(argv[4]);
+            since.version = std::stoll(argv[5]);
+        }
+        FileWriter writer(stream_path, FileWriter::Binary);
+        if (!writer.is_opened()) {
+            std::cout << "open stream file failed: " << stream_path << std::endl;
+            return ErrorCode::NOT_FOUND_ERROR;
+        }
+        flag = database.Export(writer, since, exported);
+        if (flag != 0) {
+            return flag;
+        }
+        std::cout << "exported version: " << exported.epoch << " " << exported.version << std::endl;
+        return 0;
+    }
+
+    if (command == "import") {
+        // an edge node may start without a database
+        FileReader reader(stream_path, FileReader::Binary);
+        if (!reader.is_opened()) {
+            std::cout << "open stream file failed: " << stream_path << std::endl;
+            return ErrorCode::NOT_FOUND_ERROR;
+        }
+        FaceDatabaseVersion imported;
+        flag = database.Import(reader, imported);
+        if (flag != 0) {
+            std::cout << "import failed: " << flag << ", export again from the previous version" << std::endl;
+            return flag;
+        }
+        flag = database.Sync(db_dir.c_str());
+        if (flag != 0) {
+            std::cout << "save face database failed: " << db_dir << std::endl;
+            return flag;
+        }
+        std::cout << "imported version: " << imported.epoch << " " << imported.version << std::endl;
+        return 0;
+    }
+
+    std::cout << "unknown command: " << command << std::endl;
+    return -1;
+}
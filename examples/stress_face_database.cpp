@@ -0,0 +1,188 @@
+#include "FaceDatabase.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace mirror;
+
+// Queries the database from several threads while others insert, update and delete faces:
+// stress_face_database [seconds] [reader threads] [writer threads]
+// A set of stable faces is never modified, each reader checks that every stable face still finds
+// itself with similarity 1 and that results are well formed, whatever the writers are doing.
+
+static const int kStableFaces = 2000;
+static const int kChurnFaces = 500;
+
+static void RandomFeature(std::mt19937 &rng, std::vector<float> &feat) {
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+    feat.resize(kFaceFeatureDim);
+    for (auto &v : feat) {
+        v = dist(rng);
+    }
+}
+
+struct StressCounters {
+    std::atomic<long> queries;
+    std::atomic<long> writes;
+    std::atomic<long> errors;
+};
+
+static void ReportError(StressCounters &counters, const std::string &message) {
+    if (counters.errors.fetch_add(1) < 10) {
+        std::cerr << "error: " << message << std::endl;
+    }
+}
+
+static void Reader(const FaceDatabase &database, const std::vector<std::vector<float>> &stable, int seed,
+                   const std::atomic<bool> &stop, StressCounters &counters) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<int> pick(0, kStableFaces - 1);
+    const int batch_size = 8;
+    std::vector<float> batch;
+    std::vector<int> batch_faces(batch_size);
+    QueryResult query_result;
+    std::vector<QueryResult> query_results;
+    std::vector<std::vector<QueryResult>> batch_results;
+    long queries = 0;
+    while (!stop.load()) {
+        const int face = pick(rng);
+        const std::string name = "stable" + std::to_string(face);
+        switch (queries % 3) {
+            case 0:
+                if (database.QueryTop(stable[face], query_result) != 0 || query_result.name_ != name ||
+                    std::fabs(query_result.sim_ - 1.0f) > 1e-2f) {
+                    ReportError(counters, "QueryTop " + name + " -> " + query_result.name_);
+                }
+                break;
+            case 1:
+                if (database.QueryTopK(stable[face], 5, -1.0f, query_results) != 0 || query_results.empty() ||
+                    query_results.front().name_ != name) {
+                    ReportError(counters, "QueryTopK " + name);
+                    break;
+                }
+                for (size_t i = 1; i < query_results.size(); ++i) {
+                    if (query_results[i].sim_ > query_results[i - 1].sim_ ||
+                        query_results[i].name_ == query_results[i - 1].name_) {
+                        ReportError(counters, "QueryTopK results of " + name + " out of order");
+                    }
+                }
+                break;
+            default:
+                batch.clear();
+                for (int j = 0; j < batch_size; ++j) {
+                    batch_faces[j] = pick(rng);
+                    batch.insert(batch.end(), stable[batch_faces[j]].begin(), stable[batch_faces[j]].end());
+                }
+                if (database.QueryBatch(batch.data(), batch_size, 1, -1.0f, batch_results) != 0 ||
+                    batch_results.size() != static_cast<size_t>(batch_size)) {
+                    ReportError(counters, "QueryBatch failed");
+                    break;
+                }
+                for (int j = 0; j < batch_size; ++j) {
+                    const std::string expected = "stable" + std::to_string(batch_faces[j]);
+                    if (batch_results[j].empty() || batch_results[j].front().name_ != expected) {
+                        ReportError(counters, "QueryBatch " + expected);
+                    }
+                }
+                break;
+        }
+        ++queries;
+    }
+    counters.queries.fetch_add(queries);
+}
+
+static void Writer(FaceDatabase &database, int writer, const std::atomic<bool> &stop, StressCounters &counters) {
+    std::mt19937 rng(1000 + writer);
+    std::uniform_int_distribution<int> pick(0, kChurnFaces - 1);
+    std::uniform_int_distribution<int> op(0, 2);
+    std::vector<float> feat;
+    long writes = 0;
+    while (!stop.load()) {
+        const std::string name = "churn" + std::to_string(writer) + "_" + std::to_string(pick(rng));
+        if (op(rng) == 0) {
+            database.Delete(name);
+        } else {
+            // inserts a new face or updates an existing one
+            RandomFeature(rng, feat);
+            database.Insert(feat, name);
+        }
+        ++writes;
+    }
+    counters.writes.fetch_add(writes);
+}
+
+static int RunStress(const FaceDatabaseParams &params, const std::string &tag, int seconds,
+                     int num_readers, int num_writers) {
+    std::mt19937 rng(2021);
+    std::vector<std::vector<float>> stable(kStableFaces);
+    FaceDatabase database(params);
+    for (int i = 0; i < kStableFaces; ++i) {
+        RandomFeature(rng, stable[i]);
+        database.Insert(stable[i], "stable" + std::to_string(i));
+    }
+
+    StressCounters counters;
+    counters.queries.store(0);
+    counters.writes.store(0);
+    counters.errors.store(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_readers; ++i) {
+        threads.emplace_back(Reader, std::cref(database), std::cref(stable), i, std::cref(stop), std::ref(counters));
+    }
+    for (int i = 0; i < num_writers; ++i) {
+        threads.emplace_back(Writer, std::ref(database), i, std::cref(stop), std::ref(counters));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop.store(true);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    std::vector<std::string> names;
+    database.Find(names);
+    for (size_t i = 1; i < names.size(); ++i) {
+        if (names[i] == names[i - 1]) {
+            ReportError(counters, "duplicate face " + names[i]);
+        }
+    }
+
+    std::cout << tag << " readers: " << num_readers << " writers: " << num_writers
+              << " queries: " << counters.queries.load() << " writes: " << counters.writes.load()
+              << " faces: " << names.size() << " errors: " << counters.errors.load() << std::endl;
+    return counters.errors.load() == 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    const int seconds = argc >= 2 ? std::stoi(argv[1]) : 5;
+    const int num_readers = argc >= 3 ? std::stoi(argv[2]) : 4;
+    const int num_writers = argc >= 4 ? std::stoi(argv[3]) : 2;
+
+    int flag = 0;
+    FaceDatabaseParams params;
+    flag |= RunStress(params, "flat float32", seconds, num_readers, num_writers);
+
+    params.storageType = FaceStorageType::INT8_STORAGE;
+    params.storageRerank = 16;
+    flag |= RunStress(params, "flat int8 rerank", seconds, num_readers, num_writers);
+
+    params = FaceDatabaseParams();
+    params.indexType = FaceIndexType::HNSW_INDEX;
+    flag |= RunStress(params, "hnsw", seconds, num_readers, num_writers);
+
+    params = FaceDatabaseParams();
+    params.indexType = FaceIndexType::IVFPQ_INDEX;
+    params.ivfNlist = 16;
+    params.ivfNprobe = 16;
+    params.ivfRerank = 64;
+    flag |= RunStress(params, "ivfpq", seconds, num_readers, num_writers);
+
+    std::cout << (flag == 0 ? "stress test passed" : "stress test FAILED") << std::endl;
+    return flag;
+}
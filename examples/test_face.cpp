@@ -380,6 +380,15 @@ int TestFaceApi(int argc, char *argv[]) {
         face_engine->verifyFace(img_src, result, true);
     }
 
+    // verify every face in view with a single detection and one batched extraction and query
+    std::vector<VerificationResult> results;
+    if (face_engine->verifyFaces(img_src, results) == 0) {
+        for (const auto &face_result : results) {
+            std::cout << "face at " << face_result.location << ": " << face_result.name
+                      << " similarity: " << face_result.sim << std::endl;
+        }
+    }
+
     // 1. detect faces
     std::vector<FaceInfo> faces;
     face_engine->detectFace(img_src, faces);
@@ -453,13 +462,13 @@ int TestTrack(int argc, char *argv[]) {
 
         double start = static_cast<double>(cv::getTickCount());
 
-        // detect faces
-        std::vector<FaceInfo> curr_faces;
-        face_engine->detectFace(frame, curr_faces);
-
-        // track faces
+        // detect faces on keyframes and track them
         std::vector<TrackedFaceInfo> faces;
-        face_engine->track(curr_faces, faces);
+        face_engine->trackFaces(frame, faces);
+
+        // recognize the tracks, a track keeps its identity across frames and is only recognized again now and then
+        std::vector<VerificationResult> results;
+        face_engine->verifyTracks(frame, faces, results);
 
         // anti face detect
         for (int i = 0; i < static_cast<int>(faces.size()); ++i) {
@@ -490,29 +499,14 @@ int TestTrack(int argc, char *argv[]) {
             }
 
             // face recognition
-            if (is_living) {
-                // align face
-                cv::Mat faceAligned;
-                std::vector<cv::Point2f> keyPoints;
-                ConvertKeyPoints(tracked_face_info.face_info_.keypoints_, 5, keyPoints);
-                face_engine->alignFace(frame, keyPoints, faceAligned);
-
-                // extract features
-                std::vector<float> feat;
-                face_engine->extractFeature(faceAligned, feat);
-
-                // compare features
-                QueryResult query_result;
-                if (face_engine->QueryTop(feat, query_result) == 0) {
-                    if (query_result.sim_ > 0.5) {
-                        sprintf(text, "%s %.1f%%", query_result.name_.c_str(),
-                                query_result.sim_ * 100);
-                    } else {
-                        sprintf(text, "%s %.1f%%", "stranger",
-                                query_result.sim_ * 100);
-                    }
-                    utility::DrawText(frame, cv::Point2i(roi.tl().x, next_y), text);
+            if (is_living && i < static_cast<int>(results.size())) {
+                const VerificationResult &result = results.at(i);
+                if (result.sim > 0.5) {
+                    sprintf(text, "%s %.1f%%", result.name.c_str(), result.sim * 100);
+                } else {
+                    sprintf(text, "%s %.1f%%", "stranger", result.sim * 100);
                 }
+                utility::DrawText(frame, cv::Point2i(roi.tl().x, next_y), text);
             }
         }
 
@@ -0,0 +1,82 @@
+#include "ScanPool.h"
+
+#include <algorithm>
+
+namespace mirror {
+    ScanPool::ScanPool(int num_threads) {
+        for (int i = 1; i < num_threads; ++i) {
+            workers_.emplace_back(&ScanPool::Work, this);
+        }
+    }
+
+    ScanPool::~ScanPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void ScanPool::Run(int num_tasks, const std::function<void(int)> &task) {
+        if (workers_.empty() || num_tasks <= 1) {
+            for (int i = 0; i < num_tasks; ++i) {
+                task(i);
+            }
+            return;
+        }
+
+        Job job;
+        job.task = &task;
+        job.num_tasks = num_tasks;
+        job.next.store(0);
+        job.active = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(&job);
+        }
+        wake_.notify_all();
+
+        Execute(job);
+
+        // every task is claimed, wait for the workers still running one
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = std::find(jobs_.begin(), jobs_.end(), &job);
+        if (it != jobs_.end()) {
+            jobs_.erase(it);
+        }
+        left_.wait(lock, [&job]() { return job.active == 0; });
+    }
+
+    void ScanPool::Execute(Job &job) {
+        for (int i = job.next.fetch_add(1); i < job.num_tasks; i = job.next.fetch_add(1)) {
+            (*job.task)(i);
+        }
+    }
+
+    void ScanPool::Work() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [this]() { return stop_ || !jobs_.empty(); });
+            if (stop_) {
+                return;
+            }
+            Job *job = jobs_.front();
+            ++job->active;
+            lock.unlock();
+            Execute(*job);
+            lock.lock();
+            // the job has no task left to claim, later jobs come next
+            auto it = std::find(jobs_.begin(), jobs_.end(), job);
+            if (it != jobs_.end()) {
+                jobs_.erase(it);
+            }
+            if (--job->active == 0) {
+                left_.notify_all();
+            }
+        }
+    }
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mirror {
+    /// \brief Worker threads sharing the tasks of parallel jobs, e.g. the shards of a gallery scan or the
+    /// tiles of a detection. The thread calling Run works on its own job as well, so jobs issued from several
+    /// threads at once all progress even when the workers are busy with another job, and a pool of one
+    /// thread runs everything inline.
+    class ScanPool {
+    public:
+        //! 'num_threads' counts the calling thread, num_threads - 1 workers are started
+        explicit ScanPool(int num_threads);
+
+        ScanPool(const ScanPool &other) = delete;
+
+        ScanPool &operator=(const ScanPool &other) = delete;
+
+        ~ScanPool();
+
+        inline int Threads() const { return static_cast<int>(workers_.size()) + 1; }
+
+        //! Call task(0) ... task(num_tasks - 1) over the pool, returns once every call finished
+        void Run(int num_tasks, const std::function<void(int)> &task);
+
+    private:
+        struct Job {
+            const std::function<void(int)> *task;
+            int num_tasks;
+            //! next task to claim
+            std::atomic<int> next;
+            //! workers inside the job, it lives on the stack of Run until they all left
+            int active;
+        };
+
+        static void Execute(Job &job);
+
+        void Work();
+
+        std::vector<std::thread> workers_;
+        std::mutex mutex_;
+        std::condition_variable wake_;
+        std::condition_variable left_;
+        std::deque<Job *> jobs_;
+        bool stop_ = false;
+    };
+
+}
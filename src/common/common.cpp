@@ -1,4 +1,5 @@
 #include "common.h"
+#include "../face/database/kernels/SimilarityKernels.h"
 #include <algorithm>
 #include <iostream>
 
@@ -92,17 +93,10 @@ namespace mirror {
             std::cout << "feature size not match." << std::endl;
             return 10003;
         }
-        float inner_product = 0.0f;
-        float feature_norm1 = 0.0f;
-        float feature_norm2 = 0.0f;
-#if defined(_OPENMP)
-#pragma omp parallel for num_threads(CUSTOM_THREAD_NUMBER)
-#endif
-        for (int i = 0; i < kFaceFeatureDim; ++i) {
-            inner_product += feature1[i] * feature2[i];
-            feature_norm1 += feature1[i] * feature1[i];
-            feature_norm2 += feature2[i] * feature2[i];
-        }
+        const int dim = static_cast<int>(feature1.size());
+        const float inner_product = DotProduct(feature1.data(), feature2.data(), dim);
+        const float feature_norm1 = DotProduct(feature1.data(), feature1.data(), dim);
+        const float feature_norm2 = DotProduct(feature2.data(), feature2.data(), dim);
         return inner_product / sqrt(feature_norm1) / sqrt(feature_norm2);
     }
 
@@ -174,6 +168,43 @@ namespace mirror {
         }
     }
 
+    std::string GetFaceIndexTypeName(FaceIndexType type) {
+        switch (type) {
+            case FLAT_INDEX:
+                return "FLAT_INDEX";
+            case HNSW_INDEX:
+                return "HNSW_INDEX";
+            case IVFPQ_INDEX:
+                return "IVFPQ_INDEX";
+            default:
+                return "NONE";
+        }
+    }
+
+    std::string GetFaceStorageTypeName(FaceStorageType type) {
+        switch (type) {
+            case FLOAT32_STORAGE:
+                return "FLOAT32_STORAGE";
+            case FP16_STORAGE:
+                return "FP16_STORAGE";
+            case INT8_STORAGE:
+                return "INT8_STORAGE";
+            default:
+                return "NONE";
+        }
+    }
+
+    std::string GetFaceTemplateAggregationName(FaceTemplateAggregation type) {
+        switch (type) {
+            case MAX_AGGREGATION:
+                return "MAX_AGGREGATION";
+            case MEAN_AGGREGATION:
+                return "MEAN_AGGREGATION";
+            default:
+                return "NONE";
+        }
+    }
+
     std::string GetAntiSpoofingTypeName(FaceAntiSpoofingType type) {
         switch (type) {
             case LIVE_FACE:
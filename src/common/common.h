@@ -17,7 +17,10 @@
 #endif
 
 namespace mirror {
+// feature dimension of the default recognizer, the legacy database format is bound to it
 #define kFaceFeatureDim 128
+// largest feature dimension a recognizer and the face database may use
+#define kMaxFaceFeatureDim 1024
 #define kFaceNameDim 256
 
     // common
@@ -36,6 +39,7 @@ namespace mirror {
         const int NOT_FOUND_ERROR = 10006;
         const int EMPTY_DATA_ERROR = 10007;
         const int DATABASE_UPDATE_ERROR = 10008;
+        const int DATA_CORRUPTED_ERROR = 10009;
     }
 
 
@@ -218,17 +222,65 @@ namespace mirror {
 
     struct TrackedFaceInfo {
         FaceInfo face_info_;
-        float iou_score_;
+        float iou_score_ = 0.0f;
+        int track_id_ = -1; // stable across the frames the tracker follows the face in
     };
 
     struct QueryResult {
         std::string name_;
         float sim_;
+        int64_t id_ = -1; // stable face index assigned by the database on insert
     };
 
     struct VerificationResult {
         std::string name;
         float sim;
+        cv::Rect location; // box of the verified face, filled by verifyFaces
+    };
+
+    enum FaceIndexType {
+        FLAT_INDEX = 0, // exact brute force scan
+        HNSW_INDEX = 1, // approximate graph search for large galleries
+        IVFPQ_INDEX = 2, // inverted file + product quantization for galleries that do not fit in memory
+    };
+
+    enum FaceStorageType {
+        FLOAT32_STORAGE = 0, // exact features
+        FP16_STORAGE = 1, // half precision, half the memory and bandwidth of float32
+        INT8_STORAGE = 2, // per-vector scaled int8, a quarter of the memory and bandwidth of float32
+    };
+
+    enum FaceTemplateAggregation {
+        MAX_AGGREGATION = 0, // an identity scores its best matching template
+        MEAN_AGGREGATION = 1, // an identity scores the mean similarity of its templates
+    };
+
+    struct FaceDatabaseParams {
+        // dimension of the stored features, fixed when the database is created; FaceEngine sets it
+        // from the recognizer
+        int featureDim = kFaceFeatureDim;
+        FaceIndexType indexType = FaceIndexType::FLAT_INDEX;
+        // precision of the feature matrix scanned by the flat index
+        FaceStorageType storageType = FaceStorageType::FLOAT32_STORAGE;
+        // candidates re-scored with exact float features after a quantized scan, 0 disables re-ranking;
+        // re-ranking keeps a float copy of every face next to the codes
+        int storageRerank = 0;
+        // templates kept per identity (angles, lighting, glasses...), inserting a registered name adds a
+        // template and drops its oldest one beyond maxTemplates; 1 replaces the feature of the name
+        int maxTemplates = 1;
+        FaceTemplateAggregation templateAggregation = FaceTemplateAggregation::MAX_AGGREGATION;
+        // threads sharing the exact scan of one query, 0 uses every core; independent of
+        // FaceEngineParams::threadNum which sets the threads of the networks
+        int scanThreads = 1;
+        // only available when indexType = FaceIndexType::HNSW_INDEX
+        int hnswM = 16; // links per node, level 0 keeps 2 * hnswM
+        int hnswEfConstruction = 200; // candidate list size while inserting
+        int hnswEfSearch = 64; // candidate list size while querying, trades recall for speed
+        // only available when indexType = FaceIndexType::IVFPQ_INDEX
+        int ivfNlist = 1024; // number of coarse clusters (inverted lists)
+        int ivfPqCodeSize = 32; // bytes per compressed face, must divide the feature dimension
+        int ivfNprobe = 16; // inverted lists visited per query
+        int ivfRerank = 64; // candidates re-scored with the exact features, 0 disables re-ranking
     };
 
     struct FaceEngineParams {
@@ -237,6 +289,28 @@ namespace mirror {
         bool gpuEnabled = false;
         bool verbose = false;
         int threadNum = 4;
+        // workers of registerFaces, each takes whole images through decoding, detection and alignment;
+        // 0 starts one worker per threadNum cores
+        int enrolThreads = 0;
+        // recognition cache of verifyTracks, a track keeps its identity until it is trackRefreshFrames frames old,
+        // its face grows trackRefreshGrowth times larger or turns clearly more frontal; identities with a
+        // similarity below trackConfidentSim are retried every trackRefreshFrames / 4 frames
+        int trackRefreshFrames = 30;
+        float trackRefreshGrowth = 1.5f;
+        float trackConfidentSim = 0.6f;
+        // track lifecycle, a track is reported after trackMinHits matches and dropped after trackMaxAge frames
+        // without one
+        int trackMaxAge = 30;
+        int trackMinHits = 3;
+        // video mode of trackFaces, the detector runs on keyframes at most videoKeyframeInterval frames apart,
+        // sooner when the faces move fast or one is lost, and the faces are followed without it in between;
+        // a face entering the frame shows up at the next keyframe. 1 detects every frame
+        int videoKeyframeInterval = 10;
+        // tiled detection of high resolution frames: a frame whose long side is over detectTileSize is split into
+        // tiles of detectTileSize overlapping by detectTileOverlap pixels, run at native scale in parallel, plus
+        // one pass of the whole frame for the faces larger than the overlap. 0 fits the whole frame to the model
+        int detectTileSize = 0;
+        int detectTileOverlap = 128;
         float nmsThreshold = -1.0f; // face detection thresh
         float scoreThreshold = -1.0f; // face detection thresh
         float livingThreshold = -1.0f; // living detection thresh
@@ -248,11 +322,18 @@ namespace mirror {
         FaceLandMarkerType faceLandMarkerType = FaceLandMarkerType::INSIGHTFACE_LANDMARKER;
         FaceDetectorType faceDetectorType = FaceDetectorType::RETINA_FACE;
         FaceRecognizerType faceRecognizerType = FaceRecognizerType::ARC_FACE;
+        FaceDatabaseParams databaseParams;
 #if defined __ANDROID__
         AAssetManager* mgr = nullptr;
 #endif
     };
 
+    std::string GetFaceIndexTypeName(FaceIndexType type);
+
+    std::string GetFaceStorageTypeName(FaceStorageType type);
+
+    std::string GetFaceTemplateAggregationName(FaceTemplateAggregation type);
+
     std::string GetAntiSpoofingTypeName(FaceAntiSpoofingType type);
 
     std::string GetLandMarkerTypeName(FaceLandMarkerType type);
@@ -1,5 +1,11 @@
 #include "FaceEngine.h"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <limits>
+#include <thread>
+#include <unordered_map>
+#include <opencv2/highgui.hpp>
 
 #include "../common/Singleton.h"
 #include "detector/Detector.h"
@@ -8,6 +14,7 @@
 #include "living/FaceAntiSpoofing.h"
 #include "aligner/FaceAligner.h"
 #include "tracker/Tracker.h"
+#include "tracker/FacePropagator.h"
 #include "database/FaceDatabase.h"
 
 namespace mirror {
@@ -16,6 +23,7 @@ namespace mirror {
     public:
         Impl() {
             tracker_ = new Tracker();
+            propagator_ = new FacePropagator();
             aligner_ = new FaceAligner();
             database_ = new FaceDatabase();
             initialized_ = false;
@@ -33,6 +41,11 @@ namespace mirror {
                 tracker_ = nullptr;
             }
 
+            if (propagator_) {
+                delete propagator_;
+                propagator_ = nullptr;
+            }
+
             if (aligner_) {
                 delete aligner_;
                 aligner_ = nullptr;
@@ -254,6 +267,34 @@ namespace mirror {
                 destroyFaceLandMarker();
             }
 
+            // the database stores the features of the recognizer, a new dimension needs a new database
+            FaceDatabaseParams databaseParams = params.databaseParams;
+            if (recognizer_) {
+                databaseParams.featureDim = recognizer_->getFeatureDim();
+            }
+            if (database_ && database_->Dim() != databaseParams.featureDim) {
+                delete database_;
+                database_ = new FaceDatabase(databaseParams);
+            }
+            if (database_ && (errorCode = database_->Update(databaseParams)) != 0) {
+                initialized_ = false;
+                return errorCode;
+            }
+
+            const int cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+            enrolThreads_ = params.enrolThreads > 0 ? params.enrolThreads :
+                            std::max(1, cores / std::max(1, params.threadNum));
+            trackRefreshFrames_ = std::max(1, params.trackRefreshFrames);
+            trackRefreshGrowth_ = params.trackRefreshGrowth;
+            trackConfidentSim_ = params.trackConfidentSim;
+            trackIdentities_.clear();
+            if (tracker_) {
+                tracker_->update(params);
+            }
+            videoKeyframeInterval_ = std::max(1, params.videoKeyframeInterval);
+            keyframeInterval_ = videoKeyframeInterval_;
+            keyframeDue_ = true;
+
             PrintConfigurations(params);
 
             initialized_ = true;
@@ -278,6 +319,13 @@ namespace mirror {
             configureInfo += std::string("\nlandmarker Enabled: ") +
                              (params.faceLandMarkerEnabled ? "True" : "False");
             configureInfo += std::string("\nthread number: ") + std::to_string(params.threadNum);
+            configureInfo += std::string("\nenrol threads: ") + std::to_string(enrolThreads_);
+            configureInfo += std::string("\ntrack refresh frames: ") + std::to_string(trackRefreshFrames_);
+            configureInfo += std::string("\ntrack max age: ") + std::to_string(params.trackMaxAge) +
+                             " min hits: " + std::to_string(params.trackMinHits);
+            configureInfo += std::string("\nvideo keyframe interval: ") + std::to_string(videoKeyframeInterval_);
+            configureInfo += std::string("\ndetect tile size: ") + std::to_string(params.detectTileSize) +
+                             " overlap: " + std::to_string(params.detectTileOverlap);
 
             if (detector_) {
                 configureInfo += "\ndetector type: " + GetDetectorTypeName(detector_->getType());
@@ -297,6 +345,19 @@ namespace mirror {
                                  GetLandMarkerTypeName(landmarker_->getType());
             }
 
+            if (database_) {
+                configureInfo += "\nface feature dimension: " + std::to_string(database_->Dim());
+            }
+            configureInfo += "\nface database index type: " +
+                             GetFaceIndexTypeName(params.databaseParams.indexType);
+            configureInfo += "\nface database storage type: " +
+                             GetFaceStorageTypeName(params.databaseParams.storageType);
+            configureInfo += "\nface database templates per identity: " +
+                             std::to_string(params.databaseParams.maxTemplates) + " (" +
+                             GetFaceTemplateAggregationName(params.databaseParams.templateAggregation) + ")";
+            configureInfo += "\nface database scan threads: " +
+                             std::to_string(params.databaseParams.scanThreads);
+
             std::cout << configureInfo << std::endl;
             std::cout << "-----------------------------------------------" << std::endl;
         }
@@ -309,6 +370,40 @@ namespace mirror {
             return tracker_->track(currFaces, faces);
         }
 
+        inline int TrackFaces(const cv::Mat &frame, std::vector<TrackedFaceInfo> &faces) {
+            if (!initialized_ || !detector_ || !tracker_) {
+                std::cout << "face detector model uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            if (frame.empty()) {
+                return ErrorCode::EMPTY_INPUT_ERROR;
+            }
+
+            // between keyframes the faces of the last keyframe are followed, losing one brings the detector back
+            // on this very frame
+            std::vector<FaceInfo> detections;
+            bool keyframe = keyframeDue_ || framesSinceKeyframe_ + 1 >= keyframeInterval_;
+            if (!keyframe) {
+                float motion = 0.0f;
+                keyframe = !propagator_->propagate(frame, detections, motion);
+                if (!keyframe) {
+                    ++framesSinceKeyframe_;
+                    keyframeInterval_ = KeyframeInterval(motion);
+                }
+            }
+            if (keyframe) {
+                int flag = DetectFace(frame, detections);
+                if (flag != 0) {
+                    keyframeDue_ = true;
+                    return flag;
+                }
+                propagator_->reset(frame, detections);
+                framesSinceKeyframe_ = 0;
+                keyframeDue_ = false;
+            }
+            return tracker_->track(detections, faces);
+        }
+
         inline bool DetectLivingFace(const cv::Mat &imgSrc, float &livingScore) const {
             if (!initialized_ || !detector_ || !faceAntiSpoofing_) {
                 std::cout << "face anti spoofing model uninitialized!" << std::endl;
@@ -331,7 +426,7 @@ namespace mirror {
             return faceAntiSpoofing_->detect(imgSrc, box, livingScore);
         }
 
-        inline int VerifyFace(const cv::Mat &imgSrc, VerificationResult &result,
+        inline int VerifyFace(const std::string &partition, const cv::Mat &imgSrc, VerificationResult &result,
                               bool livingEnabled = false) const {
             if (!initialized_ || !aligner_ || !detector_ || !recognizer_ || !database_) {
                 std::cout << "face detector, recognizer model or database uninitialized!" << std::endl;
@@ -362,12 +457,15 @@ namespace mirror {
                 std::vector<cv::Point2f> keyPoints;
                 // only register first face
                 ConvertKeyPoints(faces.at(0).keypoints_, 5, keyPoints);
-                AlignFace(imgSrc, keyPoints, faceAligned);
+                int flag = AlignFaceInput(imgSrc, keyPoints, faceAligned);
+                if (flag != 0) {
+                    return flag;
+                }
 
                 // extract feature
                 std::vector<float> feat;
-                int flag = ExtractFeature(faceAligned, feat);
-                if (flag != 0 || feat.size() != kFaceFeatureDim) {
+                flag = ExtractFeature(faceAligned, feat);
+                if (flag != 0 || feat.size() != static_cast<size_t>(database_->Dim())) {
                     return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
                 }
 
@@ -375,7 +473,7 @@ namespace mirror {
                 QueryResult query_result;
                 query_result.sim_ = 0.0f;
                 query_result.name_ = "stranger";
-                flag = QueryTop(feat, query_result);
+                flag = QueryTop(partition, feat, query_result);
                 if (flag == ErrorCode::EMPTY_DATA_ERROR) {
                     std::cout << "face database is empty, please register first!" << std::endl;
                     return ErrorCode::EMPTY_DATA_ERROR;
@@ -390,7 +488,7 @@ namespace mirror {
             return ErrorCode::SUCCESS;
         }
 
-        inline int VerifyFace(const cv::Mat &imgSrc,
+        inline int VerifyFace(const std::string &partition, const cv::Mat &imgSrc,
                               const std::vector<cv::Point2f> &keyPoints,
                               VerificationResult &result) const {
             if (!initialized_ || !aligner_ || !recognizer_ || !database_) {
@@ -407,12 +505,15 @@ namespace mirror {
 
             // align face
             cv::Mat faceAligned;
-            AlignFace(imgSrc, keyPoints, faceAligned);
+            int flag = AlignFaceInput(imgSrc, keyPoints, faceAligned);
+            if (flag != 0) {
+                return flag;
+            }
 
             // extract feature
             std::vector<float> feat;
-            int flag = ExtractFeature(faceAligned, feat);
-            if (flag != 0 || feat.size() != kFaceFeatureDim) {
+            flag = ExtractFeature(faceAligned, feat);
+            if (flag != 0 || feat.size() != static_cast<size_t>(database_->Dim())) {
                 return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
             }
 
@@ -420,7 +521,7 @@ namespace mirror {
             QueryResult query_result;
             query_result.sim_ = 0.0f;
             query_result.name_ = "stranger";
-            flag = QueryTop(feat, query_result);
+            flag = QueryTop(partition, feat, query_result);
             if (flag == ErrorCode::EMPTY_DATA_ERROR) {
                 std::cout << "face database is empty, please register first!" << std::endl;
                 return ErrorCode::EMPTY_DATA_ERROR;
@@ -432,7 +533,199 @@ namespace mirror {
             return ErrorCode::SUCCESS;
         }
 
-        inline int RegisterFace(const cv::Mat &imgSrc, const std::string &name) {
+        inline int VerifyFaces(const std::string &partition, const cv::Mat &imgSrc,
+                               std::vector<VerificationResult> &results) const {
+            results.clear();
+            if (!initialized_ || !aligner_ || !detector_ || !recognizer_ || !database_) {
+                std::cout << "face detector, recognizer model or database uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+
+            std::vector<FaceInfo> faces;
+            DetectFace(imgSrc, faces);
+            if (faces.empty()) {
+                std::cout << "Cannot detect any face!" << std::endl;
+                return ErrorCode::NOT_FOUND_ERROR;
+            }
+
+            // align every face, then extract and query them together instead of once per face,
+            // a face that cannot be aligned is answered as a stranger without failing the others
+            results.resize(faces.size());
+            std::vector<size_t> pending;
+            std::vector<cv::Mat> facesAligned;
+            std::vector<cv::Point2f> keyPoints;
+            for (size_t i = 0; i < faces.size(); ++i) {
+                results[i].location = faces[i].location_;
+                results[i].name = "stranger";
+                results[i].sim = 0.0f;
+                facesAligned.emplace_back();
+                ConvertKeyPoints(faces[i].keypoints_, 5, keyPoints);
+                if (AlignFaceInput(imgSrc, keyPoints, facesAligned.back()) != 0) {
+                    facesAligned.pop_back();
+                    continue;
+                }
+                pending.push_back(i);
+            }
+            if (pending.empty()) {
+                return ErrorCode::SUCCESS;
+            }
+
+            std::vector<std::vector<float>> feats;
+            int flag = ExtractFeatures(facesAligned, feats);
+            if (flag != 0) {
+                results.clear();
+                return flag;
+            }
+            const size_t dim = static_cast<size_t>(database_->Dim());
+            std::vector<float> probes;
+            probes.reserve(feats.size() * dim);
+            for (const auto &feat : feats) {
+                if (feat.size() != dim) {
+                    results.clear();
+                    return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+                }
+                probes.insert(probes.end(), feat.begin(), feat.end());
+            }
+
+            std::vector<std::vector<QueryResult>> queryResults;
+            flag = database_->QueryBatch(partition, probes.data(), static_cast<int>(feats.size()), 1,
+                                         -std::numeric_limits<float>::max(), queryResults);
+            if (flag == ErrorCode::EMPTY_DATA_ERROR) {
+                std::cout << "face database is empty, please register first!" << std::endl;
+                results.clear();
+                return ErrorCode::EMPTY_DATA_ERROR;
+            }
+            if (flag != 0) {
+                results.clear();
+                return flag;
+            }
+
+            for (size_t j = 0; j < pending.size(); ++j) {
+                if (!queryResults[j].empty()) {
+                    results[pending[j]].name = queryResults[j].front().name_;
+                    results[pending[j]].sim = queryResults[j].front().sim_;
+                }
+            }
+
+            return ErrorCode::SUCCESS;
+        }
+
+        inline int VerifyTracks(const std::string &partition, const cv::Mat &imgSrc,
+                                const std::vector<TrackedFaceInfo> &faces, std::vector<VerificationResult> &results) {
+            results.clear();
+            if (!initialized_ || !aligner_ || !recognizer_ || !database_) {
+                std::cout << "face recognizer model or database uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            ++trackFrame_;
+
+            // the tracks whose cached identity is still good are answered from the cache,
+            // the others are aligned for one batched extraction and query
+            results.resize(faces.size());
+            std::vector<size_t> pending;
+            std::vector<cv::Mat> facesAligned;
+            std::vector<cv::Point2f> keyPoints;
+            for (size_t i = 0; i < faces.size(); ++i) {
+                const FaceInfo &face = faces[i].face_info_;
+                results[i].location = face.location_;
+                auto cached = trackIdentities_.find(faces[i].track_id_);
+                if (cached != trackIdentities_.end()) {
+                    cached->second.seen = trackFrame_;
+                    if (!NeedsRecognition(cached->second, partition, face)) {
+                        results[i].name = cached->second.name;
+                        results[i].sim = cached->second.sim;
+                        continue;
+                    }
+                }
+                facesAligned.emplace_back();
+                ConvertKeyPoints(face.keypoints_, 5, keyPoints);
+                if (AlignFaceInput(imgSrc, keyPoints, facesAligned.back()) != 0) {
+                    facesAligned.pop_back();
+                    results[i].name = "stranger";
+                    results[i].sim = 0.0f;
+                    continue;
+                }
+                pending.push_back(i);
+            }
+
+            // tracks out of sight for a while are gone for good, the tracks of this frame were just seen
+            for (auto it = trackIdentities_.begin(); it != trackIdentities_.end();) {
+                if (trackFrame_ - it->second.seen > trackRefreshFrames_) {
+                    it = trackIdentities_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            if (!pending.empty()) {
+                std::vector<std::vector<float>> feats;
+                int flag = ExtractFeatures(facesAligned, feats);
+                if (flag != 0) {
+                    results.clear();
+                    return flag;
+                }
+                const size_t dim = static_cast<size_t>(database_->Dim());
+                std::vector<float> probes(pending.size() * dim);
+                for (size_t j = 0; j < pending.size(); ++j) {
+                    if (feats[j].size() != dim) {
+                        results.clear();
+                        return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+                    }
+                    // a track refreshed on its age is queried with its embedding averaged over the frames,
+                    // a larger or more frontal face replaces the embedding of the poorer faces seen before
+                    float *probe = probes.data() + j * dim;
+                    NormalizeEmbedding(feats[j].data(), probe, dim);
+                    const TrackedFaceInfo &face = faces[pending[j]];
+                    auto cached = trackIdentities_.find(face.track_id_);
+                    if (cached != trackIdentities_.end() && cached->second.feat.size() == dim &&
+                        !IsBetterFace(cached->second, face.face_info_)) {
+                        for (size_t d = 0; d < dim; ++d) {
+                            probe[d] += cached->second.feat[d];
+                        }
+                        NormalizeEmbedding(probe, probe, dim);
+                    }
+                }
+
+                std::vector<std::vector<QueryResult>> queryResults;
+                flag = database_->QueryBatch(partition, probes.data(), static_cast<int>(pending.size()), 1,
+                                             -std::numeric_limits<float>::max(), queryResults);
+                if (flag == ErrorCode::EMPTY_DATA_ERROR) {
+                    std::cout << "face database is empty, please register first!" << std::endl;
+                    results.clear();
+                    return ErrorCode::EMPTY_DATA_ERROR;
+                }
+                if (flag != 0) {
+                    results.clear();
+                    return flag;
+                }
+
+                for (size_t j = 0; j < pending.size(); ++j) {
+                    VerificationResult &result = results[pending[j]];
+                    if (queryResults[j].empty()) {
+                        result.name = "stranger";
+                        result.sim = 0.0f;
+                    } else {
+                        result.name = queryResults[j].front().name_;
+                        result.sim = queryResults[j].front().sim_;
+                    }
+                    const TrackedFaceInfo &face = faces[pending[j]];
+                    if (face.track_id_ < 0) continue;
+                    TrackIdentity &identity = trackIdentities_[face.track_id_];
+                    identity.partition = partition;
+                    identity.name = result.name;
+                    identity.sim = result.sim;
+                    identity.feat.assign(probes.begin() + j * dim, probes.begin() + (j + 1) * dim);
+                    identity.frame = trackFrame_;
+                    identity.seen = trackFrame_;
+                    identity.area = static_cast<float>(face.face_info_.location_.area());
+                    identity.frontal = Frontality(face.face_info_);
+                }
+            }
+
+            return ErrorCode::SUCCESS;
+        }
+
+        inline int RegisterFace(const std::string &partition, const cv::Mat &imgSrc, const std::string &name) {
             if (!initialized_ || !detector_ || !recognizer_ || !database_) {
                 std::cout << "face detector, recognizer model or database uninitialized!" << std::endl;
                 return ErrorCode::UNINITIALIZED_ERROR;
@@ -446,34 +739,157 @@ namespace mirror {
                 }
             }
 
-            std::vector<FaceInfo> faces;
-            DetectFace(imgSrc, faces);
-            if (faces.empty()) {
+            std::vector<float> feat;
+            int flag = ExtractFirstFace(imgSrc, feat);
+            if (flag != 0) {
+                return flag;
+            }
+
+            Insert(partition, feat, name);
+            if (Save() != 0) {
+                std::cout << "Save face database failed!" << std::endl;
+                return ErrorCode::DATABASE_UPDATE_ERROR;
+            }
+
+            return ErrorCode::SUCCESS;
+        }
+
+        inline int RegisterFaces(const std::string &partition, const std::vector<std::string> &imagePaths,
+                                 const std::vector<std::string> &names, std::vector<int> &flags) {
+            flags.assign(imagePaths.size(), ErrorCode::UNINITIALIZED_ERROR);
+            if (!initialized_ || !detector_ || !recognizer_ || !database_) {
+                std::cout << "face detector, recognizer model or database uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            if (imagePaths.empty() || imagePaths.size() != names.size()) {
+                std::cout << "every image needs a face name!" << std::endl;
+                return ErrorCode::EMPTY_INPUT_ERROR;
+            }
+
+            if (database_->IsEmpty()) {
+                std::cout << "database unloaded!" << std::endl;
+                if (Load() != 0) {
+                    std::cout << "database load failed!" << std::endl;
+                    return ErrorCode::UNINITIALIZED_ERROR;
+                }
+            }
+
+            // the workers take the images of a window through decoding, detection and alignment, then the
+            // faces aligned in the window are extracted in one batch; the window bounds the memory of the tensors
+            const size_t kEnrolBatch = 32;
+            const size_t num_images = imagePaths.size();
+            const size_t dim = static_cast<size_t>(database_->Dim());
+            std::vector<float> feats(num_images * dim);
+            std::vector<cv::Mat> facesAligned(std::min(num_images, kEnrolBatch));
+            std::vector<cv::Mat> batch;
+            std::vector<std::vector<float>> batchFeats;
+            const size_t num_workers = std::min(facesAligned.size(), static_cast<size_t>(enrolThreads_));
+            for (size_t begin = 0; begin < num_images; begin += kEnrolBatch) {
+                const size_t end = std::min(num_images, begin + kEnrolBatch);
+                std::atomic<size_t> next(begin);
+                auto work = [&]() {
+                    for (size_t i = next.fetch_add(1); i < end; i = next.fetch_add(1)) {
+                        cv::Mat imgSrc = cv::imread(imagePaths[i]);
+                        if (imgSrc.empty()) {
+                            std::cout << "Cannot read image: " << imagePaths[i] << std::endl;
+                            flags[i] = ErrorCode::EMPTY_INPUT_ERROR;
+                            continue;
+                        }
+                        flags[i] = AlignFirstFace(imgSrc, facesAligned[i - begin]);
+                    }
+                };
+                std::vector<std::thread> workers;
+                for (size_t w = 1; w < num_workers; ++w) {
+                    workers.emplace_back(work);
+                }
+                work();
+                for (auto &worker : workers) {
+                    worker.join();
+                }
+
+                batch.clear();
+                for (size_t i = begin; i < end; ++i) {
+                    if (flags[i] == 0) {
+                        batch.push_back(facesAligned[i - begin]);
+                    }
+                }
+                if (batch.empty()) continue;
+                const int flag = ExtractFeatures(batch, batchFeats);
+                size_t j = 0;
+                for (size_t i = begin; i < end; ++i) {
+                    if (flags[i] != 0) continue;
+                    if (flag != 0) {
+                        flags[i] = flag;
+                    } else if (batchFeats[j].size() != dim) {
+                        flags[i] = ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+                    } else {
+                        std::copy(batchFeats[j].begin(), batchFeats[j].end(), feats.begin() + i * dim);
+                    }
+                    ++j;
+                }
+            }
+
+            // the faces found are inserted at once and persisted with a single save
+            std::vector<std::string> registered;
+            size_t row = 0;
+            for (size_t i = 0; i < num_images; ++i) {
+                if (flags[i] != 0) continue;
+                if (row != i) {
+                    std::copy(feats.begin() + i * dim, feats.begin() + (i + 1) * dim, feats.begin() + row * dim);
+                }
+                registered.push_back(names[i]);
+                ++row;
+            }
+            if (registered.empty()) {
                 std::cout << "Cannot detect any face!" << std::endl;
                 return ErrorCode::NOT_FOUND_ERROR;
             }
+            int flag = database_->InsertBatch(partition, feats.data(), registered);
+            if (flag != 0) {
+                return flag;
+            }
+            if (Save() != 0) {
+                std::cout << "Save face database failed!" << std::endl;
+                return ErrorCode::DATABASE_UPDATE_ERROR;
+            }
+            std::cout << "register " << registered.size() << " of " << num_images << " faces" << std::endl;
 
-            // align face
+            return ErrorCode::SUCCESS;
+        }
+
+        //! Detect, align and extract the feature of the first face in 'imgSrc'
+        inline int ExtractFirstFace(const cv::Mat &imgSrc, std::vector<float> &feat) const {
             cv::Mat faceAligned;
-            std::vector<cv::Point2f> keyPoints;
-            // only register first face
-            ConvertKeyPoints(faces.at(0).keypoints_, 5, keyPoints);
-            AlignFace(imgSrc, keyPoints, faceAligned);
+            int flag = AlignFirstFace(imgSrc, faceAligned);
+            if (flag != 0) {
+                return flag;
+            }
 
             // extract feature
-            std::vector<float> feat;
-            int flag = ExtractFeature(faceAligned, feat);
-            if (flag != 0 || feat.size() != kFaceFeatureDim) {
+            flag = ExtractFeature(faceAligned, feat);
+            if (flag != 0) {
                 return flag;
             }
+            if (feat.size() != static_cast<size_t>(database_->Dim())) {
+                return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+            }
+            return 0;
+        }
 
-            Insert(feat, name);
-            if (Save() != 0) {
-                std::cout << "Save face database failed!" << std::endl;
-                return ErrorCode::DATABASE_UPDATE_ERROR;
+        //! Detect the first face in 'imgSrc' and align it into the input tensor of the recognizer
+        inline int AlignFirstFace(const cv::Mat &imgSrc, cv::Mat &faceAligned) const {
+            std::vector<FaceInfo> faces;
+            DetectFace(imgSrc, faces);
+            if (faces.empty()) {
+                std::cout << "Cannot detect any face!" << std::endl;
+                return ErrorCode::NOT_FOUND_ERROR;
             }
 
-            return ErrorCode::SUCCESS;
+            // align face
+            std::vector<cv::Point2f> keyPoints;
+            // only register first face
+            ConvertKeyPoints(faces.at(0).keypoints_, 5, keyPoints);
+            return AlignFaceInput(imgSrc, keyPoints, faceAligned);
         }
 
         inline int DetectFace(const cv::Mat &imgSrc, std::vector<FaceInfo> &faces) const {
@@ -484,6 +900,15 @@ namespace mirror {
             return detector_->detect(imgSrc, faces);
         }
 
+        inline int DetectFace(const cv::Mat &imgSrc, const std::vector<cv::Rect> &rois,
+                              std::vector<FaceInfo> &faces, bool merge) const {
+            if (!initialized_ || !detector_) {
+                std::cout << "face detector model uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            return detector_->detect(imgSrc, rois, faces, merge);
+        }
+
         inline int ExtractKeypoints(const cv::Mat &imgSrc,
                                     const cv::Rect &box, std::vector<cv::Point2f> &keypoints) {
             if (!initialized_ || !landmarker_) {
@@ -503,6 +928,18 @@ namespace mirror {
             return aligner_->alignFace(imgSrc, keypoints, faceAligned);
         }
 
+        //! Align a face straight into the input tensor of the recognizer, skipping the 8 bit face image
+        inline int AlignFaceInput(const cv::Mat &imgSrc,
+                                  const std::vector<cv::Point2f> &keypoints,
+                                  cv::Mat &faceInput) const {
+            if (!initialized_ || !aligner_ || !recognizer_) {
+                std::cout << "face aligner or recognizer model uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            return aligner_->alignFaceTensor(imgSrc, keypoints, faceInput, recognizer_->getInputSize(),
+                                             recognizer_->getMeanVals(), recognizer_->getNormVals());
+        }
+
         inline int ExtractFeature(const cv::Mat &imgSrc, std::vector<float> &feat) const {
             if (!initialized_ || !recognizer_) {
                 std::cout << "face recognizer model uninitialized!" << std::endl;
@@ -511,7 +948,16 @@ namespace mirror {
             return recognizer_->extract(imgSrc, feat);
         }
 
-        inline int Insert(const std::vector<float> &feat, const std::string &name) {
+        inline int ExtractFeatures(const std::vector<cv::Mat> &facesAligned,
+                                   std::vector<std::vector<float>> &feats) const {
+            if (!initialized_ || !recognizer_) {
+                std::cout << "face recognizer model uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            return recognizer_->extractFeatures(facesAligned, feats);
+        }
+
+        inline int Insert(const std::string &partition, const std::vector<float> &feat, const std::string &name) {
             if (!initialized_ || !database_) {
                 std::cout << "face database model uninitialized!" << std::endl;
                 return ErrorCode::UNINITIALIZED_ERROR;
@@ -523,18 +969,18 @@ namespace mirror {
                     return ErrorCode::UNINITIALIZED_ERROR;
                 }
             }
-            return static_cast<int>(database_->Insert(feat, name));
+            return static_cast<int>(database_->Insert(partition, feat, name));
         }
 
-        inline int Find(std::vector<std::string> &names) const {
+        inline int Find(const std::string &partition, std::vector<std::string> &names) const {
             if (!initialized_ || !database_) {
                 std::cout << "face database model uninitialized!" << std::endl;
                 return ErrorCode::UNINITIALIZED_ERROR;
             }
-            return database_->Find(names);
+            return database_->Find(partition, names);
         }
 
-        inline int Delete(const std::string &name) {
+        inline int Delete(const std::string &partition, const std::string &name) {
             if (!initialized_ || !database_) {
                 std::cout << "face database model uninitialized!" << std::endl;
                 return ErrorCode::UNINITIALIZED_ERROR;
@@ -546,7 +992,7 @@ namespace mirror {
                     return ErrorCode::UNINITIALIZED_ERROR;
                 }
             }
-            return database_->Delete(name);
+            return database_->Delete(partition, name);
         }
 
         inline int Clear() {
@@ -555,15 +1001,68 @@ namespace mirror {
                 return ErrorCode::UNINITIALIZED_ERROR;
             }
             database_->Clear();
+            trackIdentities_.clear();
             return 0;
         }
 
-        inline int QueryTop(const std::vector<float> &feat, QueryResult &queryResult) const {
+        inline int QueryTop(const std::string &partition, const std::vector<float> &feat,
+                            QueryResult &queryResult) const {
             if (!initialized_ || !database_) {
                 std::cout << "face database model uninitialized!" << std::endl;
                 return ErrorCode::UNINITIALIZED_ERROR;
             }
-            return database_->QueryTop(feat, queryResult);
+            return database_->QueryTop(partition, feat, queryResult);
+        }
+
+        inline int QueryTopK(const std::string &partition, const std::vector<float> &feat, int k, float minSim,
+                             std::vector<QueryResult> &queryResults) const {
+            if (!initialized_ || !database_) {
+                std::cout << "face database model uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            return database_->QueryTopK(partition, feat, k, minSim, queryResults);
+        }
+
+        inline int QueryBatch(const std::string &partition, const std::vector<std::vector<float>> &feats,
+                              int k, float minSim, std::vector<std::vector<QueryResult>> &queryResults) const {
+            if (!initialized_ || !database_) {
+                std::cout << "face database model uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            std::vector<float> probes;
+            const size_t dim = static_cast<size_t>(database_->Dim());
+            probes.reserve(feats.size() * dim);
+            for (const auto &feat : feats) {
+                if (feat.size() != dim) {
+                    return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+                }
+                probes.insert(probes.end(), feat.begin(), feat.end());
+            }
+            return database_->QueryBatch(partition, probes.data(), static_cast<int>(feats.size()),
+                                         k, minSim, queryResults);
+        }
+
+        inline int DropPartition(const std::string &partition) {
+            if (!initialized_ || !database_) {
+                std::cout << "face database model uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            if (database_->IsEmpty()) {
+                std::cout << "database unloaded!" << std::endl;
+                if (Load() != 0) {
+                    std::cout << "database load failed!" << std::endl;
+                    return ErrorCode::UNINITIALIZED_ERROR;
+                }
+            }
+            return database_->DropPartition(partition);
+        }
+
+        inline int ListPartitions(std::vector<std::string> &partitions) const {
+            if (!initialized_ || !database_) {
+                std::cout << "face database model uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            return database_->ListPartitions(partitions);
         }
 
         inline int Save() const {
@@ -571,7 +1070,15 @@ namespace mirror {
                 std::cout << "face database model uninitialized!" << std::endl;
                 return ErrorCode::UNINITIALIZED_ERROR;
             }
-            return database_->Save(db_name_.c_str());
+            return database_->Sync(db_name_.c_str());
+        }
+
+        inline int Compact() {
+            if (!initialized_ || !database_) {
+                std::cout << "face database model uninitialized!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            return database_->Compact();
         }
 
         inline int Load() {
@@ -591,6 +1098,70 @@ namespace mirror {
         }
 
     private:
+        //! Identity and embedding of a track, as of the frame it was last recognized in
+        struct TrackIdentity {
+            std::string partition;
+            std::string name;
+            float sim = 0.0f;
+            std::vector<float> feat;
+            int64_t frame = 0; // frame of the recognition
+            int64_t seen = 0; // last frame the track was in
+            float area = 0.0f;
+            float frontal = 0.0f;
+        };
+
+        //! How much more frontal a face must be to be recognized again
+        static constexpr float kFrontalGain = 0.2f;
+
+        //! 1 for a frontal face, towards 0 as the nose leaves the middle of the eyes
+        static inline float Frontality(const FaceInfo &face) {
+            const float eyes = face.keypoints_[1].x - face.keypoints_[0].x;
+            if (eyes <= 0.0f) return 0.0f;
+            const float offset = std::abs(face.keypoints_[2].x - (face.keypoints_[0].x + face.keypoints_[1].x) / 2);
+            return std::max(0.0f, 1.0f - 2.0f * offset / eyes);
+        }
+
+        static inline void NormalizeEmbedding(const float *feat, float *normalized, size_t dim) {
+            float norm = 0.0f;
+            for (size_t d = 0; d < dim; ++d) {
+                norm += feat[d] * feat[d];
+            }
+            const float scale = norm > 0.0f ? 1.0f / std::sqrt(norm) : 0.0f;
+            for (size_t d = 0; d < dim; ++d) {
+                normalized[d] = feat[d] * scale;
+            }
+        }
+
+        inline bool IsBetterFace(const TrackIdentity &identity, const FaceInfo &face) const {
+            return face.location_.area() >= identity.area * trackRefreshGrowth_ ||
+                   Frontality(face) >= identity.frontal + kFrontalGain;
+        }
+
+        inline bool NeedsRecognition(const TrackIdentity &identity, const std::string &partition,
+                                     const FaceInfo &face) const {
+            const int64_t age = trackFrame_ - identity.frame;
+            if (identity.partition != partition || age >= trackRefreshFrames_) {
+                return true;
+            }
+            if (identity.sim < trackConfidentSim_ && age >= std::max(1, trackRefreshFrames_ / 4)) {
+                return true;
+            }
+            return IsBetterFace(identity, face);
+        }
+
+        //! Frames between keyframes for faces moving 'motion' face widths per frame, the faster the sooner
+        inline int KeyframeInterval(float motion) const {
+            // template matching keeps up with a face that moves up to this fraction of its width per frame
+            // over a full interval, faster faces drift and change their look sooner
+            static const float kSlowMotion = 0.02f;
+            if (motion <= kSlowMotion) {
+                return videoKeyframeInterval_;
+            }
+            // one followed frame between keyframes at least, it measures the motion to grow the interval back
+            return std::max(std::min(2, videoKeyframeInterval_),
+                            static_cast<int>(videoKeyframeInterval_ * kSlowMotion / motion));
+        }
+
         bool initialized_;
         std::string db_name_;
         FaceAntiSpoofing *faceAntiSpoofing_ = nullptr;
@@ -599,7 +1170,18 @@ namespace mirror {
         Recognizer *recognizer_ = nullptr;
         FaceAligner *aligner_ = nullptr;
         Tracker *tracker_ = nullptr;
+        FacePropagator *propagator_ = nullptr;
         FaceDatabase *database_ = nullptr;
+        int enrolThreads_ = 1;
+        int trackRefreshFrames_ = 30;
+        float trackRefreshGrowth_ = 1.5f;
+        float trackConfidentSim_ = 0.6f;
+        int64_t trackFrame_ = 0;
+        std::unordered_map<int, TrackIdentity> trackIdentities_;
+        int videoKeyframeInterval_ = 10;
+        int keyframeInterval_ = 10; // adapted to the motion of the faces
+        int framesSinceKeyframe_ = 0;
+        bool keyframeDue_ = true;
     };
 
     //! Unique instance of ecvOptions
@@ -648,10 +1230,19 @@ namespace mirror {
         return impl_->Track(currFaces, faces);
     }
 
+    int FaceEngine::trackFaces(const cv::Mat &frame, std::vector<TrackedFaceInfo> &faces) {
+        return impl_->TrackFaces(frame, faces);
+    }
+
     int FaceEngine::detectFace(const cv::Mat &imgSrc, std::vector<FaceInfo> &faces) const {
         return impl_->DetectFace(imgSrc, faces);
     }
 
+    int FaceEngine::detectFace(const cv::Mat &imgSrc, const std::vector<cv::Rect> &rois,
+                               std::vector<FaceInfo> &faces, bool merge) const {
+        return impl_->DetectFace(imgSrc, rois, faces, merge);
+    }
+
     int FaceEngine::extractKeypoints(const cv::Mat &imgSrc,
                                      const cv::Rect &box,
                                      std::vector<cv::Point2f> &keypoints) const {
@@ -668,8 +1259,27 @@ namespace mirror {
         return impl_->ExtractFeature(imgSrc, feat);
     }
 
+    int FaceEngine::extractFeatures(const std::vector<cv::Mat> &facesAligned,
+                                    std::vector<std::vector<float>> &features) const {
+        return impl_->ExtractFeatures(facesAligned, features);
+    }
+
     int FaceEngine::registerFace(const cv::Mat &imgSrc, const std::string &name) {
-        return impl_->RegisterFace(imgSrc, name);
+        return impl_->RegisterFace(std::string(), imgSrc, name);
+    }
+
+    int FaceEngine::registerFace(const std::string &partition, const cv::Mat &imgSrc, const std::string &name) {
+        return impl_->RegisterFace(partition, imgSrc, name);
+    }
+
+    int FaceEngine::registerFaces(const std::vector<std::string> &imagePaths, const std::vector<std::string> &names,
+                                  std::vector<int> &flags) {
+        return impl_->RegisterFaces(std::string(), imagePaths, names, flags);
+    }
+
+    int FaceEngine::registerFaces(const std::string &partition, const std::vector<std::string> &imagePaths,
+                                  const std::vector<std::string> &names, std::vector<int> &flags) {
+        return impl_->RegisterFaces(partition, imagePaths, names, flags);
     }
 
     bool FaceEngine::detectLivingFace(const cv::Mat &imgSrc, const cv::Rect &box, float &livingScore) const {
@@ -681,12 +1291,41 @@ namespace mirror {
     }
 
     int FaceEngine::verifyFace(const cv::Mat &imgSrc, VerificationResult &result, bool livingEnabled) const {
-        return impl_->VerifyFace(imgSrc, result, livingEnabled);
+        return impl_->VerifyFace(std::string(), imgSrc, result, livingEnabled);
     }
 
     int FaceEngine::verifyFace(const cv::Mat &imgSrc, const std::vector<cv::Point2f> &keyPoints,
                                VerificationResult &result) const {
-        return impl_->VerifyFace(imgSrc, keyPoints, result);
+        return impl_->VerifyFace(std::string(), imgSrc, keyPoints, result);
+    }
+
+    int FaceEngine::verifyFace(const std::string &partition, const cv::Mat &imgSrc, VerificationResult &result,
+                               bool livingEnabled) const {
+        return impl_->VerifyFace(partition, imgSrc, result, livingEnabled);
+    }
+
+    int FaceEngine::verifyFace(const std::string &partition, const cv::Mat &imgSrc,
+                               const std::vector<cv::Point2f> &keyPoints, VerificationResult &result) const {
+        return impl_->VerifyFace(partition, imgSrc, keyPoints, result);
+    }
+
+    int FaceEngine::verifyFaces(const cv::Mat &imgSrc, std::vector<VerificationResult> &results) const {
+        return impl_->VerifyFaces(std::string(), imgSrc, results);
+    }
+
+    int FaceEngine::verifyFaces(const std::string &partition, const cv::Mat &imgSrc,
+                                std::vector<VerificationResult> &results) const {
+        return impl_->VerifyFaces(partition, imgSrc, results);
+    }
+
+    int FaceEngine::verifyTracks(const cv::Mat &imgSrc, const std::vector<TrackedFaceInfo> &faces,
+                                 std::vector<VerificationResult> &results) {
+        return impl_->VerifyTracks(std::string(), imgSrc, faces, results);
+    }
+
+    int FaceEngine::verifyTracks(const std::string &partition, const cv::Mat &imgSrc,
+                                 const std::vector<TrackedFaceInfo> &faces, std::vector<VerificationResult> &results) {
+        return impl_->VerifyTracks(partition, imgSrc, faces, results);
     }
 
     int FaceEngine::Save() const {
@@ -697,16 +1336,36 @@ namespace mirror {
         return impl_->Load();
     }
 
+    int FaceEngine::Compact() {
+        return impl_->Compact();
+    }
+
     int FaceEngine::Clear() {
         return impl_->Clear();
     }
 
     int FaceEngine::Delete(const std::string &name) {
-        return impl_->Delete(name);
+        return impl_->Delete(std::string(), name);
+    }
+
+    int FaceEngine::Delete(const std::string &partition, const std::string &name) {
+        return impl_->Delete(partition, name);
     }
 
     int FaceEngine::Insert(const std::vector<float> &feat, const std::string &name) {
-        return impl_->Insert(feat, name);
+        return impl_->Insert(std::string(), feat, name);
+    }
+
+    int FaceEngine::Insert(const std::string &partition, const std::vector<float> &feat, const std::string &name) {
+        return impl_->Insert(partition, feat, name);
+    }
+
+    int FaceEngine::DropPartition(const std::string &partition) {
+        return impl_->DropPartition(partition);
+    }
+
+    int FaceEngine::ListPartitions(std::vector<std::string> &partitions) const {
+        return impl_->ListPartitions(partitions);
     }
 
     int FaceEngine::QueryTop(const std::vector<float> &feat, QueryResult &queryResult) const {
@@ -717,7 +1376,31 @@ namespace mirror {
                 return ErrorCode::UNINITIALIZED_ERROR;
             }
         }
-        return impl_->QueryTop(feat, queryResult);
+        return impl_->QueryTop(std::string(), feat, queryResult);
+    }
+
+    int FaceEngine::QueryTopK(const std::vector<float> &feat, int k, float minSim,
+                              std::vector<QueryResult> &queryResults) const {
+        if (impl_->databaseEmpty()) {
+            std::cout << "database unloaded!" << std::endl;
+            if (impl_->Load() != 0) {
+                std::cout << "database load failed!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+        }
+        return impl_->QueryTopK(std::string(), feat, k, minSim, queryResults);
+    }
+
+    int FaceEngine::QueryBatch(const std::vector<std::vector<float>> &feats, int k, float minSim,
+                               std::vector<std::vector<QueryResult>> &queryResults) const {
+        if (impl_->databaseEmpty()) {
+            std::cout << "database unloaded!" << std::endl;
+            if (impl_->Load() != 0) {
+                std::cout << "database load failed!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+        }
+        return impl_->QueryBatch(std::string(), feats, k, minSim, queryResults);
     }
 
     int FaceEngine::Find(std::vector<std::string> &names) const {
@@ -728,7 +1411,54 @@ namespace mirror {
                 return ErrorCode::UNINITIALIZED_ERROR;
             }
         }
-        return impl_->Find(names);
+        return impl_->Find(std::string(), names);
+    }
+
+    int FaceEngine::QueryTop(const std::string &partition, const std::vector<float> &feat,
+                             QueryResult &queryResult) const {
+        if (impl_->databaseEmpty()) {
+            std::cout << "database unloaded!" << std::endl;
+            if (impl_->Load() != 0) {
+                std::cout << "database load failed!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+        }
+        return impl_->QueryTop(partition, feat, queryResult);
+    }
+
+    int FaceEngine::QueryTopK(const std::string &partition, const std::vector<float> &feat, int k, float minSim,
+                              std::vector<QueryResult> &queryResults) const {
+        if (impl_->databaseEmpty()) {
+            std::cout << "database unloaded!" << std::endl;
+            if (impl_->Load() != 0) {
+                std::cout << "database load failed!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+        }
+        return impl_->QueryTopK(partition, feat, k, minSim, queryResults);
+    }
+
+    int FaceEngine::QueryBatch(const std::string &partition, const std::vector<std::vector<float>> &feats,
+                               int k, float minSim, std::vector<std::vector<QueryResult>> &queryResults) const {
+        if (impl_->databaseEmpty()) {
+            std::cout << "database unloaded!" << std::endl;
+            if (impl_->Load() != 0) {
+                std::cout << "database load failed!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+        }
+        return impl_->QueryBatch(partition, feats, k, minSim, queryResults);
+    }
+
+    int FaceEngine::Find(const std::string &partition, std::vector<std::string> &names) const {
+        if (impl_->databaseEmpty()) {
+            std::cout << "database unloaded!" << std::endl;
+            if (impl_->Load() != 0) {
+                std::cout << "database load failed!" << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+        }
+        return impl_->Find(partition, names);
     }
 
 }
\ No newline at end of file
@@ -40,6 +40,16 @@ namespace mirror {
         /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
         FACE_API int registerFace(const cv::Mat &imgSrc, const std::string &name);
 
+        /// \brief Register many faces at once, e.g. a directory of ID photos. The images are decoded and their
+        /// first face detected and aligned on FaceEngineParams::enrolThreads workers, the aligned faces are
+        /// extracted in batches, then inserted as one batch and the database is saved once.
+        /// \param imagePaths [in] The image files.
+        /// \param names [in] The face id or name of every image.
+        /// \param flags [out] 0 for every registered image, else the ErrorCode it failed with.
+        /// \return Return 0 if any face is registered else ErrorCode [please reference to "common.h"].
+        FACE_API int registerFaces(const std::vector<std::string> &imagePaths, const std::vector<std::string> &names,
+                                   std::vector<int> &flags);
+
         /// \brief Verify face
         /// \param imgSrc [in] The input cv::Mat origin image.
         /// \param result [out] The verification result.
@@ -57,6 +67,24 @@ namespace mirror {
                                 const std::vector<cv::Point2f> &keyPoints,
                                 VerificationResult &result) const;
 
+        /// \brief Verify every face of the image, e.g. several people in view of a turnstile. The image is
+        /// detected once, and the faces are aligned, extracted and queried against the database together.
+        /// \param imgSrc [in] The input cv::Mat origin image.
+        /// \param results [out] One verification result per detected face, with the box of the face.
+        /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
+        FACE_API int verifyFaces(const cv::Mat &imgSrc, std::vector<VerificationResult> &results) const;
+
+        /// \brief Verify the tracked faces of a video frame. The identity and embedding of every track are cached,
+        /// a track is only recognized again once its identity is trackRefreshFrames frames old, its face has grown
+        /// trackRefreshGrowth times larger or turned more frontal, or its similarity is below trackConfidentSim
+        /// [please reference to "FaceEngineParams"]. The faces to recognize are extracted and queried together.
+        /// \param imgSrc [in] The input cv::Mat video frame.
+        /// \param faces [in] The faces of the frame as returned by track.
+        /// \param results [out] One verification result per tracked face, with the box of the face.
+        /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
+        FACE_API int verifyTracks(const cv::Mat &imgSrc, const std::vector<TrackedFaceInfo> &faces,
+                                  std::vector<VerificationResult> &results);
+
         /// \brief Detect living face
         /// \param imgSrc [in] The input cv::Mat origin image.
         /// \param livingScore [out] If greater than this score threshold, real face. Otherwise, fake face.
@@ -76,6 +104,17 @@ namespace mirror {
         /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
         FACE_API int detectFace(const cv::Mat &imgSrc, std::vector<FaceInfo> &faces) const;
 
+        /// \brief Detect faces inside regions of the image only, such as a doorway or the boxes of tracked faces.
+        /// The regions run at native resolution instead of the whole image being scaled to the model input, which
+        /// costs less and keeps small faces.
+        /// \param imgSrc [in] The input cv::Mat image.
+        /// \param rois [in] The regions to detect faces in, clipped to the image.
+        /// \param faces [out] The detected faces information, in image coordinates.
+        /// \param merge [in] Join the regions that overlap or are cheaper to run together.
+        /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
+        FACE_API int detectFace(const cv::Mat &imgSrc, const std::vector<cv::Rect> &rois,
+                                std::vector<FaceInfo> &faces, bool merge = true) const;
+
         /// \brief Track faces
         /// \param currFaces [in] The current detected faces information.
         /// \param faces [out] The faces will be tracked
@@ -83,6 +122,14 @@ namespace mirror {
         FACE_API int track(const std::vector<FaceInfo> &currFaces,
                            std::vector<TrackedFaceInfo> &faces);
 
+        /// \brief Detect and track the faces of a video frame. The detector only runs on keyframes, at most
+        /// videoKeyframeInterval frames apart and closer when the faces move fast; in between the faces are
+        /// followed from the last keyframe and a lost face makes the frame a keyframe. Frames go in their order.
+        /// \param frame [in] The current video frame.
+        /// \param faces [out] The tracked faces, as returned by track.
+        /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
+        FACE_API int trackFaces(const cv::Mat &frame, std::vector<TrackedFaceInfo> &faces);
+
         /// \brief Detect living faces
         /// \param imgSrc [in] The input cv::Mat image.
         /// \param box [in] The single cv::Rect detected face box
@@ -93,10 +140,17 @@ namespace mirror {
 
         /// \brief Extract face feature from input aligned image with 112*112
         /// \param imgSrc [in] The input aligned image with 112*112 in cv::Mat format.
-        /// \param feature [out] The extracted face feature with kFaceFeatureDim
+        /// \param feature [out] The extracted face feature with the feature dimension of the recognizer
         /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
         FACE_API int extractFeature(const cv::Mat &imgSrc, std::vector<float> &feature) const;
 
+        /// \brief Extract the features of several aligned faces at once, faster than one extractFeature per face
+        /// \param facesAligned [in] The aligned images with 112*112 in cv::Mat format.
+        /// \param features [out] The extracted face features, features[i] belongs to facesAligned[i].
+        /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
+        FACE_API int extractFeatures(const std::vector<cv::Mat> &facesAligned,
+                                     std::vector<std::vector<float>> &features) const;
+
         /// \brief Extract face feature from input aligned image with 112*112
         /// \param imgSrc [in] The input aligned image with 112*112 in cv::Mat format.
         /// \param keypoints [in] The extracted face keypoints with 2D coordinate like (x, y) * n.
@@ -107,9 +161,11 @@ namespace mirror {
 
         //! Load registered faces from database file
         FACE_API int Load();
-        //! Save face database cache
+        //! Persist face database changes, appended to its journal and only rewritten in full once that grows large
         FACE_API int Save() const;
-        //! Reset face database
+        //! Fold the face database journal into the database file
+        FACE_API int Compact();
+        //! Reset face database, every partition is dropped
         FACE_API int Clear();
         //! Delete registered face information from database by given face name
         FACE_API int Delete(const std::string &name);
@@ -117,17 +173,97 @@ namespace mirror {
         FACE_API int Find(std::vector<std::string> &names) const;
 
         /// \brief Insert face features into database
-        /// \param feat [in] The extracted face feature with kFaceFeatureDim.
+        /// \param feat [in] The extracted face feature with the feature dimension of the recognizer.
         /// \param name [in] The face id or name
         /// \return The new face index if success else ErrorCode [please reference to "common.h"].
         FACE_API int Insert(const std::vector<float> &feat, const std::string &name);
 
         /// \brief Query the most similarity face from registered faces
-        /// \param feat [in] The extracted face feature with kFaceFeatureDim.
+        /// \param feat [in] The extracted face feature with the feature dimension of the recognizer.
         /// \param queryResult [out] The query result with similarity and registered face name
         /// \return The new face index if success else ErrorCode [please reference to "common.h"].
         FACE_API int QueryTop(const std::vector<float> &feat, QueryResult &queryResult) const;
 
+        /// \brief Query the k most similar faces from registered faces
+        /// \param feat [in] The extracted face feature with the feature dimension of the recognizer.
+        /// \param k [in] The maximum number of returned faces.
+        /// \param minSim [in] Faces with lower similarity than minSim are skipped.
+        /// \param queryResults [out] At most k results sorted by descending similarity, may be empty.
+        /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
+        FACE_API int QueryTopK(const std::vector<float> &feat, int k, float minSim,
+                               std::vector<QueryResult> &queryResults) const;
+
+        /// \brief Query the k most similar faces for several features in one pass over the gallery
+        /// \param feats [in] The extracted face features, each with the feature dimension of the recognizer.
+        /// \param k [in] The maximum number of returned faces per feature.
+        /// \param minSim [in] Faces with lower similarity than minSim are skipped.
+        /// \param queryResults [out] One result list per feature, see QueryTopK.
+        /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
+        FACE_API int QueryBatch(const std::vector<std::vector<float>> &feats, int k, float minSim,
+                                std::vector<std::vector<QueryResult>> &queryResults) const;
+
+        // The same face database operations scoped to a named partition, e.g. one per site. A partition has
+        // its own storage and index, is created by registering or inserting its first face and is saved and
+        // loaded along with the database. The empty name designates the default partition used above.
+
+        /// \brief Register face into a partition
+        /// \param partition [in] The partition name, with [A-Za-z0-9_.-] only and not starting with a dot.
+        /// \param imgSrc [in] The input cv::Mat origin image.
+        /// \param name [in] The face id or name
+        /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
+        FACE_API int registerFace(const std::string &partition, const cv::Mat &imgSrc, const std::string &name);
+
+        //! Register many faces into a partition at once, see registerFaces
+        FACE_API int registerFaces(const std::string &partition, const std::vector<std::string> &imagePaths,
+                                   const std::vector<std::string> &names, std::vector<int> &flags);
+
+        /// \brief Verify face against the faces of a partition
+        /// \param partition [in] The partition name.
+        /// \param imgSrc [in] The input cv::Mat origin image.
+        /// \param result [out] The verification result.
+        /// \param livingEnabled [in] If true, using living detection.
+        /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
+        FACE_API int verifyFace(const std::string &partition, const cv::Mat &imgSrc, VerificationResult &result,
+                                bool livingEnabled = false) const;
+
+        /// \brief Verify face against the faces of a partition
+        /// \param partition [in] The partition name.
+        /// \param imgSrc [in] The input cv::Mat origin image.
+        /// \param keyPoints [in] The face keypoints used for alignment
+        /// \param result [out] The verification result.
+        /// \return Return 0 if success else ErrorCode [please reference to "common.h"].
+        FACE_API int verifyFace(const std::string &partition, const cv::Mat &imgSrc,
+                                const std::vector<cv::Point2f> &keyPoints,
+                                VerificationResult &result) const;
+
+        //! Verify every face of the image against the faces of a partition, see verifyFaces
+        FACE_API int verifyFaces(const std::string &partition, const cv::Mat &imgSrc,
+                                 std::vector<VerificationResult> &results) const;
+
+        //! Verify the tracked faces of a video frame against the faces of a partition, see verifyTracks
+        FACE_API int verifyTracks(const std::string &partition, const cv::Mat &imgSrc,
+                                  const std::vector<TrackedFaceInfo> &faces, std::vector<VerificationResult> &results);
+
+        //! Delete registered face information from a partition by given face name
+        FACE_API int Delete(const std::string &partition, const std::string &name);
+        //! Find all registered faces names of a partition
+        FACE_API int Find(const std::string &partition, std::vector<std::string> &names) const;
+        //! Insert face features into a partition, see Insert
+        FACE_API int Insert(const std::string &partition, const std::vector<float> &feat, const std::string &name);
+        //! Query the most similar face of a partition, see QueryTop
+        FACE_API int QueryTop(const std::string &partition, const std::vector<float> &feat,
+                              QueryResult &queryResult) const;
+        //! Query the k most similar faces of a partition, see QueryTopK
+        FACE_API int QueryTopK(const std::string &partition, const std::vector<float> &feat, int k, float minSim,
+                               std::vector<QueryResult> &queryResults) const;
+        //! Query the k most similar faces of a partition for several features, see QueryBatch
+        FACE_API int QueryBatch(const std::string &partition, const std::vector<std::vector<float>> &feats,
+                                int k, float minSim, std::vector<std::vector<QueryResult>> &queryResults) const;
+        //! Remove a partition with all its faces, Save drops it from the database files
+        FACE_API int DropPartition(const std::string &partition);
+        //! Names of all partitions, sorted
+        FACE_API int ListPartitions(std::vector<std::string> &partitions) const;
+
     private:
         //! Default constructor
         /** Shouldn't be called directly. Use 'GetUniqueInstance' instead.
@@ -1,4 +1,5 @@
 #include "FaceAligner.h"
+#include <cmath>
 #include <iostream>
 #include "../common/common.h"
 #include "opencv2/core.hpp"
@@ -7,23 +8,19 @@
 namespace mirror {
     class FaceAligner::Impl {
     public:
-        Impl()
-        {
-            dst_mat = cv::Mat(5, 2, CV_32FC1, points_dst);
-        }
+        Impl() = default;
 
         int AlignFace(const cv::Mat &img_src, const std::vector<cv::Point2f> &keypoints, cv::Mat &face_aligned) const;
 
-    private:
-        static cv::Mat MeanAxis0(const cv::Mat &src);
-
-        static cv::Mat ElementwiseMinus(const cv::Mat &A, const cv::Mat &B);
+        int AlignFaceTensor(const cv::Mat &img_src, const std::vector<cv::Point2f> &keypoints, cv::Mat &face_tensor,
+                            const cv::Size &size, const float *mean_vals, const float *norm_vals) const;
 
-        static cv::Mat VarAxis0(const cv::Mat &src);
+    private:
+        static int SelectPoints(const std::vector<cv::Point2f> &keypoints, float points_src[5][2]);
 
-        static int MatrixRank(const cv::Mat &M);
+        static void SimilarTransform(const float src[5][2], const float dst[5][2], float transform[2][3]);
 
-        static cv::Mat SimilarTransform(const cv::Mat &src, const cv::Mat &dst);
+        int Transform(const std::vector<cv::Point2f> &keypoints, const cv::Size &size, float transform[2][3]) const;
 
         float points_dst[5][2] = {
                 {30.2946f + 8.0f, 51.6963f},
@@ -32,7 +29,6 @@ namespace mirror {
                 {33.5493f + 8.0f, 92.3655f},
                 {62.7299f + 8.0f, 92.2041f}
         };
-        cv::Mat dst_mat;
     };
 
 
@@ -52,6 +48,12 @@ namespace mirror {
         return impl_->AlignFace(img_src, keypoints, face_aligned);
     }
 
+    int FaceAligner::alignFaceTensor(const cv::Mat &img_src, const std::vector<cv::Point2f> &keypoints,
+                                     cv::Mat &face_tensor, const cv::Size &size,
+                                     const float *mean_vals, const float *norm_vals) const {
+        return impl_->AlignFaceTensor(img_src, keypoints, face_tensor, size, mean_vals, norm_vals);
+    }
+
     //----------------------------------------------------------------------------------------
     // Calculating the turning angle of face
     //----------------------------------------------------------------------------------------
@@ -62,164 +64,187 @@ namespace mirror {
         return angle;
     }
 
-    int FaceAligner::Impl::AlignFace(const cv::Mat &img_src,
-                                     const std::vector<cv::Point2f> &keypoints, cv::Mat &face_aligned) const {
-        std::cout << "start align face." << std::endl;
-        if (img_src.empty()) {
-            std::cout << "input empty." << std::endl;
-            return ErrorCode::EMPTY_INPUT_ERROR;
-        }
-        if (keypoints.empty()) {
-            std::cout << "keypoints empty." << std::endl;
-            return ErrorCode::EMPTY_INPUT_ERROR;
-        }
-
-        cv::Mat src_mat;
+    int FaceAligner::Impl::SelectPoints(const std::vector<cv::Point2f> &keypoints, float points_src[5][2]) {
+        static const int kPoints106[5] = {104, 105, 46, 84, 90};
         if (keypoints.size() == 5) {
-            float points_src[5][2] = {
-                    {keypoints[0].x, keypoints[0].y},
-                    {keypoints[1].x, keypoints[1].y},
-                    {keypoints[2].x, keypoints[2].y},
-                    {keypoints[3].x, keypoints[3].y},
-                    {keypoints[4].x, keypoints[4].y}
-            };
-            src_mat = cv::Mat(5, 2, CV_32FC1, points_src);
+            for (int i = 0; i < 5; ++i) {
+                points_src[i][0] = keypoints[i].x;
+                points_src[i][1] = keypoints[i].y;
+            }
         } else if (keypoints.size() == 106) {
-            float points_src[5][2] = {
-                    {keypoints[104].x, keypoints[104].y},
-                    {keypoints[105].x, keypoints[105].y},
-                    {keypoints[46].x,  keypoints[46].y},
-                    {keypoints[84].x,  keypoints[84].y},
-                    {keypoints[90].x,  keypoints[90].y}
-            };
-            src_mat = cv::Mat(5, 2, CV_32FC1, points_src);
+            for (int i = 0; i < 5; ++i) {
+                points_src[i][0] = keypoints[kPoints106[i]].x;
+                points_src[i][1] = keypoints[kPoints106[i]].y;
+            }
         } else {
             std::cout << "unsupported keypoints dimension." << std::endl;
             return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
         }
-
-        cv::Mat transform = SimilarTransform(src_mat, dst_mat);
-
-        face_aligned.create(112, 112, CV_32FC3);
-
-        cv::Mat transfer_mat = transform(cv::Rect(0, 0, 3, 2));
-        cv::warpAffine(img_src.clone(), face_aligned, transfer_mat,
-                       cv::Size(112, 112), 1, 0, 0);
-
-        std::cout << "end align face." << std::endl;
         return 0;
     }
 
-    cv::Mat FaceAligner::Impl::MeanAxis0(const cv::Mat &src) {
-        int num = src.rows;
-        int dim = src.cols;
-
-        // x1 y1
-        // x2 y2
+/*
+References: "Least-squares estimation of transformation parameters between two point patterns",
+Shinji Umeyama, PAMI 1991, DOI: 10.1109/34.88573
+In 2D the rotation and scale of the similarity reduce to the two parameters a = s*cos(theta), b = s*sin(theta),
+whose least-squares solution is closed form, no SVD needed.
+*/
+    void FaceAligner::Impl::SimilarTransform(const float src[5][2], const float dst[5][2], float transform[2][3]) {
+        float src_mean[2] = {0.0f, 0.0f};
+        float dst_mean[2] = {0.0f, 0.0f};
+        for (int i = 0; i < 5; ++i) {
+            src_mean[0] += src[i][0] / 5;
+            src_mean[1] += src[i][1] / 5;
+            dst_mean[0] += dst[i][0] / 5;
+            dst_mean[1] += dst[i][1] / 5;
+        }
 
-        cv::Mat output(1, dim, CV_32FC1);
-        for (int i = 0; i < dim; i++) {
-            float sum = 0;
-            for (int j = 0; j < num; j++) {
-                sum += src.at<float>(j, i);
-            }
-            output.at<float>(0, i) = sum / num;
+        float dot = 0.0f, cross = 0.0f, var = 0.0f;
+        for (int i = 0; i < 5; ++i) {
+            const float sx = src[i][0] - src_mean[0], sy = src[i][1] - src_mean[1];
+            const float dx = dst[i][0] - dst_mean[0], dy = dst[i][1] - dst_mean[1];
+            dot += sx * dx + sy * dy;
+            cross += sx * dy - sy * dx;
+            var += sx * sx + sy * sy;
         }
+        // coincident keypoints leave the scale undetermined, collapse to the mean like the SVD solution does
+        const float a = var > 0.0f ? dot / var : 0.0f;
+        const float b = var > 0.0f ? cross / var : 0.0f;
+
+        transform[0][0] = a;
+        transform[0][1] = -b;
+        transform[0][2] = dst_mean[0] - (a * src_mean[0] - b * src_mean[1]);
+        transform[1][0] = b;
+        transform[1][1] = a;
+        transform[1][2] = dst_mean[1] - (b * src_mean[0] + a * src_mean[1]);
+    }
 
-        return output;
+    int FaceAligner::Impl::Transform(const std::vector<cv::Point2f> &keypoints, const cv::Size &size,
+                                     float transform[2][3]) const {
+        float points_src[5][2];
+        int flag = SelectPoints(keypoints, points_src);
+        if (flag != 0) {
+            return flag;
+        }
+        // the reference points are laid out for 112x112 faces
+        float points_size[5][2];
+        for (int i = 0; i < 5; ++i) {
+            points_size[i][0] = points_dst[i][0] * size.width / 112.0f;
+            points_size[i][1] = points_dst[i][1] * size.height / 112.0f;
+        }
+        SimilarTransform(points_src, points_size, transform);
+        return 0;
     }
 
-    cv::Mat FaceAligner::Impl::ElementwiseMinus(const cv::Mat &A, const cv::Mat &B) {
-        cv::Mat output(A.rows, A.cols, A.type());
-        assert(B.cols == A.cols);
-        if (B.cols == A.cols) {
-            for (int i = 0; i < A.rows; i++) {
-                for (int j = 0; j < B.cols; j++) {
-                    output.at<float>(i, j) = A.at<float>(i, j) - B.at<float>(0, j);
-                }
-            }
+    int FaceAligner::Impl::AlignFace(const cv::Mat &img_src,
+                                     const std::vector<cv::Point2f> &keypoints, cv::Mat &face_aligned) const {
+        if (img_src.empty()) {
+            std::cout << "input empty." << std::endl;
+            return ErrorCode::EMPTY_INPUT_ERROR;
+        }
+        if (keypoints.empty()) {
+            std::cout << "keypoints empty." << std::endl;
+            return ErrorCode::EMPTY_INPUT_ERROR;
         }
 
-        return output;
-    }
+        float transform[2][3];
+        int flag = Transform(keypoints, cv::Size(112, 112), transform);
+        if (flag != 0) {
+            return flag;
+        }
 
-    cv::Mat FaceAligner::Impl::VarAxis0(const cv::Mat &src) {
-        cv::Mat temp_ = ElementwiseMinus(src, MeanAxis0(src));
-        cv::multiply(temp_, temp_, temp_);
-        return MeanAxis0(temp_);
+        // warp straight from the source view, the frame is only read where the face is
+        cv::Mat transfer_mat(2, 3, CV_32FC1, transform);
+        cv::warpAffine(img_src, face_aligned, transfer_mat, cv::Size(112, 112), 1, 0, 0);
+        return 0;
     }
 
-    int FaceAligner::Impl::MatrixRank(const cv::Mat &M) {
-        cv::Mat w, u, vt;
-        cv::SVD::compute(M, w, u, vt);
-        cv::Mat1b nonZeroSingularValues = w > 0.0001;
-        int rank = countNonZero(nonZeroSingularValues);
-        return rank;
-    }
+    int FaceAligner::Impl::AlignFaceTensor(const cv::Mat &img_src, const std::vector<cv::Point2f> &keypoints,
+                                           cv::Mat &face_tensor, const cv::Size &size,
+                                           const float *mean_vals, const float *norm_vals) const {
+        if (img_src.empty()) {
+            std::cout << "input empty." << std::endl;
+            return ErrorCode::EMPTY_INPUT_ERROR;
+        }
+        if (keypoints.empty()) {
+            std::cout << "keypoints empty." << std::endl;
+            return ErrorCode::EMPTY_INPUT_ERROR;
+        }
+        if (img_src.type() != CV_8UC3) {
+            std::cout << "unsupported image type, a BGR image is expected." << std::endl;
+            return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+        }
 
-/*
-References: "Least-squares estimation of transformation parameters between two point patterns",
-Shinji Umeyama, PAMI 1991, DOI: 10.1109/34.88573
-Anthor: Jack Yu
-*/
-    cv::Mat FaceAligner::Impl::SimilarTransform(const cv::Mat &src, const cv::Mat &dst) {
-        int num = src.rows;
-        int dim = src.cols;
-        cv::Mat src_mean = MeanAxis0(src);
-        cv::Mat dst_mean = MeanAxis0(dst);
-        cv::Mat src_demean = ElementwiseMinus(src, src_mean);
-        cv::Mat dst_demean = ElementwiseMinus(dst, dst_mean);
-        cv::Mat A = (dst_demean.t() * src_demean) / static_cast<float>(num);
-        cv::Mat d(dim, 1, CV_32F);
-        d.setTo(1.0f);
-        if (cv::determinant(A) < 0) {
-            d.at<float>(dim - 1, 0) = -1;
+        float transform[2][3];
+        int flag = Transform(keypoints, size, transform);
+        if (flag != 0) {
+            return flag;
+        }
 
+        // invert the similarity to walk the face pixels back into the source
+        const float det = transform[0][0] * transform[1][1] - transform[0][1] * transform[1][0];
+        if (det == 0.0f) {
+            std::cout << "degenerate keypoints." << std::endl;
+            return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
         }
-        cv::Mat T = cv::Mat::eye(dim + 1, dim + 1, CV_32F);
-        cv::Mat U, S, V;
-        cv::SVD::compute(A, S, U, V);
-
-        // the SVD function in opencv differ from scipy .
-
-        int rank = MatrixRank(A);
-        if (rank == 0) {
-            assert(rank == 0);
-
-        } else if (rank == dim - 1) {
-            if (cv::determinant(U) * cv::determinant(V) > 0) {
-                T.rowRange(0, dim).colRange(0, dim) = U * V;
-            } else {
-                int s = d.at<float>(dim - 1, 0) = -1;
-                d.at<float>(dim - 1, 0) = -1;
-
-                T.rowRange(0, dim).colRange(0, dim) = U * V;
-                cv::Mat diag_ = cv::Mat::diag(d);
-                cv::Mat twp = diag_ * V; //np.dot(np.diag(d), V.T)
-                cv::Mat B = cv::Mat::zeros(3, 3, CV_8UC1);
-                cv::Mat C = B.diag(0);
-                T.rowRange(0, dim).colRange(0, dim) = U * twp;
-                d.at<float>(dim - 1, 0) = s;
+        const float ia = transform[1][1] / det, ib = -transform[0][1] / det;
+        const float ic = -transform[1][0] / det, id = transform[0][0] / det;
+        const float ie = -(ia * transform[0][2] + ib * transform[1][2]);
+        const float iff = -(ic * transform[0][2] + id * transform[1][2]);
+
+        const float mean[3] = {mean_vals ? mean_vals[0] : 0.0f, mean_vals ? mean_vals[1] : 0.0f,
+                               mean_vals ? mean_vals[2] : 0.0f};
+        const float norm[3] = {norm_vals ? norm_vals[0] : 1.0f, norm_vals ? norm_vals[1] : 1.0f,
+                               norm_vals ? norm_vals[2] : 1.0f};
+
+        face_tensor.create(3 * size.height, size.width, CV_32FC1);
+        const size_t plane = static_cast<size_t>(size.width) * size.height;
+        float *out_r = face_tensor.ptr<float>(0);
+        float *out_g = out_r + plane;
+        float *out_b = out_g + plane;
+        const int max_x = img_src.cols - 1;
+        const int max_y = img_src.rows - 1;
+        const size_t step = img_src.step;
+
+        // bilinear sampling, BGR to RGB and normalization in one pass, pixels outside the frame are black
+        // like the constant border of warpAffine
+        for (int y = 0; y < size.height; ++y) {
+            float sx = ib * y + ie;
+            float sy = id * y + iff;
+            for (int x = 0; x < size.width; ++x, sx += ia, sy += ic) {
+                const int x0 = static_cast<int>(std::floor(sx));
+                const int y0 = static_cast<int>(std::floor(sy));
+                const float fx = sx - x0;
+                const float fy = sy - y0;
+                float bgr[3] = {0.0f, 0.0f, 0.0f};
+                if (x0 >= 0 && y0 >= 0 && x0 < max_x && y0 < max_y) {
+                    const unsigned char *p0 = img_src.data + y0 * step + x0 * 3;
+                    const unsigned char *p1 = p0 + step;
+                    for (int c = 0; c < 3; ++c) {
+                        const float top = p0[c] + (p0[c + 3] - p0[c]) * fx;
+                        const float bottom = p1[c] + (p1[c + 3] - p1[c]) * fx;
+                        bgr[c] = top + (bottom - top) * fy;
+                    }
+                } else if (x0 >= -1 && y0 >= -1 && x0 <= max_x && y0 <= max_y) {
+                    // on the edge of the frame, the taps outside of it weigh as black
+                    const float weights[4] = {(1 - fx) * (1 - fy), fx * (1 - fy), (1 - fx) * fy, fx * fy};
+                    for (int k = 0; k < 4; ++k) {
+                        const int px = x0 + (k & 1);
+                        const int py = y0 + (k >> 1);
+                        if (px < 0 || py < 0 || px > max_x || py > max_y) continue;
+                        const unsigned char *p = img_src.data + py * step + px * 3;
+                        for (int c = 0; c < 3; ++c) {
+                            bgr[c] += p[c] * weights[k];
+                        }
+                    }
+                }
+                const size_t i = static_cast<size_t>(y) * size.width + x;
+                out_r[i] = (bgr[2] - mean[0]) * norm[0];
+                out_g[i] = (bgr[1] - mean[1]) * norm[1];
+                out_b[i] = (bgr[0] - mean[2]) * norm[2];
             }
-        } else {
-            cv::Mat diag_ = cv::Mat::diag(d);
-            cv::Mat twp = diag_ * V.t(); //np.dot(np.diag(d), V.T)
-            cv::Mat res = U * twp; // U
-            T.rowRange(0, dim).colRange(0, dim) = -U.t() * twp;
         }
-        cv::Mat var_ = VarAxis0(src_demean);
-        float val = cv::sum(var_).val[0];
-        cv::Mat res;
-        cv::multiply(d, S, res);
-        float scale = 1.0 / val * cv::sum(res).val[0];
-        T.rowRange(0, dim).colRange(0, dim) = -T.rowRange(0, dim).colRange(0, dim).t();
-        cv::Mat temp1 = T.rowRange(0, dim).colRange(0, dim); // T[:dim, :dim]
-        cv::Mat temp2 = src_mean.t();
-        cv::Mat temp3 = temp1 * temp2;
-        cv::Mat temp4 = scale * temp3;
-        T.rowRange(0, dim).colRange(dim, dim + 1) = -(temp4 - dst_mean.t());
-        T.rowRange(0, dim).colRange(0, dim) *= scale;
-        return T;
+        return 0;
     }
 
 }
@@ -11,6 +11,15 @@ public:
 	int alignFace(const cv::Mat & img_src,
                   const std::vector<cv::Point2f>& keypoints, cv::Mat& face_aligned) const;
 
+	/// \brief Align a face straight into the planar float input of a recognizer. Bilinear sampling of the
+	/// source view, BGR to RGB and (value - mean) * norm are done in one pass, with no copy of the frame.
+	/// \param img_src [in] BGR image, only read around the face.
+	/// \param face_tensor [out] CV_32FC1 of 3 * size.height rows and size.width columns, the R, G and B planes.
+	/// \param mean_vals, norm_vals [in] Per RGB channel normalization, none when null.
+	int alignFaceTensor(const cv::Mat& img_src, const std::vector<cv::Point2f>& keypoints, cv::Mat& face_tensor,
+	                    const cv::Size& size = cv::Size(112, 112),
+	                    const float* mean_vals = nullptr, const float* norm_vals = nullptr) const;
+
 private:
 	class Impl;
 	Impl* impl_;
@@ -1,176 +1,2408 @@
 #include "FaceDatabase.h"
+#include "FeatureMatrix.h"
+#include "Journal.h"
+#include "Rcu.h"
+#include "./kernels/SimilarityKernels.h"
+#include "./kernels/AlignedAllocator.h"
+#include "./index/HnswIndex.h"
+#include "./index/IvfPqIndex.h"
+#include "./stream/ChunkedStream.h"
+#include "./stream/Crc32c.h"
+#include "./stream/MappedFile.h"
+#include "TopKHeap.h"
+#include "../../common/ScanPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+namespace mirror {
+    //! gallery tile scored at once by QueryBatch, half of a typical L2 cache
+    static const int kBatchTileBytes = 128 * 1024;
+    //! probes scored against one gallery tile at a time
+    static const int kBatchProbeBlock = 64;
+    //! rows scored per call of the single probe scan
+    static const int kScanTile = 1024;
+    //! fewest rows worth a thread of their own, a smaller scan is done before the thread wakes up
+    static const size_t kMinShardRows = 16384;
+
+    static const uint32_t kDatabaseMagic = 0x32424446; // "FDB2"
+    static const uint32_t kDatabaseVersion = 2;
+    static const size_t kFileAlignment = 64;
+    //! journal records tolerated before Sync folds them into the base file
+    static const size_t kJournalCompactRecords = 1024;
+    //! rows of the first part of a gallery, every later part doubles the rows
+    static const size_t kMinPartRows = 1024;
+    //! deleted rows tolerated before the live rows are packed again
+    static const size_t kCompactDeletedRows = 1024;
+
+    /// \brief Header of the v2 database file, which is mapped and queried in place:
+    ///   header | features: count rows of 'stride' floats, L2 normalized | names_size bytes of names table
+    /// The names table holds count + 1 uint64 offsets followed by the name bytes, name i spans
+    /// [offsets[i], offsets[i + 1]). Features and names table start on 64 byte boundaries.
+    /// The legacy format has no header, it starts with the face count followed by
+    /// kFaceNameDim name bytes and kFaceFeatureDim raw floats per face.
+    struct DatabaseHeader {
+        uint32_t magic;
+        uint32_t version;
+        int32_t dim;
+        int32_t stride;
+        uint64_t count;
+        uint64_t features_offset;
+        uint64_t names_offset;
+        uint64_t names_size;
+        //! crc32c of the header (with checksum = 0) and the names table, the feature block
+        //! is left out so that opening a database does not touch every page of it
+        uint32_t checksum;
+        uint32_t reserved[3];
+    };
+
+    static_assert(sizeof(DatabaseHeader) == kFileAlignment, "database header must fill one cache line");
+
+    static const uint32_t kExportMagic = 0x58424446; // "FDBX"
+    static const uint32_t kExportVersion = 1;
+    //! deletions remembered for incremental exports, an export since an older version is a full one
+    static const size_t kMaxTombstones = 65536;
+    //! templates imported per published snapshot
+    static const size_t kImportBatch = 1024;
+    //! bounds of a sane export record, a larger one is taken for a corrupted stream
+    static const uint32_t kMaxExportName = 1 << 16;
+    static const uint32_t kMaxExportTemplates = 1 << 16;
+
+    /// \brief Header of an export stream, carried in the chunks of a ChunkedWriter and followed by records:
+    ///   uint8 op | uint32 name size | name | insert only: uint32 template count, count * dim floats
+    /// An insert replaces the identity, a delete removes it and an end record closes the stream. A full
+    /// export replaces the whole gallery, an incremental one the identities changed after 'since'.
+    struct ExportHeader {
+        uint32_t magic;
+        uint32_t version;
+        int32_t dim;
+        uint32_t full;
+        uint64_t epoch;
+        int64_t since;
+        int64_t until;
+    };
+
+    enum ExportRecord {
+        EXPORT_INSERT = 1,
+        EXPORT_DELETE = 2,
+        EXPORT_END = 3,
+    };
+
+    static bool WriteExportRecord(StreamWriter &writer, ExportRecord op, const std::string &name,
+                                  const float *block, size_t count, int dim, int stride) {
+        const uint8_t code = static_cast<uint8_t>(op);
+        const uint32_t name_size = static_cast<uint32_t>(name.size());
+        bool good = Write(writer, code) == sizeof(code) && Write(writer, name_size) == sizeof(name_size) &&
+                    writer.write(name.data(), name.size()) == name.size();
+        if (op == EXPORT_INSERT) {
+            const uint32_t num_templates = static_cast<uint32_t>(count);
+            good = good && Write(writer, num_templates) == sizeof(num_templates);
+            for (size_t i = 0; good && i < count; ++i) {
+                good = Write(writer, block + i * stride, static_cast<size_t>(dim)) == sizeof(float) * dim;
+            }
+        }
+        return good;
+    }
+
+    //! History of the ids of a new gallery, versions of different histories are never compared
+    static uint64_t NewEpoch() {
+        static std::atomic<uint64_t> sequence(0);
+        std::random_device device;
+        const uint64_t random = (static_cast<uint64_t>(device()) << 32) | device();
+        return random ^ sequence.fetch_add(1);
+    }
+
+    /// \brief History following 'epoch' (splitmix64). Derived rather than drawn, so that replaying a journal
+    /// on the base it belongs to rebuilds the same histories and versions in every process loading them.
+    static inline uint64_t NextEpoch(uint64_t epoch) {
+        uint64_t z = epoch + 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    static inline size_t AlignOffset(size_t offset) {
+        return (offset + kFileAlignment - 1) / kFileAlignment * kFileAlignment;
+    }
+
+    /// \brief A block of gallery rows. Rows below the size of a published snapshot are never written
+    /// again, writers only fill the free rows past it, so readers scan a part without any lock.
+    /// The templates of an identity are consecutive rows of one part, headed by the first of them.
+    struct GalleryPart {
+        GalleryPart(size_t begin_row, size_t num_rows, int dim) :
+                begin(begin_row), capacity(num_rows), features(dim), names(num_rows), ids(num_rows, -1),
+                templates(num_rows, 0), centroid_slots(num_rows, -1) {
+        }
+
+        //! Room for the centroids of multi template identities, which span two rows at least
+        void EnableCentroids(int stride) {
+            centroids.resize(capacity / 2 * stride, 0.0f);
+            radii.resize(capacity / 2, 0.0f);
+        }
+
+        inline bool HasCentroids() const { return !radii.empty(); }
+
+        //! gallery row of the first row of the part
+        const size_t begin;
+        const size_t capacity;
+        //! sized to 'capacity' up front, empty while the ivfpq index holds the features
+        FeatureMatrix features;
+        std::vector<std::string> names;
+        std::vector<int64_t> ids;
+        //! template count of the identity headed by a row, 0 for the other rows
+        std::vector<uint32_t> templates;
+        //! centroid of the identity headed by a row when it has several templates, -1 otherwise
+        std::vector<int32_t> centroid_slots;
+        //! mean of the templates (not normalized) and the largest distance of a template to it
+        AlignedVector<float> centroids;
+        std::vector<float> radii;
+        //! centroid slots handed out, writer only
+        size_t num_centroids = 0;
+        //! the database file the features are mapped from, kept open by every snapshot using the part
+        std::shared_ptr<MappedFile> mapping;
+    };
+
+    /// \brief An immutable version of the gallery, read by the queries while a writer prepares the next.
+    /// Ids increase with the rows, which gives the rows of the index results by binary search.
+    /// Deleted rows stay in place, flagged in 'deleted', until the live rows are packed again.
+    struct GallerySnapshot {
+        std::vector<std::shared_ptr<GalleryPart>> parts;
+        //! rows including the deleted ones
+        size_t size = 0;
+        size_t num_deleted = 0;
+        //! one bit per row, rows past its end are live
+        std::shared_ptr<const std::vector<uint64_t>> deleted;
+        //! live identities with several templates, the scans go identity by identity then
+        size_t num_multi = 0;
+        //! live identities, one per head row
+        size_t num_identities = 0;
+        int max_templates = 1;
+        FaceTemplateAggregation aggregation = FaceTemplateAggregation::MAX_AGGREGATION;
+        //! false once the ivfpq index holds the features
+        bool resident = true;
+        //! exact re-ranking depth of quantized scans, 0 when scores are exact
+        int rerank = 0;
+        //! indexes the queries may search, null while a writer modifies them in place
+        const HnswIndex *hnsw = nullptr;
+        const IvfPqIndex *ivfpq = nullptr;
+        //! threads sharing the exact scans, null for a single thread
+        std::shared_ptr<ScanPool> pool;
+
+        inline size_t Live() const { return size - num_deleted; }
+
+        inline bool HasIndex() const { return hnsw || ivfpq; }
+
+        inline size_t PartRows(const GalleryPart &part) const {
+            return std::min(part.capacity, size - part.begin);
+        }
+
+        inline bool IsDeleted(size_t row) const {
+            return deleted && (row >> 6) < deleted->size() && (((*deleted)[row >> 6] >> (row & 63)) & 1u);
+        }
+
+        const GalleryPart &Locate(size_t row, size_t &offset) const {
+            auto it = std::upper_bound(parts.begin(), parts.end(), row,
+                                       [](size_t value, const std::shared_ptr<GalleryPart> &part) {
+                                           return value < part->begin;
+                                       });
+            const GalleryPart &part = **(it - 1);
+            offset = row - part.begin;
+            return part;
+        }
+
+        //! First row of the identity 'offset' belongs to
+        static inline size_t Head(const GalleryPart &part, size_t offset) {
+            while (part.templates[offset] == 0) {
+                --offset;
+            }
+            return offset;
+        }
+
+        //! Row of the live face 'id'
+        bool FindRow(int64_t id, size_t &row) const {
+            auto it = std::upper_bound(parts.begin(), parts.end(), id,
+                                       [](int64_t value, const std::shared_ptr<GalleryPart> &part) {
+                                           return value < part->ids.front();
+                                       });
+            if (it == parts.begin()) return false;
+            const GalleryPart &part = **(it - 1);
+            auto last = part.ids.begin() + PartRows(part);
+            auto found = std::lower_bound(part.ids.begin(), last, id);
+            if (found == last || *found != id) return false;
+            row = part.begin + static_cast<size_t>(found - part.ids.begin());
+            return !IsDeleted(row);
+        }
+
+        template<typename Visit>
+        void ForEachLive(Visit visit) const {
+            for (const auto &part : parts) {
+                const size_t num_rows = PartRows(*part);
+                for (size_t offset = 0; offset < num_rows; ++offset) {
+                    if (!IsDeleted(part->begin + offset)) {
+                        visit(*part, offset);
+                    }
+                }
+            }
+        }
+    };
+
+    /// \brief One gallery with its own storage, index and journal, the default gallery of a database or one
+    /// of its partitions. Queries never lock: they read the snapshot published last, inside an rcu read section.
+    /// Writers are serialized by 'mutex_', build the next snapshot next to the current one and publish
+    /// it with an atomic exchange; the replaced snapshot is freed after a grace period. The indexes are
+    /// modified in place, so a writer first publishes a snapshot without them and waits for the readers
+    /// still searching them. Queries meanwhile fall back to the exact scan, or wait for the ivfpq index
+    /// when it holds the only copy of the features.
+    class FaceGallery {
+    public:
+        FaceGallery(const FaceDatabaseParams &params, const std::shared_ptr<ScanPool> &pool) :
+                dim_(CheckFeatureDim(params.featureDim)), stride_(AlignedFeatureDim(dim_)), journal_(dim_),
+                epoch_(NewEpoch()) {
+            current_.store(new GallerySnapshot());
+            FaceDatabaseParams checked = params;
+            checked.featureDim = dim_;
+            Update(checked, pool);
+        }
+
+        ~FaceGallery() {
+            DestroyIndex();
+            delete current_.load();
+        }
+
+        //! Apply 'params', the exact scans then run on 'pool' which the partitions of a database share
+        int Update(const FaceDatabaseParams &params, const std::shared_ptr<ScanPool> &pool) {
+            if (params.featureDim != dim_) {
+                std::cout << "the feature dimension of a database is fixed to " << dim_
+                          << ", create another database for " << params.featureDim << std::endl;
+                return ErrorCode::DATABASE_UPDATE_ERROR;
+            }
+            if (params.indexType == FaceIndexType::IVFPQ_INDEX &&
+                (params.ivfNlist <= 0 || params.ivfPqCodeSize <= 0 || dim_ % params.ivfPqCodeSize != 0)) {
+                std::cout << "invalid ivfpq code size " << params.ivfPqCodeSize
+                          << ", it must divide the feature dimension " << dim_ << std::endl;
+                return ErrorCode::DATABASE_UPDATE_ERROR;
+            }
+            if (params.maxTemplates < 1) {
+                std::cout << "an identity needs one template at least." << std::endl;
+                return ErrorCode::DATABASE_UPDATE_ERROR;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            const bool rebuild = params.indexType != params_.indexType ||
+                                 (params.indexType == FaceIndexType::HNSW_INDEX &&
+                                  (params.hnswM != params_.hnswM ||
+                                   params.hnswEfConstruction != params_.hnswEfConstruction)) ||
+                                 (params.indexType == FaceIndexType::IVFPQ_INDEX &&
+                                  (params.ivfNlist != params_.ivfNlist ||
+                                   params.ivfPqCodeSize != params_.ivfPqCodeSize));
+            const bool restore = params.storageType != params_.storageType || KeepFloat(params) != KeepFloat(params_);
+            // the search parameters are not atomic either
+            DetachIndex();
+            params_ = params;
+            // the ivfpq index may hold the only copy of the features
+            if ((rebuild && !resident_) || (restore && resident_)) {
+                RebuildRows(true);
+            }
+            if (rebuild) {
+                DestroyIndex();
+                if (params_.indexType == FaceIndexType::HNSW_INDEX) {
+                    hnsw_ = new HnswIndex(dim_, params_.hnswM, params_.hnswEfConstruction, params_.hnswEfSearch);
+                } else if (params_.indexType == FaceIndexType::IVFPQ_INDEX) {
+                    ivfpq_ = new IvfPqIndex(dim_, params_.ivfNlist, params_.ivfPqCodeSize,
+                                            params_.ivfNprobe, params_.ivfRerank);
+                }
+                BuildIndex();
+            }
+
+            if (hnsw_) {
+                hnsw_->SetEfSearch(params_.hnswEfSearch);
+            }
+            if (ivfpq_) {
+                ivfpq_->SetNprobe(params_.ivfNprobe);
+                ivfpq_->SetRerank(params_.ivfRerank);
+            }
+            // the snapshots still scanning with the previous pool keep it alive until they are freed
+            pool_ = pool;
+            AttachIndex();
+            return 0;
+        }
+
+        int TrainIndex(const float *samples, int num_samples) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!ivfpq_) {
+                std::cout << "only the ivfpq index needs training." << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            if (!samples || num_samples <= 0) {
+                return ErrorCode::EMPTY_INPUT_ERROR;
+            }
+
+            AlignedVector<float> normalized(static_cast<size_t>(num_samples) * stride_, 0.0f);
+            for (int i = 0; i < num_samples; ++i) {
+                NormalizeFeature(samples + static_cast<size_t>(i) * dim_,
+                                 normalized.data() + static_cast<size_t>(i) * stride_, dim_);
+            }
+
+            // re-encode every face with the new codebooks
+            DetachIndex();
+            if (!resident_) {
+                RebuildRows(true);
+            }
+            int flag = ivfpq_->Train(normalized.data(), static_cast<size_t>(num_samples), stride_);
+            BuildIndex();
+            AttachIndex();
+            return flag;
+        }
+
+        //! Write the base file and the index to 'dir' and start a new journal on top of them
+        int Save(const std::string &dir) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return SaveDatabase(dir);
+        }
+
+        int Sync(const std::string &dir) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!IsJournaling(dir) || NeedsCompaction()) {
+                return SaveDatabase(dir);
+            }
+            return journal_.Sync();
+        }
+
+        int Compact() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (journal_dir_.empty()) {
+                std::cout << "face database was neither loaded nor saved." << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            const std::string dir = journal_dir_;
+            return SaveDatabase(dir);
+        }
+
+        int Load(const std::string &dir) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            journal_.Close();
+            has_base_ = false;
+            DetachIndex();
+            const std::string db_name = dir + "/db";
+            // with a compressed index the features are served from its mapped file and skipped here
+            int flag = LoadBase(db_name, !ivfpq_);
+            if (flag == 0 && LoadIndex(dir) != 0) {
+                // the compressed index is missing or stale, read the features again and rebuild it
+                flag = LoadBase(db_name, true);
+                if (flag == 0) {
+                    BuildIndex();
+                }
+            }
+            if (flag == 0 && !resident_ && current_.load()->num_multi > 0) {
+                // the centroids of a compressed gallery are computed from the features of its index
+                RebuildRows(false);
+            }
+            if (flag == 0) {
+                // the ids of a loaded base are its rows, so the base names their history
+                if (has_base_) {
+                    epoch_ = NextEpoch(base_checksum_);
+                }
+                flag = AttachJournal(dir);
+            }
+            AttachIndex();
+            return flag;
+        }
+
+        int64_t Insert(const std::string &name, const std::vector<float> &feat) {
+            if (feat.size() != static_cast<size_t>(dim_)) {
+                return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            const int64_t id = Upsert(name, feat.data());
+            if (journal_.IsOpened()) {
+                journal_.AppendInsert(name, feat.data());
+            }
+            return id;
+        }
+
+        int InsertBatch(const float *feats, const std::vector<std::string> &names) {
+            if (!feats || names.empty()) {
+                return ErrorCode::EMPTY_INPUT_ERROR;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<int64_t> ids(names.size());
+            Upsert(names.data(), feats, names.size(), ids.data());
+            if (journal_.IsOpened()) {
+                for (size_t i = 0; i < names.size(); ++i) {
+                    journal_.AppendInsert(names[i], feats + i * dim_);
+                }
+            }
+            return 0;
+        }
+
+        int Delete(const std::string &name) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            int flag = Remove(name);
+            if (flag == 0 && journal_.IsOpened()) {
+                flag = journal_.AppendDelete(name);
+            }
+            return flag;
+        }
+
+        void Clear() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            DetachIndex();
+            Reset();
+            AttachIndex();
+            if (journal_.IsOpened()) {
+                journal_.AppendClear();
+            }
+        }
+
+        /// \brief Stream the identities changed after 'since', or all of them when the deletions since then are
+        /// forgotten or 'since' belongs to another history. Writers wait meanwhile, queries do not.
+        int Export(StreamWriter &writer, const FaceDatabaseVersion &since, FaceDatabaseVersion &exported) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const bool full = since.epoch != epoch_ || since.version < tombstone_floor_ || since.version > max_index_;
+            ExportHeader header;
+            std::memset(&header, 0, sizeof(header));
+            header.magic = kExportMagic;
+            header.version = kExportVersion;
+            header.dim = dim_;
+            header.full = full ? 1 : 0;
+            header.epoch = epoch_;
+            header.since = full ? -1 : since.version;
+            header.until = max_index_;
+
+            ChunkedWriter chunked(writer);
+            bool good = Write(chunked, header) == sizeof(header);
+            if (!full) {
+                for (const auto &tombstone : tombstones_) {
+                    if (good && tombstone.first >= since.version) {
+                        good = WriteExportRecord(chunked, EXPORT_DELETE, tombstone.second, nullptr, 0, dim_, stride_);
+                    }
+                }
+            }
+            // identities are written again with new ids, so the ones changed since carry ids from 'since' on
+            const GallerySnapshot &snapshot = *current_.load();
+            AlignedVector<float> block;
+            snapshot.ForEachLive([&](const GalleryPart &part, size_t offset) {
+                const size_t count = part.templates[offset];
+                if (!good || count == 0 || (!full && part.ids[offset] < since.version)) return;
+                ReadTemplates(snapshot, part, offset, count, block);
+                good = WriteExportRecord(chunked, EXPORT_INSERT, part.names[offset], block.data(), count,
+                                         dim_, stride_);
+            });
+            good = good && WriteExportRecord(chunked, EXPORT_END, std::string(), nullptr, 0, dim_, stride_);
+            if (!good || !chunked.Finish()) {
+                std::cout << "Write export stream failed." << std::endl;
+                return ErrorCode::DATABASE_UPDATE_ERROR;
+            }
+            exported.epoch = epoch_;
+            exported.version = max_index_;
+            return 0;
+        }
+
+        /// \brief Apply an export stream. The records of the verified chunks are applied as they come, a stream
+        /// broken off later leaves them applied; they are idempotent, importing from the same version repairs it.
+        int Import(StreamReader &reader, FaceDatabaseVersion &imported) {
+            ChunkedReader chunked(reader);
+            ExportHeader header;
+            if (Read(chunked, header) != sizeof(header) || header.magic != kExportMagic ||
+                header.version != kExportVersion) {
+                std::cout << "invalid face database export stream." << std::endl;
+                return ErrorCode::DATA_CORRUPTED_ERROR;
+            }
+            if (header.dim != dim_) {
+                std::cout << "export of dimension " << header.dim << " mismatch: " << dim_ << std::endl;
+                return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (header.full) {
+                DetachIndex();
+                Reset();
+                AttachIndex();
+                if (journal_.IsOpened()) {
+                    journal_.AppendClear();
+                }
+            }
+
+            std::vector<std::string> names;
+            std::vector<float> feats;
+            auto flush = [&]() {
+                if (names.empty()) return;
+                std::vector<int64_t> ids(names.size());
+                Upsert(names.data(), feats.data(), names.size(), ids.data());
+                if (journal_.IsOpened()) {
+                    for (size_t i = 0; i < names.size(); ++i) {
+                        journal_.AppendInsert(names[i], feats.data() + i * dim_);
+                    }
+                }
+                names.clear();
+                feats.clear();
+            };
+            bool complete = false;
+            for (;;) {
+                uint8_t op = 0;
+                uint32_t name_size = 0;
+                if (Read(chunked, op) != sizeof(op) || Read(chunked, name_size) != sizeof(name_size) ||
+                    name_size > kMaxExportName) {
+                    break;
+                }
+                std::string name(name_size, '\0');
+                if (chunked.read(&name[0], name_size) != name_size) break;
+                if (op == EXPORT_END) {
+                    // nothing may follow the end record but the end of the stream
+                    char extra = 0;
+                    complete = chunked.read(&extra, 1) == 0 && chunked.Finished();
+                    break;
+                }
+                if (op == EXPORT_DELETE) {
+                    flush();
+                    if (Remove(name) == 0 && journal_.IsOpened()) {
+                        journal_.AppendDelete(name);
+                    }
+                    continue;
+                }
+                uint32_t count = 0;
+                if (op != EXPORT_INSERT || Read(chunked, count) != sizeof(count) || count == 0 ||
+                    count > kMaxExportTemplates) {
+                    break;
+                }
+                const size_t size = feats.size();
+                feats.resize(size + static_cast<size_t>(count) * dim_);
+                if (Read(chunked, feats.data() + size, static_cast<size_t>(count) * dim_) !=
+                    sizeof(float) * count * dim_) {
+                    feats.resize(size);
+                    break;
+                }
+                if (ids_.count(name) > 0) {
+                    // the templates replace the identity instead of joining its templates
+                    const std::vector<float> pending(feats.begin() + size, feats.end());
+                    feats.resize(size);
+                    flush();
+                    if (Remove(name) == 0 && journal_.IsOpened()) {
+                        journal_.AppendDelete(name);
+                    }
+                    feats = pending;
+                }
+                names.insert(names.end(), count, name);
+                if (names.size() >= kImportBatch) {
+                    flush();
+                }
+            }
+            flush();
+            if (!complete) {
+                std::cout << "face database export stream truncated or corrupted." << std::endl;
+                return ErrorCode::DATA_CORRUPTED_ERROR;
+            }
+            imported.epoch = header.epoch;
+            imported.version = header.until;
+            return 0;
+        }
+
+        inline int Dim() const { return dim_; }
+
+        bool IsEmpty() const {
+            RcuReadGuard guard(rcu_);
+            return current_.load()->Live() == 0;
+        }
+
+        int Find(std::vector<std::string> &names) const {
+            names.clear();
+            {
+                RcuReadGuard guard(rcu_);
+                const GallerySnapshot &snapshot = *current_.load();
+                names.reserve(snapshot.num_identities);
+                // an identity is listed once, by the head row of its templates
+                snapshot.ForEachLive([&](const GalleryPart &part, size_t offset) {
+                    if (part.templates[offset] == 0) return;
+                    names.push_back(part.names[offset]);
+                });
+            }
+            std::sort(names.begin(), names.end());
+            return names.empty() ? ErrorCode::EMPTY_DATA_ERROR : 0;
+        }
+
+        int QueryTop(const std::vector<float> &feat, QueryResult &query_result) const {
+            // normalize the probe once, the gallery rows are stored normalized,
+            // so cosine similarity reduces to a single dot product per row
+            alignas(64) float probe[AlignedFeatureDim(kMaxFaceFeatureDim)];
+            return ReadSnapshot([&](const GallerySnapshot &snapshot) -> int {
+                if (snapshot.Live() == 0) {
+                    query_result.name_ = "unknown";
+                    query_result.sim_ = 0;
+                    return ErrorCode::EMPTY_DATA_ERROR;
+                }
+                if (feat.size() != static_cast<size_t>(dim_)) {
+                    return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+                }
+                NormalizeFeature(feat.data(), probe, dim_);
+
+                std::vector<QueryResult> query_results;
+                if (snapshot.HasIndex()) {
+                    SearchIndex(snapshot, probe, 1, -std::numeric_limits<float>::max(), query_results);
+                }
+                if (query_results.empty()) {
+                    ScanTopK(snapshot, probe, 1, -std::numeric_limits<float>::max(), query_results);
+                }
+                if (query_results.empty()) {
+                    query_result.name_ = "unknown";
+                    query_result.sim_ = 0;
+                    return ErrorCode::EMPTY_DATA_ERROR;
+                }
+                query_result = query_results.front();
+                return 0;
+            });
+        }
+
+        int QueryTopK(const std::vector<float> &feat, int k, float min_sim,
+                      std::vector<QueryResult> &query_results) const {
+            alignas(64) float probe[AlignedFeatureDim(kMaxFaceFeatureDim)];
+            return ReadSnapshot([&](const GallerySnapshot &snapshot) -> int {
+                query_results.clear();
+                if (snapshot.Live() == 0) {
+                    return ErrorCode::EMPTY_DATA_ERROR;
+                }
+                if (feat.size() != static_cast<size_t>(dim_)) {
+                    return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+                }
+                NormalizeFeature(feat.data(), probe, dim_);
+
+                if (snapshot.HasIndex()) {
+                    SearchIndex(snapshot, probe, k, min_sim, query_results);
+                } else {
+                    ScanTopK(snapshot, probe, k, min_sim, query_results);
+                }
+                return 0;
+            });
+        }
+
+        int QueryBatch(const float *probes, int num_probes, int k, float min_sim,
+                       std::vector<std::vector<QueryResult>> &query_results) const {
+            query_results.clear();
+            if (!probes || num_probes <= 0) {
+                return IsEmpty() ? ErrorCode::EMPTY_DATA_ERROR : ErrorCode::EMPTY_INPUT_ERROR;
+            }
+
+            AlignedVector<float> normalized(static_cast<size_t>(num_probes) * stride_, 0.0f);
+            for (int j = 0; j < num_probes; ++j) {
+                NormalizeFeature(probes + static_cast<size_t>(j) * dim_,
+                                 normalized.data() + static_cast<size_t>(j) * stride_, dim_);
+            }
+
+            return ReadSnapshot([&](const GallerySnapshot &snapshot) -> int {
+                if (snapshot.Live() == 0) {
+                    return ErrorCode::EMPTY_DATA_ERROR;
+                }
+                query_results.resize(static_cast<size_t>(num_probes));
+                if (snapshot.HasIndex()) {
+                    for (int j = 0; j < num_probes; ++j) {
+                        SearchIndex(snapshot, normalized.data() + static_cast<size_t>(j) * stride_,
+                                    k, min_sim, query_results[j]);
+                    }
+                    return 0;
+                }
+                ScanBatch(snapshot, normalized.data(), num_probes, k, min_sim, query_results);
+                return 0;
+            });
+        }
+
+    private:
+        static inline bool KeepFloat(const FaceDatabaseParams &params) {
+            return params.storageType != FaceStorageType::FLOAT32_STORAGE && params.storageRerank > 0;
+        }
+
+        /// \brief Run 'query' on the current snapshot. A gallery whose features only live in the ivfpq
+        /// index can not be scanned, the query is retried once the writer hands the index back.
+        template<typename Query>
+        int ReadSnapshot(Query query) const {
+            for (;;) {
+                {
+                    RcuReadGuard guard(rcu_);
+                    const GallerySnapshot &snapshot = *current_.load();
+                    if (snapshot.resident || snapshot.ivfpq || snapshot.Live() == 0) {
+                        return query(snapshot);
+                    }
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        //! Writable copy of the current snapshot, sharing its parts
+        inline GallerySnapshot *Fork() const {
+            return new GallerySnapshot(*current_.load());
+        }
+
+        //! Make 'next' the version read by the queries and free the replaced one once no reader holds it
+        void Publish(GallerySnapshot *next) {
+            next->resident = resident_;
+            next->rerank = KeepFloat(params_) ? params_.storageRerank : 0;
+            next->max_templates = params_.maxTemplates;
+            next->aggregation = params_.templateAggregation;
+            next->hnsw = detached_ > 0 ? nullptr : hnsw_;
+            next->ivfpq = detached_ > 0 || resident_ ? nullptr : ivfpq_;
+            next->pool = pool_;
+            GallerySnapshot *previous = current_.exchange(next);
+            rcu_.Synchronize();
+            delete previous;
+        }
+
+        /// \brief Hide the indexes from the queries until the matching AttachIndex, so that they may be
+        /// modified in place. 'next' is published along, the current snapshot otherwise.
+        void DetachIndex(GallerySnapshot *next = nullptr) {
+            if (detached_++ == 0 && !next && (hnsw_ || (ivfpq_ && !resident_))) {
+                next = Fork();
+            }
+            if (next) {
+                Publish(next);
+            }
+        }
+
+        //! Publish the indexes again, along with the search settings changed meanwhile
+        void AttachIndex() {
+            if (--detached_ == 0) {
+                Publish(Fork());
+            }
+        }
+
+        int SaveIndex(const std::string &dir) const {
+            if (!hnsw_ && !(ivfpq_ && !resident_)) return 0;
+
+            // faces are reloaded in row order and get their row as id, store that id in the index
+            std::unordered_map<int64_t, int64_t> relabel;
+            const GallerySnapshot &snapshot = *current_.load();
+            relabel.reserve(snapshot.Live());
+            snapshot.ForEachLive([&](const GalleryPart &part, size_t offset) {
+                const int64_t row = static_cast<int64_t>(relabel.size());
+                relabel[part.ids[offset]] = row;
+            });
+
+            if (ivfpq_) {
+                return ivfpq_->Save(dir + "/db.ivfpq", relabel);
+            }
+
+            const std::string path = dir + "/db.hnsw";
+            FileWriter ofile(path, FileWriter::Binary);
+            if (!ofile.is_opened()) {
+                std::cout << "Open index file failed: " << path << std::endl;
+                return ErrorCode::NOT_FOUND_ERROR;
+            }
+            return hnsw_->Save(ofile, relabel);
+        }
+
+        //! Non zero when the ivfpq index could not be restored, the features then have to be reloaded
+        int LoadIndex(const std::string &dir) {
+            const GallerySnapshot &snapshot = *current_.load();
+            if (hnsw_) {
+                FileReader ifile(dir + "/db.hnsw", FileReader::Binary);
+                bool loaded = ifile.is_opened() && hnsw_->Load(ifile) == 0 && hnsw_->Size() == snapshot.Live();
+                snapshot.ForEachLive([&](const GalleryPart &part, size_t offset) {
+                    loaded = loaded && hnsw_->Contains(part.ids[offset]);
+                });
+                if (!loaded) {
+                    std::cout << "index file missing or stale, rebuild hnsw index." << std::endl;
+                    BuildIndex();
+                }
+                hnsw_->SetEfSearch(params_.hnswEfSearch);
+            }
+
+            if (ivfpq_ && !resident_) {
+                bool loaded = ivfpq_->Load(dir + "/db.ivfpq") == 0 && ivfpq_->Size() == snapshot.Live();
+                snapshot.ForEachLive([&](const GalleryPart &part, size_t offset) {
+                    loaded = loaded && ivfpq_->Contains(part.ids[offset]);
+                });
+                if (!loaded) {
+                    std::cout << "index file missing or stale, rebuild ivfpq index." << std::endl;
+                    return ErrorCode::DATA_CORRUPTED_ERROR;
+                }
+                ivfpq_->SetNprobe(params_.ivfNprobe);
+                ivfpq_->SetRerank(params_.ivfRerank);
+            }
+            return 0;
+        }
+
+        //! Rebuild the index from the resident features, the hnsw index must be detached
+        void BuildIndex() {
+            const GallerySnapshot &snapshot = *current_.load();
+            alignas(64) float buffer[AlignedFeatureDim(kMaxFaceFeatureDim)];
+            if (hnsw_) {
+                hnsw_->Clear();
+                hnsw_->Reserve(snapshot.Live());
+                snapshot.ForEachLive([&](const GalleryPart &part, size_t offset) {
+                    hnsw_->Add(part.ids[offset], part.features.Row(offset, buffer));
+                });
+            }
+
+            if (ivfpq_) {
+                // queries do not search the ivfpq index while the features are resident
+                ivfpq_->Clear();
+                // queries scan the rows until there are enough faces to train on
+                if (!ivfpq_->IsTrained()) {
+                    if (snapshot.Live() < ivfpq_->MinTrainingSize()) return;
+                    // the codebooks are trained on contiguous rows, quantized ones decoded
+                    AlignedVector<float> rows(snapshot.Live() * stride_);
+                    size_t row = 0;
+                    snapshot.ForEachLive([&](const GalleryPart &part, size_t offset) {
+                        float *dst = rows.data() + (row++) * stride_;
+                        const float *feat = part.features.Row(offset, dst);
+                        if (feat != dst) {
+                            std::copy(feat, feat + stride_, dst);
+                        }
+                    });
+                    if (ivfpq_->Train(rows.data(), snapshot.Live(), stride_) != 0) return;
+                }
+                ivfpq_->Reserve(snapshot.Live());
+                snapshot.ForEachLive([&](const GalleryPart &part, size_t offset) {
+                    ivfpq_->Add(part.ids[offset], part.features.Row(offset, buffer));
+                });
+                // the compressed index holds the exact features from now on
+                RebuildRows(false);
+            }
+        }
+
+        /// \brief Publish the live rows packed into one part, ids and order unchanged so the indexes stay
+        /// valid. The features are encoded in the configured storage, or dropped for the ivfpq index.
+        void RebuildRows(bool with_features) {
+            const GallerySnapshot &current = *current_.load();
+            GallerySnapshot *next = new GallerySnapshot();
+            const size_t num_rows = current.Live();
+            if (num_rows > 0) {
+                std::shared_ptr<GalleryPart> part = std::make_shared<GalleryPart>(0, num_rows, dim_);
+                if (with_features) {
+                    part->features.SetStorage(params_.storageType, KeepFloat(params_));
+                    part->features.Resize(num_rows);
+                }
+                if (current.num_multi > 0 || params_.maxTemplates > 1) {
+                    part->EnableCentroids(stride_);
+                }
+                AlignedVector<float> block;
+                size_t row = 0;
+                current.ForEachLive([&](const GalleryPart &from, size_t offset) {
+                    part->names[row] = from.names[offset];
+                    part->ids[row] = from.ids[offset];
+                    part->templates[row] = from.templates[offset];
+                    if (with_features) {
+                        if (current.resident) {
+                            part->features.CopyRow(from.features, offset, row);
+                        } else if (const float *feat = ivfpq_->Vector(from.ids[offset])) {
+                            part->features.Set(row, feat);
+                        }
+                    }
+                    const size_t count = from.templates[offset];
+                    if (count > 0) {
+                        ++next->num_identities;
+                    }
+                    if (count > 1) {
+                        const int32_t slot = static_cast<int32_t>(part->num_centroids++);
+                        part->centroid_slots[row] = slot;
+                        float *centroid = part->centroids.data() + static_cast<size_t>(slot) * stride_;
+                        if (from.centroid_slots[offset] >= 0) {
+                            const float *src = from.centroids.data() +
+                                               static_cast<size_t>(from.centroid_slots[offset]) * stride_;
+                            std::copy(src, src + stride_, centroid);
+                            part->radii[slot] = from.radii[from.centroid_slots[offset]];
+                        } else {
+                            ReadTemplates(current, from, offset, count, block);
+                            part->radii[slot] = ComputeCentroid(block.data(), count, centroid);
+                        }
+                        ++next->num_multi;
+                    }
+                    ++row;
+                });
+                next->parts.push_back(part);
+                next->size = num_rows;
+            }
+            resident_ = with_features;
+            Publish(next);
+        }
+
+        //! Pack the rows again once the deleted ones take a noticeable share of the scans
+        void CompactRows() {
+            const GallerySnapshot &current = *current_.load();
+            if (current.num_deleted > std::max(kCompactDeletedRows, current.size / 4)) {
+                RebuildRows(resident_);
+            }
+        }
+
+        //! Write the v2 format through a temporary file, so a database mapped from 'path' stays valid
+        int SaveBase(const std::string &path, uint32_t *base_checksum) const {
+            const GallerySnapshot &snapshot = *current_.load();
+            const size_t num_faces = snapshot.Live();
+            std::vector<uint64_t> offsets(1, 0);
+            offsets.reserve(num_faces + 1);
+            std::string name_bytes;
+            snapshot.ForEachLive([&](const GalleryPart &part, size_t offset) {
+                name_bytes += part.names[offset];
+                offsets.push_back(name_bytes.size());
+            });
+
+            DatabaseHeader header;
+            std::memset(&header, 0, sizeof(header));
+            header.magic = kDatabaseMagic;
+            header.version = kDatabaseVersion;
+            header.dim = dim_;
+            header.stride = stride_;
+            header.count = num_faces;
+            header.features_offset = sizeof(DatabaseHeader);
+            header.names_offset = AlignOffset(header.features_offset + sizeof(float) * stride_ * num_faces);
+            header.names_size = sizeof(uint64_t) * offsets.size() + name_bytes.size();
+            uint32_t checksum = Crc32c(&header, sizeof(header));
+            checksum = Crc32c(offsets.data(), sizeof(uint64_t) * offsets.size(), checksum);
+            header.checksum = Crc32c(name_bytes.data(), name_bytes.size(), checksum);
+
+            const std::string tmp_path = path + ".tmp";
+            {
+                FileWriter ofile(tmp_path, FileWriter::Binary);
+                if (!ofile.is_opened()) {
+                    std::cout << "Open database failed: " << tmp_path << std::endl;
+                    return ErrorCode::NOT_FOUND_ERROR;
+                }
+
+                size_t offset = Write(ofile, header);
+                // quantized rows without a float copy are written dequantized
+                alignas(64) float buffer[AlignedFeatureDim(kMaxFaceFeatureDim)];
+                snapshot.ForEachLive([&](const GalleryPart &part, size_t row) {
+                    offset += Write(ofile, Feature(snapshot, part, row, buffer), static_cast<size_t>(stride_));
+                });
+                const char padding[kFileAlignment] = {0};
+                offset += Write(ofile, padding, header.names_offset - offset);
+                offset += Write(ofile, offsets.data(), offsets.size());
+                offset += Write(ofile, name_bytes.data(), name_bytes.size());
+                if (offset != header.names_offset + header.names_size) {
+                    std::cout << "Write database failed: " << tmp_path << std::endl;
+                    return ErrorCode::NOT_FOUND_ERROR;
+                }
+            }
+
+#if defined(_WIN32)
+            std::remove(path.c_str());
+#endif
+            if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+                std::cout << "Replace database failed: " << path << std::endl;
+                return ErrorCode::NOT_FOUND_ERROR;
+            }
+
+            *base_checksum = header.checksum;
+            std::cout << "FaceDatabase Saved " << num_faces << " faces" << std::endl;
+            return 0;
+        }
+
+        int SaveDatabase(const std::string &dir) {
+            std::cout << "start save data." << std::endl;
+            uint32_t base_checksum = 0;
+            int flag = SaveBase(dir + "/db", &base_checksum);
+            if (flag != 0) {
+                return flag;
+            }
+            flag = SaveIndex(dir);
+            if (flag != 0) {
+                return flag;
+            }
+            // the new base holds every change, later ones are journaled next to it
+            has_base_ = true;
+            base_checksum_ = base_checksum;
+            journal_dir_ = dir;
+            return journal_.Reset(dir + "/db.journal", base_checksum);
+        }
+
+        /// \brief Load a v2 database by mapping it, or a legacy one by reading it, and publish it.
+        /// Without 'keep_features' only names are kept, the features are expected in the ivfpq index.
+        int LoadBase(const std::string &path, bool keep_features) {
+            Reset();
+            std::shared_ptr<MappedFile> mapping = std::make_shared<MappedFile>();
+            if (!mapping->open(path)) {
+                std::cout << "Open database failed (file not found)." << std::endl;
+                return ErrorCode::NOT_FOUND_ERROR;
+            }
+            uint32_t magic = 0;
+            if (mapping->size() >= sizeof(magic)) {
+                std::memcpy(&magic, mapping->data(), sizeof(magic));
+            }
+            if (magic != kDatabaseMagic) {
+                const size_t file_size = mapping->size();
+                mapping.reset();
+                FileReader ifile(path, FileReader::Binary);
+                if (!ifile.is_opened()) {
+                    std::cout << "Open database failed (file not found)." << std::endl;
+                    return ErrorCode::NOT_FOUND_ERROR;
+                }
+                std::cout << "legacy database format, save it again to map it in place." << std::endl;
+                return LoadLegacy(ifile, file_size, keep_features);
+            }
+
+            int flag = LoadMapped(mapping, keep_features);
+            if (flag != 0) {
+                Reset();
+                return flag;
+            }
+            std::cout << "FaceDatabase Loaded " << current_.load()->Live() << " faces" << std::endl;
+            return 0;
+        }
+
+        int LoadMapped(const std::shared_ptr<MappedFile> &mapping, bool keep_features) {
+            DatabaseHeader header;
+            if (mapping->size() < sizeof(header)) {
+                return ErrorCode::DATA_CORRUPTED_ERROR;
+            }
+            std::memcpy(&header, mapping->data(), sizeof(header));
+            if (header.version != kDatabaseVersion) {
+                std::cout << "unsupported database version " << header.version << std::endl;
+                return ErrorCode::DATA_CORRUPTED_ERROR;
+            }
+            if (header.dim != dim_ || header.stride != stride_) {
+                return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+            }
+            const size_t file_size = mapping->size();
+            const uint64_t count = header.count;
+            if (header.features_offset % kFileAlignment != 0 || header.names_offset % kFileAlignment != 0 ||
+                header.features_offset < sizeof(header) || count > file_size / sizeof(uint64_t) ||
+                header.features_offset + sizeof(float) * stride_ * count > header.names_offset ||
+                header.names_offset > file_size || header.names_size > file_size - header.names_offset ||
+                header.names_size < sizeof(uint64_t) * (count + 1)) {
+                std::cout << "database file truncated or corrupted." << std::endl;
+                return ErrorCode::DATA_CORRUPTED_ERROR;
+            }
+
+            const char *names = mapping->data() + header.names_offset;
+            const uint32_t expected = header.checksum;
+            header.checksum = 0;
+            uint32_t checksum = Crc32c(&header, sizeof(header));
+            checksum = Crc32c(names, static_cast<size_t>(header.names_size), checksum);
+            if (checksum != expected) {
+                std::cout << "database checksum mismatch." << std::endl;
+                return ErrorCode::DATA_CORRUPTED_ERROR;
+            }
+
+            const size_t num_faces = static_cast<size_t>(count);
+            const uint64_t *offsets = reinterpret_cast<const uint64_t *>(names);
+            const char *name_bytes = names + sizeof(uint64_t) * (num_faces + 1);
+            const uint64_t name_size = header.names_size - sizeof(uint64_t) * (num_faces + 1);
+            std::shared_ptr<GalleryPart> part = std::make_shared<GalleryPart>(0, num_faces, dim_);
+            ids_.reserve(num_faces);
+            // the templates of an identity are saved in consecutive rows
+            size_t head = 0;
+            size_t num_multi = 0;
+            for (size_t row = 0; row < num_faces; ++row) {
+                if (offsets[row] > offsets[row + 1] || offsets[row + 1] > name_size) {
+                    return ErrorCode::DATA_CORRUPTED_ERROR;
+                }
+                std::string name(name_bytes + offsets[row], static_cast<size_t>(offsets[row + 1] - offsets[row]));
+                if (row > 0 && name == part->names[head]) {
+                    num_multi += ++part->templates[head] == 2;
+                } else if (ids_.emplace(name, static_cast<int64_t>(row)).second) {
+                    head = row;
+                    part->templates[head] = 1;
+                } else {
+                    return ErrorCode::DATA_CORRUPTED_ERROR;
+                }
+                part->names[row] = std::move(name);
+                part->ids[row] = static_cast<int64_t>(row);
+            }
+            max_index_ = static_cast<int64_t>(num_faces);
+            has_base_ = true;
+            base_checksum_ = expected;
+
+            const float *rows = reinterpret_cast<const float *>(mapping->data() + header.features_offset);
+            if (keep_features) {
+                part->features.SetStorage(params_.storageType, KeepFloat(params_));
+                part->features.Map(rows, num_faces);
+                // the ivfpq index has its own copy of the features, so do quantized rows
+                if (part->features.IsMapped()) {
+                    part->mapping = mapping;
+                }
+            }
+            if (num_multi > 0 || params_.maxTemplates > 1) {
+                part->EnableCentroids(stride_);
+            }
+            // only the pages of multi template identities are read, later for a compressed gallery
+            for (size_t row = 0; keep_features && row < num_faces; row += part->templates[row]) {
+                const size_t count = part->templates[row];
+                if (count > 1) {
+                    const int32_t slot = static_cast<int32_t>(part->num_centroids++);
+                    part->centroid_slots[row] = slot;
+                    part->radii[slot] = ComputeCentroid(rows + row * stride_, count,
+                                                        part->centroids.data() + static_cast<size_t>(slot) * stride_);
+                }
+            }
+            resident_ = keep_features;
+            GallerySnapshot *next = new GallerySnapshot();
+            if (num_faces > 0) {
+                next->parts.push_back(part);
+                next->size = num_faces;
+                next->num_multi = num_multi;
+                next->num_identities = ids_.size();
+            }
+            Publish(next);
+            return 0;
+        }
+
+        //! 'file_size' bounds the face count of the header, a corrupted count must not size the buffers
+        int LoadLegacy(StreamReader &reader, size_t file_size, bool keep_features) {
+            if (dim_ != kFaceFeatureDim) {
+                std::cout << "legacy databases hold " << kFaceFeatureDim << " dimensional features only." << std::endl;
+                return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+            }
+            uint64_t num_faces = 0;
+            const uint64_t dim_feat = kFaceFeatureDim;
+            const uint64_t dim_name = kFaceNameDim;
+
+            const uint64_t face_bytes = dim_name + sizeof(float) * dim_feat;
+            if (Read(reader, num_faces) != sizeof(num_faces) || file_size < sizeof(num_faces) ||
+                num_faces > (file_size - sizeof(num_faces)) / face_bytes) {
+                std::cout << "legacy database corrupted, face count " << num_faces << " does not fit the file."
+                          << std::endl;
+                return ErrorCode::DATA_CORRUPTED_ERROR;
+            }
+            std::cout << "number faces is: " << num_faces << std::endl;
+
+            // a face registered twice keeps its last feature
+            std::vector<std::string> names;
+            AlignedVector<float> features;
+            std::unordered_map<std::string, size_t> rows;
+            names.reserve(static_cast<size_t>(num_faces));
+            features.reserve(static_cast<size_t>(num_faces) * stride_);
+            float feat[kFaceFeatureDim];
+            for (size_t i = 0; i < num_faces; ++i) {
+                char name_arr[kFaceNameDim];
+                if (Read(reader, name_arr, size_t(dim_name)) != dim_name ||
+                    Read(reader, feat, size_t(dim_feat)) != sizeof(float) * dim_feat) {
+                    std::cout << "legacy database truncated at face " << i << "." << std::endl;
+                    return ErrorCode::DATA_CORRUPTED_ERROR;
+                }
+                name_arr[kFaceNameDim - 1] = '\0';
+                auto it = rows.emplace(std::string(name_arr), names.size());
+                if (it.second) {
+                    names.push_back(it.first->first);
+                    features.resize(features.size() + stride_);
+                }
+                NormalizeFeature(feat, features.data() + it.first->second * stride_, dim_);
+            }
+
+            std::shared_ptr<GalleryPart> part = std::make_shared<GalleryPart>(0, names.size(), dim_);
+            if (keep_features) {
+                part->features.SetStorage(params_.storageType, KeepFloat(params_));
+                part->features.Resize(names.size());
+            }
+            for (size_t row = 0; row < names.size(); ++row) {
+                const int64_t id = max_index_++;
+                if (keep_features) {
+                    part->features.Set(row, features.data() + row * stride_);
+                }
+                part->templates[row] = 1;
+                ids_.emplace(names[row], id);
+                part->names[row] = std::move(names[row]);
+                part->ids[row] = id;
+            }
+            resident_ = keep_features;
+            GallerySnapshot *next = new GallerySnapshot();
+            if (part->capacity > 0) {
+                next->parts.push_back(part);
+                next->size = part->capacity;
+                next->num_identities = part->capacity;
+            }
+            Publish(next);
+
+            std::cout << "FaceDatabase Loaded " << num_faces << " faces" << std::endl;
+
+            return 0;
+        }
+
+        /// \brief Replay and keep appending to the journal of the base loaded from 'dir'.
+        /// A legacy base has no checksum to pin a journal to, it is journaled once saved again.
+        int AttachJournal(const std::string &dir) {
+            if (!has_base_) return 0;
+            std::vector<Journal::Record> records;
+            int flag = journal_.Open(dir + "/db.journal", base_checksum_, records);
+            if (flag != 0) {
+                return flag;
+            }
+            for (const Journal::Record &record : records) {
+                if (record.op == Journal::INSERT_RECORD) {
+                    Upsert(record.name, record.feat.data());
+                } else if (record.op == Journal::DELETE_RECORD) {
+                    Remove(record.name);
+                } else {
+                    Reset();
+                }
+            }
+            if (!records.empty()) {
+                std::cout << "replay " << records.size() << " journal records" << std::endl;
+            }
+            journal_dir_ = dir;
+            return 0;
+        }
+
+        inline bool IsJournaling(const std::string &dir) const {
+            return journal_.IsOpened() && journal_dir_ == dir;
+        }
+
+        //! Once the journal outgrows a quarter of the gallery replaying it costs more than rewriting the base
+        inline bool NeedsCompaction() const {
+            return journal_.Size() > std::max(kJournalCompactRecords, current_.load()->Live() / 4);
+        }
+
+        /// \brief Register a face or add a template to a registered one. The identity is written again as
+        /// a new block of rows with new ids and its old rows are deleted. Beyond maxTemplates the oldest
+        /// template is dropped, so with a single template per identity the feature is replaced.
+        int64_t Upsert(const std::string &name, const float *feat) {
+            int64_t id = 0;
+            Upsert(&name, feat, 1, &id);
+            return id;
+        }
+
+        /// \brief Upsert 'num_faces' faces (num_faces * dim_ contiguous floats) in order. They are written into
+        /// a single snapshot and the indexes are detached once, so a batch costs one grace period of the readers.
+        void Upsert(const std::string *names, const float *feats, size_t num_faces, int64_t *ids) {
+            GallerySnapshot *next = Fork();
+            const bool indexed = hnsw_ || !resident_;
+            // the index is edited face after face once the rows are published, in the order of the batch
+            AlignedVector<float> blocks;
+            std::vector<size_t> counts;
+            std::vector<std::vector<int64_t>> old_ids(indexed ? num_faces : 0);
+            AlignedVector<float> block;
+            for (size_t i = 0; i < num_faces; ++i) {
+                const std::string &name = names[i];
+                block.clear();
+                auto it = ids_.find(name);
+                size_t row = 0;
+                if (it != ids_.end() && next->FindRow(it->second, row)) {
+                    size_t offset = 0;
+                    const GalleryPart &part = next->Locate(row, offset);
+                    const size_t count = part.templates[offset];
+                    const size_t keep = std::min(count, static_cast<size_t>(params_.maxTemplates - 1));
+                    ReadTemplates(*next, part, offset + count - keep, keep, block);
+                    if (indexed) {
+                        old_ids[i].assign(part.ids.begin() + offset, part.ids.begin() + offset + count);
+                    }
+                    MarkDeleted(*next, it->second);
+                    if (keep > 0) {
+                        std::cout << "add " << name << " face template" << std::endl;
+                    } else {
+                        std::cout << "update " << name << " face feature" << std::endl;
+                    }
+                }
+                const size_t count = block.size() / stride_ + 1;
+                block.resize(count * stride_, 0.0f);
+                NormalizeFeature(feats + i * dim_, block.data() + (count - 1) * stride_, dim_);
+                ids[i] = Append(*next, name, block.data(), count);
+                ids_[name] = ids[i];
+                if (indexed) {
+                    blocks.insert(blocks.end(), block.begin(), block.end());
+                    counts.push_back(count);
+                }
+            }
+
+            if (!indexed) {
+                Publish(next);
+                if (ivfpq_ && current_.load()->Live() >= ivfpq_->MinTrainingSize()) {
+                    BuildIndex();
+                }
+                CompactRows();
+                return;
+            }
+
+            DetachIndex(next);
+            const float *block_rows = blocks.data();
+            for (size_t i = 0; i < num_faces; ++i) {
+                for (int64_t old_id : old_ids[i]) {
+                    if (hnsw_) {
+                        hnsw_->Remove(old_id);
+                    } else {
+                        ivfpq_->Remove(old_id);
+                    }
+                }
+                for (size_t t = 0; t < counts[i]; ++t) {
+                    if (hnsw_) {
+                        hnsw_->Add(ids[i] + static_cast<int64_t>(t), block_rows);
+                    } else {
+                        ivfpq_->Add(ids[i] + static_cast<int64_t>(t), block_rows);
+                    }
+                    block_rows += stride_;
+                }
+            }
+            CompactIndex();
+            AttachIndex();
+            CompactRows();
+        }
+
+        int Remove(const std::string &name) {
+            auto it = ids_.find(name);
+            if (it == ids_.end()) {
+                return ErrorCode::NOT_FOUND_ERROR;
+            }
+            AddTombstone(name);
+
+            GallerySnapshot *next = Fork();
+            std::vector<int64_t> old_ids;
+            size_t row = 0;
+            if (next->FindRow(it->second, row)) {
+                size_t offset = 0;
+                const GalleryPart &part = next->Locate(row, offset);
+                old_ids.assign(part.ids.begin() + offset, part.ids.begin() + offset + part.templates[offset]);
+                MarkDeleted(*next, it->second);
+            }
+            ids_.erase(it);
+            if (hnsw_ || !resident_) {
+                DetachIndex(next);
+                for (int64_t old_id : old_ids) {
+                    if (hnsw_) {
+                        hnsw_->Remove(old_id);
+                    } else {
+                        ivfpq_->Remove(old_id);
+                    }
+                }
+                CompactIndex();
+                AttachIndex();
+            } else {
+                Publish(next);
+            }
+            CompactRows();
+
+            std::cout << "Delete: " << name << " successfully." << std::endl;
+            return 0;
+        }
+
+        //! Remember a deletion for the incremental exports, the deletion takes a version of its own
+        void AddTombstone(const std::string &name) {
+            tombstones_.emplace_back(max_index_++, name);
+            if (tombstones_.size() > kMaxTombstones) {
+                tombstones_.erase(tombstones_.begin(), tombstones_.begin() + kMaxTombstones / 2);
+                tombstone_floor_ = tombstones_.front().first;
+            }
+        }
+
+        //! Publish an empty gallery, the indexes must be detached. The ids start over in a new history
+        void Reset() {
+            ids_.clear();
+            max_index_ = 0;
+            epoch_ = NextEpoch(epoch_);
+            tombstones_.clear();
+            tombstone_floor_ = 0;
+            if (hnsw_) {
+                hnsw_->Clear();
+            }
+            if (ivfpq_) {
+                ivfpq_->Clear();
+            }
+            Publish(new GallerySnapshot());
+        }
+
+        /// \brief Write the 'count' templates of an identity into consecutive free rows of the last part of
+        /// 'next', or of a new part. Returns the id of the first template, the others follow it.
+        int64_t Append(GallerySnapshot &next, const std::string &name, const float *block, size_t count) {
+            const bool multi = count > 1;
+            if (!next.parts.empty()) {
+                const GalleryPart &last = *next.parts.back();
+                const size_t free_rows = last.begin + last.capacity - next.size;
+                if (free_rows > 0 && (free_rows < count || (multi && !last.HasCentroids()))) {
+                    // the templates of an identity never span two parts
+                    SkipRows(next, free_rows);
+                }
+            }
+            if (next.parts.empty() || next.parts.back()->begin + next.parts.back()->capacity == next.size) {
+                // parts double the gallery, so there are few of them
+                std::shared_ptr<GalleryPart> part = std::make_shared<GalleryPart>(
+                        next.size, std::max(std::max(kMinPartRows, next.size), count), dim_);
+                if (resident_) {
+                    part->features.SetStorage(params_.storageType, KeepFloat(params_));
+                    part->features.Resize(part->capacity);
+                }
+                if (multi || params_.maxTemplates > 1) {
+                    part->EnableCentroids(stride_);
+                }
+                next.parts.push_back(part);
+            }
+            GalleryPart &part = *next.parts.back();
+            const size_t head = next.size - part.begin;
+            const int64_t id = max_index_;
+            for (size_t i = 0; i < count; ++i) {
+                if (resident_) {
+                    part.features.Set(head + i, block + i * stride_);
+                }
+                part.names[head + i] = name;
+                part.ids[head + i] = max_index_++;
+            }
+            part.templates[head] = static_cast<uint32_t>(count);
+            if (multi) {
+                const int32_t slot = static_cast<int32_t>(part.num_centroids++);
+                part.centroid_slots[head] = slot;
+                part.radii[slot] = ComputeCentroid(block, count,
+                                                   part.centroids.data() + static_cast<size_t>(slot) * stride_);
+                ++next.num_multi;
+            }
+            ++next.num_identities;
+            next.size += count;
+            return id;
+        }
+
+        //! Leave the free rows at the end of the last part of 'next' unused, they are flagged as deleted
+        void SkipRows(GallerySnapshot &next, size_t num_rows) const {
+            GalleryPart &part = *next.parts.back();
+            const size_t offset = next.size - part.begin;
+            // repeating the last id keeps the ids sorted, FindRow meets its own row first
+            std::fill(part.ids.begin() + offset, part.ids.begin() + offset + num_rows, part.ids[offset - 1]);
+            MarkRows(next, next.size, num_rows);
+            next.size += num_rows;
+        }
+
+        //! Delete the identity headed by the template 'id'
+        void MarkDeleted(GallerySnapshot &next, int64_t id) const {
+            size_t row = 0;
+            if (!next.FindRow(id, row)) return;
+            size_t offset = 0;
+            const GalleryPart &part = next.Locate(row, offset);
+            const size_t count = part.templates[offset];
+            if (count > 1) {
+                --next.num_multi;
+            }
+            --next.num_identities;
+            MarkRows(next, row, count);
+        }
+
+        void MarkRows(GallerySnapshot &next, size_t row, size_t count) const {
+            std::shared_ptr<std::vector<uint64_t>> deleted = next.deleted ?
+                    std::make_shared<std::vector<uint64_t>>(*next.deleted) :
+                    std::make_shared<std::vector<uint64_t>>();
+            const size_t end = row + count;
+            if (deleted->size() < (end + 63) / 64) {
+                deleted->resize((end + 63) / 64, 0);
+            }
+            for (size_t r = row; r < end; ++r) {
+                (*deleted)[r >> 6] |= uint64_t(1) << (r & 63);
+            }
+            next.deleted = deleted;
+            next.num_deleted += count;
+        }
+
+        //! Float copies of the 'count' template rows from 'offset' on, 'stride_' floats apart
+        void ReadTemplates(const GallerySnapshot &snapshot, const GalleryPart &part, size_t offset, size_t count,
+                           AlignedVector<float> &block) const {
+            block.resize(count * stride_);
+            for (size_t i = 0; i < count; ++i) {
+                float *dst = block.data() + i * stride_;
+                const float *feat = Feature(snapshot, part, offset + i, dst);
+                if (feat != dst) {
+                    std::copy(feat, feat + stride_, dst);
+                }
+            }
+        }
+
+        //! Mean of 'count' templates ('stride_' floats apart) into 'centroid', returns the largest template
+        //! distance to it: no template scores more than <probe, centroid> + radius against a unit probe
+        float ComputeCentroid(const float *block, size_t count, float *centroid) const {
+            std::fill(centroid, centroid + stride_, 0.0f);
+            for (size_t i = 0; i < count; ++i) {
+                const float *feat = block + i * stride_;
+                for (int j = 0; j < dim_; ++j) {
+                    centroid[j] += feat[j];
+                }
+            }
+            const float scale = 1.0f / static_cast<float>(count);
+            for (int j = 0; j < dim_; ++j) {
+                centroid[j] *= scale;
+            }
+            float radius = 0.0f;
+            for (size_t i = 0; i < count; ++i) {
+                const float *feat = block + i * stride_;
+                float distance = 0.0f;
+                for (int j = 0; j < dim_; ++j) {
+                    distance += (feat[j] - centroid[j]) * (feat[j] - centroid[j]);
+                }
+                radius = std::max(radius, std::sqrt(distance));
+            }
+            return radius;
+        }
 
-namespace mirror {
+        inline const float *Feature(const GallerySnapshot &snapshot, const GalleryPart &part, size_t offset,
+                                    float *buffer) const {
+            if (snapshot.resident) {
+                return part.features.Row(offset, buffer);
+            }
+            const float *feat = ivfpq_->Vector(part.ids[offset]);
+            if (!feat) {
+                std::fill(buffer, buffer + stride_, 0.0f);
+                return buffer;
+            }
+            return feat;
+        }
+
+        //! Candidates of a flat scan, quantized scores only shortlist faces when they are re-ranked
+        static TopKHeap ScanHeap(const GallerySnapshot &snapshot, int k, float min_sim) {
+            if (snapshot.rerank > 0) {
+                return TopKHeap(std::max(k, snapshot.rerank), -std::numeric_limits<float>::max());
+            }
+            return TopKHeap(k, min_sim);
+        }
+
+        //! Re-score the shortlist with the exact features if needed and fill the results
+        void FinishScan(const GallerySnapshot &snapshot, const float *probe, TopKHeap &heap, int k,
+                        float min_sim, std::vector<QueryResult> &query_results) const {
+            if (snapshot.rerank <= 0) {
+                FillResults(snapshot, heap, query_results);
+                return;
+            }
+            std::vector<ScoredLabel> candidates;
+            heap.Extract(candidates);
+            TopKHeap exact(k, min_sim);
+            for (const ScoredLabel &candidate : candidates) {
+                exact.Push(ExactIdentityScore(snapshot, probe, static_cast<size_t>(candidate.label_)),
+                           candidate.label_);
+            }
+            FillResults(snapshot, exact, query_results);
+        }
+
+        //! Score of the identity headed by 'row', exact when float features are kept
+        float ExactIdentityScore(const GallerySnapshot &snapshot, const float *probe, size_t row) const {
+            size_t offset = 0;
+            const GalleryPart &part = snapshot.Locate(row, offset);
+            const size_t count = part.templates[offset];
+            if (count == 1) {
+                return part.features.ExactScore(probe, offset);
+            }
+            const bool mean = snapshot.aggregation == FaceTemplateAggregation::MEAN_AGGREGATION;
+            const int32_t slot = part.centroid_slots[offset];
+            if (mean && slot >= 0) {
+                return DotProduct(probe, part.centroids.data() + static_cast<size_t>(slot) * stride_, dim_);
+            }
+            float best = -std::numeric_limits<float>::max();
+            float sum = 0.0f;
+            for (size_t i = 0; i < count; ++i) {
+                const float score = part.features.ExactScore(probe, offset + i);
+                best = std::max(best, score);
+                sum += score;
+            }
+            return mean ? sum / static_cast<float>(count) : best;
+        }
+
+        //! Aggregated score of the templates of the identity headed by 'offset', in the storage precision
+        float IdentityScore(const GallerySnapshot &snapshot, const FeatureMatrix::Probe &probe,
+                            const GalleryPart &part, size_t offset) const {
+            const size_t count = part.templates[offset];
+            float scores[kScanTile];
+            float best = -std::numeric_limits<float>::max();
+            float sum = 0.0f;
+            for (size_t begin = offset; begin < offset + count; begin += kScanTile) {
+                const size_t end = std::min<size_t>(begin + kScanTile, offset + count);
+                part.features.Score(probe, begin, end, scores);
+                for (size_t i = 0; i < end - begin; ++i) {
+                    best = std::max(best, scores[i]);
+                    sum += scores[i];
+                }
+            }
+            return snapshot.aggregation == FaceTemplateAggregation::MEAN_AGGREGATION ?
+                   sum / static_cast<float>(count) : best;
+        }
+
+        /// \brief Scan identity by identity when some have several templates. The mean of the template
+        /// scores is the score of the centroid. For the best template, <probe, centroid> + radius bounds
+        /// every template score: the identities with the highest bounds are scored first to raise the
+        /// top-K threshold, then the others are visited in storage order and the templates of those
+        /// whose bound can not enter the top-K are never read.
+        void ScanIdentities(const GallerySnapshot &snapshot, const float *probe, int k, float min_sim,
+                            std::vector<QueryResult> &query_results) const {
+            TopKHeap heap = ScanHeap(snapshot, k, min_sim);
+            if (!snapshot.resident || snapshot.parts.empty()) {
+                FinishScan(snapshot, probe, heap, k, min_sim, query_results);
+                return;
+            }
+
+            FeatureMatrix::Probe encoded;
+            snapshot.parts.front()->features.EncodeProbe(probe, encoded);
+            const bool mean = snapshot.aggregation == FaceTemplateAggregation::MEAN_AGGREGATION;
+            // identities whose templates are still to be scored, in storage order
+            std::vector<float> bounds;
+            std::vector<std::pair<const GalleryPart *, size_t>> pending;
+            for (const auto &part : snapshot.parts) {
+                const size_t num_rows = snapshot.PartRows(*part);
+                for (size_t offset = 0; offset < num_rows;) {
+                    const size_t count = part->templates[offset];
+                    if (count == 0) {
+                        // rows skipped to keep the templates of an identity in one part
+                        ++offset;
+                        continue;
+                    }
+                    const size_t row = part->begin + offset;
+                    if (!snapshot.IsDeleted(row)) {
+                        const int32_t slot = part->centroid_slots[offset];
+                        if (count == 1) {
+                            float score = 0.0f;
+                            part->features.Score(encoded, offset, offset + 1, &score);
+                            heap.Push(score, static_cast<int64_t>(row));
+                        } else if (slot >= 0) {
+                            const float score = DotProduct(
+                                    probe, part->centroids.data() + static_cast<size_t>(slot) * stride_, dim_);
+                            if (mean) {
+                                heap.Push(score, static_cast<int64_t>(row));
+                            } else {
+                                bounds.push_back(score + part->radii[slot]);
+                                pending.emplace_back(part.get(), offset);
+                            }
+                        } else {
+                            bounds.push_back(std::numeric_limits<float>::max());
+                            pending.emplace_back(part.get(), offset);
+                        }
+                    }
+                    offset += count;
+                }
+            }
+
+            // a sorted visit would read the templates in random order, which costs more than the
+            // pruning saves when bounds are loose, seeding the heap gives most of the pruning instead
+            const size_t num_seeds = std::min(pending.size(), static_cast<size_t>(std::max(k, snapshot.rerank)));
+            std::vector<ScoredLabel> seeds(pending.size());
+            for (size_t i = 0; i < pending.size(); ++i) {
+                seeds[i] = {bounds[i], static_cast<int64_t>(i)};
+            }
+            auto greater = [](const ScoredLabel &a, const ScoredLabel &b) { return a.sim_ > b.sim_; };
+            std::nth_element(seeds.begin(), seeds.begin() + num_seeds, seeds.end(), greater);
+            for (size_t i = 0; i < num_seeds; ++i) {
+                const size_t index = static_cast<size_t>(seeds[i].label_);
+                const GalleryPart &part = *pending[index].first;
+                heap.Push(IdentityScore(snapshot, encoded, part, pending[index].second),
+                          static_cast<int64_t>(part.begin + pending[index].second));
+                bounds[index] = -std::numeric_limits<float>::max();
+            }
+            for (size_t i = 0; i < pending.size(); ++i) {
+                if (bounds[i] < heap.Threshold()) {
+                    continue;
+                }
+                const GalleryPart &part = *pending[i].first;
+                heap.Push(IdentityScore(snapshot, encoded, part, pending[i].second),
+                          static_cast<int64_t>(part.begin + pending[i].second));
+            }
+            FinishScan(snapshot, probe, heap, k, min_sim, query_results);
+        }
+
+        //! Rows [begin, end) of a part, scanned by one thread
+        struct ScanShard {
+            const GalleryPart *part;
+            size_t begin;
+            size_t end;
+        };
+
+        /// \brief Run scan(shard, heaps) over shards of the gallery on the threads of the snapshot, one heap
+        /// per probe. Every shard fills heaps of its own, merged into 'heaps' once all shards are done.
+        template<typename Scan>
+        static void ScanShards(const GallerySnapshot &snapshot, std::vector<TopKHeap> &heaps, Scan scan) {
+            const size_t num_threads = snapshot.pool ? static_cast<size_t>(snapshot.pool->Threads()) : 1;
+            const size_t shard_rows = std::max(kMinShardRows, (snapshot.size + num_threads - 1) / num_threads);
+            std::vector<ScanShard> shards;
+            for (const auto &part : snapshot.parts) {
+                const size_t num_rows = snapshot.PartRows(*part);
+                for (size_t begin = 0; begin < num_rows; begin += shard_rows) {
+                    shards.push_back({part.get(), begin, std::min(begin + shard_rows, num_rows)});
+                }
+            }
+            if (num_threads == 1 || shards.size() == 1) {
+                for (const ScanShard &shard : shards) {
+                    scan(shard, heaps);
+                }
+                return;
+            }
+
+            std::vector<std::vector<TopKHeap>> shard_heaps(shards.size(), heaps);
+            snapshot.pool->Run(static_cast<int>(shards.size()), [&](int i) {
+                scan(shards[i], shard_heaps[i]);
+            });
+            for (const auto &local : shard_heaps) {
+                for (size_t j = 0; j < heaps.size(); ++j) {
+                    heaps[j].Merge(local[j]);
+                }
+            }
+        }
+
+        void ScanTopK(const GallerySnapshot &snapshot, const float *probe, int k, float min_sim,
+                      std::vector<QueryResult> &query_results) const {
+            if (snapshot.num_multi > 0) {
+                ScanIdentities(snapshot, probe, k, min_sim, query_results);
+                return;
+            }
+            std::vector<TopKHeap> heaps(1, ScanHeap(snapshot, k, min_sim));
+            if (snapshot.resident && !snapshot.parts.empty()) {
+                FeatureMatrix::Probe encoded;
+                snapshot.parts.front()->features.EncodeProbe(probe, encoded);
+                ScanShards(snapshot, heaps, [&](const ScanShard &shard, std::vector<TopKHeap> &shard_heaps) {
+                    float scores[kScanTile];
+                    TopKHeap &heap = shard_heaps.front();
+                    const GalleryPart &part = *shard.part;
+                    for (size_t row_begin = shard.begin; row_begin < shard.end; row_begin += kScanTile) {
+                        const size_t row_end = std::min<size_t>(row_begin + kScanTile, shard.end);
+                        part.features.Score(encoded, row_begin, row_end, scores);
+                        for (size_t row = row_begin; row < row_end; ++row) {
+                            if (!snapshot.IsDeleted(part.begin + row)) {
+                                heap.Push(scores[row - row_begin], static_cast<int64_t>(part.begin + row));
+                            }
+                        }
+                    }
+                });
+            }
+            FinishScan(snapshot, probe, heaps.front(), k, min_sim, query_results);
+        }
+
+        void ScanBatch(const GallerySnapshot &snapshot, const float *probes, int num_probes, int k, float min_sim,
+                       std::vector<std::vector<QueryResult>> &query_results) const {
+            if (snapshot.num_multi > 0) {
+                for (int j = 0; j < num_probes; ++j) {
+                    ScanIdentities(snapshot, probes + static_cast<size_t>(j) * stride_, k, min_sim, query_results[j]);
+                }
+                return;
+            }
+            std::vector<TopKHeap> heaps(static_cast<size_t>(num_probes), ScanHeap(snapshot, k, min_sim));
+            if (snapshot.resident && !snapshot.parts.empty()) {
+                const FeatureMatrix &front = snapshot.parts.front()->features;
+                const int tile_rows = std::max(2, kBatchTileBytes / static_cast<int>(front.BytesPerRow()));
+                if (front.IsQuantized()) {
+                    // no blocked kernel for the codes, each tile is still read from memory only once
+                    std::vector<FeatureMatrix::Probe> encoded(static_cast<size_t>(num_probes));
+                    for (int j = 0; j < num_probes; ++j) {
+                        front.EncodeProbe(probes + static_cast<size_t>(j) * stride_, encoded[j]);
+                    }
+                    ScanShards(snapshot, heaps, [&](const ScanShard &shard, std::vector<TopKHeap> &shard_heaps) {
+                        std::vector<float> scores(static_cast<size_t>(tile_rows));
+                        const GalleryPart &part = *shard.part;
+                        for (size_t row_begin = shard.begin; row_begin < shard.end; row_begin += tile_rows) {
+                            const size_t row_end = std::min<size_t>(row_begin + tile_rows, shard.end);
+                            for (int j = 0; j < num_probes; ++j) {
+                                part.features.Score(encoded[j], row_begin, row_end, scores.data());
+                                for (size_t row = row_begin; row < row_end; ++row) {
+                                    if (!snapshot.IsDeleted(part.begin + row)) {
+                                        shard_heaps[j].Push(scores[row - row_begin],
+                                                            static_cast<int64_t>(part.begin + row));
+                                    }
+                                }
+                            }
+                        }
+                    });
+                } else {
+                    // Score the probes as one blocked matrix multiply: the gallery is walked
+                    // once in tiles small enough to stay in L2 while every probe block is
+                    // scored against them, instead of streaming the gallery once per probe.
+                    const int probe_block = std::min(num_probes, kBatchProbeBlock);
+                    ScanShards(snapshot, heaps, [&](const ScanShard &shard, std::vector<TopKHeap> &shard_heaps) {
+                        std::vector<float> scores(static_cast<size_t>(probe_block) * tile_rows);
+                        const GalleryPart &part = *shard.part;
+                        const float *rows = part.features.FloatData();
+                        for (size_t row_begin = shard.begin; row_begin < shard.end; row_begin += tile_rows) {
+                            const int rows_in_tile = static_cast<int>(std::min<size_t>(tile_rows, shard.end - row_begin));
+                            for (int probe_begin = 0; probe_begin < num_probes; probe_begin += probe_block) {
+                                const int probes_in_block = std::min(probe_block, num_probes - probe_begin);
+                                DotProductBlock(probes + static_cast<size_t>(probe_begin) * stride_,
+                                                probes_in_block, stride_,
+                                                rows + row_begin * stride_, rows_in_tile, stride_,
+                                                dim_, scores.data(), tile_rows);
+                                for (int j = 0; j < probes_in_block; ++j) {
+                                    TopKHeap &heap = shard_heaps[probe_begin + j];
+                                    const float *probe_scores = scores.data() + static_cast<size_t>(j) * tile_rows;
+                                    for (int r = 0; r < rows_in_tile; ++r) {
+                                        const size_t row = part.begin + row_begin + r;
+                                        if (!snapshot.IsDeleted(row)) {
+                                            heap.Push(probe_scores[r], static_cast<int64_t>(row));
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    });
+                }
+            }
+
+            for (int j = 0; j < num_probes; ++j) {
+                FinishScan(snapshot, probes + static_cast<size_t>(j) * stride_, heaps[j], k, min_sim,
+                           query_results[j]);
+            }
+        }
+
+        static void FillResults(const GallerySnapshot &snapshot, TopKHeap &heap,
+                                std::vector<QueryResult> &query_results) {
+            std::vector<ScoredLabel> scored;
+            heap.Extract(scored);
+            query_results.resize(scored.size());
+            for (size_t i = 0; i < scored.size(); ++i) {
+                size_t offset = 0;
+                const GalleryPart &part = snapshot.Locate(static_cast<size_t>(scored[i].label_), offset);
+                query_results[i].name_ = part.names[offset];
+                query_results[i].sim_ = scored[i].sim_;
+                query_results[i].id_ = part.ids[offset];
+            }
+        }
+
+        //! Search the index for templates, an identity is reported once, for its best template or its mean
+        void SearchIndex(const GallerySnapshot &snapshot, const float *probe, int k, float min_sim,
+                         std::vector<QueryResult> &query_results) const {
+            const bool grouped = snapshot.num_multi > 0;
+            const bool mean = snapshot.aggregation == FaceTemplateAggregation::MEAN_AGGREGATION;
+            const int num_candidates = grouped ? k * std::max(2, snapshot.max_templates) : k;
+            std::vector<ScoredLabel> scored;
+            if (snapshot.hnsw) {
+                snapshot.hnsw->Search(probe, num_candidates, min_sim, scored);
+            } else {
+                snapshot.ivfpq->Search(probe, num_candidates, min_sim, scored);
+            }
+            query_results.clear();
+            query_results.reserve(scored.size());
+            std::vector<size_t> heads;
+            for (const ScoredLabel &label : scored) {
+                size_t row = 0;
+                if (!snapshot.FindRow(label.label_, row)) continue;
+                size_t offset = 0;
+                const GalleryPart &part = snapshot.Locate(row, offset);
+                const size_t head = GallerySnapshot::Head(part, offset);
+                // the results come best first, later templates of a reported identity score less
+                if (std::find(heads.begin(), heads.end(), part.begin + head) != heads.end()) continue;
+                heads.push_back(part.begin + head);
+                QueryResult query_result;
+                query_result.name_ = part.names[head];
+                query_result.sim_ = label.sim_;
+                query_result.id_ = part.ids[head];
+                if (mean && part.centroid_slots[head] >= 0) {
+                    const float *centroid = part.centroids.data() + static_cast<size_t>(part.centroid_slots[head]) * stride_;
+                    query_result.sim_ = DotProduct(probe, centroid, dim_);
+                    if (query_result.sim_ < min_sim) continue;
+                }
+                query_results.push_back(query_result);
+            }
+            if (grouped) {
+                std::stable_sort(query_results.begin(), query_results.end(),
+                                 [](const QueryResult &a, const QueryResult &b) { return a.sim_ > b.sim_; });
+                if (query_results.size() > static_cast<size_t>(std::max(k, 0))) {
+                    query_results.resize(static_cast<size_t>(std::max(k, 0)));
+                }
+            }
+        }
+
+        //! Rebuild the graph once tombstones outnumber the live nodes, the index must be detached
+        void CompactIndex() {
+            if (hnsw_ && hnsw_->DeletedCount() > std::max<size_t>(hnsw_->Size(), 1024)) {
+                BuildIndex();
+            }
+        }
+
+        void DestroyIndex() {
+            if (hnsw_) {
+                delete hnsw_;
+                hnsw_ = nullptr;
+            }
+            if (ivfpq_) {
+                delete ivfpq_;
+                ivfpq_ = nullptr;
+            }
+        }
+
+    private:
+        //! Dimension the database is created for, the default one when 'dim' is out of range
+        static int CheckFeatureDim(int dim) {
+            if (dim <= 0 || dim > kMaxFaceFeatureDim) {
+                std::cout << "invalid feature dimension " << dim << ", " << kFaceFeatureDim << " is used." << std::endl;
+                return kFaceFeatureDim;
+            }
+            return dim;
+        }
+
+        const int dim_;
+        //! padded row length in floats, keeps every row cache line aligned
+        const int stride_;
+
+        //! the version read by the queries, replaced by writers only
+        std::atomic<GallerySnapshot *> current_;
+        mutable RcuDomain rcu_;
+
+        // writer state, guarded by 'mutex_'
+        std::mutex mutex_;
+        //! id of every live face
+        std::unordered_map<std::string, int64_t> ids_;
+        int64_t max_index_ = 0;
+        //! false once a trained ivfpq index holds the features, the parts then only hold names
+        bool resident_ = true;
+        //! nesting depth of DetachIndex, the indexes are hidden from the queries while it is non zero
+        int detached_ = 0;
+        //! mutations since the base file in 'journal_dir_' was written, pinned to its checksum
+        Journal journal_;
+        std::string journal_dir_;
+        bool has_base_ = false;
+        uint32_t base_checksum_ = 0;
+        //! history of the ids, 'max_index_' is its version; exports since a version stream the deletions
+        //! after it and the identities with ids from it on
+        uint64_t epoch_;
+        std::deque<std::pair<int64_t, std::string>> tombstones_;
+        //! versions before it miss forgotten deletions
+        int64_t tombstone_floor_ = 0;
+
+        FaceDatabaseParams params_;
+        //! optional approximate indexes, at most one of them is set
+        HnswIndex *hnsw_ = nullptr;
+        IvfPqIndex *ivfpq_ = nullptr;
+        //! threads of the exact scans, handed to the snapshots
+        std::shared_ptr<ScanPool> pool_;
+    };
 
+    /// \brief The default gallery and the named partitions. Every partition is a gallery of its own, so a
+    /// query only reads the rows of its partition. The partitions are published like the snapshots of a
+    /// gallery: readers look a partition up in the current map inside an rcu read section and keep using
+    /// it until they leave, creating or dropping a partition replaces the map under 'mutex_'. Streaming a
+    /// partition takes longer than a query, so Export and Import pin the gallery and leave the read section.
+    /// On disk the default gallery fills 'path' as before, partition p lives in 'path'/partitions/p and
+    /// 'path'/partitions.list names the partitions, one per line.
     class FaceDatabase::Impl {
     public:
-        Impl() {
-            max_index_ = 0;
-            features_db_.clear();
+        explicit Impl(const FaceDatabaseParams &params) : pool_(CreatePool(params.scanThreads)) {
+            default_ = new FaceGallery(params, pool_);
+            params_ = params;
+            params_.featureDim = default_->Dim();
+            partitions_.store(new PartitionMap());
         }
 
-        ~Impl() = default;
+        ~Impl() {
+            delete partitions_.load();
+            delete default_;
+        }
 
-        int Find(std::vector<std::string> &names) const {
-            names.clear();
-            for (auto const &line : db_) {
-                names.emplace_back(line.first);
+        int Update(const FaceDatabaseParams &params) {
+            if (params.scanThreads < 0) {
+                std::cout << "invalid scan threads " << params.scanThreads << std::endl;
+                return ErrorCode::DATABASE_UPDATE_ERROR;
             }
-            return names.empty() ? ErrorCode::EMPTY_DATA_ERROR : 0;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::shared_ptr<ScanPool> pool = pool_;
+            if ((pool ? pool->Threads() : 1) != ScanThreads(params.scanThreads)) {
+                pool = CreatePool(params.scanThreads);
+            }
+            int flag = default_->Update(params, pool);
+            if (flag != 0) {
+                return flag;
+            }
+            params_ = params;
+            pool_ = pool;
+            for (const auto &partition : *partitions_.load()) {
+                partition.second->Update(params_, pool_);
+            }
+            return 0;
         }
 
-        int Save(StreamWriter &writer) const {
-            const uint64_t num_faces = db_.size();
-            const uint64_t dim_feat = kFaceFeatureDim;
-            const uint64_t dim_name = kFaceNameDim;
+        //! Every gallery using the ivfpq index is trained on the samples
+        int TrainIndex(const float *samples, int num_samples) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            int flag = default_->TrainIndex(samples, num_samples);
+            for (const auto &partition : *partitions_.load()) {
+                if (flag != 0) break;
+                flag = partition.second->TrainIndex(samples, num_samples);
+            }
+            return flag;
+        }
 
-            Write(writer, num_faces);
-            for (auto &line : db_) {
-                auto &name = line.first;
-                auto &feat = line.second;
+        int Save(const std::string &dir) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return SaveAll(dir, false);
+        }
 
-                char name_arr[kFaceNameDim];
-                sprintf(name_arr, "%s", name.c_str());
+        int Sync(const std::string &dir) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return SaveAll(dir, true);
+        }
 
-                Write(writer, name_arr, size_t(dim_name));
-                Write(writer, &feat[0], size_t(dim_feat));
+        //! Fold the journals into the base files, new partitions are saved in full
+        int Compact() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (dir_.empty()) {
+                std::cout << "face database was neither loaded nor saved." << std::endl;
+                return ErrorCode::UNINITIALIZED_ERROR;
+            }
+            const std::string dir = dir_;
+            return SaveAll(dir, false);
+        }
 
+        int Load(const std::string &dir) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            int flag = default_->Load(dir);
+            if (flag != 0) {
+                return flag;
             }
 
-            std::cout << "FaceDatabase Saved " << num_faces << " faces" << std::endl;
+            std::vector<std::string> names;
+            ReadManifest(dir, names);
+            PartitionMap *next = new PartitionMap();
+            for (const std::string &name : names) {
+                std::shared_ptr<FaceGallery> gallery = std::make_shared<FaceGallery>(params_, pool_);
+                (*next)[name] = gallery;
+                flag = gallery->Load(PartitionDir(dir, name));
+                if (flag != 0) {
+                    std::cout << "Load partition " << name << " failed." << std::endl;
+                    break;
+                }
+            }
+            if (flag != 0) {
+                delete next;
+                return flag;
+            }
+            ReplacePartitions(next);
+            dir_ = dir;
+            manifest_dirty_ = false;
             return 0;
         }
 
-        int Load(StreamReader &reader) {
-            uint64_t num_faces = 0;
-            const uint64_t dim_feat = kFaceFeatureDim;
-            const uint64_t dim_name = kFaceNameDim;
+        int64_t Insert(const std::string &partition, const std::string &name, const std::vector<float> &feat) {
+            if (feat.size() != static_cast<size_t>(default_->Dim())) {
+                return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+            }
+            return WritePartition(partition, [&](FaceGallery &gallery) {
+                return gallery.Insert(name, feat);
+            });
+        }
 
-            Read(reader, num_faces);
-            std::cout << "number faces is: " << num_faces << std::endl;
+        int InsertBatch(const std::string &partition, const float *feats, const std::vector<std::string> &names) {
+            if (!feats || names.empty()) {
+                return ErrorCode::EMPTY_INPUT_ERROR;
+            }
+            return static_cast<int>(WritePartition(partition, [&](FaceGallery &gallery) {
+                return gallery.InsertBatch(feats, names);
+            }));
+        }
 
-            db_.clear();
-            max_index_ = -1;
+        int Delete(const std::string &partition, const std::string &name) {
+            return ReadPartition(partition, [&](FaceGallery &gallery) {
+                return gallery.Delete(name);
+            });
+        }
 
-            for (size_t i = 0; i < num_faces; ++i) {
-                char name_arr[kFaceNameDim];
-                Read(reader, name_arr, size_t(dim_name));
-                std::cout << "name is: " << name_arr << std::endl;
+        //! Clear the default gallery and drop every partition
+        void Clear() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            default_->Clear();
+            if (!partitions_.load()->empty()) {
+                ReplacePartitions(new PartitionMap());
+                manifest_dirty_ = true;
+            }
+        }
 
-                std::vector<float> feat(kFaceFeatureDim);
-                Read(reader, &feat[0], size_t(dim_feat));
+        inline int Dim() const { return default_->Dim(); }
 
-                db_.insert(std::make_pair(std::string(name_arr), feat));
-                max_index_ = (max_index_ > i ? max_index_ : i);
+        bool IsEmpty() const {
+            if (!default_->IsEmpty()) {
+                return false;
             }
-            ++max_index_;
+            RcuReadGuard guard(rcu_);
+            for (const auto &partition : *partitions_.load()) {
+                if (!partition.second->IsEmpty()) {
+                    return false;
+                }
+            }
+            return true;
+        }
 
-            std::cout << "FaceDatabase Loaded " << num_faces << " faces" << std::endl;
+        int Find(const std::string &partition, std::vector<std::string> &names) const {
+            names.clear();
+            return ReadPartition(partition, [&](FaceGallery &gallery) {
+                return gallery.Find(names);
+            });
+        }
 
-            return 0;
+        int QueryTop(const std::string &partition, const std::vector<float> &feat, QueryResult &query_result) const {
+            const int flag = ReadPartition(partition, [&](FaceGallery &gallery) {
+                return gallery.QueryTop(feat, query_result);
+            });
+            if (flag == ErrorCode::NOT_FOUND_ERROR) {
+                query_result.name_ = "unknown";
+                query_result.sim_ = 0;
+            }
+            return flag;
         }
 
+        int QueryTopK(const std::string &partition, const std::vector<float> &feat, int k, float min_sim,
+                      std::vector<QueryResult> &query_results) const {
+            query_results.clear();
+            return ReadPartition(partition, [&](FaceGallery &gallery) {
+                return gallery.QueryTopK(feat, k, min_sim, query_results);
+            });
+        }
 
-        int64_t Insert(const std::string &name, const std::vector<float> &feat) {
-            if (feat.size() != kFaceFeatureDim) {
-                return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+        int QueryBatch(const std::string &partition, const float *probes, int num_probes, int k, float min_sim,
+                       std::vector<std::vector<QueryResult>> &query_results) const {
+            query_results.clear();
+            return ReadPartition(partition, [&](FaceGallery &gallery) {
+                return gallery.QueryBatch(probes, num_probes, k, min_sim, query_results);
+            });
+        }
+
+        int Export(const std::string &partition, StreamWriter &writer, const FaceDatabaseVersion &since,
+                   FaceDatabaseVersion &exported) const {
+            if (partition.empty()) {
+                return default_->Export(writer, since, exported);
+            }
+            const std::shared_ptr<FaceGallery> gallery = Pin(partition);
+            if (!gallery) {
+                return ErrorCode::NOT_FOUND_ERROR;
             }
+            return gallery->Export(writer, since, exported);
+        }
 
-            int64_t new_index = max_index_;
-            if (db_.find(name) == db_.end()) {
-                ++max_index_;
-                db_.insert(std::make_pair(name, feat));
-            } else {
-                db_[name] = feat;
-                std::cout << "update " << name << "face feature" << std::endl;
+        int Import(const std::string &partition, StreamReader &reader, FaceDatabaseVersion &imported) {
+            if (partition.empty()) {
+                return default_->Import(reader, imported);
+            }
+            std::shared_ptr<FaceGallery> gallery = Pin(partition);
+            while (!gallery) {
+                const int flag = CreatePartition(partition);
+                if (flag != 0) {
+                    return flag;
+                }
+                gallery = Pin(partition);
             }
-            std::cout << "new index is: " << new_index << std::endl;
-            return new_index;
+            return gallery->Import(reader, imported);
         }
 
-        int Delete(const std::string &name) {
-            auto it = db_.find(name);
-            if (it != db_.end()) {
-                db_.erase(it);
-                std::cout << "Delete: " << name << " successfully." << std::endl;
-            } else {
+        //! Remove a partition with its faces, its files stay on disk until the manifest is written over
+        int DropPartition(const std::string &partition) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const PartitionMap &current = *partitions_.load();
+            auto it = current.find(partition);
+            if (it == current.end()) {
                 return ErrorCode::NOT_FOUND_ERROR;
             }
+            PartitionMap *next = new PartitionMap(current);
+            next->erase(partition);
+            ReplacePartitions(next);
+            manifest_dirty_ = true;
+            std::cout << "Drop partition: " << partition << " successfully." << std::endl;
             return 0;
         }
 
-        void Clear() {
-            db_.clear();
-            max_index_ = 0;
-            std::cout << "Clear face database successfully." << std::endl;
+        int ListPartitions(std::vector<std::string> &partitions) const {
+            partitions.clear();
+            {
+                RcuReadGuard guard(rcu_);
+                for (const auto &partition : *partitions_.load()) {
+                    partitions.push_back(partition.first);
+                }
+            }
+            return partitions.empty() ? ErrorCode::EMPTY_DATA_ERROR : 0;
         }
 
-        bool IsEmpty() const { return db_.empty(); }
+    private:
+        //! sorted by name, ListPartitions and the manifest come out in order
+        typedef std::map<std::string, std::shared_ptr<FaceGallery>> PartitionMap;
+
+        static int ScanThreads(int scan_threads) {
+            return scan_threads > 0 ? scan_threads : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        }
 
-        static float CalculateSimilarity(const std::vector<float> &feat1, const std::vector<float> &feat2) {
-            double dot = 0;
-            double norm1 = 0;
-            double norm2 = 0;
-            for (size_t i = 0; i < kFaceFeatureDim; ++i) {
-                dot += feat1[i] * feat2[i];
-                norm1 += feat1[i] * feat1[i];
-                norm2 += feat2[i] * feat2[i];
+        //! Threads shared by the exact scans of every gallery, none for a single thread
+        static std::shared_ptr<ScanPool> CreatePool(int scan_threads) {
+            if (scan_threads < 0 || ScanThreads(scan_threads) == 1) {
+                return nullptr;
             }
-            return static_cast<float>(dot / (sqrt(norm1 * norm2) + 1e-5));
+            return std::make_shared<ScanPool>(ScanThreads(scan_threads));
         }
 
-        static float Compare(const std::vector<float> &feat1, const std::vector<float> &feat2) {
-            if (feat1.empty() || feat2.empty()) {
-                return 0.0f;
+        //! Partition names become directory names, so they are restricted to [A-Za-z0-9_.-] without a leading dot
+        static bool IsValidName(const std::string &name) {
+            if (name.empty() || name[0] == '.') {
+                return false;
+            }
+            for (char c : name) {
+                if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-' && c != '.') {
+                    return false;
+                }
             }
-            return CalculateSimilarity(feat1, feat2);
+            return true;
         }
 
-        int QueryTop(const std::vector<float> &feat, QueryResult &query_result) const {
-            if (db_.empty()) {
-                query_result.name_ = "unknown";
-                query_result.sim_ = 0;
-                return ErrorCode::EMPTY_DATA_ERROR;
+        static inline std::string PartitionDir(const std::string &dir, const std::string &name) {
+            return dir + "/partitions/" + name;
+        }
+
+        //! Gallery of 'partition' in the published map, the caller is inside a read section of 'rcu_'
+        inline FaceGallery *Lookup(const std::string &partition) const {
+            const PartitionMap &partitions = *partitions_.load();
+            auto it = partitions.find(partition);
+            return it == partitions.end() ? nullptr : it->second.get();
+        }
+
+        //! Gallery of 'partition' kept alive past the read section, even if the partition is dropped meanwhile
+        std::shared_ptr<FaceGallery> Pin(const std::string &partition) const {
+            RcuReadGuard guard(rcu_);
+            const PartitionMap &partitions = *partitions_.load();
+            auto it = partitions.find(partition);
+            return it == partitions.end() ? nullptr : it->second;
+        }
+
+        //! Run 'call' on the gallery of 'partition', the empty name is the default gallery
+        template<typename Call>
+        int ReadPartition(const std::string &partition, Call call) const {
+            if (partition.empty()) {
+                return call(*default_);
+            }
+            RcuReadGuard guard(rcu_);
+            FaceGallery *gallery = Lookup(partition);
+            if (!gallery) {
+                return ErrorCode::NOT_FOUND_ERROR;
             }
+            return call(*gallery);
+        }
 
-            std::vector<std::pair<std::string, float>> result(db_.size());
-            {
-                std::size_t i = 0;
-                for (auto &line : db_) {
-                    result[i].first = line.first;
-                    result[i].second = Compare(feat, line.second);
-                    i++;
+        //! Run 'call' on the gallery of 'partition', which is created if it does not exist yet
+        template<typename Call>
+        int64_t WritePartition(const std::string &partition, Call call) {
+            if (partition.empty()) {
+                return call(*default_);
+            }
+            for (;;) {
+                {
+                    RcuReadGuard guard(rcu_);
+                    FaceGallery *gallery = Lookup(partition);
+                    if (gallery) {
+                        return call(*gallery);
+                    }
+                }
+                // created outside of the read section, publishing the map waits for the readers
+                const int flag = CreatePartition(partition);
+                if (flag != 0) {
+                    return flag;
                 }
             }
+        }
 
-            if (result.empty()) {
-                query_result.name_ = "unknown";
-                query_result.sim_ = 0;
-                return ErrorCode::EMPTY_DATA_ERROR;
+        int CreatePartition(const std::string &partition) {
+            if (!IsValidName(partition)) {
+                std::cout << "invalid partition name: " << partition << std::endl;
+                return ErrorCode::DATABASE_UPDATE_ERROR;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            const PartitionMap &current = *partitions_.load();
+            if (current.count(partition) > 0) {
+                return 0;
             }
+            PartitionMap *next = new PartitionMap(current);
+            (*next)[partition] = std::make_shared<FaceGallery>(params_, pool_);
+            ReplacePartitions(next);
+            manifest_dirty_ = true;
+            std::cout << "Create partition: " << partition << std::endl;
+            return 0;
+        }
 
-            std::partial_sort(result.begin(), result.begin() + 1, result.end(), [](
-                    const std::pair<std::string, float> &a, const std::pair<std::string, float> &b) -> bool {
-                return a.second > b.second;
-            });
+        /// \brief Publish 'next' and free the replaced map once no reader holds it. A gallery left out of
+        /// 'next' goes with it, unless an export or import still pins it. The caller holds 'mutex_'.
+        void ReplacePartitions(PartitionMap *next) {
+            PartitionMap *previous = partitions_.exchange(next);
+            rcu_.Synchronize();
+            delete previous;
+        }
 
-            query_result.name_ = result[0].first;
-            query_result.sim_ = result[0].second;
+        /// \brief Save or sync every gallery into 'dir', then list the partitions in the manifest. Syncing
+        /// only writes the manifest again after a partition was created or dropped.
+        int SaveAll(const std::string &dir, bool sync) {
+            int flag = sync ? default_->Sync(dir) : default_->Save(dir);
+            if (flag != 0) {
+                return flag;
+            }
+            const PartitionMap &partitions = *partitions_.load();
+            if (!partitions.empty() && !MakeDirectory(dir + "/partitions")) {
+                std::cout << "Create directory failed: " << dir << "/partitions" << std::endl;
+                return ErrorCode::DATABASE_UPDATE_ERROR;
+            }
+            for (const auto &partition : partitions) {
+                const std::string partition_dir = PartitionDir(dir, partition.first);
+                if (!MakeDirectory(partition_dir)) {
+                    std::cout << "Create directory failed: " << partition_dir << std::endl;
+                    return ErrorCode::DATABASE_UPDATE_ERROR;
+                }
+                flag = sync ? partition.second->Sync(partition_dir) : partition.second->Save(partition_dir);
+                if (flag != 0) {
+                    return flag;
+                }
+            }
+            if (!sync || manifest_dirty_ || dir_ != dir) {
+                flag = WriteManifest(dir, partitions);
+                if (flag != 0) {
+                    return flag;
+                }
+            }
+            dir_ = dir;
+            manifest_dirty_ = false;
+            return 0;
+        }
 
+        //! Replace the manifest through a temporary file, a crash leaves the previous list behind
+        static int WriteManifest(const std::string &dir, const PartitionMap &partitions) {
+            const std::string path = dir + "/partitions.list";
+            if (partitions.empty()) {
+                // a database without partitions keeps the layout it had before they existed
+                std::remove(path.c_str());
+                return 0;
+            }
+            const std::string tmp_path = path + ".tmp";
+            {
+                std::ofstream ofile(tmp_path.c_str(), std::ios::out | std::ios::trunc);
+                if (!ofile.is_open()) {
+                    std::cout << "Open partition list failed: " << tmp_path << std::endl;
+                    return ErrorCode::DATABASE_UPDATE_ERROR;
+                }
+                for (const auto &partition : partitions) {
+                    ofile << partition.first << "\n";
+                }
+                ofile.flush();
+                if (!ofile.good()) {
+                    std::cout << "Write partition list failed: " << tmp_path << std::endl;
+                    return ErrorCode::DATABASE_UPDATE_ERROR;
+                }
+            }
+            std::remove(path.c_str());
+            if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+                std::cout << "Replace partition list failed: " << path << std::endl;
+                return ErrorCode::DATABASE_UPDATE_ERROR;
+            }
             return 0;
         }
 
+        //! A database saved without partitions has no manifest
+        static void ReadManifest(const std::string &dir, std::vector<std::string> &names) {
+            std::ifstream ifile((dir + "/partitions.list").c_str());
+            std::string name;
+            while (std::getline(ifile, name)) {
+                if (IsValidName(name)) {
+                    names.push_back(name);
+                }
+            }
+        }
 
-    private:
-        std::map<int64_t, std::vector<float>> features_db_;
-        std::map<int64_t, std::string> names_db_;
-        std::map<std::string, std::vector<float>> db_;
-        int64_t max_index_ = 0;
+        FaceGallery *default_ = nullptr;
+        //! the partitions read by the queries, replaced under 'mutex_' only
+        std::atomic<PartitionMap *> partitions_;
+        mutable RcuDomain rcu_;
+
+        // guards creating, dropping, loading and saving partitions
+        std::mutex mutex_;
+        FaceDatabaseParams params_;
+        std::shared_ptr<ScanPool> pool_;
+        //! directory last loaded or saved, and whether its manifest misses a partition change
+        std::string dir_;
+        bool manifest_dirty_ = false;
     };
 
     FaceDatabase::FaceDatabase() {
-        impl_ = new FaceDatabase::Impl();
+        impl_ = new FaceDatabase::Impl(FaceDatabaseParams());
+    }
+
+    FaceDatabase::FaceDatabase(const FaceDatabaseParams &params) {
+        impl_ = new FaceDatabase::Impl(params);
+    }
+
+    int FaceDatabase::Update(const FaceDatabaseParams &params) {
+        return impl_->Update(params);
+    }
+
+    int FaceDatabase::TrainIndex(const float *samples, int n) {
+        return impl_->TrainIndex(samples, n);
     }
 
     FaceDatabase::~FaceDatabase() {
@@ -181,48 +2413,121 @@ namespace mirror {
     }
 
     int FaceDatabase::Save(const char *path) const {
-        std::cout << "start save data." << std::endl;
-        std::string db_name = std::string(path) + "/db";
-        FileWriter ofile(db_name, FileWriter::Binary);
-        if (!ofile.is_opened()) {
-            std::cout << "Open database failed (file not found)." << std::endl;
-            return ErrorCode::NOT_FOUND_ERROR;
-        }
-        return impl_->Save(ofile);
+        return impl_->Save(path);
+    }
+
+    int FaceDatabase::Sync(const char *path) {
+        return impl_->Sync(path);
+    }
+
+    int FaceDatabase::Compact() {
+        return impl_->Compact();
     }
 
     int FaceDatabase::Load(const char *path) {
-        std::string db_name = std::string(path) + "/db";
-        FileReader ifile(db_name, FileWriter::Binary);
-        if (!ifile.is_opened()) {
-            std::cout << "Open database failed (file not found)." << std::endl;
-            return ErrorCode::NOT_FOUND_ERROR;
-        }
-        return impl_->Load(ifile);
+        return impl_->Load(path);
     }
 
     int64_t FaceDatabase::Insert(const std::vector<float> &feat, const std::string &name) {
-        return impl_->Insert(name, feat);
+        return impl_->Insert(std::string(), name, feat);
     }
 
     int FaceDatabase::Delete(const std::string &name) {
-        return impl_->Delete(name);
+        return impl_->Delete(std::string(), name);
     }
 
     int FaceDatabase::QueryTop(const std::vector<float> &feat, QueryResult &query_result) const {
-        return impl_->QueryTop(feat, query_result);
+        return impl_->QueryTop(std::string(), feat, query_result);
+    }
+
+    int FaceDatabase::QueryTopK(const std::vector<float> &feat, int k, float min_sim,
+                                std::vector<QueryResult> &query_results) const {
+        return impl_->QueryTopK(std::string(), feat, k, min_sim, query_results);
+    }
+
+    int FaceDatabase::QueryBatch(const float *probes, int n, int k, float min_sim,
+                                 std::vector<std::vector<QueryResult>> &query_results) const {
+        return impl_->QueryBatch(std::string(), probes, n, k, min_sim, query_results);
     }
 
     void FaceDatabase::Clear() {
         impl_->Clear();
+        std::cout << "Clear face database successfully." << std::endl;
     }
 
     bool FaceDatabase::IsEmpty() const {
         return impl_->IsEmpty();
     }
 
+    int FaceDatabase::Dim() const {
+        return impl_->Dim();
+    }
+
     int FaceDatabase::Find(std::vector<std::string> &names) const {
-        return impl_->Find(names);
+        return impl_->Find(std::string(), names);
+    }
+
+    int64_t FaceDatabase::Insert(const std::string &partition, const std::vector<float> &feat,
+                                 const std::string &name) {
+        return impl_->Insert(partition, name, feat);
+    }
+
+    int FaceDatabase::InsertBatch(const float *feats, const std::vector<std::string> &names) {
+        return impl_->InsertBatch(std::string(), feats, names);
+    }
+
+    int FaceDatabase::InsertBatch(const std::string &partition, const float *feats,
+                                  const std::vector<std::string> &names) {
+        return impl_->InsertBatch(partition, feats, names);
+    }
+
+    int FaceDatabase::Delete(const std::string &partition, const std::string &name) {
+        return impl_->Delete(partition, name);
+    }
+
+    int FaceDatabase::Find(const std::string &partition, std::vector<std::string> &names) const {
+        return impl_->Find(partition, names);
+    }
+
+    int FaceDatabase::QueryTop(const std::string &partition, const std::vector<float> &feat,
+                               QueryResult &query_result) const {
+        return impl_->QueryTop(partition, feat, query_result);
+    }
+
+    int FaceDatabase::QueryTopK(const std::string &partition, const std::vector<float> &feat, int k, float min_sim,
+                                std::vector<QueryResult> &query_results) const {
+        return impl_->QueryTopK(partition, feat, k, min_sim, query_results);
+    }
+
+    int FaceDatabase::QueryBatch(const std::string &partition, const float *probes, int n, int k, float min_sim,
+                                 std::vector<std::vector<QueryResult>> &query_results) const {
+        return impl_->QueryBatch(partition, probes, n, k, min_sim, query_results);
+    }
+
+    int FaceDatabase::Export(StreamWriter &writer, const FaceDatabaseVersion &since,
+                             FaceDatabaseVersion &exported) const {
+        return impl_->Export(std::string(), writer, since, exported);
+    }
+
+    int FaceDatabase::Import(StreamReader &reader, FaceDatabaseVersion &imported) {
+        return impl_->Import(std::string(), reader, imported);
+    }
+
+    int FaceDatabase::Export(const std::string &partition, StreamWriter &writer, const FaceDatabaseVersion &since,
+                             FaceDatabaseVersion &exported) const {
+        return impl_->Export(partition, writer, since, exported);
+    }
+
+    int FaceDatabase::Import(const std::string &partition, StreamReader &reader, FaceDatabaseVersion &imported) {
+        return impl_->Import(partition, reader, imported);
+    }
+
+    int FaceDatabase::DropPartition(const std::string &partition) {
+        return impl_->DropPartition(partition);
+    }
+
+    int FaceDatabase::ListPartitions(std::vector<std::string> &partitions) const {
+        return impl_->ListPartitions(partitions);
     }
 
 }
@@ -10,21 +10,89 @@
 
 namespace mirror {
 
+/// \brief Position in the history of a gallery, returned by Export and Import. A new history starts when the
+/// gallery is cleared or loaded from another base file, loading the same base and journal again resumes it.
+/// Versions of different histories are never compared, an export since one of them streams the whole gallery.
+struct FaceDatabaseVersion {
+	uint64_t epoch = 0;
+	int64_t version = -1;
+};
+
+/// \brief Gallery of registered faces. Any number of threads may query while others modify it: queries
+/// read an immutable snapshot of the gallery without locking, modifications are serialized and publish
+/// the next snapshot atomically. Updating the feature of a registered face gives it a new id.
+/// Faces are registered in the default gallery or in named partitions, e.g. one per site. Every partition
+/// has its own storage and index, so a query scoped to a partition never reads the rows of another one.
+/// A partition is created by its first Insert, named with [A-Za-z0-9_.-] only and not starting with a dot;
+/// the empty name designates the default gallery. Save, Sync, Load and Compact cover all partitions.
 class FaceDatabase {
 public:
     FaceDatabase(const FaceDatabase &other) = delete;
     const FaceDatabase &operator=(const FaceDatabase &other) = delete;
 	FaceDatabase();
+	explicit FaceDatabase(const FaceDatabaseParams& params);
 	~FaceDatabase();
 
+	//! Switch index type or tune it, the index is rebuilt from the stored features when needed.
+	//! The feature dimension is fixed by the constructor, Update fails for another one
+	int Update(const FaceDatabaseParams& params);
+	//! Train the IVFPQ codebooks on n representative features (n * Dim() contiguous floats)
+	int TrainIndex(const float* samples, int n);
+
+	//! Clear the default gallery and drop every partition
 	void Clear();
+	//! True when neither the default gallery nor a partition holds a face
 	bool IsEmpty() const;
+	//! Dimension of the features it stores and queries with
+	int Dim() const;
+	//! Map 'path'/db in place (v2 format), a legacy database is read into memory instead
 	int Load(const char* path);
+	//! Always writes the v2 format, loading a legacy database and saving it converts it
 	int Save(const char* path) const;
+	/// \brief Make every change durable in 'path' at O(1) cost: Insert / Delete / Clear after Load or Save
+	/// are appended to 'path'/db.journal, Sync fsyncs them. A database not journaled in 'path' is saved
+	/// in full, so is one whose journal grew large enough to be folded into the base file.
+	int Sync(const char* path);
+	//! Fold the journal into the base file of the directory last loaded or saved
+	int Compact();
 	int Delete(const std::string& name);
 	int Find(std::vector<std::string>& names) const;
 	int64_t Insert(const std::vector<float>& feat, const std::string& name);
+	//! Insert names.size() faces (names.size() * Dim() contiguous floats) as one change the queries see at once
+	int InsertBatch(const float* feats, const std::vector<std::string>& names);
 	int QueryTop(const std::vector<float>& feat, QueryResult& query_result) const;
+	//! The (at most) k best matches with similarity >= min_sim, sorted by descending similarity
+	int QueryTopK(const std::vector<float>& feat, int k, float min_sim,
+	              std::vector<QueryResult>& query_results) const;
+	//! Top-K of n probes (n * Dim() contiguous floats) scored in one blocked pass over the gallery
+	int QueryBatch(const float* probes, int n, int k, float min_sim,
+	               std::vector<std::vector<QueryResult>>& query_results) const;
+	/// \brief Write the gallery to 'writer' as a stream of crc32c checked chunks for Import on another host.
+	/// Only the changes after 'since', the version an earlier stream brought the importer to, are written
+	/// while the gallery remembers them, the whole gallery otherwise. 'exported' is the version streamed.
+	int Export(StreamWriter& writer, const FaceDatabaseVersion& since, FaceDatabaseVersion& exported) const;
+	/// \brief Apply a stream of Export, 'imported' is the version of the exporter it brings the gallery to.
+	/// A corrupted or truncated stream fails with DATA_CORRUPTED_ERROR once the records of the chunks
+	/// verified before it are applied; importing again from the previous version completes it.
+	int Import(StreamReader& reader, FaceDatabaseVersion& imported);
+
+	// the same operations scoped to a partition, NOT_FOUND_ERROR for a partition which does not exist
+	int64_t Insert(const std::string& partition, const std::vector<float>& feat, const std::string& name);
+	int InsertBatch(const std::string& partition, const float* feats, const std::vector<std::string>& names);
+	int Delete(const std::string& partition, const std::string& name);
+	int Find(const std::string& partition, std::vector<std::string>& names) const;
+	int QueryTop(const std::string& partition, const std::vector<float>& feat, QueryResult& query_result) const;
+	int QueryTopK(const std::string& partition, const std::vector<float>& feat, int k, float min_sim,
+	              std::vector<QueryResult>& query_results) const;
+	int QueryBatch(const std::string& partition, const float* probes, int n, int k, float min_sim,
+	               std::vector<std::vector<QueryResult>>& query_results) const;
+	int Export(const std::string& partition, StreamWriter& writer, const FaceDatabaseVersion& since,
+	           FaceDatabaseVersion& exported) const;
+	int Import(const std::string& partition, StreamReader& reader, FaceDatabaseVersion& imported);
+	//! Remove a partition and its faces, the next Save or Sync drops it from the database directory
+	int DropPartition(const std::string& partition);
+	//! Names of the partitions, sorted
+	int ListPartitions(std::vector<std::string>& partitions) const;
 
 
 private:
@@ -0,0 +1,213 @@
+#include "FeatureMatrix.h"
+#include "./kernels/SimilarityKernels.h"
+#include "./kernels/QuantizedKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mirror {
+    static size_t CodeStride(FaceStorageType type, int dim) {
+        size_t bytes = 0;
+        if (type == FaceStorageType::FP16_STORAGE) {
+            bytes = static_cast<size_t>(dim) * sizeof(uint16_t);
+        } else if (type == FaceStorageType::INT8_STORAGE) {
+            bytes = static_cast<size_t>(dim) * sizeof(int8_t);
+        }
+        return (bytes + 63) / 64 * 64;
+    }
+
+    FeatureMatrix::FeatureMatrix(int dim) :
+            dim_(dim), stride_(AlignedFeatureDim(dim)) {
+    }
+
+    void FeatureMatrix::SetStorage(FaceStorageType type, bool keep_float) {
+        keep_float = keep_float && type != FaceStorageType::FLOAT32_STORAGE;
+        if (type == type_ && keep_float == keep_float_) return;
+
+        // decode what is stored, precision dropped by a previous quantization is not recovered
+        AlignedVector<float> rows(num_rows_ * stride_, 0.0f);
+        for (size_t row = 0; row < num_rows_; ++row) {
+            const float *feat = Row(row, rows.data() + row * stride_);
+            if (feat != rows.data() + row * stride_) {
+                std::copy(feat, feat + stride_, rows.data() + row * stride_);
+            }
+        }
+
+        const size_t num_rows = num_rows_;
+        Release();
+        type_ = type;
+        keep_float_ = keep_float;
+        code_stride_ = CodeStride(type_, dim_);
+        Resize(num_rows);
+        for (size_t row = 0; row < num_rows; ++row) {
+            Set(row, rows.data() + row * stride_);
+        }
+    }
+
+    void FeatureMatrix::Map(const float *rows, size_t num_rows) {
+        Release();
+        num_rows_ = num_rows;
+        if (IsQuantized()) {
+            codes_.resize(num_rows * code_stride_);
+            if (type_ == FaceStorageType::INT8_STORAGE) {
+                scales_.resize(num_rows);
+            }
+            for (size_t row = 0; row < num_rows; ++row) {
+                Encode(row, rows + row * stride_);
+            }
+        }
+        if (HasFloat()) {
+            mapped_ = rows;
+        }
+    }
+
+    void FeatureMatrix::Detach() {
+        if (!mapped_) return;
+        floats_.assign(mapped_, mapped_ + num_rows_ * stride_);
+        mapped_ = nullptr;
+    }
+
+    void FeatureMatrix::Reserve(size_t num_rows) {
+        Detach();
+        if (HasFloat()) {
+            floats_.reserve(num_rows * stride_);
+        }
+        if (IsQuantized()) {
+            codes_.reserve(num_rows * code_stride_);
+        }
+        if (type_ == FaceStorageType::INT8_STORAGE) {
+            scales_.reserve(num_rows);
+        }
+    }
+
+    void FeatureMatrix::Resize(size_t num_rows) {
+        Detach();
+        if (HasFloat()) {
+            floats_.resize(num_rows * stride_, 0.0f);
+        }
+        if (IsQuantized()) {
+            codes_.resize(num_rows * code_stride_, 0);
+        }
+        if (type_ == FaceStorageType::INT8_STORAGE) {
+            scales_.resize(num_rows, 0.0f);
+        }
+        num_rows_ = num_rows;
+    }
+
+    void FeatureMatrix::Clear() {
+        mapped_ = nullptr;
+        floats_.clear();
+        codes_.clear();
+        scales_.clear();
+        num_rows_ = 0;
+    }
+
+    void FeatureMatrix::Release() {
+        mapped_ = nullptr;
+        AlignedVector<float>().swap(floats_);
+        AlignedVector<uint8_t>().swap(codes_);
+        std::vector<float>().swap(scales_);
+        num_rows_ = 0;
+    }
+
+    void FeatureMatrix::Set(size_t row, const float *normalized) {
+        Detach();
+        if (HasFloat()) {
+            float *dst = floats_.data() + row * stride_;
+            std::copy(normalized, normalized + dim_, dst);
+            std::fill(dst + dim_, dst + stride_, 0.0f);
+        }
+        if (IsQuantized()) {
+            Encode(row, normalized);
+        }
+    }
+
+    void FeatureMatrix::Encode(size_t row, const float *normalized) {
+        uint8_t *code = CodePtr(row);
+        std::memset(code, 0, code_stride_);
+        if (type_ == FaceStorageType::FP16_STORAGE) {
+            FloatToHalf(normalized, reinterpret_cast<uint16_t *>(code), dim_);
+        } else {
+            scales_[row] = QuantizeInt8(normalized, reinterpret_cast<int8_t *>(code), dim_);
+        }
+    }
+
+    void FeatureMatrix::CopyRow(const FeatureMatrix &other, size_t from, size_t to) {
+        if (other.type_ != type_ || other.HasFloat() != HasFloat()) {
+            // re-encode, a row quantized twice with the same scale keeps its codes
+            AlignedVector<float> buffer(static_cast<size_t>(stride_));
+            Set(to, other.Row(from, buffer.data()));
+            return;
+        }
+        Detach();
+        if (HasFloat()) {
+            const float *src = other.FloatData() + from * stride_;
+            std::copy(src, src + stride_, floats_.data() + to * stride_);
+        }
+        if (IsQuantized()) {
+            std::copy(other.CodePtr(from), other.CodePtr(from) + code_stride_, CodePtr(to));
+        }
+        if (type_ == FaceStorageType::INT8_STORAGE) {
+            scales_[to] = other.scales_[from];
+        }
+    }
+
+    const float *FeatureMatrix::Row(size_t row, float *buffer) const {
+        if (HasFloat()) {
+            return FloatData() + row * stride_;
+        }
+        if (type_ == FaceStorageType::FP16_STORAGE) {
+            HalfToFloat(reinterpret_cast<const uint16_t *>(CodePtr(row)), buffer, dim_);
+        } else {
+            DequantizeInt8(reinterpret_cast<const int8_t *>(CodePtr(row)), scales_[row], buffer, dim_);
+        }
+        std::fill(buffer + dim_, buffer + stride_, 0.0f);
+        return buffer;
+    }
+
+    float FeatureMatrix::ExactScore(const float *probe, size_t row) const {
+        if (HasFloat()) {
+            return DotProduct(probe, FloatData() + row * stride_, dim_);
+        }
+        Probe encoded;
+        EncodeProbe(probe, encoded);
+        float score = 0.0f;
+        Score(encoded, row, row + 1, &score);
+        return score;
+    }
+
+    void FeatureMatrix::EncodeProbe(const float *normalized, Probe &probe) const {
+        probe.feat = normalized;
+        if (type_ == FaceStorageType::INT8_STORAGE) {
+            probe.codes.resize(static_cast<size_t>(dim_));
+            probe.scale = QuantizeInt8(normalized, probe.codes.data(), dim_);
+        }
+    }
+
+    void FeatureMatrix::Score(const Probe &probe, size_t begin, size_t end, float *scores) const {
+        if (type_ == FaceStorageType::FP16_STORAGE) {
+            for (size_t row = begin; row < end; ++row) {
+                *scores++ = DotProductFp16(probe.feat, reinterpret_cast<const uint16_t *>(CodePtr(row)), dim_);
+            }
+        } else if (type_ == FaceStorageType::INT8_STORAGE) {
+            for (size_t row = begin; row < end; ++row) {
+                const int32_t dot = DotProductInt8(probe.codes.data(), reinterpret_cast<const int8_t *>(CodePtr(row)), dim_);
+                *scores++ = static_cast<float>(dot) * probe.scale * scales_[row];
+            }
+        } else {
+            const DotProductFunc dot = SelectDotProduct(dim_);
+            const float *row_ptr = FloatData() + begin * stride_;
+            for (size_t row = begin; row < end; ++row, row_ptr += stride_) {
+                *scores++ = dot(probe.feat, row_ptr, dim_);
+            }
+        }
+    }
+
+    size_t FeatureMatrix::BytesPerRow() const {
+        if (!IsQuantized()) {
+            return static_cast<size_t>(stride_) * sizeof(float);
+        }
+        return code_stride_ + (type_ == FaceStorageType::INT8_STORAGE ? sizeof(float) : 0);
+    }
+
+}
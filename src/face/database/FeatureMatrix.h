@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "./kernels/AlignedAllocator.h"
+#include "../../common/common.h"
+
+namespace mirror {
+    /// \brief Row-major matrix of L2 normalized features stored as float32, fp16 or int8.
+    /// int8 rows carry one scale each (symmetric per-vector quantization). Quantized rows
+    /// may keep an exact float copy next to the codes so the best candidates of a scan can
+    /// be re-scored exactly, the scan itself then still streams only the compact codes.
+    class FeatureMatrix {
+    public:
+        //! A probe converted once into the storage precision, reused for every scored row
+        struct Probe {
+            const float *feat = nullptr;
+            std::vector<int8_t> codes;
+            float scale = 0.0f;
+        };
+
+        explicit FeatureMatrix(int dim);
+
+        //! Change the storage precision, the stored rows are re-encoded
+        void SetStorage(FaceStorageType type, bool keep_float);
+
+        inline FaceStorageType GetStorageType() const { return type_; }
+
+        inline size_t Rows() const { return num_rows_; }
+
+        void Reserve(size_t num_rows);
+
+        //! Grow or shrink to 'num_rows', new rows are zero
+        void Resize(size_t num_rows);
+
+        void Clear();
+
+        //! Clear and give the memory back
+        void Release();
+
+        void Set(size_t row, const float *normalized);
+
+        //! Copy row 'from' of 'other' into row 'to', the codes are copied as is when the storage matches
+        void CopyRow(const FeatureMatrix &other, size_t from, size_t to);
+
+        /// \brief Serve the float rows straight from 'rows' (e.g. a mapped file, stride AlignedFeatureDim(dim))
+        /// until the matrix is modified, the rows are copied then. Quantized storage encodes 'rows' and
+        /// only keeps referencing them as the float copy used for re-ranking.
+        void Map(const float *rows, size_t num_rows);
+
+        inline bool IsMapped() const { return mapped_ != nullptr; }
+
+        //! Exact float rows (stride AlignedFeatureDim(dim)) or nullptr when only codes are kept
+        inline const float *FloatData() const {
+            return mapped_ ? mapped_ : (floats_.empty() ? nullptr : floats_.data());
+        }
+
+        inline bool HasFloat() const { return type_ == FaceStorageType::FLOAT32_STORAGE || keep_float_; }
+
+        inline bool IsQuantized() const { return type_ != FaceStorageType::FLOAT32_STORAGE; }
+
+        //! Float view of a row, decoded into 'buffer' (AlignedFeatureDim(dim) floats) when only codes are kept
+        const float *Row(size_t row, float *buffer) const;
+
+        //! Exact score of a row when float rows are kept, the quantized one otherwise
+        float ExactScore(const float *probe, size_t row) const;
+
+        void EncodeProbe(const float *normalized, Probe &probe) const;
+
+        //! scores[i] = <probe, row begin + i> in the storage precision for rows [begin, end)
+        void Score(const Probe &probe, size_t begin, size_t end, float *scores) const;
+
+        //! Bytes streamed per row by Score
+        size_t BytesPerRow() const;
+
+    private:
+        inline const uint8_t *CodePtr(size_t row) const { return codes_.data() + row * code_stride_; }
+
+        inline uint8_t *CodePtr(size_t row) { return codes_.data() + row * code_stride_; }
+
+        void Encode(size_t row, const float *normalized);
+
+        //! Copy mapped rows into owned memory before they are modified
+        void Detach();
+
+    private:
+        const int dim_;
+        const int stride_;
+        FaceStorageType type_ = FaceStorageType::FLOAT32_STORAGE;
+        bool keep_float_ = false;
+        size_t num_rows_ = 0;
+        //! bytes per code row, padded to a cache line
+        size_t code_stride_ = 0;
+        AlignedVector<float> floats_;
+        const float *mapped_ = nullptr;
+        AlignedVector<uint8_t> codes_;
+        std::vector<float> scales_;
+    };
+
+}
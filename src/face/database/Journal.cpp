@@ -0,0 +1,249 @@
+#include "Journal.h"
+#include "./stream/Crc32c.h"
+#include "../../common/common.h"
+
+#include <cstring>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace mirror {
+    static const uint32_t kJournalMagic = 0x4A424446; // "FDBJ"
+    static const uint32_t kJournalVersion = 1;
+    //! appended records are fsynced at least every kJournalSyncBatch records, even without Sync
+    static const size_t kJournalSyncBatch = 64;
+
+    /// Journal file: header | records, a record is
+    ///   uint32 payload size | uint32 crc32c of the payload | payload: uint8 op, uint32 name size, name, dim floats (insert)
+    struct JournalHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t base_checksum;
+        int32_t dim;
+    };
+
+    static bool SyncFile(FILE *file) {
+        if (std::fflush(file) != 0) return false;
+#if defined(_WIN32)
+        return _commit(_fileno(file)) == 0;
+#else
+        return fsync(fileno(file)) == 0;
+#endif
+    }
+
+    static void EncodeRecord(Journal::Operation op, const std::string &name, const float *feat, int dim,
+                             std::vector<char> &buffer) {
+        const uint32_t name_size = static_cast<uint32_t>(name.size());
+        const uint32_t payload_size = static_cast<uint32_t>(sizeof(uint8_t) + sizeof(name_size) + name.size() +
+                                                            (feat ? sizeof(float) * dim : 0));
+        buffer.resize(2 * sizeof(uint32_t) + payload_size);
+        char *payload = buffer.data() + 2 * sizeof(uint32_t);
+        char *p = payload;
+        *p++ = static_cast<char>(op);
+        std::memcpy(p, &name_size, sizeof(name_size));
+        p += sizeof(name_size);
+        std::memcpy(p, name.data(), name.size());
+        p += name.size();
+        if (feat) {
+            std::memcpy(p, feat, sizeof(float) * dim);
+        }
+        const uint32_t crc = Crc32c(payload, payload_size);
+        std::memcpy(buffer.data(), &payload_size, sizeof(payload_size));
+        std::memcpy(buffer.data() + sizeof(payload_size), &crc, sizeof(crc));
+    }
+
+    //! Parse one record at 'data', returns its size or 0 for a torn or corrupted record
+    static size_t DecodeRecord(const char *data, size_t size, int dim, Journal::Record &record) {
+        uint32_t payload_size = 0;
+        uint32_t crc = 0;
+        if (size < 2 * sizeof(uint32_t)) return 0;
+        std::memcpy(&payload_size, data, sizeof(payload_size));
+        std::memcpy(&crc, data + sizeof(payload_size), sizeof(crc));
+        const char *payload = data + 2 * sizeof(uint32_t);
+        if (payload_size > size - 2 * sizeof(uint32_t) || payload_size < sizeof(uint8_t) + sizeof(uint32_t) ||
+            Crc32c(payload, payload_size) != crc) {
+            return 0;
+        }
+
+        uint32_t name_size = 0;
+        std::memcpy(&name_size, payload + sizeof(uint8_t), sizeof(name_size));
+        const size_t head_size = sizeof(uint8_t) + sizeof(name_size);
+        if (name_size > payload_size - head_size) return 0;
+        record.op = static_cast<Journal::Operation>(static_cast<uint8_t>(payload[0]));
+        record.name.assign(payload + head_size, name_size);
+        record.feat.clear();
+        const size_t feat_size = payload_size - head_size - name_size;
+        if (record.op == Journal::INSERT_RECORD) {
+            if (feat_size != sizeof(float) * dim) return 0;
+            record.feat.resize(static_cast<size_t>(dim));
+            std::memcpy(record.feat.data(), payload + head_size + name_size, feat_size);
+        } else if ((record.op != Journal::DELETE_RECORD && record.op != Journal::CLEAR_RECORD) || feat_size != 0) {
+            return 0;
+        }
+        return 2 * sizeof(uint32_t) + payload_size;
+    }
+
+    int Journal::Open(const std::string &path, uint32_t base_checksum, std::vector<Record> &records) {
+        Close();
+        records.clear();
+
+        std::vector<char> data;
+        FILE *file = std::fopen(path.c_str(), "rb");
+        if (file) {
+            if (std::fseek(file, 0, SEEK_END) == 0) {
+                const long size = std::ftell(file);
+                if (size > 0 && std::fseek(file, 0, SEEK_SET) == 0) {
+                    data.resize(static_cast<size_t>(size));
+                    data.resize(std::fread(data.data(), 1, data.size(), file));
+                }
+            }
+            std::fclose(file);
+        }
+
+        JournalHeader header;
+        std::memset(&header, 0, sizeof(header));
+        if (data.size() >= sizeof(header)) {
+            std::memcpy(&header, data.data(), sizeof(header));
+        }
+        if (header.magic != kJournalMagic || header.version != kJournalVersion ||
+            header.base_checksum != base_checksum || header.dim != dim_) {
+            if (!data.empty()) {
+                std::cout << "journal does not belong to the database, discard it." << std::endl;
+            }
+            return Create(path, base_checksum, records);
+        }
+
+        size_t offset = sizeof(header);
+        Record record;
+        while (offset < data.size()) {
+            const size_t record_size = DecodeRecord(data.data() + offset, data.size() - offset, dim_, record);
+            if (record_size == 0) break;
+            records.push_back(record);
+            offset += record_size;
+        }
+        if (offset != data.size()) {
+            // drop the torn tail, records appended after it could never be replayed
+            std::cout << "journal truncated after " << records.size() << " records." << std::endl;
+            return Create(path, base_checksum, records);
+        }
+
+        file_ = std::fopen(path.c_str(), "ab");
+        if (!file_) {
+            std::cout << "Open journal failed: " << path << std::endl;
+            return ErrorCode::NOT_FOUND_ERROR;
+        }
+        path_ = path;
+        num_records_ = records.size();
+        unsynced_ = 0;
+        return 0;
+    }
+
+    int Journal::Reset(const std::string &path, uint32_t base_checksum) {
+        Close();
+        return Create(path, base_checksum, std::vector<Record>());
+    }
+
+    int Journal::Create(const std::string &path, uint32_t base_checksum, const std::vector<Record> &records) {
+        const std::string tmp_path = path + ".tmp";
+        FILE *file = std::fopen(tmp_path.c_str(), "wb");
+        if (!file) {
+            std::cout << "Open journal failed: " << tmp_path << std::endl;
+            return ErrorCode::NOT_FOUND_ERROR;
+        }
+        JournalHeader header;
+        header.magic = kJournalMagic;
+        header.version = kJournalVersion;
+        header.base_checksum = base_checksum;
+        header.dim = dim_;
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        std::vector<char> buffer;
+        for (size_t i = 0; ok && i < records.size(); ++i) {
+            const Record &record = records[i];
+            EncodeRecord(record.op, record.name, record.feat.empty() ? nullptr : record.feat.data(), dim_, buffer);
+            ok = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        }
+        ok = SyncFile(file) && ok;
+        std::fclose(file);
+        if (!ok) {
+            std::cout << "Write journal failed: " << tmp_path << std::endl;
+            return ErrorCode::NOT_FOUND_ERROR;
+        }
+
+#if defined(_WIN32)
+        std::remove(path.c_str());
+#endif
+        if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            std::cout << "Replace journal failed: " << path << std::endl;
+            return ErrorCode::NOT_FOUND_ERROR;
+        }
+
+        file_ = std::fopen(path.c_str(), "ab");
+        if (!file_) {
+            std::cout << "Open journal failed: " << path << std::endl;
+            return ErrorCode::NOT_FOUND_ERROR;
+        }
+        path_ = path;
+        num_records_ = records.size();
+        unsynced_ = 0;
+        return 0;
+    }
+
+    void Journal::Close() {
+        if (!file_) return;
+        Sync();
+        std::fclose(file_);
+        file_ = nullptr;
+        path_.clear();
+        num_records_ = 0;
+        unsynced_ = 0;
+    }
+
+    int Journal::AppendInsert(const std::string &name, const float *feat) {
+        return Append(INSERT_RECORD, name, feat);
+    }
+
+    int Journal::AppendDelete(const std::string &name) {
+        return Append(DELETE_RECORD, name, nullptr);
+    }
+
+    int Journal::AppendClear() {
+        return Append(CLEAR_RECORD, std::string(), nullptr);
+    }
+
+    int Journal::Append(Operation op, const std::string &name, const float *feat) {
+        if (!file_) {
+            return ErrorCode::UNINITIALIZED_ERROR;
+        }
+        std::vector<char> buffer;
+        EncodeRecord(op, name, feat, dim_, buffer);
+        if (std::fwrite(buffer.data(), 1, buffer.size(), file_) != buffer.size()) {
+            std::cout << "Append journal failed: " << path_ << std::endl;
+            return ErrorCode::DATABASE_UPDATE_ERROR;
+        }
+        ++num_records_;
+        if (++unsynced_ >= kJournalSyncBatch) {
+            return Sync();
+        }
+        return 0;
+    }
+
+    int Journal::Sync() {
+        if (!file_) {
+            return ErrorCode::UNINITIALIZED_ERROR;
+        }
+        if (unsynced_ == 0) {
+            return 0;
+        }
+        if (!SyncFile(file_)) {
+            std::cout << "Sync journal failed: " << path_ << std::endl;
+            return ErrorCode::DATABASE_UPDATE_ERROR;
+        }
+        unsynced_ = 0;
+        return 0;
+    }
+
+}
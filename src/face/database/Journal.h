@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace mirror {
+    /// \brief Append-only log of the gallery mutations made since the base database file was written.
+    /// The journal names the base it applies to by the checksum of the base header, so a journal left
+    /// behind by an older base is discarded instead of replayed. Every record carries its own crc32c,
+    /// replay stops at the first torn record a crash may have left at the tail.
+    class Journal {
+    public:
+        enum Operation {
+            INSERT_RECORD = 1,
+            DELETE_RECORD = 2,
+            CLEAR_RECORD = 3,
+        };
+
+        struct Record {
+            Operation op;
+            std::string name;
+            //! raw feature of an INSERT_RECORD, empty otherwise
+            std::vector<float> feat;
+        };
+
+        explicit Journal(int dim) : dim_(dim) {
+        }
+
+        Journal(const Journal &other) = delete;
+
+        Journal &operator=(const Journal &other) = delete;
+
+        ~Journal() {
+            Close();
+        }
+
+        /// \brief Open 'path' for appending on top of the base with 'base_checksum'. The records it already
+        /// holds for that base are returned for replay; a journal of another base is started over.
+        int Open(const std::string &path, uint32_t base_checksum, std::vector<Record> &records);
+
+        //! Start an empty journal on top of a freshly written base
+        int Reset(const std::string &path, uint32_t base_checksum);
+
+        //! Sync and close
+        void Close();
+
+        inline bool IsOpened() const { return file_ != nullptr; }
+
+        inline const std::string &Path() const { return path_; }
+
+        //! Records in the journal, replayed by the next Load
+        inline size_t Size() const { return num_records_; }
+
+        int AppendInsert(const std::string &name, const float *feat);
+
+        int AppendDelete(const std::string &name);
+
+        int AppendClear();
+
+        //! Flush the appended records and fsync them, nothing is written when there are none
+        int Sync();
+
+    private:
+        int Append(Operation op, const std::string &name, const float *feat);
+
+        int Create(const std::string &path, uint32_t base_checksum, const std::vector<Record> &records);
+
+    private:
+        const int dim_;
+        std::string path_;
+        FILE *file_ = nullptr;
+        size_t num_records_ = 0;
+        //! records appended since the last fsync
+        size_t unsynced_ = 0;
+    };
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+
+namespace mirror {
+    /// \brief Grace periods for read-copy-update. Readers announce themselves on one of two counters
+    /// without ever blocking; a writer that replaced a shared version waits in Synchronize until every
+    /// reader which may still hold the old version has left, then it may free it. The two counters
+    /// alternate so that readers arriving during the wait never delay it.
+    class RcuDomain {
+    public:
+        RcuDomain() {
+            epoch_.store(0);
+            readers_[0].count.store(0);
+            readers_[1].count.store(0);
+        }
+
+        RcuDomain(const RcuDomain &other) = delete;
+
+        RcuDomain &operator=(const RcuDomain &other) = delete;
+
+        //! Enter a read side section, the returned slot is handed to ReadUnlock
+        inline unsigned ReadLock() {
+            const unsigned slot = epoch_.load() & 1u;
+            readers_[slot].count.fetch_add(1);
+            return slot;
+        }
+
+        inline void ReadUnlock(unsigned slot) {
+            readers_[slot].count.fetch_sub(1);
+        }
+
+        //! Wait for the readers which entered before the call, writers must not call it concurrently
+        void Synchronize() {
+            // a reader may pick its slot before a flip and only count itself after it,
+            // draining both slots once covers that reader whichever slot it ended up in
+            for (int phase = 0; phase < 2; ++phase) {
+                const unsigned slot = epoch_.fetch_add(1) & 1u;
+                while (readers_[slot].count.load() != 0) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        //! one cache line per counter, readers of different slots do not share a line
+        struct Counter {
+            std::atomic<int> count;
+            char padding[64 - sizeof(std::atomic<int>)];
+        };
+
+        std::atomic<unsigned> epoch_;
+        Counter readers_[2];
+    };
+
+    class RcuReadGuard {
+    public:
+        explicit RcuReadGuard(RcuDomain &domain) : domain_(domain), slot_(domain.ReadLock()) {
+        }
+
+        RcuReadGuard(const RcuReadGuard &other) = delete;
+
+        RcuReadGuard &operator=(const RcuReadGuard &other) = delete;
+
+        ~RcuReadGuard() {
+            domain_.ReadUnlock(slot_);
+        }
+
+    private:
+        RcuDomain &domain_;
+        const unsigned slot_;
+    };
+
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace mirror {
+    struct ScoredLabel {
+        float sim_;
+        int64_t label_;
+    };
+
+    //! Bounded min-heap keeping the 'k' best scores seen so far, never holds more than 'k' entries
+    class TopKHeap {
+    public:
+        TopKHeap() = default;
+
+        TopKHeap(int k, float min_sim) {
+            Reset(k, min_sim);
+        }
+
+        void Reset(int k, float min_sim) {
+            k_ = k > 0 ? k : 0;
+            min_sim_ = min_sim;
+            heap_.clear();
+            heap_.reserve(static_cast<size_t>(k_));
+        }
+
+        //! Scores below this value can not enter the heap any more
+        inline float Threshold() const {
+            return static_cast<int>(heap_.size()) < k_ ? min_sim_ : heap_.front().sim_;
+        }
+
+        inline bool Push(float sim, int64_t label) {
+            if (k_ == 0 || sim < min_sim_) return false;
+            if (static_cast<int>(heap_.size()) < k_) {
+                heap_.push_back({sim, label});
+                std::push_heap(heap_.begin(), heap_.end(), Greater);
+                return true;
+            }
+            if (sim <= heap_.front().sim_) return false;
+            std::pop_heap(heap_.begin(), heap_.end(), Greater);
+            heap_.back() = {sim, label};
+            std::push_heap(heap_.begin(), heap_.end(), Greater);
+            return true;
+        }
+
+        //! Merge all entries of another heap into this one
+        void Merge(const TopKHeap &other) {
+            for (const auto &item : other.heap_) {
+                Push(item.sim_, item.label_);
+            }
+        }
+
+        inline int Size() const { return static_cast<int>(heap_.size()); }
+
+        inline bool Full() const { return static_cast<int>(heap_.size()) >= k_; }
+
+        //! Move the entries out sorted by descending similarity, the heap is left empty
+        void Extract(std::vector<ScoredLabel> &sorted) {
+            std::sort_heap(heap_.begin(), heap_.end(), Greater);
+            sorted.assign(heap_.begin(), heap_.end());
+            heap_.clear();
+        }
+
+    private:
+        static inline bool Greater(const ScoredLabel &a, const ScoredLabel &b) {
+            return a.sim_ > b.sim_;
+        }
+
+    private:
+        int k_ = 0;
+        float min_sim_ = -std::numeric_limits<float>::max();
+        std::vector<ScoredLabel> heap_;
+    };
+
+}
@@ -0,0 +1,406 @@
+#include "HnswIndex.h"
+#include "../kernels/SimilarityKernels.h"
+#include "../../../common/common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <queue>
+
+namespace mirror {
+    static const uint32_t kHnswMagic = 0x57534E48; // "HNSW"
+    static const uint32_t kHnswVersion = 1;
+
+    //! Epoch tagged visited set, one per thread so concurrent searches never share it
+    struct VisitedTable {
+        std::vector<uint32_t> tags;
+        uint32_t epoch = 0;
+
+        inline void Prepare(size_t num_nodes) {
+            if (tags.size() < num_nodes) {
+                tags.resize(num_nodes, 0);
+            }
+            if (++epoch == 0) {
+                std::fill(tags.begin(), tags.end(), 0);
+                epoch = 1;
+            }
+        }
+
+        //! Returns false if the node has already been visited by the current search
+        inline bool Visit(int node) {
+            if (tags[node] == epoch) return false;
+            tags[node] = epoch;
+            return true;
+        }
+    };
+
+    static VisitedTable &GetVisitedTable() {
+        static thread_local VisitedTable table;
+        return table;
+    }
+
+    HnswIndex::HnswIndex(int dim, int M, int ef_construction, int ef_search) :
+            dim_(dim),
+            stride_(AlignedFeatureDim(dim)),
+            M_(std::max(M, 2)),
+            M0_(2 * std::max(M, 2)),
+            ef_construction_(std::max(ef_construction, M)),
+            ef_search_(std::max(ef_search, 1)),
+            level_mult_(1.0 / std::log(static_cast<double>(std::max(M, 2)))),
+            rng_(100) {
+    }
+
+    void HnswIndex::Clear() {
+        entry_point_ = -1;
+        max_level_ = -1;
+        vectors_.clear();
+        labels_.clear();
+        levels_.clear();
+        deleted_.clear();
+        links0_.clear();
+        links_upper_.clear();
+        label_to_node_.clear();
+    }
+
+    void HnswIndex::Reserve(size_t num_nodes) {
+        vectors_.reserve(num_nodes * stride_);
+        labels_.reserve(num_nodes);
+        levels_.reserve(num_nodes);
+        deleted_.reserve(num_nodes);
+        links0_.reserve(num_nodes * (M0_ + 1));
+        links_upper_.reserve(num_nodes);
+        label_to_node_.reserve(num_nodes);
+    }
+
+    int HnswIndex::RandomLevel() {
+        std::uniform_real_distribution<double> distribution(0.0, 1.0);
+        double r = -std::log(std::max(distribution(rng_), 1e-12)) * level_mult_;
+        return static_cast<int>(r);
+    }
+
+    int HnswIndex::GreedyClosest(const float *query, int entry, int level) const {
+        int curr = entry;
+        float curr_sim = DotProduct(query, NodeData(curr), dim_);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            const int *links = LinkList(curr, level);
+            for (int i = 1; i <= links[0]; ++i) {
+                const int neighbor = links[i];
+                const float sim = DotProduct(query, NodeData(neighbor), dim_);
+                if (sim > curr_sim) {
+                    curr_sim = sim;
+                    curr = neighbor;
+                    changed = true;
+                }
+            }
+        }
+        return curr;
+    }
+
+    void HnswIndex::SearchLayer(const float *query, int entry, int ef, int level, bool skip_deleted,
+                                std::vector<Candidate> &results) const {
+        const std::greater<Candidate> min_heap;
+        VisitedTable &visited = GetVisitedTable();
+        visited.Prepare(labels_.size());
+
+        // max-heap of nodes to expand, results is a min-heap bounded by 'ef'
+        std::priority_queue<Candidate> candidates;
+        results.clear();
+
+        const float entry_sim = DotProduct(query, NodeData(entry), dim_);
+        visited.Visit(entry);
+        candidates.emplace(entry_sim, entry);
+        if (!skip_deleted || !deleted_[entry]) {
+            results.emplace_back(entry_sim, entry);
+        }
+        float lower_bound = results.empty() ? -std::numeric_limits<float>::max() : entry_sim;
+
+        while (!candidates.empty()) {
+            const Candidate curr = candidates.top();
+            if (curr.first < lower_bound && static_cast<int>(results.size()) >= ef) {
+                break;
+            }
+            candidates.pop();
+
+            const int *links = LinkList(curr.second, level);
+            for (int i = 1; i <= links[0]; ++i) {
+                const int neighbor = links[i];
+                if (!visited.Visit(neighbor)) continue;
+
+                const float sim = DotProduct(query, NodeData(neighbor), dim_);
+                if (static_cast<int>(results.size()) < ef || sim > lower_bound) {
+                    candidates.emplace(sim, neighbor);
+                    if (!skip_deleted || !deleted_[neighbor]) {
+                        results.emplace_back(sim, neighbor);
+                        std::push_heap(results.begin(), results.end(), min_heap);
+                        if (static_cast<int>(results.size()) > ef) {
+                            std::pop_heap(results.begin(), results.end(), min_heap);
+                            results.pop_back();
+                        }
+                    }
+                    if (!results.empty()) {
+                        lower_bound = results.front().first;
+                    }
+                }
+            }
+        }
+    }
+
+    void HnswIndex::SelectNeighbors(std::vector<Candidate> &candidates, int max_links) const {
+        std::sort(candidates.begin(), candidates.end(), std::greater<Candidate>());
+        if (static_cast<int>(candidates.size()) <= max_links) {
+            return;
+        }
+
+        // keep a candidate only if it is closer to the query than to every neighbour
+        // selected so far, which spreads the links over different directions
+        std::vector<Candidate> selected;
+        selected.reserve(max_links);
+        for (const auto &candidate : candidates) {
+            const float *data = NodeData(candidate.second);
+            bool good = true;
+            for (const auto &kept : selected) {
+                if (DotProduct(data, NodeData(kept.second), dim_) > candidate.first) {
+                    good = false;
+                    break;
+                }
+            }
+            if (good) {
+                selected.push_back(candidate);
+                if (static_cast<int>(selected.size()) >= max_links) break;
+            }
+        }
+        candidates.swap(selected);
+    }
+
+    void HnswIndex::Connect(int node, int level, std::vector<Candidate> &neighbors) {
+        const int max_links = level == 0 ? M0_ : M_;
+        int *links = LinkList(node, level);
+        links[0] = static_cast<int>(neighbors.size());
+        for (size_t i = 0; i < neighbors.size(); ++i) {
+            links[i + 1] = neighbors[i].second;
+        }
+
+        std::vector<Candidate> shrink;
+        for (const auto &neighbor : neighbors) {
+            int *neighbor_links = LinkList(neighbor.second, level);
+            if (neighbor_links[0] < max_links) {
+                neighbor_links[++neighbor_links[0]] = node;
+                continue;
+            }
+
+            // the neighbour is full, re-select its links among the old ones plus the new node
+            const float *data = NodeData(neighbor.second);
+            shrink.clear();
+            shrink.emplace_back(neighbor.first, node);
+            for (int i = 1; i <= neighbor_links[0]; ++i) {
+                shrink.emplace_back(DotProduct(data, NodeData(neighbor_links[i]), dim_), neighbor_links[i]);
+            }
+            SelectNeighbors(shrink, max_links);
+            neighbor_links[0] = static_cast<int>(shrink.size());
+            for (size_t i = 0; i < shrink.size(); ++i) {
+                neighbor_links[i + 1] = shrink[i].second;
+            }
+        }
+    }
+
+    int HnswIndex::Add(int64_t label, const float *feat) {
+        if (label_to_node_.count(label)) {
+            Remove(label);
+        }
+
+        const int node = static_cast<int>(labels_.size());
+        const int level = RandomLevel();
+
+        vectors_.resize(static_cast<size_t>(node + 1) * stride_, 0.0f);
+        std::copy(feat, feat + dim_, vectors_.begin() + static_cast<size_t>(node) * stride_);
+        labels_.push_back(label);
+        levels_.push_back(level);
+        deleted_.push_back(0);
+        links0_.resize(static_cast<size_t>(node + 1) * (M0_ + 1), 0);
+        links_upper_.emplace_back(static_cast<size_t>(level) * (M_ + 1), 0);
+        label_to_node_[label] = node;
+
+        if (entry_point_ < 0) {
+            entry_point_ = node;
+            max_level_ = level;
+            return 0;
+        }
+
+        const float *query = NodeData(node);
+        int curr = entry_point_;
+        for (int l = max_level_; l > level; --l) {
+            curr = GreedyClosest(query, curr, l);
+        }
+
+        std::vector<Candidate> candidates;
+        for (int l = std::min(level, max_level_); l >= 0; --l) {
+            SearchLayer(query, curr, ef_construction_, l, false, candidates);
+            curr = std::max_element(candidates.begin(), candidates.end())->second;
+            SelectNeighbors(candidates, M_);
+            Connect(node, l, candidates);
+        }
+
+        if (level > max_level_) {
+            max_level_ = level;
+            entry_point_ = node;
+        }
+        return 0;
+    }
+
+    int HnswIndex::Remove(int64_t label) {
+        auto it = label_to_node_.find(label);
+        if (it == label_to_node_.end()) {
+            return ErrorCode::NOT_FOUND_ERROR;
+        }
+        deleted_[it->second] = 1;
+        label_to_node_.erase(it);
+        return 0;
+    }
+
+    void HnswIndex::Search(const float *probe, int k, float min_sim, std::vector<ScoredLabel> &results) const {
+        results.clear();
+        if (label_to_node_.empty() || k <= 0) {
+            return;
+        }
+
+        int curr = entry_point_;
+        for (int l = max_level_; l > 0; --l) {
+            curr = GreedyClosest(probe, curr, l);
+        }
+
+        std::vector<Candidate> candidates;
+        SearchLayer(probe, curr, std::max(ef_search_, k), 0, true, candidates);
+
+        TopKHeap heap(k, min_sim);
+        for (const auto &candidate : candidates) {
+            heap.Push(candidate.first, labels_[candidate.second]);
+        }
+        heap.Extract(results);
+    }
+
+    int HnswIndex::Save(StreamWriter &writer, const std::unordered_map<int64_t, int64_t> &relabel) const {
+        const int32_t dim = dim_;
+        const int32_t M = M_;
+        const int32_t ef_construction = ef_construction_;
+        const uint64_t num_nodes = labels_.size();
+        const int32_t entry_point = entry_point_;
+        const int32_t max_level = max_level_;
+
+        Write(writer, kHnswMagic);
+        Write(writer, kHnswVersion);
+        Write(writer, dim);
+        Write(writer, M);
+        Write(writer, ef_construction);
+        Write(writer, num_nodes);
+        Write(writer, entry_point);
+        Write(writer, max_level);
+
+        for (size_t node = 0; node < labels_.size(); ++node) {
+            int64_t label = -1;
+            uint8_t deleted = 1;
+            if (!deleted_[node]) {
+                auto it = relabel.find(labels_[node]);
+                if (it != relabel.end()) {
+                    label = it->second;
+                    deleted = 0;
+                }
+            }
+            const int32_t level = levels_[node];
+            Write(writer, label);
+            Write(writer, level);
+            Write(writer, deleted);
+            Write(writer, NodeData(static_cast<int>(node)), size_t(dim_));
+            Write(writer, &links0_[node * (M0_ + 1)], size_t(M0_ + 1));
+            if (level > 0) {
+                Write(writer, links_upper_[node].data(), links_upper_[node].size());
+            }
+        }
+        return 0;
+    }
+
+    int HnswIndex::Load(StreamReader &reader) {
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        int32_t dim = 0, M = 0, ef_construction = 0;
+        uint64_t num_nodes = 0;
+        int32_t entry_point = -1, max_level = -1;
+
+        Read(reader, magic);
+        Read(reader, version);
+        if (magic != kHnswMagic || version != kHnswVersion) {
+            return ErrorCode::DATA_CORRUPTED_ERROR;
+        }
+        Read(reader, dim);
+        Read(reader, M);
+        Read(reader, ef_construction);
+        Read(reader, num_nodes);
+        Read(reader, entry_point);
+        if (Read(reader, max_level) != sizeof(max_level)) {
+            return ErrorCode::DATA_CORRUPTED_ERROR;
+        }
+        if (dim != dim_) {
+            return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+        }
+
+        Clear();
+        M_ = std::max(M, 2);
+        M0_ = 2 * M_;
+        ef_construction_ = ef_construction;
+        level_mult_ = 1.0 / std::log(static_cast<double>(M_));
+        Reserve(static_cast<size_t>(num_nodes));
+
+        vectors_.resize(static_cast<size_t>(num_nodes) * stride_, 0.0f);
+        links0_.resize(static_cast<size_t>(num_nodes) * (M0_ + 1), 0);
+        for (size_t node = 0; node < num_nodes; ++node) {
+            int64_t label = -1;
+            int32_t level = 0;
+            uint8_t deleted = 0;
+            Read(reader, label);
+            Read(reader, level);
+            Read(reader, deleted);
+            Read(reader, &vectors_[node * stride_], size_t(dim_));
+            size_t bytes = Read(reader, &links0_[node * (M0_ + 1)], size_t(M0_ + 1));
+            links_upper_.emplace_back(static_cast<size_t>(std::max(level, 0)) * (M_ + 1), 0);
+            if (level > 0) {
+                bytes = Read(reader, links_upper_.back().data(), links_upper_.back().size());
+            }
+            if (bytes == 0 || level < 0) {
+                Clear();
+                return ErrorCode::DATA_CORRUPTED_ERROR;
+            }
+
+            labels_.push_back(label);
+            levels_.push_back(level);
+            deleted_.push_back(deleted);
+            if (!deleted) {
+                label_to_node_[label] = static_cast<int>(node);
+            }
+        }
+
+        // reject graphs pointing outside of the node table before anything walks them
+        const int node_count = static_cast<int>(num_nodes);
+        bool valid = num_nodes == 0 || (entry_point >= 0 && entry_point < node_count);
+        for (int node = 0; valid && node < node_count; ++node) {
+            for (int level = 0; valid && level <= levels_[node]; ++level) {
+                const int *links = LinkList(node, level);
+                const int max_links = level == 0 ? M0_ : M_;
+                valid = links[0] >= 0 && links[0] <= max_links;
+                for (int i = 1; valid && i <= links[0]; ++i) {
+                    valid = links[i] >= 0 && links[i] < node_count;
+                }
+            }
+        }
+        if (!valid) {
+            Clear();
+            return ErrorCode::DATA_CORRUPTED_ERROR;
+        }
+
+        entry_point_ = num_nodes == 0 ? -1 : entry_point;
+        max_level_ = num_nodes == 0 ? -1 : max_level;
+        return 0;
+    }
+
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "../kernels/AlignedAllocator.h"
+#include "../stream/FileSystem.h"
+#include "../TopKHeap.h"
+
+namespace mirror {
+    /// \brief Hierarchical Navigable Small World graph over L2 normalized features.
+    /// Nodes are scored by inner product (cosine similarity), deletions are tombstones:
+    /// a deleted node keeps routing queries through the graph but is never returned.
+    /// Reference: "Efficient and robust approximate nearest neighbor search using
+    /// Hierarchical Navigable Small World graphs", Malkov & Yashunin, TPAMI 2018.
+    class HnswIndex {
+    public:
+        HnswIndex(int dim, int M, int ef_construction, int ef_search);
+
+        ~HnswIndex() = default;
+
+        void Clear();
+
+        void Reserve(size_t num_nodes);
+
+        //! Insert a normalized feature under 'label', an existing node with the same label is tombstoned first
+        int Add(int64_t label, const float *feat);
+
+        //! Tombstone the node stored under 'label'
+        int Remove(int64_t label);
+
+        //! The k best live nodes with similarity >= min_sim, sorted by descending similarity
+        void Search(const float *probe, int k, float min_sim, std::vector<ScoredLabel> &results) const;
+
+        inline void SetEfSearch(int ef_search) { ef_search_ = ef_search > 0 ? ef_search : ef_search_; }
+
+        inline int GetEfSearch() const { return ef_search_; }
+
+        inline int GetM() const { return M_; }
+
+        inline int GetEfConstruction() const { return ef_construction_; }
+
+        inline bool Contains(int64_t label) const { return label_to_node_.count(label) != 0; }
+
+        //! Number of live (not deleted) nodes
+        inline size_t Size() const { return label_to_node_.size(); }
+
+        inline size_t DeletedCount() const { return labels_.size() - label_to_node_.size(); }
+
+        //! Labels are written through 'relabel' (old label -> label after reload), deleted nodes keep -1
+        int Save(StreamWriter &writer, const std::unordered_map<int64_t, int64_t> &relabel) const;
+
+        int Load(StreamReader &reader);
+
+    private:
+        using Candidate = std::pair<float, int>;
+
+        inline const float *NodeData(int node) const {
+            return vectors_.data() + static_cast<size_t>(node) * stride_;
+        }
+
+        inline int *LinkList(int node, int level) {
+            return level == 0 ? &links0_[static_cast<size_t>(node) * (M0_ + 1)]
+                              : &links_upper_[node][static_cast<size_t>(level - 1) * (M_ + 1)];
+        }
+
+        inline const int *LinkList(int node, int level) const {
+            return level == 0 ? &links0_[static_cast<size_t>(node) * (M0_ + 1)]
+                              : &links_upper_[node][static_cast<size_t>(level - 1) * (M_ + 1)];
+        }
+
+        int RandomLevel();
+
+        int GreedyClosest(const float *query, int entry, int level) const;
+
+        //! Best-first search of one layer, returns up to 'ef' nodes as a min-heap on similarity
+        void SearchLayer(const float *query, int entry, int ef, int level, bool skip_deleted,
+                         std::vector<Candidate> &results) const;
+
+        //! Keep at most 'max_links' diverse candidates (the HNSW neighbour selection heuristic)
+        void SelectNeighbors(std::vector<Candidate> &candidates, int max_links) const;
+
+        void Connect(int node, int level, std::vector<Candidate> &neighbors);
+
+    private:
+        int dim_;
+        int stride_;
+        int M_;
+        int M0_;
+        int ef_construction_;
+        int ef_search_;
+        double level_mult_;
+
+        int entry_point_ = -1;
+        int max_level_ = -1;
+
+        AlignedVector<float> vectors_;
+        std::vector<int64_t> labels_;
+        std::vector<int> levels_;
+        std::vector<uint8_t> deleted_;
+        //! level 0 links: [count, M0 neighbours] per node
+        std::vector<int> links0_;
+        //! levels >= 1 links: level * [count, M neighbours] per node
+        std::vector<std::vector<int>> links_upper_;
+        std::unordered_map<int64_t, int> label_to_node_;
+
+        std::mt19937 rng_;
+    };
+
+}
@@ -0,0 +1,444 @@
+#include "IvfPqIndex.h"
+#include "KMeans.h"
+#include "../kernels/SimilarityKernels.h"
+#include "../../../common/common.h"
+
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+
+namespace mirror {
+    static const uint32_t kIvfPqMagic = 0x51505649; // "IVPQ"
+    static const uint32_t kIvfPqVersion = 1;
+    //! 8 bit sub-quantizers
+    static const int kPqCentroids = 256;
+    static const int kTrainingIters = 10;
+    //! k-means samples per centroid, larger inputs are sub-sampled
+    static const size_t kTrainingPointsPerCentroid = 64;
+    static const size_t kMinPointsPerCentroid = 8;
+    //! the exact feature block of the index file starts on a cache line
+    static const size_t kFileAlignment = 64;
+
+    //! Per thread buffers of Search so concurrent queries never share them
+    struct IvfPqSearchScratch {
+        std::vector<std::pair<float, int>> lists;
+        std::vector<float> tables;
+        TopKHeap candidates;
+        std::vector<ScoredLabel> scored;
+    };
+
+    static IvfPqSearchScratch &GetSearchScratch() {
+        static thread_local IvfPqSearchScratch scratch;
+        return scratch;
+    }
+
+    IvfPqIndex::IvfPqIndex(int dim, int nlist, int code_size, int nprobe, int rerank) :
+            dim_(dim),
+            stride_(AlignedFeatureDim(dim)),
+            nlist_(std::max(nlist, 1)),
+            code_size_(code_size),
+            dsub_(dim / code_size),
+            nprobe_(std::max(1, std::min(nprobe, std::max(nlist, 1)))),
+            rerank_(std::max(rerank, 0)) {
+        list_codes_.resize(static_cast<size_t>(nlist_));
+        list_nodes_.resize(static_cast<size_t>(nlist_));
+    }
+
+    void IvfPqIndex::Clear() {
+        for (int list = 0; list < nlist_; ++list) {
+            list_codes_[list].clear();
+            list_nodes_[list].clear();
+        }
+        labels_.clear();
+        node_lists_.clear();
+        node_offsets_.clear();
+        label_to_node_.clear();
+        vectors_.clear();
+        mapped_.close();
+        mapped_vectors_ = nullptr;
+        num_mapped_ = 0;
+    }
+
+    void IvfPqIndex::Reserve(size_t num_nodes) {
+        labels_.reserve(num_nodes);
+        node_lists_.reserve(num_nodes);
+        node_offsets_.reserve(num_nodes);
+        label_to_node_.reserve(num_nodes);
+        if (num_nodes > num_mapped_) {
+            vectors_.reserve((num_nodes - num_mapped_) * stride_);
+        }
+    }
+
+    size_t IvfPqIndex::MinTrainingSize() const {
+        return static_cast<size_t>(std::max(nlist_, kPqCentroids)) * kMinPointsPerCentroid;
+    }
+
+    int IvfPqIndex::Train(const float *data, size_t n, int stride) {
+        if (n < MinTrainingSize()) {
+            std::cout << "ivfpq training needs at least " << MinTrainingSize() << " faces." << std::endl;
+            return ErrorCode::EMPTY_DATA_ERROR;
+        }
+        Clear();
+        trained_ = false;
+
+        std::mt19937 rng(2021);
+        const size_t num_samples = std::min(
+                n, static_cast<size_t>(std::max(nlist_, kPqCentroids)) * kTrainingPointsPerCentroid);
+        // the sub-quantizers have far fewer centroids than the coarse quantizer
+        const size_t num_pq_samples = std::min(num_samples, kPqCentroids * kTrainingPointsPerCentroid);
+        std::vector<size_t> perm(n);
+        std::iota(perm.begin(), perm.end(), size_t(0));
+        for (size_t i = 0; i < num_samples; ++i) {
+            std::uniform_int_distribution<size_t> pick(i, n - 1);
+            std::swap(perm[i], perm[pick(rng)]);
+        }
+        std::vector<float> samples(num_samples * dim_);
+        for (size_t i = 0; i < num_samples; ++i) {
+            const float *row = data + perm[i] * stride;
+            std::copy(row, row + dim_, samples.begin() + i * dim_);
+        }
+
+        int flag = KMeans(samples.data(), num_samples, dim_, nlist_, kTrainingIters, true, rng(), centroids_);
+        if (flag != 0) {
+            return flag;
+        }
+
+        // the sub-quantizers are trained on the residuals to the coarse centroids
+        std::vector<int> assignments;
+        AssignClusters(samples.data(), num_samples, dim_, centroids_.data(), nlist_, true, assignments);
+        for (size_t i = 0; i < num_samples; ++i) {
+            const float *centroid = &centroids_[static_cast<size_t>(assignments[i]) * dim_];
+            float *sample = &samples[i * dim_];
+            for (int d = 0; d < dim_; ++d) {
+                sample[d] -= centroid[d];
+            }
+        }
+
+        codebooks_.resize(static_cast<size_t>(code_size_) * kPqCentroids * dsub_);
+        std::vector<float> sub_samples(num_pq_samples * dsub_);
+        std::vector<float> codebook;
+        for (int j = 0; j < code_size_; ++j) {
+            for (size_t i = 0; i < num_pq_samples; ++i) {
+                const float *sub = &samples[i * dim_ + static_cast<size_t>(j) * dsub_];
+                std::copy(sub, sub + dsub_, sub_samples.begin() + i * dsub_);
+            }
+            flag = KMeans(sub_samples.data(), num_pq_samples, dsub_, kPqCentroids, kTrainingIters, false, rng(), codebook);
+            if (flag != 0) {
+                return flag;
+            }
+            std::copy(codebook.begin(), codebook.end(),
+                      codebooks_.begin() + static_cast<size_t>(j) * kPqCentroids * dsub_);
+        }
+
+        trained_ = true;
+        return 0;
+    }
+
+    int IvfPqIndex::NearestList(const float *feat) const {
+        int best = 0;
+        float best_sim = -std::numeric_limits<float>::max();
+        for (int list = 0; list < nlist_; ++list) {
+            const float sim = DotProduct(feat, &centroids_[static_cast<size_t>(list) * dim_], dim_);
+            if (sim > best_sim) {
+                best_sim = sim;
+                best = list;
+            }
+        }
+        return best;
+    }
+
+    void IvfPqIndex::Encode(const float *residual, uint8_t *code) const {
+        for (int j = 0; j < code_size_; ++j) {
+            const float *sub = residual + j * dsub_;
+            const float *codeword = &codebooks_[static_cast<size_t>(j) * kPqCentroids * dsub_];
+            int best = 0;
+            float best_dist = std::numeric_limits<float>::max();
+            for (int c = 0; c < kPqCentroids; ++c, codeword += dsub_) {
+                float dist = 0.0f;
+                for (int d = 0; d < dsub_; ++d) {
+                    const float diff = sub[d] - codeword[d];
+                    dist += diff * diff;
+                }
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    best = c;
+                }
+            }
+            code[j] = static_cast<uint8_t>(best);
+        }
+    }
+
+    int IvfPqIndex::Add(int64_t label, const float *feat) {
+        if (!trained_) {
+            return ErrorCode::UNINITIALIZED_ERROR;
+        }
+        Remove(label);
+
+        const int node = static_cast<int>(labels_.size());
+        const int list = NearestList(feat);
+        std::vector<float> residual(feat, feat + dim_);
+        const float *centroid = &centroids_[static_cast<size_t>(list) * dim_];
+        for (int d = 0; d < dim_; ++d) {
+            residual[d] -= centroid[d];
+        }
+        std::vector<uint8_t> &codes = list_codes_[list];
+        codes.resize(codes.size() + code_size_);
+        Encode(residual.data(), &codes[codes.size() - code_size_]);
+
+        node_offsets_.push_back(static_cast<int>(list_nodes_[list].size()));
+        list_nodes_[list].push_back(node);
+        node_lists_.push_back(list);
+        labels_.push_back(label);
+        label_to_node_[label] = node;
+
+        const size_t offset = vectors_.size();
+        vectors_.resize(offset + stride_, 0.0f);
+        std::copy(feat, feat + dim_, vectors_.begin() + offset);
+        return 0;
+    }
+
+    int IvfPqIndex::Remove(int64_t label) {
+        auto it = label_to_node_.find(label);
+        if (it == label_to_node_.end()) {
+            return ErrorCode::NOT_FOUND_ERROR;
+        }
+        const int node = it->second;
+        const int list = node_lists_[node];
+        const int offset = node_offsets_[node];
+        std::vector<int> &nodes = list_nodes_[list];
+        std::vector<uint8_t> &codes = list_codes_[list];
+        const int last = static_cast<int>(nodes.size()) - 1;
+        if (offset != last) {
+            const int moved = nodes[last];
+            nodes[offset] = moved;
+            node_offsets_[moved] = offset;
+            std::memcpy(&codes[static_cast<size_t>(offset) * code_size_],
+                        &codes[static_cast<size_t>(last) * code_size_], static_cast<size_t>(code_size_));
+        }
+        nodes.pop_back();
+        codes.resize(static_cast<size_t>(last) * code_size_);
+        // the exact feature of a removed node is dropped on the next save / load
+        node_lists_[node] = -1;
+        label_to_node_.erase(it);
+        return 0;
+    }
+
+    const float *IvfPqIndex::Vector(int64_t label) const {
+        auto it = label_to_node_.find(label);
+        return it == label_to_node_.end() ? nullptr : NodeVector(it->second);
+    }
+
+    void IvfPqIndex::Search(const float *probe, int k, float min_sim, std::vector<ScoredLabel> &results) const {
+        results.clear();
+        if (!trained_ || k <= 0 || label_to_node_.empty()) return;
+
+        IvfPqSearchScratch &scratch = GetSearchScratch();
+
+        // <q, c + r> = <q, c> + <q, r>: the coarse score is shared by a whole list
+        scratch.lists.resize(static_cast<size_t>(nlist_));
+        for (int list = 0; list < nlist_; ++list) {
+            scratch.lists[list].first = DotProduct(probe, &centroids_[static_cast<size_t>(list) * dim_], dim_);
+            scratch.lists[list].second = list;
+        }
+        const int nprobe = std::min(nprobe_, nlist_);
+        std::partial_sort(scratch.lists.begin(), scratch.lists.begin() + nprobe, scratch.lists.end(),
+                          std::greater<std::pair<float, int>>());
+
+        // and <q, r> is approximated by the sum of the probe sub-vectors against the codewords
+        scratch.tables.resize(static_cast<size_t>(code_size_) * kPqCentroids);
+        float *table = scratch.tables.data();
+        const float *codeword = codebooks_.data();
+        for (int j = 0; j < code_size_; ++j) {
+            const float *sub = probe + j * dsub_;
+            for (int c = 0; c < kPqCentroids; ++c, codeword += dsub_) {
+                float sim = 0.0f;
+                for (int d = 0; d < dsub_; ++d) {
+                    sim += sub[d] * codeword[d];
+                }
+                *table++ = sim;
+            }
+        }
+
+        const bool rerank = rerank_ > 0;
+        scratch.candidates.Reset(rerank ? std::max(k, rerank_) : k,
+                                 rerank ? -std::numeric_limits<float>::max() : min_sim);
+        for (int p = 0; p < nprobe; ++p) {
+            const int list = scratch.lists[p].second;
+            const float base = scratch.lists[p].first;
+            const uint8_t *code = list_codes_[list].data();
+            const std::vector<int> &nodes = list_nodes_[list];
+            for (size_t i = 0; i < nodes.size(); ++i, code += code_size_) {
+                const float *lut = scratch.tables.data();
+                float sim = base;
+                for (int j = 0; j < code_size_; ++j, lut += kPqCentroids) {
+                    sim += lut[code[j]];
+                }
+                scratch.candidates.Push(sim, nodes[i]);
+            }
+        }
+
+        if (rerank) {
+            scratch.candidates.Extract(scratch.scored);
+            scratch.candidates.Reset(k, min_sim);
+            for (const auto &candidate : scratch.scored) {
+                const int node = static_cast<int>(candidate.label_);
+                scratch.candidates.Push(DotProduct(probe, NodeVector(node), dim_), node);
+            }
+        }
+        scratch.candidates.Extract(results);
+        for (auto &result : results) {
+            result.label_ = labels_[static_cast<size_t>(result.label_)];
+        }
+    }
+
+    int IvfPqIndex::Save(const std::string &path, const std::unordered_map<int64_t, int64_t> &relabel) const {
+        if (!trained_) {
+            return ErrorCode::UNINITIALIZED_ERROR;
+        }
+
+        // live nodes in inverted list order, so every list reads a contiguous range of the mapped features
+        std::vector<int> nodes;
+        nodes.reserve(label_to_node_.size());
+        for (int list = 0; list < nlist_; ++list) {
+            for (int node : list_nodes_[list]) {
+                if (relabel.count(labels_[node])) {
+                    nodes.push_back(node);
+                }
+            }
+        }
+
+        const std::string tmp_path = path + ".tmp";
+        {
+            FileWriter ofile(tmp_path, FileWriter::Binary);
+            if (!ofile.is_opened()) {
+                std::cout << "Open index file failed: " << tmp_path << std::endl;
+                return ErrorCode::NOT_FOUND_ERROR;
+            }
+
+            const int32_t dim = dim_;
+            const int32_t nlist = nlist_;
+            const int32_t code_size = code_size_;
+            const int32_t pq_centroids = kPqCentroids;
+            const uint64_t num_nodes = nodes.size();
+            size_t offset = 0;
+            offset += Write(ofile, kIvfPqMagic);
+            offset += Write(ofile, kIvfPqVersion);
+            offset += Write(ofile, dim);
+            offset += Write(ofile, nlist);
+            offset += Write(ofile, code_size);
+            offset += Write(ofile, pq_centroids);
+            offset += Write(ofile, num_nodes);
+            offset += Write(ofile, centroids_.data(), centroids_.size());
+            offset += Write(ofile, codebooks_.data(), codebooks_.size());
+            for (int node : nodes) {
+                const int64_t label = relabel.at(labels_[node]);
+                const int32_t list = node_lists_[node];
+                offset += Write(ofile, label);
+                offset += Write(ofile, list);
+            }
+            for (int node : nodes) {
+                const uint8_t *code = &list_codes_[node_lists_[node]][
+                        static_cast<size_t>(node_offsets_[node]) * code_size_];
+                offset += Write(ofile, code, static_cast<size_t>(code_size_));
+            }
+            const char padding[kFileAlignment] = {0};
+            offset += Write(ofile, padding, (kFileAlignment - offset % kFileAlignment) % kFileAlignment);
+            for (int node : nodes) {
+                offset += Write(ofile, NodeVector(node), static_cast<size_t>(stride_));
+            }
+            if (offset == 0) {
+                return ErrorCode::NOT_FOUND_ERROR;
+            }
+        }
+
+#if defined(_WIN32)
+        std::remove(path.c_str());
+#endif
+        // replacing the file keeps the old inode alive for anyone who still maps it
+        if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            std::cout << "Replace index file failed: " << path << std::endl;
+            return ErrorCode::NOT_FOUND_ERROR;
+        }
+        return 0;
+    }
+
+    int IvfPqIndex::Load(const std::string &path) {
+        Clear();
+        trained_ = false;
+        if (!mapped_.open(path)) {
+            return ErrorCode::NOT_FOUND_ERROR;
+        }
+
+        MemoryReader reader(mapped_.data(), mapped_.size());
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        int32_t dim = 0, nlist = 0, code_size = 0, pq_centroids = 0;
+        uint64_t num_nodes = 0;
+        Read(reader, magic);
+        Read(reader, version);
+        Read(reader, dim);
+        Read(reader, nlist);
+        Read(reader, code_size);
+        Read(reader, pq_centroids);
+        Read(reader, num_nodes);
+        if (magic != kIvfPqMagic || version != kIvfPqVersion || nlist <= 0 || code_size <= 0 ||
+            dim % code_size != 0 || pq_centroids != kPqCentroids || num_nodes > mapped_.size()) {
+            Clear();
+            return ErrorCode::DATA_CORRUPTED_ERROR;
+        }
+        if (dim != dim_) {
+            Clear();
+            return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+        }
+
+        const size_t codebook_size = static_cast<size_t>(code_size) * kPqCentroids * (dim / code_size);
+        size_t codes_offset = reader.tell() + sizeof(float) * (static_cast<size_t>(nlist) * dim + codebook_size) +
+                              (sizeof(int64_t) + sizeof(int32_t)) * num_nodes;
+        size_t vectors_offset = codes_offset + static_cast<size_t>(code_size) * num_nodes;
+        vectors_offset = (vectors_offset + kFileAlignment - 1) / kFileAlignment * kFileAlignment;
+        if (vectors_offset + sizeof(float) * stride_ * num_nodes > mapped_.size()) {
+            Clear();
+            return ErrorCode::DATA_CORRUPTED_ERROR;
+        }
+
+        nlist_ = nlist;
+        code_size_ = code_size;
+        dsub_ = dim / code_size;
+        SetNprobe(nprobe_);
+        list_codes_.assign(static_cast<size_t>(nlist_), std::vector<uint8_t>());
+        list_nodes_.assign(static_cast<size_t>(nlist_), std::vector<int>());
+        centroids_.resize(static_cast<size_t>(nlist_) * dim_);
+        codebooks_.resize(codebook_size);
+        Read(reader, centroids_.data(), centroids_.size());
+        Read(reader, codebooks_.data(), codebooks_.size());
+
+        Reserve(static_cast<size_t>(num_nodes));
+        const uint8_t *code = reinterpret_cast<const uint8_t *>(mapped_.data() + codes_offset);
+        for (size_t node = 0; node < num_nodes; ++node, code += code_size_) {
+            int64_t label = -1;
+            int32_t list = -1;
+            Read(reader, label);
+            Read(reader, list);
+            if (list < 0 || list >= nlist_ || label_to_node_.count(label)) {
+                Clear();
+                return ErrorCode::DATA_CORRUPTED_ERROR;
+            }
+            list_codes_[list].insert(list_codes_[list].end(), code, code + code_size_);
+            node_offsets_.push_back(static_cast<int>(list_nodes_[list].size()));
+            list_nodes_[list].push_back(static_cast<int>(node));
+            node_lists_.push_back(list);
+            labels_.push_back(label);
+            label_to_node_[label] = static_cast<int>(node);
+        }
+
+        mapped_vectors_ = reinterpret_cast<const float *>(mapped_.data() + vectors_offset);
+        num_mapped_ = static_cast<size_t>(num_nodes);
+        trained_ = true;
+        return 0;
+    }
+
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../kernels/AlignedAllocator.h"
+#include "../stream/MappedFile.h"
+#include "../TopKHeap.h"
+
+namespace mirror {
+    /// \brief Inverted file index with product quantized residuals over L2 normalized features.
+    /// Every face is assigned to its closest coarse centroid and the residual to that centroid is
+    /// compressed to 'code_size' bytes (one 8 bit sub-quantizer per dim / code_size dimensions).
+    /// Queries visit the 'nprobe' closest inverted lists and score codes with per-query lookup tables
+    /// (asymmetric distance computation), the best 'rerank' candidates are then re-scored exactly.
+    /// The exact features of a loaded index are read from the memory mapped index file, so resident
+    /// memory is the codes plus the codebooks.
+    /// Reference: "Product quantization for nearest neighbor search", Jegou et al., TPAMI 2011.
+    class IvfPqIndex {
+    public:
+        IvfPqIndex(int dim, int nlist, int code_size, int nprobe, int rerank);
+
+        ~IvfPqIndex() = default;
+
+        //! Drop every face, the trained codebooks are kept
+        void Clear();
+
+        void Reserve(size_t num_nodes);
+
+        /// \brief Learn the coarse centroids (spherical k-means) and the PQ codebooks (k-means on
+        /// the residuals of every sub-space) from 'n' normalized rows, 'stride' floats apart.
+        /// Large inputs are sub-sampled. Faces added before are dropped.
+        int Train(const float *data, size_t n, int stride);
+
+        inline bool IsTrained() const { return trained_; }
+
+        //! Fewest rows accepted by Train
+        size_t MinTrainingSize() const;
+
+        //! Encode a normalized feature under 'label', an existing face with the same label is replaced
+        int Add(int64_t label, const float *feat);
+
+        int Remove(int64_t label);
+
+        //! The k best faces with similarity >= min_sim, sorted by descending similarity
+        void Search(const float *probe, int k, float min_sim, std::vector<ScoredLabel> &results) const;
+
+        //! Exact (normalized, zero padded) feature of 'label', nullptr if unknown
+        const float *Vector(int64_t label) const;
+
+        inline bool Contains(int64_t label) const { return label_to_node_.count(label) != 0; }
+
+        inline size_t Size() const { return label_to_node_.size(); }
+
+        inline void SetNprobe(int nprobe) { nprobe_ = std::max(1, std::min(nprobe, nlist_)); }
+
+        inline void SetRerank(int rerank) { rerank_ = std::max(rerank, 0); }
+
+        inline int GetNlist() const { return nlist_; }
+
+        inline int GetCodeSize() const { return code_size_; }
+
+        //! Bytes held in memory per face: code, label and list bookkeeping, without the exact feature
+        inline size_t BytesPerFace() const {
+            return code_size_ + sizeof(int64_t) + 3 * sizeof(int);
+        }
+
+        /// \brief Write codebooks, codes and exact features to 'path' (through a temporary file so an
+        /// index mapped from 'path' stays valid). Labels are written through 'relabel'.
+        int Save(const std::string &path, const std::unordered_map<int64_t, int64_t> &relabel) const;
+
+        //! Map 'path' written by Save, the exact features stay in the mapping
+        int Load(const std::string &path);
+
+    private:
+        inline const float *NodeVector(int node) const {
+            return static_cast<size_t>(node) < num_mapped_
+                   ? mapped_vectors_ + static_cast<size_t>(node) * stride_
+                   : vectors_.data() + (static_cast<size_t>(node) - num_mapped_) * stride_;
+        }
+
+        int NearestList(const float *feat) const;
+
+        void Encode(const float *residual, uint8_t *code) const;
+
+    private:
+        int dim_;
+        int stride_;
+        int nlist_;
+        int code_size_;
+        int dsub_;
+        int nprobe_;
+        int rerank_;
+        bool trained_ = false;
+
+        //! nlist * dim, L2 normalized
+        std::vector<float> centroids_;
+        //! code_size * 256 * dsub, sub-quantizer j owns the block starting at j * 256 * dsub
+        std::vector<float> codebooks_;
+
+        std::vector<std::vector<uint8_t>> list_codes_;
+        std::vector<std::vector<int>> list_nodes_;
+
+        std::vector<int64_t> labels_;
+        //! inverted list of every node, -1 once removed
+        std::vector<int> node_lists_;
+        //! position of every node inside its inverted list
+        std::vector<int> node_offsets_;
+        std::unordered_map<int64_t, int> label_to_node_;
+
+        //! nodes [0, num_mapped_) have their exact features in the mapped file, the others in 'vectors_'
+        MappedFile mapped_;
+        const float *mapped_vectors_ = nullptr;
+        size_t num_mapped_ = 0;
+        AlignedVector<float> vectors_;
+    };
+
+}
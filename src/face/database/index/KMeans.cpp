@@ -0,0 +1,152 @@
+#include "KMeans.h"
+#include "../kernels/SimilarityKernels.h"
+#include "../../../common/common.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+namespace mirror {
+    //! Points scored against all centroids at once, keeps the score block small enough for L2
+    static const int kAssignBlock = 64;
+
+    void AssignClusters(const float *data, size_t n, int dim, const float *centroids, int k,
+                        bool spherical, std::vector<int> &assignments) {
+        assignments.resize(n);
+
+        // argmin |x - c|^2 == argmax <x, c> - |c|^2 / 2
+        std::vector<float> bias(static_cast<size_t>(k), 0.0f);
+        if (!spherical) {
+            for (int c = 0; c < k; ++c) {
+                const float *centroid = centroids + static_cast<size_t>(c) * dim;
+                bias[c] = -0.5f * DotProduct(centroid, centroid, dim);
+            }
+        }
+
+        // sub-quantizer spaces have only a few dimensions, score them with the centroids stored
+        // dimension-major so the inner loop runs over all centroids of one point at once
+        const bool small_dim = dim < kFeatureAlignment;
+        std::vector<float> transposed;
+        if (small_dim) {
+            transposed.resize(static_cast<size_t>(k) * dim);
+            for (int c = 0; c < k; ++c) {
+                for (int d = 0; d < dim; ++d) {
+                    transposed[static_cast<size_t>(d) * k + c] = centroids[static_cast<size_t>(c) * dim + d];
+                }
+            }
+        }
+
+        const int num_blocks = static_cast<int>((n + kAssignBlock - 1) / kAssignBlock);
+#pragma omp parallel for num_threads(CUSTOM_THREAD_NUMBER)
+        for (int block = 0; block < num_blocks; ++block) {
+            const size_t start = static_cast<size_t>(block) * kAssignBlock;
+            const int num_points = static_cast<int>(std::min<size_t>(kAssignBlock, n - start));
+            std::vector<float> scores(static_cast<size_t>(num_points) * k, 0.0f);
+            if (small_dim) {
+                for (int j = 0; j < num_points; ++j) {
+                    const float *point = data + (start + j) * dim;
+                    float *point_scores = scores.data() + static_cast<size_t>(j) * k;
+                    for (int d = 0; d < dim; ++d) {
+                        const float x = point[d];
+                        const float *column = &transposed[static_cast<size_t>(d) * k];
+                        for (int c = 0; c < k; ++c) {
+                            point_scores[c] += x * column[c];
+                        }
+                    }
+                }
+            } else {
+                DotProductBlock(data + start * dim, num_points, dim, centroids, k, dim, dim, scores.data(), k);
+            }
+
+            for (int j = 0; j < num_points; ++j) {
+                const float *point_scores = scores.data() + static_cast<size_t>(j) * k;
+                int best = 0;
+                float best_score = point_scores[0] + bias[0];
+                for (int c = 1; c < k; ++c) {
+                    const float score = point_scores[c] + bias[c];
+                    if (score > best_score) {
+                        best_score = score;
+                        best = c;
+                    }
+                }
+                assignments[start + j] = best;
+            }
+        }
+    }
+
+    int KMeans(const float *data, size_t n, int dim, int k, int num_iters, bool spherical,
+               uint32_t seed, std::vector<float> &centroids) {
+        if (k <= 0 || n < static_cast<size_t>(k)) {
+            return ErrorCode::EMPTY_DATA_ERROR;
+        }
+
+        // seed with k distinct random points
+        std::mt19937 rng(seed);
+        std::vector<size_t> perm(n);
+        std::iota(perm.begin(), perm.end(), size_t(0));
+        for (int c = 0; c < k; ++c) {
+            std::uniform_int_distribution<size_t> pick(static_cast<size_t>(c), n - 1);
+            std::swap(perm[c], perm[pick(rng)]);
+        }
+        centroids.resize(static_cast<size_t>(k) * dim);
+        for (int c = 0; c < k; ++c) {
+            std::copy(data + perm[c] * dim, data + (perm[c] + 1) * dim,
+                      centroids.begin() + static_cast<size_t>(c) * dim);
+        }
+
+        std::vector<int> assignments;
+        std::vector<double> sums(static_cast<size_t>(k) * dim);
+        std::vector<size_t> counts(static_cast<size_t>(k));
+        for (int iter = 0; iter < num_iters; ++iter) {
+            AssignClusters(data, n, dim, centroids.data(), k, spherical, assignments);
+
+            std::fill(sums.begin(), sums.end(), 0.0);
+            std::fill(counts.begin(), counts.end(), size_t(0));
+            for (size_t i = 0; i < n; ++i) {
+                const int c = assignments[i];
+                const float *point = data + i * dim;
+                double *sum = &sums[static_cast<size_t>(c) * dim];
+                for (int d = 0; d < dim; ++d) {
+                    sum[d] += point[d];
+                }
+                ++counts[c];
+            }
+
+            for (int c = 0; c < k; ++c) {
+                if (counts[c] == 0) continue;
+                float *centroid = &centroids[static_cast<size_t>(c) * dim];
+                const double *sum = &sums[static_cast<size_t>(c) * dim];
+                for (int d = 0; d < dim; ++d) {
+                    centroid[d] = static_cast<float>(sum[d] / counts[c]);
+                }
+            }
+
+            // split the largest cluster in two slightly perturbed halves for every empty one
+            for (int c = 0; c < k; ++c) {
+                if (counts[c] != 0) continue;
+                const int largest = static_cast<int>(
+                        std::max_element(counts.begin(), counts.end()) - counts.begin());
+                float *centroid = &centroids[static_cast<size_t>(c) * dim];
+                float *source = &centroids[static_cast<size_t>(largest) * dim];
+                const float eps = 1.0f / 1024.0f;
+                for (int d = 0; d < dim; ++d) {
+                    const float sign = (d % 2 == 0) ? 1.0f : -1.0f;
+                    centroid[d] = source[d] * (1.0f + sign * eps);
+                    source[d] = source[d] * (1.0f - sign * eps);
+                }
+                counts[c] = counts[largest] / 2;
+                counts[largest] -= counts[c];
+            }
+
+            if (spherical) {
+                for (int c = 0; c < k; ++c) {
+                    float *centroid = &centroids[static_cast<size_t>(c) * dim];
+                    NormalizeFeature(centroid, centroid, dim);
+                }
+            }
+        }
+        return 0;
+    }
+
+}
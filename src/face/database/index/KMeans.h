@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace mirror {
+    /// \brief Lloyd's k-means over 'n' dense rows of 'dim' floats.
+    /// With 'spherical' set the centroids are L2 normalized after every update and points are
+    /// assigned by inner product, which matches cosine similarity on normalized features.
+    /// Empty clusters are re-seeded by splitting the largest one.
+    /// \return 0 on success, EMPTY_DATA_ERROR if there are fewer points than clusters
+    int KMeans(const float *data, size_t n, int dim, int k, int num_iters, bool spherical,
+               uint32_t seed, std::vector<float> &centroids);
+
+    //! Best centroid of every point: max inner product if 'spherical', min L2 distance otherwise
+    void AssignClusters(const float *data, size_t n, int dim, const float *centroids, int k,
+                        bool spherical, std::vector<int> &assignments);
+
+}
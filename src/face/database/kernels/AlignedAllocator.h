@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#if defined(_MSC_VER) || defined(_WIN32) || defined(_WIN64)
+#include <malloc.h>
+#endif
+
+namespace mirror {
+    //! Minimal std::allocator replacement returning 'Alignment' byte aligned blocks
+    template<typename T, std::size_t Alignment = 64>
+    class AlignedAllocator {
+    public:
+        using value_type = T;
+
+        template<typename U>
+        struct rebind {
+            using other = AlignedAllocator<U, Alignment>;
+        };
+
+        AlignedAllocator() = default;
+
+        template<typename U>
+        AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+        T *allocate(std::size_t n) {
+            if (n == 0) return nullptr;
+            void *ptr = nullptr;
+#if defined(_MSC_VER) || defined(_WIN32) || defined(_WIN64)
+            ptr = _aligned_malloc(n * sizeof(T), Alignment);
+#else
+            if (posix_memalign(&ptr, Alignment, n * sizeof(T)) != 0) {
+                ptr = nullptr;
+            }
+#endif
+            if (!ptr) throw std::bad_alloc();
+            return static_cast<T *>(ptr);
+        }
+
+        void deallocate(T *ptr, std::size_t) {
+#if defined(_MSC_VER) || defined(_WIN32) || defined(_WIN64)
+            _aligned_free(ptr);
+#else
+            free(ptr);
+#endif
+        }
+    };
+
+    template<typename T, typename U, std::size_t A>
+    inline bool operator==(const AlignedAllocator<T, A> &, const AlignedAllocator<U, A> &) { return true; }
+
+    template<typename T, typename U, std::size_t A>
+    inline bool operator!=(const AlignedAllocator<T, A> &, const AlignedAllocator<U, A> &) { return false; }
+
+    //! Contiguous, cache line aligned storage used by the feature matrices
+    template<typename T>
+    using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+}
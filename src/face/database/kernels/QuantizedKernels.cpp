@@ -0,0 +1,331 @@
+#include "QuantizedKernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MIRROR_X86_DISPATCH 1
+#include <immintrin.h>
+#define MIRROR_TARGET(arch) __attribute__((target(arch)))
+#elif defined(_MSC_VER) && (defined(__AVX2__) || defined(__AVX512F__))
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#define MIRROR_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace mirror {
+    using DotProductFp16Func = float (*)(const float *, const uint16_t *, int);
+    using DotProductInt8Func = int32_t (*)(const int8_t *, const int8_t *, int);
+
+    static inline uint16_t FloatToHalfScalar(float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+        const uint32_t abs = bits & 0x7FFFFFFFu;
+        if (abs >= 0x7F800000u) {
+            // inf stays inf, nan stays a quiet nan
+            return static_cast<uint16_t>(sign | 0x7C00u | (abs > 0x7F800000u ? 0x200u : 0u));
+        }
+        if (abs >= 0x477FF000u) {
+            // >= 65520 rounds to inf
+            return static_cast<uint16_t>(sign | 0x7C00u);
+        }
+        if (abs < 0x38800000u) {
+            // below 2^-14: half subnormal or zero
+            if (abs < 0x33000000u) return sign;
+            const uint32_t shift = 126u - (abs >> 23);
+            const uint32_t mant = (abs & 0x7FFFFFu) | 0x800000u;
+            uint32_t half = mant >> shift;
+            const uint32_t rem = mant & ((1u << shift) - 1u);
+            const uint32_t halfway = 1u << (shift - 1u);
+            if (rem > halfway || (rem == halfway && (half & 1u))) ++half;
+            return static_cast<uint16_t>(sign | half);
+        }
+        // rebias the exponent and round the mantissa to 10 bits, a carry correctly bumps the exponent
+        uint32_t half = (abs - 0x38000000u) >> 13;
+        const uint32_t rem = abs & 0x1FFFu;
+        if (rem > 0x1000u || (rem == 0x1000u && (half & 1u))) ++half;
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    static inline float HalfToFloatScalar(uint16_t value) {
+        const uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+        uint32_t exp = (value >> 10) & 0x1Fu;
+        uint32_t mant = value & 0x3FFu;
+        uint32_t bits;
+        if (exp == 0x1Fu) {
+            bits = sign | 0x7F800000u | (mant << 13);
+        } else if (exp != 0) {
+            bits = sign | ((exp + 112u) << 23) | (mant << 13);
+        } else if (mant == 0) {
+            bits = sign;
+        } else {
+            // normalize the subnormal
+            exp = 113u;
+            while (!(mant & 0x400u)) {
+                mant <<= 1;
+                --exp;
+            }
+            bits = sign | (exp << 23) | ((mant & 0x3FFu) << 13);
+        }
+        float result;
+        std::memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    void FloatToHalf(const float *src, uint16_t *dst, int dim) {
+        for (int i = 0; i < dim; ++i) {
+            dst[i] = FloatToHalfScalar(src[i]);
+        }
+    }
+
+    void HalfToFloat(const uint16_t *src, float *dst, int dim) {
+        for (int i = 0; i < dim; ++i) {
+            dst[i] = HalfToFloatScalar(src[i]);
+        }
+    }
+
+    float QuantizeInt8(const float *src, int8_t *dst, int dim) {
+        float max_abs = 0.0f;
+        for (int i = 0; i < dim; ++i) {
+            max_abs = std::max(max_abs, std::fabs(src[i]));
+        }
+        if (max_abs == 0.0f) {
+            std::fill(dst, dst + dim, int8_t(0));
+            return 0.0f;
+        }
+        const float inv_scale = 127.0f / max_abs;
+        for (int i = 0; i < dim; ++i) {
+            const float q = std::round(src[i] * inv_scale);
+            dst[i] = static_cast<int8_t>(std::max(-127.0f, std::min(127.0f, q)));
+        }
+        return max_abs / 127.0f;
+    }
+
+    void DequantizeInt8(const int8_t *src, float scale, float *dst, int dim) {
+        for (int i = 0; i < dim; ++i) {
+            dst[i] = src[i] * scale;
+        }
+    }
+
+    static float DotProductFp16Scalar(const float *a, const uint16_t *b, int dim) {
+        float sum = 0.0f;
+        for (int i = 0; i < dim; ++i) {
+            sum += a[i] * HalfToFloatScalar(b[i]);
+        }
+        return sum;
+    }
+
+    static int32_t DotProductInt8Scalar(const int8_t *a, const int8_t *b, int dim) {
+        int32_t sum = 0;
+        for (int i = 0; i < dim; ++i) {
+            sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+        }
+        return sum;
+    }
+
+#if defined(MIRROR_X86_DISPATCH) || (defined(_MSC_VER) && defined(__AVX2__))
+
+#if defined(MIRROR_X86_DISPATCH)
+    MIRROR_TARGET("avx2,fma,f16c")
+#endif
+    static float DotProductFp16AVX2(const float *a, const uint16_t *b, int dim) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 16 <= dim; i += 16) {
+            const __m256 b0 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i)));
+            const __m256 b1 = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i + 8)));
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), b0, acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), b1, acc1);
+        }
+        acc0 = _mm256_add_ps(acc0, acc1);
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+        float result = _mm_cvtss_f32(sum);
+        for (; i < dim; ++i) {
+            result += a[i] * HalfToFloatScalar(b[i]);
+        }
+        return result;
+    }
+
+#if defined(MIRROR_X86_DISPATCH)
+    MIRROR_TARGET("avx2")
+#endif
+    static int32_t DotProductInt8AVX2(const int8_t *a, const int8_t *b, int dim) {
+        // |a| * (b * sign(a)) == a * b, and maddubs needs an unsigned first operand;
+        // with codes in [-127, 127] the pairwise int16 sums can not saturate
+        const __m256i ones = _mm256_set1_epi16(1);
+        __m256i acc = _mm256_setzero_si256();
+        int i = 0;
+        for (; i + 32 <= dim; i += 32) {
+            const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+            const __m256i products = _mm256_maddubs_epi16(_mm256_sign_epi8(va, va), _mm256_sign_epi8(vb, va));
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(products, ones));
+        }
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+        int32_t result = _mm_cvtsi128_si32(sum);
+        for (; i < dim; ++i) {
+            result += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+        }
+        return result;
+    }
+
+#endif
+
+#if defined(MIRROR_X86_DISPATCH) || (defined(_MSC_VER) && defined(__AVX512F__))
+
+#if defined(MIRROR_X86_DISPATCH)
+    MIRROR_TARGET("avx512f")
+#endif
+    static float DotProductFp16AVX512(const float *a, const uint16_t *b, int dim) {
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        int i = 0;
+        for (; i + 32 <= dim; i += 32) {
+            const __m512 b0 = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+            const __m512 b1 = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i + 16)));
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), b0, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), b1, acc1);
+        }
+        for (; i + 16 <= dim; i += 16) {
+            const __m512 b0 = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i)));
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), b0, acc0);
+        }
+        float result = _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+        for (; i < dim; ++i) {
+            result += a[i] * HalfToFloatScalar(b[i]);
+        }
+        return result;
+    }
+
+#if defined(MIRROR_X86_DISPATCH)
+    MIRROR_TARGET("avx512f,avx512bw,avx512vnni")
+#endif
+    static int32_t DotProductInt8VNNI(const int8_t *a, const int8_t *b, int dim) {
+        // vpdpbusd multiplies unsigned by signed bytes: feed it |a| and b with the sign of a
+        const __m512i zero = _mm512_setzero_si512();
+        __m512i acc = _mm512_setzero_si512();
+        int i = 0;
+        for (; i + 64 <= dim; i += 64) {
+            const __m512i va = _mm512_loadu_si512(a + i);
+            const __m512i vb = _mm512_loadu_si512(b + i);
+            const __mmask64 negative = _mm512_movepi8_mask(va);
+            const __m512i signed_b = _mm512_mask_sub_epi8(vb, negative, zero, vb);
+            acc = _mm512_dpbusd_epi32(acc, _mm512_abs_epi8(va), signed_b);
+        }
+        int32_t result = _mm512_reduce_add_epi32(acc);
+        for (; i < dim; ++i) {
+            result += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+        }
+        return result;
+    }
+
+#endif
+
+#if defined(MIRROR_NEON)
+
+#if defined(__aarch64__)
+    static float DotProductFp16NEON(const float *a, const uint16_t *b, int dim) {
+        float32x4_t acc0 = vdupq_n_f32(0.0f);
+        float32x4_t acc1 = vdupq_n_f32(0.0f);
+        int i = 0;
+        for (; i + 8 <= dim; i += 8) {
+            const float16x8_t half = vreinterpretq_f16_u16(vld1q_u16(b + i));
+            acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vcvt_f32_f16(vget_low_f16(half)));
+            acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vcvt_high_f32_f16(half));
+        }
+        float result = vaddvq_f32(vaddq_f32(acc0, acc1));
+        for (; i < dim; ++i) {
+            result += a[i] * HalfToFloatScalar(b[i]);
+        }
+        return result;
+    }
+#endif
+
+    static int32_t DotProductInt8NEON(const int8_t *a, const int8_t *b, int dim) {
+        int32x4_t acc = vdupq_n_s32(0);
+        int i = 0;
+        for (; i + 16 <= dim; i += 16) {
+            const int8x16_t va = vld1q_s8(a + i);
+            const int8x16_t vb = vld1q_s8(b + i);
+#if defined(__ARM_FEATURE_DOTPROD)
+            acc = vdotq_s32(acc, va, vb);
+#else
+            int16x8_t products = vmull_s8(vget_low_s8(va), vget_low_s8(vb));
+            products = vmlal_s8(products, vget_high_s8(va), vget_high_s8(vb));
+            acc = vpadalq_s16(acc, products);
+#endif
+        }
+#if defined(__aarch64__)
+        int32_t result = vaddvq_s32(acc);
+#else
+        int32x2_t half = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+        int32_t result = vget_lane_s32(vpadd_s32(half, half), 0);
+#endif
+        for (; i < dim; ++i) {
+            result += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+        }
+        return result;
+    }
+
+#endif
+
+    struct QuantizedKernel {
+        DotProductFp16Func fp16_func;
+        DotProductInt8Func int8_func;
+        const char *name;
+    };
+
+    static QuantizedKernel SelectQuantizedKernel() {
+#if defined(MIRROR_X86_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            if (__builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vnni")) {
+                return {DotProductFp16AVX512, DotProductInt8VNNI, "AVX512/AVX512-VNNI"};
+            }
+            if (__builtin_cpu_supports("avx2")) {
+                return {DotProductFp16AVX512, DotProductInt8AVX2, "AVX512/AVX2"};
+            }
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return {DotProductFp16AVX2, DotProductInt8AVX2, "AVX2"};
+        }
+#elif defined(_MSC_VER) && defined(__AVX512F__)
+        return {DotProductFp16AVX512, DotProductInt8AVX2, "AVX512/AVX2"};
+#elif defined(_MSC_VER) && defined(__AVX2__)
+        return {DotProductFp16AVX2, DotProductInt8AVX2, "AVX2"};
+#elif defined(MIRROR_NEON) && defined(__aarch64__)
+#if defined(__ARM_FEATURE_DOTPROD)
+        return {DotProductFp16NEON, DotProductInt8NEON, "NEON/SDOT"};
+#else
+        return {DotProductFp16NEON, DotProductInt8NEON, "NEON"};
+#endif
+#elif defined(MIRROR_NEON)
+        return {DotProductFp16Scalar, DotProductInt8NEON, "C++/NEON"};
+#endif
+        return {DotProductFp16Scalar, DotProductInt8Scalar, "C++"};
+    }
+
+    static const QuantizedKernel g_quantized_kernel = SelectQuantizedKernel();
+
+    float DotProductFp16(const float *a, const uint16_t *b, int dim) {
+        return g_quantized_kernel.fp16_func(a, b, dim);
+    }
+
+    int32_t DotProductInt8(const int8_t *a, const int8_t *b, int dim) {
+        return g_quantized_kernel.int8_func(a, b, dim);
+    }
+
+    const char *GetQuantizedKernelName() {
+        return g_quantized_kernel.name;
+    }
+
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+
+namespace mirror {
+    //! IEEE half precision conversion (round to nearest even)
+    void FloatToHalf(const float *src, uint16_t *dst, int dim);
+
+    void HalfToFloat(const uint16_t *src, float *dst, int dim);
+
+    /// \brief Symmetric per-vector int8 quantization, dst[i] = round(src[i] / scale) in [-127, 127].
+    /// -128 is never produced so the kernels may negate codes freely.
+    /// \return The scale (max |src[i]| / 127), 0 for an all zero vector.
+    float QuantizeInt8(const float *src, int8_t *dst, int dim);
+
+    void DequantizeInt8(const int8_t *src, float scale, float *dst, int dim);
+
+    /// \brief Inner product of a float vector with a half precision one.
+    /// Dispatched at runtime to AVX-512 / AVX2 + F16C on x86, NEON on aarch64 and plain C++ otherwise.
+    float DotProductFp16(const float *a, const uint16_t *b, int dim);
+
+    /// \brief Inner product of two int8 vectors with values in [-127, 127].
+    /// Uses AVX-512 VNNI (vpdpbusd) or AVX2 (vpmaddubsw) on x86, sdot / smull on arm.
+    int32_t DotProductInt8(const int8_t *a, const int8_t *b, int dim);
+
+    //! Instruction sets selected for the fp16 and int8 kernels, e.g. "AVX512/AVX512-VNNI"
+    const char *GetQuantizedKernelName();
+
+}
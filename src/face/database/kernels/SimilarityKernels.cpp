@@ -0,0 +1,422 @@
+#include "SimilarityKernels.h"
+#include <cmath>
+#include <cstddef>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MIRROR_X86_DISPATCH 1
+#include <immintrin.h>
+#define MIRROR_TARGET(arch) __attribute__((target(arch)))
+#elif defined(_MSC_VER) && (defined(__AVX2__) || defined(__AVX512F__))
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#define MIRROR_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace mirror {
+    // scores 4 probes against 2 rows, out[j * 2 + r]
+    using DotProduct4x2Func = void (*)(const float *, int, const float *, int, int, float *);
+
+    // Every kernel is a template on the dimension: Dim = 0 reads it at runtime, the instances for the
+    // dimensions of the common recognizers get constant trip counts, the compiler unrolls their loops
+    // and drops the tails.
+    template<int Dim>
+    static float DotProductScalar(const float *a, const float *b, int runtime_dim) {
+        const int dim = Dim > 0 ? Dim : runtime_dim;
+        float sum0 = 0.0f, sum1 = 0.0f, sum2 = 0.0f, sum3 = 0.0f;
+        int i = 0;
+        for (; i + 4 <= dim; i += 4) {
+            sum0 += a[i] * b[i];
+            sum1 += a[i + 1] * b[i + 1];
+            sum2 += a[i + 2] * b[i + 2];
+            sum3 += a[i + 3] * b[i + 3];
+        }
+        for (; i < dim; ++i) {
+            sum0 += a[i] * b[i];
+        }
+        return (sum0 + sum1) + (sum2 + sum3);
+    }
+
+    template<int Dim>
+    static void DotProduct4x2Scalar(const float *probes, int probe_stride,
+                                    const float *rows, int row_stride, int dim, float *out) {
+        for (int j = 0; j < 4; ++j) {
+            out[j * 2] = DotProductScalar<Dim>(probes + j * probe_stride, rows, dim);
+            out[j * 2 + 1] = DotProductScalar<Dim>(probes + j * probe_stride, rows + row_stride, dim);
+        }
+    }
+
+#if defined(MIRROR_X86_DISPATCH) || (defined(_MSC_VER) && defined(__AVX2__))
+
+#if defined(MIRROR_X86_DISPATCH)
+    MIRROR_TARGET("avx2,fma")
+#endif
+    static inline float HorizontalSumAVX2(__m256 v) {
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+        return _mm_cvtss_f32(sum);
+    }
+
+    template<int Dim>
+#if defined(MIRROR_X86_DISPATCH)
+    MIRROR_TARGET("avx2,fma")
+#endif
+    static float DotProductAVX2(const float *a, const float *b, int runtime_dim) {
+        const int dim = Dim > 0 ? Dim : runtime_dim;
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 32 <= dim; i += 32) {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+        }
+        for (; i + 8 <= dim; i += 8) {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        }
+        float result = HorizontalSumAVX2(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+        for (; i < dim; ++i) {
+            result += a[i] * b[i];
+        }
+        return result;
+    }
+
+    template<int Dim>
+#if defined(MIRROR_X86_DISPATCH)
+    MIRROR_TARGET("avx2,fma")
+#endif
+    static void DotProduct4x2AVX2(const float *probes, int probe_stride,
+                                  const float *rows, int row_stride, int runtime_dim, float *out) {
+        const int dim = Dim > 0 ? Dim : runtime_dim;
+        const float *p0 = probes;
+        const float *p1 = probes + probe_stride;
+        const float *p2 = probes + 2 * probe_stride;
+        const float *p3 = probes + 3 * probe_stride;
+        const float *r0 = rows;
+        const float *r1 = rows + row_stride;
+        __m256 acc00 = _mm256_setzero_ps(), acc01 = _mm256_setzero_ps();
+        __m256 acc10 = _mm256_setzero_ps(), acc11 = _mm256_setzero_ps();
+        __m256 acc20 = _mm256_setzero_ps(), acc21 = _mm256_setzero_ps();
+        __m256 acc30 = _mm256_setzero_ps(), acc31 = _mm256_setzero_ps();
+        int i = 0;
+        for (; i + 8 <= dim; i += 8) {
+            const __m256 x0 = _mm256_loadu_ps(r0 + i);
+            const __m256 x1 = _mm256_loadu_ps(r1 + i);
+            __m256 q = _mm256_loadu_ps(p0 + i);
+            acc00 = _mm256_fmadd_ps(q, x0, acc00);
+            acc01 = _mm256_fmadd_ps(q, x1, acc01);
+            q = _mm256_loadu_ps(p1 + i);
+            acc10 = _mm256_fmadd_ps(q, x0, acc10);
+            acc11 = _mm256_fmadd_ps(q, x1, acc11);
+            q = _mm256_loadu_ps(p2 + i);
+            acc20 = _mm256_fmadd_ps(q, x0, acc20);
+            acc21 = _mm256_fmadd_ps(q, x1, acc21);
+            q = _mm256_loadu_ps(p3 + i);
+            acc30 = _mm256_fmadd_ps(q, x0, acc30);
+            acc31 = _mm256_fmadd_ps(q, x1, acc31);
+        }
+        out[0] = HorizontalSumAVX2(acc00);
+        out[1] = HorizontalSumAVX2(acc01);
+        out[2] = HorizontalSumAVX2(acc10);
+        out[3] = HorizontalSumAVX2(acc11);
+        out[4] = HorizontalSumAVX2(acc20);
+        out[5] = HorizontalSumAVX2(acc21);
+        out[6] = HorizontalSumAVX2(acc30);
+        out[7] = HorizontalSumAVX2(acc31);
+        for (; i < dim; ++i) {
+            out[0] += p0[i] * r0[i];
+            out[1] += p0[i] * r1[i];
+            out[2] += p1[i] * r0[i];
+            out[3] += p1[i] * r1[i];
+            out[4] += p2[i] * r0[i];
+            out[5] += p2[i] * r1[i];
+            out[6] += p3[i] * r0[i];
+            out[7] += p3[i] * r1[i];
+        }
+    }
+
+#endif
+
+#if defined(MIRROR_X86_DISPATCH) || (defined(_MSC_VER) && defined(__AVX512F__))
+
+    template<int Dim>
+#if defined(MIRROR_X86_DISPATCH)
+    MIRROR_TARGET("avx512f")
+#endif
+    static float DotProductAVX512(const float *a, const float *b, int runtime_dim) {
+        const int dim = Dim > 0 ? Dim : runtime_dim;
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+        int i = 0;
+        for (; i + 64 <= dim; i += 64) {
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32), acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48), acc3);
+        }
+        for (; i + 16 <= dim; i += 16) {
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        }
+        float result = _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+        for (; i < dim; ++i) {
+            result += a[i] * b[i];
+        }
+        return result;
+    }
+
+    template<int Dim>
+#if defined(MIRROR_X86_DISPATCH)
+    MIRROR_TARGET("avx512f")
+#endif
+    static void DotProduct4x2AVX512(const float *probes, int probe_stride,
+                                    const float *rows, int row_stride, int runtime_dim, float *out) {
+        const int dim = Dim > 0 ? Dim : runtime_dim;
+        const float *p0 = probes;
+        const float *p1 = probes + probe_stride;
+        const float *p2 = probes + 2 * probe_stride;
+        const float *p3 = probes + 3 * probe_stride;
+        const float *r0 = rows;
+        const float *r1 = rows + row_stride;
+        __m512 acc00 = _mm512_setzero_ps(), acc01 = _mm512_setzero_ps();
+        __m512 acc10 = _mm512_setzero_ps(), acc11 = _mm512_setzero_ps();
+        __m512 acc20 = _mm512_setzero_ps(), acc21 = _mm512_setzero_ps();
+        __m512 acc30 = _mm512_setzero_ps(), acc31 = _mm512_setzero_ps();
+        int i = 0;
+        for (; i + 16 <= dim; i += 16) {
+            const __m512 x0 = _mm512_loadu_ps(r0 + i);
+            const __m512 x1 = _mm512_loadu_ps(r1 + i);
+            __m512 q = _mm512_loadu_ps(p0 + i);
+            acc00 = _mm512_fmadd_ps(q, x0, acc00);
+            acc01 = _mm512_fmadd_ps(q, x1, acc01);
+            q = _mm512_loadu_ps(p1 + i);
+            acc10 = _mm512_fmadd_ps(q, x0, acc10);
+            acc11 = _mm512_fmadd_ps(q, x1, acc11);
+            q = _mm512_loadu_ps(p2 + i);
+            acc20 = _mm512_fmadd_ps(q, x0, acc20);
+            acc21 = _mm512_fmadd_ps(q, x1, acc21);
+            q = _mm512_loadu_ps(p3 + i);
+            acc30 = _mm512_fmadd_ps(q, x0, acc30);
+            acc31 = _mm512_fmadd_ps(q, x1, acc31);
+        }
+        out[0] = _mm512_reduce_add_ps(acc00);
+        out[1] = _mm512_reduce_add_ps(acc01);
+        out[2] = _mm512_reduce_add_ps(acc10);
+        out[3] = _mm512_reduce_add_ps(acc11);
+        out[4] = _mm512_reduce_add_ps(acc20);
+        out[5] = _mm512_reduce_add_ps(acc21);
+        out[6] = _mm512_reduce_add_ps(acc30);
+        out[7] = _mm512_reduce_add_ps(acc31);
+        for (; i < dim; ++i) {
+            out[0] += p0[i] * r0[i];
+            out[1] += p0[i] * r1[i];
+            out[2] += p1[i] * r0[i];
+            out[3] += p1[i] * r1[i];
+            out[4] += p2[i] * r0[i];
+            out[5] += p2[i] * r1[i];
+            out[6] += p3[i] * r0[i];
+            out[7] += p3[i] * r1[i];
+        }
+    }
+
+#endif
+
+#if defined(MIRROR_NEON)
+
+    static inline float HorizontalSumNEON(float32x4_t v) {
+#if defined(__aarch64__)
+        return vaddvq_f32(v);
+#else
+        float32x2_t half = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+        return vget_lane_f32(vpadd_f32(half, half), 0);
+#endif
+    }
+
+    template<int Dim>
+    static float DotProductNEON(const float *a, const float *b, int runtime_dim) {
+        const int dim = Dim > 0 ? Dim : runtime_dim;
+        float32x4_t acc0 = vdupq_n_f32(0.0f);
+        float32x4_t acc1 = vdupq_n_f32(0.0f);
+        float32x4_t acc2 = vdupq_n_f32(0.0f);
+        float32x4_t acc3 = vdupq_n_f32(0.0f);
+        int i = 0;
+        for (; i + 16 <= dim; i += 16) {
+            acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+            acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+            acc2 = vmlaq_f32(acc2, vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+            acc3 = vmlaq_f32(acc3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+        }
+        for (; i + 4 <= dim; i += 4) {
+            acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        }
+        float result = HorizontalSumNEON(vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3)));
+        for (; i < dim; ++i) {
+            result += a[i] * b[i];
+        }
+        return result;
+    }
+
+    template<int Dim>
+    static void DotProduct4x2NEON(const float *probes, int probe_stride,
+                                  const float *rows, int row_stride, int runtime_dim, float *out) {
+        const int dim = Dim > 0 ? Dim : runtime_dim;
+        const float *p0 = probes;
+        const float *p1 = probes + probe_stride;
+        const float *p2 = probes + 2 * probe_stride;
+        const float *p3 = probes + 3 * probe_stride;
+        const float *r0 = rows;
+        const float *r1 = rows + row_stride;
+        float32x4_t acc00 = vdupq_n_f32(0.0f), acc01 = vdupq_n_f32(0.0f);
+        float32x4_t acc10 = vdupq_n_f32(0.0f), acc11 = vdupq_n_f32(0.0f);
+        float32x4_t acc20 = vdupq_n_f32(0.0f), acc21 = vdupq_n_f32(0.0f);
+        float32x4_t acc30 = vdupq_n_f32(0.0f), acc31 = vdupq_n_f32(0.0f);
+        int i = 0;
+        for (; i + 4 <= dim; i += 4) {
+            const float32x4_t x0 = vld1q_f32(r0 + i);
+            const float32x4_t x1 = vld1q_f32(r1 + i);
+            float32x4_t q = vld1q_f32(p0 + i);
+            acc00 = vmlaq_f32(acc00, q, x0);
+            acc01 = vmlaq_f32(acc01, q, x1);
+            q = vld1q_f32(p1 + i);
+            acc10 = vmlaq_f32(acc10, q, x0);
+            acc11 = vmlaq_f32(acc11, q, x1);
+            q = vld1q_f32(p2 + i);
+            acc20 = vmlaq_f32(acc20, q, x0);
+            acc21 = vmlaq_f32(acc21, q, x1);
+            q = vld1q_f32(p3 + i);
+            acc30 = vmlaq_f32(acc30, q, x0);
+            acc31 = vmlaq_f32(acc31, q, x1);
+        }
+        out[0] = HorizontalSumNEON(acc00);
+        out[1] = HorizontalSumNEON(acc01);
+        out[2] = HorizontalSumNEON(acc10);
+        out[3] = HorizontalSumNEON(acc11);
+        out[4] = HorizontalSumNEON(acc20);
+        out[5] = HorizontalSumNEON(acc21);
+        out[6] = HorizontalSumNEON(acc30);
+        out[7] = HorizontalSumNEON(acc31);
+        for (; i < dim; ++i) {
+            out[0] += p0[i] * r0[i];
+            out[1] += p0[i] * r1[i];
+            out[2] += p1[i] * r0[i];
+            out[3] += p1[i] * r1[i];
+            out[4] += p2[i] * r0[i];
+            out[5] += p2[i] * r1[i];
+            out[6] += p3[i] * r0[i];
+            out[7] += p3[i] * r1[i];
+        }
+    }
+
+#endif
+
+    //! kernels of one instruction set, the unrolled ones are indexed like kUnrolledFeatureDims
+    struct DotProductKernel {
+        DotProductFunc func;
+        DotProduct4x2Func block_func;
+        DotProductFunc unrolled_func[3];
+        DotProduct4x2Func unrolled_block_func[3];
+        const char *name;
+    };
+
+#define MIRROR_DOT_KERNEL(arch, name) \
+    {DotProduct##arch<0>, DotProduct4x2##arch<0>, \
+     {DotProduct##arch<128>, DotProduct##arch<256>, DotProduct##arch<512>}, \
+     {DotProduct4x2##arch<128>, DotProduct4x2##arch<256>, DotProduct4x2##arch<512>}, name}
+
+    static DotProductKernel SelectDotProductKernel() {
+#if defined(MIRROR_X86_DISPATCH)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return MIRROR_DOT_KERNEL(AVX512, "AVX512");
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return MIRROR_DOT_KERNEL(AVX2, "AVX2");
+        }
+#elif defined(_MSC_VER) && defined(__AVX512F__)
+        return MIRROR_DOT_KERNEL(AVX512, "AVX512");
+#elif defined(_MSC_VER) && defined(__AVX2__)
+        return MIRROR_DOT_KERNEL(AVX2, "AVX2");
+#elif defined(MIRROR_NEON)
+        return MIRROR_DOT_KERNEL(NEON, "NEON");
+#endif
+        return MIRROR_DOT_KERNEL(Scalar, "C++");
+    }
+
+#undef MIRROR_DOT_KERNEL
+
+    static const DotProductKernel g_dot_kernel = SelectDotProductKernel();
+
+    static inline int UnrolledKernelIndex(int dim) {
+        for (int i = 0; i < 3; ++i) {
+            if (kUnrolledFeatureDims[i] == dim) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    DotProductFunc SelectDotProduct(int dim) {
+        const int index = UnrolledKernelIndex(dim);
+        return index >= 0 ? g_dot_kernel.unrolled_func[index] : g_dot_kernel.func;
+    }
+
+    float DotProduct(const float *a, const float *b, int dim) {
+        return SelectDotProduct(dim)(a, b, dim);
+    }
+
+    void DotProductBlock(const float *probes, int num_probes, int probe_stride,
+                         const float *rows, int num_rows, int row_stride,
+                         int dim, float *scores, int score_stride) {
+        const int index = UnrolledKernelIndex(dim);
+        const DotProduct4x2Func block_func = index >= 0 ? g_dot_kernel.unrolled_block_func[index] :
+                                             g_dot_kernel.block_func;
+        const DotProductFunc func = SelectDotProduct(dim);
+        float out[8];
+        int r = 0;
+        for (; r + 2 <= num_rows; r += 2) {
+            const float *row = rows + static_cast<size_t>(r) * row_stride;
+            int j = 0;
+            for (; j + 4 <= num_probes; j += 4) {
+                block_func(probes + static_cast<size_t>(j) * probe_stride, probe_stride,
+                           row, row_stride, dim, out);
+                for (int jj = 0; jj < 4; ++jj) {
+                    scores[static_cast<size_t>(j + jj) * score_stride + r] = out[jj * 2];
+                    scores[static_cast<size_t>(j + jj) * score_stride + r + 1] = out[jj * 2 + 1];
+                }
+            }
+            for (; j < num_probes; ++j) {
+                const float *probe = probes + static_cast<size_t>(j) * probe_stride;
+                scores[static_cast<size_t>(j) * score_stride + r] = func(probe, row, dim);
+                scores[static_cast<size_t>(j) * score_stride + r + 1] = func(probe, row + row_stride, dim);
+            }
+        }
+        for (; r < num_rows; ++r) {
+            const float *row = rows + static_cast<size_t>(r) * row_stride;
+            for (int j = 0; j < num_probes; ++j) {
+                scores[static_cast<size_t>(j) * score_stride + r] =
+                        func(probes + static_cast<size_t>(j) * probe_stride, row, dim);
+            }
+        }
+    }
+
+    float NormalizeFeature(const float *src, float *dst, int dim) {
+        float norm = std::sqrt(DotProduct(src, src, dim));
+        float scale = norm > 1e-12f ? 1.0f / norm : 0.0f;
+        for (int i = 0; i < dim; ++i) {
+            dst[i] = src[i] * scale;
+        }
+        return norm;
+    }
+
+    const char *GetSimilarityKernelName() {
+        return g_dot_kernel.name;
+    }
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+namespace mirror {
+    //! Feature rows are padded to a multiple of one 64 byte cache line (16 floats)
+    const int kFeatureAlignment = 16;
+
+    constexpr int AlignedFeatureDim(int dim) {
+        return (dim + kFeatureAlignment - 1) / kFeatureAlignment * kFeatureAlignment;
+    }
+
+    //! Feature dimensions of the common recognizers, their kernels are unrolled at compile time
+    const int kUnrolledFeatureDims[3] = {128, 256, 512};
+
+    using DotProductFunc = float (*)(const float *, const float *, int);
+
+    /// \brief Inner product of two float vectors.
+    /// Dispatched at runtime to AVX-512 / AVX2 on x86, NEON on arm and plain C++ otherwise,
+    /// then to the kernel unrolled for 'dim' when it is one of kUnrolledFeatureDims.
+    float DotProduct(const float *a, const float *b, int dim);
+
+    //! The kernel DotProduct dispatches to for 'dim', for loops scoring many rows of one dimension
+    DotProductFunc SelectDotProduct(int dim);
+
+    /// \brief Inner products of a block of probes against a block of gallery rows.
+    /// scores[j * score_stride + r] = <probes[j], rows[r]> for j < num_probes and r < num_rows.
+    /// Four probes are scored against two rows at a time so every row loaded from memory
+    /// is reused by several probes, the caller tiles 'rows' so that they stay in L2.
+    void DotProductBlock(const float *probes, int num_probes, int probe_stride,
+                         const float *rows, int num_rows, int row_stride,
+                         int dim, float *scores, int score_stride);
+
+    /// \brief L2 normalize 'src' into 'dst' (they may alias).
+    /// \return The original L2 norm of 'src'.
+    float NormalizeFeature(const float *src, float *dst, int dim);
+
+    //! Name of the instruction set selected by the dispatcher, e.g. "AVX2"
+    const char *GetSimilarityKernelName();
+
+}
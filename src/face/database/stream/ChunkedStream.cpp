@@ -0,0 +1,87 @@
+#include "ChunkedStream.h"
+#include "Crc32c.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace mirror {
+    const size_t ChunkedWriter::kDefaultChunkSize;
+    const size_t ChunkedReader::kMaxChunkSize;
+
+    ChunkedWriter::ChunkedWriter(StreamWriter &writer, size_t chunk_size)
+            : writer_(writer), chunk_size_(std::max<size_t>(chunk_size, 1)) {
+        buffer_.reserve(chunk_size_);
+    }
+
+    size_t ChunkedWriter::write(const char *data, size_t length) {
+        size_t written = 0;
+        while (good_ && written < length) {
+            const size_t n = std::min(length - written, chunk_size_ - buffer_.size());
+            buffer_.insert(buffer_.end(), data + written, data + written + n);
+            written += n;
+            if (buffer_.size() == chunk_size_) {
+                FlushChunk();
+            }
+        }
+        return good_ ? length : 0;
+    }
+
+    bool ChunkedWriter::Finish() {
+        if (!buffer_.empty()) {
+            FlushChunk();
+        }
+        // the empty chunk tells a complete stream from a truncated one
+        return FlushChunk();
+    }
+
+    bool ChunkedWriter::FlushChunk() {
+        if (!good_) return false;
+        const uint32_t size = static_cast<uint32_t>(buffer_.size());
+        const uint32_t crc = Crc32c(buffer_.data(), buffer_.size());
+        good_ = Write(writer_, size) == sizeof(size) && Write(writer_, crc) == sizeof(crc) &&
+                writer_.write(buffer_.data(), buffer_.size()) == buffer_.size();
+        buffer_.clear();
+        return good_;
+    }
+
+    ChunkedReader::ChunkedReader(StreamReader &reader) : reader_(reader) {
+    }
+
+    size_t ChunkedReader::read(char *data, size_t length) {
+        size_t done = 0;
+        while (done < length) {
+            if (position_ == chunk_.size() && !NextChunk()) {
+                break;
+            }
+            const size_t n = std::min(length - done, chunk_.size() - position_);
+            std::memcpy(data + done, chunk_.data() + position_, n);
+            position_ += n;
+            done += n;
+        }
+        return done;
+    }
+
+    bool ChunkedReader::NextChunk() {
+        if (finished_ || corrupted_) return false;
+        chunk_.clear();
+        position_ = 0;
+        uint32_t size = 0;
+        uint32_t crc = 0;
+        if (Read(reader_, size) != sizeof(size) || Read(reader_, crc) != sizeof(crc) || size > kMaxChunkSize) {
+            corrupted_ = true;
+            return false;
+        }
+        chunk_.resize(size);
+        if (reader_.read(chunk_.data(), size) != size || Crc32c(chunk_.data(), size) != crc) {
+            chunk_.clear();
+            corrupted_ = true;
+            return false;
+        }
+        if (size == 0) {
+            finished_ = true;
+            return false;
+        }
+        return true;
+    }
+
+}
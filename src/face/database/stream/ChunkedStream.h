@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "FileSystem.h"
+
+namespace mirror {
+    /// \brief Stream of checksummed chunks over another stream, for moving galleries between hosts. A chunk is
+    ///   uint32 payload size | uint32 crc32c of the payload | payload
+    /// and an empty chunk ends the stream. Writes are gathered into chunks of 'chunk_size' bytes, so the
+    /// stream below sees a few large writes instead of one per field.
+    class ChunkedWriter : public StreamWriter {
+    public:
+        static const size_t kDefaultChunkSize = 1 << 20;
+
+        explicit ChunkedWriter(StreamWriter &writer, size_t chunk_size = kDefaultChunkSize);
+
+        ~ChunkedWriter() override = default;
+
+        //! Buffer 'length' bytes, returns 'length' unless the stream below failed
+        size_t write(const char *data, size_t length) override;
+
+        //! Write the buffered chunk and the end of the stream, false if the stream below failed
+        bool Finish();
+
+        inline bool Good() const { return good_; }
+
+    private:
+        bool FlushChunk();
+
+        StreamWriter &writer_;
+        std::vector<char> buffer_;
+        const size_t chunk_size_;
+        bool good_ = true;
+    };
+
+    /// \brief Reads the chunks of a ChunkedWriter. A chunk is checked as a whole before any of its bytes is
+    /// handed out, so every byte read has been verified; reading stops at the first corrupted chunk.
+    class ChunkedReader : public StreamReader {
+    public:
+        //! larger chunks are taken for corrupted sizes
+        static const size_t kMaxChunkSize = 64 << 20;
+
+        explicit ChunkedReader(StreamReader &reader);
+
+        ~ChunkedReader() override = default;
+
+        //! Returns less than 'length' at the end of the stream or at a corrupted chunk
+        size_t read(char *data, size_t length) override;
+
+        //! True once the end of the stream has been reached
+        inline bool Finished() const { return finished_; }
+
+        //! True when a chunk failed its checksum or the stream broke off before its end
+        inline bool Corrupted() const { return corrupted_; }
+
+    private:
+        bool NextChunk();
+
+        StreamReader &reader_;
+        std::vector<char> chunk_;
+        size_t position_ = 0;
+        bool finished_ = false;
+        bool corrupted_ = false;
+    };
+
+}
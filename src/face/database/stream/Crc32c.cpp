@@ -0,0 +1,44 @@
+#include "Crc32c.h"
+
+namespace mirror {
+struct Crc32cTable {
+	uint32_t table[8][256];
+
+	Crc32cTable() {
+		// reflected polynomial of CRC-32C
+		const uint32_t poly = 0x82F63B78u;
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; ++bit) {
+				crc = (crc & 1u) ? (crc >> 1) ^ poly : crc >> 1;
+			}
+			table[0][i] = crc;
+		}
+		// slicing-by-8: table[k][i] is the crc of byte i followed by k zero bytes
+		for (uint32_t i = 0; i < 256; ++i) {
+			for (int k = 1; k < 8; ++k) {
+				table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xFFu];
+			}
+		}
+	}
+};
+
+static const Crc32cTable g_crc32c_table;
+
+uint32_t Crc32c(const void *data, size_t size, uint32_t crc) {
+	const uint32_t (*t)[256] = g_crc32c_table.table;
+	const uint8_t *p = static_cast<const uint8_t *>(data);
+	crc = ~crc;
+	for (; size >= 8; size -= 8, p += 8) {
+		const uint32_t lo = crc ^ (static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+		                           static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24);
+		crc = t[7][lo & 0xFFu] ^ t[6][(lo >> 8) & 0xFFu] ^ t[5][(lo >> 16) & 0xFFu] ^ t[4][lo >> 24] ^
+		      t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+	}
+	for (; size > 0; --size, ++p) {
+		crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFFu];
+	}
+	return ~crc;
+}
+
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace mirror {
+    /// \brief CRC-32C (Castagnoli) of 'size' bytes, continuing from 'crc' (the result of a previous call, 0 to start).
+    uint32_t Crc32c(const void *data, size_t size, uint32_t crc = 0);
+
+}
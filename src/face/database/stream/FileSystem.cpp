@@ -1,5 +1,12 @@
 #include "FileSystem.h"
 
+#include <cerrno>
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
 namespace mirror {
 bool FileStream::open(const std::string & path, int mode) {
 	close();
@@ -24,6 +31,7 @@ bool FileStream::open(const std::string & path, int mode) {
 
 void FileStream::close() {
 	if (iofile_ != nullptr) std::fclose(iofile_);
+	iofile_ = nullptr;
 }
 
 bool FileStream::is_opened() const {
@@ -42,7 +50,13 @@ size_t FileStream::read(char* data, size_t length) {
 	return size_t(result);
 }
 
-
+bool MakeDirectory(const std::string& path) {
+#if defined(_WIN32)
+	return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+	return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
 }
 
 
+}
\ No newline at end of file
@@ -109,6 +109,9 @@ namespace mirror {
     };
 
 
+    //! Create the directory 'path' whose parent exists, true if it exists afterwards
+    bool MakeDirectory(const std::string &path);
+
     // read and write value
     template<typename T>
     static size_t Write(StreamWriter &writer, const T &value) {
@@ -0,0 +1,82 @@
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mirror {
+bool MappedFile::open(const std::string &path) {
+	close();
+#if defined(_WIN32)
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		return false;
+	}
+	void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	file_ = file;
+	mapping_ = mapping;
+	data_ = static_cast<const char *>(data);
+	size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		::close(fd);
+		return false;
+	}
+	void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	// the mapping keeps its own reference to the file
+	::close(fd);
+	if (data == MAP_FAILED) return false;
+	data_ = static_cast<const char *>(data);
+	size_ = static_cast<size_t>(st.st_size);
+#endif
+	return true;
+}
+
+void MappedFile::close() {
+	if (data_ == nullptr) return;
+#if defined(_WIN32)
+	UnmapViewOfFile(data_);
+	CloseHandle(mapping_);
+	CloseHandle(file_);
+	file_ = nullptr;
+	mapping_ = nullptr;
+#else
+	munmap(const_cast<char *>(data_), size_);
+#endif
+	data_ = nullptr;
+	size_ = 0;
+}
+
+size_t MemoryReader::read(char *data, size_t length) {
+	const size_t count = std::min(length, size_ - offset_);
+	std::memcpy(data, data_ + offset_, count);
+	offset_ += count;
+	return count;
+}
+
+}
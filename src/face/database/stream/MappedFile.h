@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "FileSystem.h"
+
+namespace mirror {
+
+    //! Read-only mapping of a whole file, the pages are shared with every process mapping the same file
+    class MappedFile {
+    public:
+        MappedFile() = default;
+
+        explicit MappedFile(const std::string &path) {
+            open(path);
+        }
+
+        MappedFile(const MappedFile &other) = delete;
+
+        MappedFile &operator=(const MappedFile &other) = delete;
+
+        ~MappedFile() {
+            close();
+        }
+
+        bool open(const std::string &path);
+
+        void close();
+
+        inline bool is_opened() const { return data_ != nullptr; }
+
+        inline const char *data() const { return data_; }
+
+        inline size_t size() const { return size_; }
+
+    private:
+        const char *data_ = nullptr;
+        size_t size_ = 0;
+#if defined(_WIN32)
+        void *file_ = nullptr;
+        void *mapping_ = nullptr;
+#endif
+    };
+
+    //! StreamReader over a memory block, used to parse headers of mapped files
+    class MemoryReader : public StreamReader {
+    public:
+        MemoryReader(const char *data, size_t size) : data_(data), size_(size) {
+        }
+
+        ~MemoryReader() override = default;
+
+        size_t read(char *data, size_t length) override;
+
+        inline size_t tell() const { return offset_; }
+
+    private:
+        const char *data_;
+        size_t size_;
+        size_t offset_ = 0;
+    };
+
+}
@@ -4,13 +4,18 @@
 #include "retinaface/RetinaFace.h"
 #include "anticov/AntiCovFace.h"
 #include "scrfd/Scrfd.h"
+#include "../../common/ScanPool.h"
 
 #include <ncnn/net.h>
 #include <ncnn/cpu.h>
 
+#include <algorithm>
 #include <iostream>
 
 namespace mirror {
+    // cpu threads of every extractor created on a tile worker, 0 outside the tiles keeps the net option
+    static thread_local int t_extractor_threads = 0;
+
     Detector::Detector(FaceDetectorType type) :
             type_(type),
             net_(new ncnn::Net()),
@@ -24,6 +29,10 @@ namespace mirror {
     }
 
     Detector::~Detector() {
+        if (pool_) {
+            delete pool_;
+            pool_ = nullptr;
+        }
         if (net_) {
             net_->clear();
             delete net_;
@@ -83,6 +92,7 @@ namespace mirror {
         }
         ncnn::set_omp_num_threads(num_threads);
         opt.num_threads = num_threads;
+        num_threads_ = num_threads;
 
 #if NCNN_VULKAN
         this->gpu_mode_ = params.gpuEnabled && ncnn::get_gpu_count() > 0;
@@ -96,6 +106,7 @@ namespace mirror {
 #else
         int flag = this->loadModel(params.modelPath.c_str());
 #endif
+        UpdatePool(params);
         if (flag != 0) {
             initialized_ = false;
             std::cout << "load detector model: " << GetDetectorTypeName(this->type_) << " failed!" << std::endl;
@@ -125,8 +136,14 @@ namespace mirror {
             std::cout << "start detect." << std::endl;
         }
 
+        // mtcnn builds its own pyramid from native resolution, tiles would not find it smaller faces
+        if (tile_size_ > 0 && this->type_ != FaceDetectorType::MTCNN_FACE &&
+            std::max(img_src.cols, img_src.rows) > tile_size_) {
+            return DetectTiles(img_src, faces);
+        }
+
         std::vector<FaceInfo> faces_tmp;
-        int flag = this->detectFace(img_src, faces_tmp);
+        int flag = this->detectFace(img_src, 0.0f, faces_tmp);
         if (flag != 0) {
             std::cout << "detect failed." << std::endl;
         } else {
@@ -146,6 +163,86 @@ namespace mirror {
         return flag;
     }
 
+    // joins the crops that overlap, or whose bounding box is no larger than the two apart, until none do
+    static void MergeRois(std::vector<cv::Rect> &rois) {
+        bool merged = true;
+        while (merged) {
+            merged = false;
+            for (size_t i = 0; i < rois.size() && !merged; ++i) {
+                for (size_t j = i + 1; j < rois.size(); ++j) {
+                    const cv::Rect joined = rois[i] | rois[j];
+                    if ((rois[i] & rois[j]).area() > 0 || joined.area() <= rois[i].area() + rois[j].area()) {
+                        rois[i] = joined;
+                        rois.erase(rois.begin() + j);
+                        merged = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    int Detector::detect(const cv::Mat &img_src, const std::vector<cv::Rect> &rois,
+                         std::vector<FaceInfo> &faces, bool merge) const {
+        // crops smaller than the coarsest stride of the detectors cannot hold a face
+        static const int kMinRoiSize = 32;
+        faces.clear();
+        if (!initialized_) {
+            std::cout << "face detector model: "
+                      << GetDetectorTypeName(this->type_)
+                      << " uninitialized!" << std::endl;
+            return ErrorCode::UNINITIALIZED_ERROR;
+        }
+        if (img_src.empty()) {
+            std::cout << "input empty." << std::endl;
+            return ErrorCode::EMPTY_INPUT_ERROR;
+        }
+
+        const cv::Rect bounds(0, 0, img_src.cols, img_src.rows);
+        std::vector<cv::Rect> crops;
+        for (const auto &roi : rois) {
+            const cv::Rect crop = roi & bounds;
+            if (crop.width >= kMinRoiSize && crop.height >= kMinRoiSize) {
+                crops.push_back(crop);
+            }
+        }
+        if (merge) {
+            MergeRois(crops);
+        }
+
+        if (verbose_) {
+            std::cout << "start detect in " << crops.size() << " rois." << std::endl;
+        }
+
+        std::vector<FaceInfo> faces_tmp, faces_crop;
+        for (const auto &crop : crops) {
+            // the crop is a view of the frame, the detectors read it through its row stride
+            int flag = this->detectFace(img_src(crop), 1.0f, faces_crop);
+            if (flag != 0) {
+                std::cout << "detect failed." << std::endl;
+                return flag;
+            }
+            const cv::Point2f offset(static_cast<float>(crop.x), static_cast<float>(crop.y));
+            for (auto &face : faces_crop) {
+                face.location_.x += crop.x;
+                face.location_.y += crop.y;
+                for (auto &keypoint : face.keypoints_) {
+                    keypoint += offset;
+                }
+                faces_tmp.push_back(face);
+            }
+        }
+
+        // a face on the edge of two crops is found in both
+        NMS(faces_tmp, faces, iouThreshold_);
+
+        if (verbose_) {
+            std::cout << faces.size() << " faces detected." << std::endl;
+            std::cout << "end face detect." << std::endl;
+        }
+        return 0;
+    }
+
     int Detector::update(const FaceEngineParams &params) {
         verbose_ = params.verbose;
         int flag = 0;
@@ -162,9 +259,140 @@ namespace mirror {
         if (params.scoreThreshold > 0) {
             scoreThreshold_ = params.scoreThreshold;
         }
+        UpdatePool(params);
         return flag;
     }
 
+    void Detector::UpdatePool(const FaceEngineParams &params) {
+        tile_size_ = std::max(0, params.detectTileSize);
+        tile_overlap_ = std::min(std::max(0, params.detectTileOverlap), tile_size_ / 2);
+        // the gpu runs one task after the other
+        const int pool_threads = (tile_size_ > 0 || parallel_stages_) && !gpu_mode_ ? num_threads_ : 1;
+        if (pool_ && pool_->Threads() != pool_threads) {
+            delete pool_;
+            pool_ = nullptr;
+        }
+        if (!pool_ && pool_threads > 1) {
+            pool_ = new ScanPool(pool_threads);
+        }
+    }
+
+    ncnn::Extractor Detector::NewExtractor(const ncnn::Net *net) const {
+        ncnn::Extractor ex = net->create_extractor();
+        if (t_extractor_threads > 0) {
+            ex.set_num_threads(t_extractor_threads);
+        }
+#if NCNN_VULKAN
+        if (this->gpu_mode_) {
+            ex.set_vulkan_compute(this->gpu_mode_);
+        }
+#endif
+        return ex;
+    }
+
+    int Detector::ParallelWorkers(int num_tasks) const {
+        return pool_ ? std::max(1, std::min(num_tasks, pool_->Threads())) : 1;
+    }
+
+    void Detector::RunParallel(int num_tasks, const std::function<void(int)> &task) const {
+        if (!pool_) {
+            for (int t = 0; t < num_tasks; ++t) {
+                task(t);
+            }
+            return;
+        }
+        // every task gets its share of the cpu threads for the extractors it creates
+        const int threads = std::max(1, num_threads_ / ParallelWorkers(num_tasks));
+        pool_->Run(num_tasks, [&](int t) {
+            const int previous = t_extractor_threads;
+            t_extractor_threads = threads;
+            task(t);
+            t_extractor_threads = previous;
+        });
+    }
+
+    // origins of the tiles along a side of 'length', spread evenly so that neighbours overlap by 'overlap' at least
+    static void TileOrigins(int length, int tile, int overlap, std::vector<int> &origins) {
+        origins.clear();
+        if (length <= tile) {
+            origins.push_back(0);
+            return;
+        }
+        const int count = (length - overlap + tile - overlap - 1) / (tile - overlap);
+        for (int k = 0; k < count; ++k) {
+            origins.push_back(static_cast<int>(static_cast<int64_t>(length - tile) * k / (count - 1)));
+        }
+    }
+
+    int Detector::DetectTiles(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const {
+        // a face this close to a side of its tile shared with another tile is cut by it
+        static const int kCutMargin = 2;
+        std::vector<int> xs, ys;
+        TileOrigins(img_src.cols, tile_size_, tile_overlap_, xs);
+        TileOrigins(img_src.rows, tile_size_, tile_overlap_, ys);
+        std::vector<cv::Rect> tiles;
+        for (int y : ys) {
+            for (int x : xs) {
+                tiles.push_back(cv::Rect(x, y, std::min(tile_size_, img_src.cols - x),
+                                         std::min(tile_size_, img_src.rows - y)));
+            }
+        }
+
+        if (verbose_) {
+            std::cout << "start detect in " << tiles.size() << " tiles." << std::endl;
+        }
+
+        // task 0 is the whole frame fit to the model input, it finds the faces too large for the overlap
+        const int num_tasks = static_cast<int>(tiles.size()) + 1;
+        std::vector<std::vector<FaceInfo>> results(num_tasks);
+        std::vector<int> flags(num_tasks, 0);
+        RunParallel(num_tasks, [&](int t) {
+            if (t == 0) {
+                flags[t] = this->detectFace(img_src, 0.0f, results[t]);
+            } else {
+                // tiles run at native scale, a cut face is whole in the neighbour tile when it is smaller
+                // than the overlap, and left to the whole frame pass when it is not
+                const cv::Rect &tile = tiles[t - 1];
+                std::vector<FaceInfo> &tile_faces = results[t];
+                flags[t] = this->detectFace(img_src(tile), 1.0f, tile_faces);
+                const bool left = tile.x > 0, top = tile.y > 0;
+                const bool right = tile.x + tile.width < img_src.cols;
+                const bool bottom = tile.y + tile.height < img_src.rows;
+                tile_faces.erase(std::remove_if(tile_faces.begin(), tile_faces.end(), [&](const FaceInfo &face) {
+                    const cv::Rect &box = face.location_;
+                    return (left && box.x <= kCutMargin) || (top && box.y <= kCutMargin) ||
+                           (right && box.x + box.width >= tile.width - kCutMargin) ||
+                           (bottom && box.y + box.height >= tile.height - kCutMargin);
+                }), tile_faces.end());
+                const cv::Point2f offset(static_cast<float>(tile.x), static_cast<float>(tile.y));
+                for (auto &face : tile_faces) {
+                    face.location_.x += tile.x;
+                    face.location_.y += tile.y;
+                    for (auto &keypoint : face.keypoints_) {
+                        keypoint += offset;
+                    }
+                }
+            }
+        });
+
+        std::vector<FaceInfo> faces_tmp;
+        for (int t = 0; t < num_tasks; ++t) {
+            if (flags[t] != 0) {
+                std::cout << "detect failed." << std::endl;
+                return flags[t];
+            }
+            faces_tmp.insert(faces_tmp.end(), results[t].begin(), results[t].end());
+        }
+        // the faces of the overlaps and the large faces are found twice
+        NMS(faces_tmp, faces, iouThreshold_);
+
+        if (verbose_) {
+            std::cout << faces.size() << " faces detected." << std::endl;
+            std::cout << "end face detect." << std::endl;
+        }
+        return 0;
+    }
+
 
     Detector *CenterfaceFactory::CreateDetector() const {
         return new CenterFace();
@@ -1,16 +1,20 @@
 #pragma once
 
+#include <functional>
 #include <vector>
 #include <opencv2/core.hpp>
 #include "../common/common.h"
 
 namespace ncnn {
     class Net;
+    class Extractor;
 };
 
 namespace mirror {
     using ANCHORS = std::vector<cv::Rect>;
 
+    class ScanPool;
+
     class Detector {
     public:
         using Super = Detector;
@@ -23,8 +27,14 @@ namespace mirror {
         int load(const FaceEngineParams &params);
         int update(const FaceEngineParams &params);
 
+        //! Detect faces in the whole frame, in overlapping tiles when it is larger than detectTileSize
         int detect(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const;
 
+        //! Detect faces inside 'rois' only, every crop runs at native resolution and the faces are in frame
+        //! coordinates; 'merge' joins the crops that overlap or cost no more together than apart
+        int detect(const cv::Mat &img_src, const std::vector<cv::Rect> &rois,
+                   std::vector<FaceInfo> &faces, bool merge = true) const;
+
         inline FaceDetectorType getType() const { return type_; }
 
     protected:
@@ -37,7 +47,18 @@ namespace mirror {
 
         virtual int loadModel(const char *root_path) = 0;
 
-        virtual int detectFace(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const = 0;
+        //! Run the network on 'img_src' resized by 'scale', 1 is native resolution and 0 or less fits the long
+        //! side to the input size of the model; faces in 'img_src' coordinates
+        virtual int detectFace(const cv::Mat &img_src, float scale, std::vector<FaceInfo> &faces) const = 0;
+
+        //! Extractor of 'net' for the calling thread, the tasks of RunParallel share the cpu threads
+        ncnn::Extractor NewExtractor(const ncnn::Net *net) const;
+
+        //! Workers RunParallel runs 'num_tasks' tasks on, 1 when there is no pool
+        int ParallelWorkers(int num_tasks) const;
+
+        //! Call task(0) ... task(num_tasks - 1) on the pool, or one after the other without it
+        void RunParallel(int num_tasks, const std::function<void(int)> &task) const;
 
     protected:
         FaceDetectorType type_;
@@ -49,6 +70,17 @@ namespace mirror {
         float iouThreshold_ = 0.45f;
         float scoreThreshold_ = 0.5f;
         std::string modelPath_;
+        bool parallel_stages_ = false; // the detector runs its own stages on the pool, with or without tiles
+        ScanPool *pool_ = nullptr;
+
+    private:
+        void UpdatePool(const FaceEngineParams &params);
+
+        int DetectTiles(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const;
+
+        int num_threads_ = 1;
+        int tile_size_ = 0;
+        int tile_overlap_ = 128;
     };
 
     class DetectorFactory {
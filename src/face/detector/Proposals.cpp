@@ -0,0 +1,51 @@
+#include "Proposals.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIRROR_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define MIRROR_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace mirror {
+    void SelectScores(const float *scores, int size, float threshold, std::vector<int> &indices) {
+        indices.clear();
+        int i = 0;
+#if defined(MIRROR_SSE2)
+        const __m128 limit = _mm_set1_ps(threshold);
+        for (; i + 16 <= size; i += 16) {
+            // sixteen compares folded into one mask, a single branch for sixteen background cells
+            int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(scores + i), limit)) |
+                       _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(scores + i + 4), limit)) << 4 |
+                       _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(scores + i + 8), limit)) << 8 |
+                       _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(scores + i + 12), limit)) << 12;
+            for (int lane = i; mask != 0; ++lane, mask >>= 1) {
+                if (mask & 1) indices.push_back(lane);
+            }
+        }
+#elif defined(MIRROR_NEON)
+        const float32x4_t limit = vdupq_n_f32(threshold);
+        for (; i + 16 <= size; i += 16) {
+            const uint32x4_t any = vorrq_u32(vorrq_u32(vcgeq_f32(vld1q_f32(scores + i), limit),
+                                                       vcgeq_f32(vld1q_f32(scores + i + 4), limit)),
+                                             vorrq_u32(vcgeq_f32(vld1q_f32(scores + i + 8), limit),
+                                                       vcgeq_f32(vld1q_f32(scores + i + 12), limit)));
+            const uint32x2_t folded = vorr_u32(vget_low_u32(any), vget_high_u32(any));
+            if ((vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) == 0) continue;
+            for (int lane = i; lane < i + 16; ++lane) {
+                if (scores[lane] >= threshold) indices.push_back(lane);
+            }
+        }
+#endif
+        for (; i < size; ++i) {
+            if (scores[i] >= threshold) indices.push_back(i);
+        }
+    }
+
+    std::vector<int> &ProposalIndices() {
+        static thread_local std::vector<int> indices;
+        return indices;
+    }
+
+}
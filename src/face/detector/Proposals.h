@@ -0,0 +1,13 @@
+#pragma once
+
+#include <vector>
+
+namespace mirror {
+    /// \brief Indices of the scores at or above 'threshold', in increasing order.
+    /// The scores are compared four at a time with SSE2 on x86 and NEON on arm; nearly every cell of a score
+    /// map is background, so the survivors are few and the decode that follows only visits them.
+    void SelectScores(const float *scores, int size, float threshold, std::vector<int> &indices);
+
+    //! Index buffer of SelectScores for the calling thread, kept from frame to frame
+    std::vector<int> &ProposalIndices();
+}
@@ -1,4 +1,5 @@
 #include "AntiCovFace.h"
+#include "../Proposals.h"
 #include <iostream>
 
 #include <ncnn/net.h>
@@ -60,42 +61,31 @@ namespace mirror {
 #endif
 
 
-    int AntiCovFace::detectFace(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const {
-
-        cv::Mat img_cpy = img_src.clone();
-        int img_width = img_cpy.cols;
-        int img_height = img_cpy.rows;
-        float factor_x = static_cast<float>(img_width) / inputSize_.width;
-        float factor_y = static_cast<float>(img_height) / inputSize_.height;
-
-        // pad to multiple of 32
-        int w = img_width;
-        int h = img_height;
-        if (w > h) {
-            w = inputSize_.width;
-            h = h / factor_x;
-            factor_y = factor_x;
-        } else {
-            h = inputSize_.height;
-            w = w / factor_y;
-            factor_x = factor_y;
+    int AntiCovFace::detectFace(const cv::Mat &img_src, float scale, std::vector<FaceInfo> &faces) const {
+        int img_width = img_src.cols;
+        int img_height = img_src.rows;
+
+        // the long side fits the input size unless a scale is given
+        if (scale <= 0) {
+            scale = img_width > img_height ? static_cast<float>(inputSize_.width) / img_width :
+                    static_cast<float>(inputSize_.height) / img_height;
         }
+        int w = std::max(1, static_cast<int>(img_width * scale));
+        int h = std::max(1, static_cast<int>(img_height * scale));
+        float factor_x = 1.0f / scale;
+        float factor_y = factor_x;
 
 //        ncnn::Mat in = ncnn::Mat::from_pixels_resize(img_cpy.data,
 //                                                     ncnn::Mat::PIXEL_BGR2RGB, img_width, img_height,
 //                                                     inputSize_.width, inputSize_.height);
 
-        ncnn::Mat in = ncnn::Mat::from_pixels_resize(img_cpy.data,
+        ncnn::Mat in = ncnn::Mat::from_pixels_resize(img_src.data,
                                                      ncnn::Mat::PIXEL_BGR2RGB,
                                                      img_width, img_height,
+                                                     static_cast<int>(img_src.step),
                                                      w, h);
 
-        ncnn::Extractor ex = net_->create_extractor();
-#if NCNN_VULKAN
-        if (this->gpu_mode_) {
-            ex.set_vulkan_compute(this->gpu_mode_);
-        }
-#endif
+        ncnn::Extractor ex = NewExtractor(net_);
         ex.input("data", in);
 
         faces.clear();
@@ -111,48 +101,58 @@ namespace mirror {
             ex.extract(landmark_layer_name.c_str(), landmark_mat);
             ex.extract(type_layer_name.c_str(), type_mat);
 
-            ANCHORS anchors = anchors_generated_.at(i);
-            int width = class_mat.w;
-            int height = class_mat.h;
-            int anchor_num = static_cast<int>(anchors.size());
-            for (int h = 0; h < height; ++h) {
-                for (int w = 0; w < width; ++w) {
-                    int index = h * width + w;
-                    for (int a = 0; a < anchor_num; ++a) {
-                        float score = class_mat.channel(anchor_num + a)[index];
-                        if (score < scoreThreshold_) {
-                            continue;
-                        }
-                        float prob = type_mat.channel(2 * anchor_num + a)[index];
-                        cv::Rect box = cv::Rect(w * RPNs_[i] + anchors[a].x,
-                                                h * RPNs_[i] + anchors[a].y,
-                                                anchors[a].width,
-                                                anchors[a].height);
-
-                        float delta_x = bbox_mat.channel(a * 4 + 0)[index];
-                        float delta_y = bbox_mat.channel(a * 4 + 1)[index];
-                        float delta_w = bbox_mat.channel(a * 4 + 2)[index];
-                        float delta_h = bbox_mat.channel(a * 4 + 3)[index];
-                        cv::Point2f center = cv::Point2f(box.x + box.width * 0.5f,
-                                                         box.y + box.height * 0.5f);
-                        center.x = center.x + delta_x * box.width;
-                        center.y = center.y + delta_y * box.height;
-                        float curr_width = std::exp(delta_w) * (box.width + 1);
-                        float curr_height = std::exp(delta_h) * (box.height + 1);
-                        cv::Rect curr_box = cv::Rect(center.x - curr_width * 0.5f,
-                                                     center.y - curr_height * 0.5f, curr_width, curr_height);
-                        curr_box.x = MAX(curr_box.x * factor_x, 0);
-                        curr_box.y = MAX(curr_box.y * factor_y, 0);
-                        curr_box.width = MIN(img_width - curr_box.x, curr_box.width * factor_x);
-                        curr_box.height = MIN(img_height - curr_box.y, curr_box.height * factor_y);
-
-                        FaceInfo face_info;
-                        memset(&face_info, 0, sizeof(face_info));
-                        face_info.score_ = score;
-                        face_info.mask_ = (prob > maskThreshold_);
-                        face_info.location_ = curr_box;
-                        faces.push_back(face_info);
-                    }
+            // the anchors of a cell do not depend on the input size, they are generated once at load
+            const ANCHORS &anchors = anchors_generated_.at(i);
+            const int width = class_mat.w;
+            const int size = width * class_mat.h;
+            const int anchor_num = static_cast<int>(anchors.size());
+            std::vector<int> &indices = ProposalIndices();
+            for (int a = 0; a < anchor_num; ++a) {
+                // decode the cells over the threshold only
+                SelectScores(class_mat.channel(anchor_num + a), size, scoreThreshold_, indices);
+                if (indices.empty()) continue;
+
+                const float *scores = class_mat.channel(anchor_num + a);
+                const float *probs = type_mat.channel(2 * anchor_num + a);
+                const float *deltas[4];
+                for (int k = 0; k < 4; ++k) {
+                    deltas[k] = bbox_mat.channel(a * 4 + k);
+                }
+
+                faces.reserve(faces.size() + indices.size());
+                for (int index : indices) {
+                    const int h = index / width;
+                    const int w = index - h * width;
+                    float score = scores[index];
+                    float prob = probs[index];
+                    cv::Rect box = cv::Rect(w * RPNs_[i] + anchors[a].x,
+                                            h * RPNs_[i] + anchors[a].y,
+                                            anchors[a].width,
+                                            anchors[a].height);
+
+                    float delta_x = deltas[0][index];
+                    float delta_y = deltas[1][index];
+                    float delta_w = deltas[2][index];
+                    float delta_h = deltas[3][index];
+                    cv::Point2f center = cv::Point2f(box.x + box.width * 0.5f,
+                                                     box.y + box.height * 0.5f);
+                    center.x = center.x + delta_x * box.width;
+                    center.y = center.y + delta_y * box.height;
+                    float curr_width = std::exp(delta_w) * (box.width + 1);
+                    float curr_height = std::exp(delta_h) * (box.height + 1);
+                    cv::Rect curr_box = cv::Rect(center.x - curr_width * 0.5f,
+                                                 center.y - curr_height * 0.5f, curr_width, curr_height);
+                    curr_box.x = MAX(curr_box.x * factor_x, 0);
+                    curr_box.y = MAX(curr_box.y * factor_y, 0);
+                    curr_box.width = MIN(img_width - curr_box.x, curr_box.width * factor_x);
+                    curr_box.height = MIN(img_height - curr_box.y, curr_box.height * factor_y);
+
+                    FaceInfo face_info;
+                    memset(&face_info, 0, sizeof(face_info));
+                    face_info.score_ = score;
+                    face_info.mask_ = (prob > maskThreshold_);
+                    face_info.location_ = curr_box;
+                    faces.push_back(face_info);
                 }
             }
         }
@@ -18,7 +18,7 @@ namespace mirror {
         int loadModel(AAssetManager* mgr) override;
 #endif
 
-        int detectFace(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const override;
+        int detectFace(const cv::Mat &img_src, float scale, std::vector<FaceInfo> &faces) const override;
 
     private:
         const int RPNs_[3] = {32, 16, 8};
@@ -1,4 +1,7 @@
 #include "MtcnnFace.h"
+#include "../Proposals.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include "opencv2/imgproc.hpp"
 
@@ -12,6 +15,7 @@ namespace mirror {
                                                   pnet_size_(12),
                                                   min_face_size_(40),
                                                   scale_factor_(0.709f) {
+        parallel_stages_ = true;
     }
 
     MtcnnFace::~MtcnnFace() {
@@ -100,13 +104,14 @@ namespace mirror {
 #endif
 
 
-    int MtcnnFace::detectFace(const cv::Mat &img_src,
+    int MtcnnFace::detectFace(const cv::Mat &img_src, float scale,
                               std::vector<FaceInfo> &faces) const {
+        // the pyramid starts at native resolution and scales itself down to min_face_size_, 'scale' is unused
         cv::Size max_size = cv::Size(img_src.cols, img_src.rows);
-        cv::Mat img_cpy = img_src.clone();
         ncnn::Mat img_in = ncnn::Mat::from_pixels(img_src.data,
                                                   ncnn::Mat::PIXEL_BGR2RGB,
-                                                  img_src.cols, img_src.rows);
+                                                  img_src.cols, img_src.rows,
+                                                  static_cast<int>(img_src.step));
         img_in.substract_mean_normalize(meanVals, normVals);
 
         std::vector<FaceInfo> first_bboxes, second_bboxes;
@@ -127,6 +132,69 @@ namespace mirror {
         return 0;
     }
 
+    // planar size x size tensor of a candidate face, ncnn pads the channels to 16 bytes
+    static inline size_t FaceTensorStep(int size) {
+        return static_cast<size_t>(size * size + 3) / 4 * 4;
+    }
+
+    // bilinear resize of 'box' of the planar image into the size x size planes at 'dst', what copy_cut_border
+    // then resize_bilinear compute, without their two intermediate images
+    static void CropResize(const ncnn::Mat &img, const cv::Rect &box, int size, float *dst) {
+        int xs[48], ys[48];
+        float ax[48], ay[48];
+        const float scale_x = static_cast<float>(box.width) / size;
+        const float scale_y = static_cast<float>(box.height) / size;
+        for (int d = 0; d < size; ++d) {
+            float fx = (d + 0.5f) * scale_x - 0.5f;
+            int sx = static_cast<int>(std::floor(fx));
+            fx -= sx;
+            if (sx < 0) {
+                sx = 0;
+                fx = 0.f;
+            }
+            if (sx >= box.width - 1) {
+                sx = std::max(box.width - 2, 0);
+                fx = box.width > 1 ? 1.f : 0.f;
+            }
+            xs[d] = box.x + sx;
+            ax[d] = fx;
+
+            float fy = (d + 0.5f) * scale_y - 0.5f;
+            int sy = static_cast<int>(std::floor(fy));
+            fy -= sy;
+            if (sy < 0) {
+                sy = 0;
+                fy = 0.f;
+            }
+            if (sy >= box.height - 1) {
+                sy = std::max(box.height - 2, 0);
+                fy = box.height > 1 ? 1.f : 0.f;
+            }
+            ys[d] = box.y + sy;
+            ay[d] = fy;
+        }
+
+        const int next_x = box.width > 1 ? 1 : 0;
+        const int next_y = box.height > 1 ? img.w : 0;
+        const size_t step = FaceTensorStep(size);
+        for (int c = 0; c < 3; ++c) {
+            const float *plane = img.channel(c);
+            float *out = dst + c * step;
+            for (int dy = 0; dy < size; ++dy) {
+                const float *row0 = plane + ys[dy] * img.w;
+                const float *row1 = row0 + next_y;
+                const float wy = ay[dy];
+                for (int dx = 0; dx < size; ++dx) {
+                    const int x = xs[dx];
+                    const float wx = ax[dx];
+                    const float top = row0[x] + (row0[x + next_x] - row0[x]) * wx;
+                    const float bottom = row1[x] + (row1[x + next_x] - row1[x]) * wx;
+                    *out++ = top + (bottom - top) * wy;
+                }
+            }
+        }
+    }
+
     int MtcnnFace::PDetect(const ncnn::Mat &img_in,
                            std::vector<FaceInfo> &first_bboxes) const {
         first_bboxes.clear();
@@ -142,85 +210,122 @@ namespace mirror {
             curr_scale *= scale_factor_;
         }
 
-        // mutiscale resize the image
-        for (float scale : scales) {
+        // the levels of the pyramid are independent, they run at once and are joined in their order
+        const int num_levels = static_cast<int>(scales.size());
+        std::vector<std::vector<FaceInfo>> level_bboxes(num_levels);
+        RunParallel(num_levels, [&](int level) {
+            const float scale = scales[level];
             int new_w = static_cast<int>(width * scale);
             int new_h = static_cast<int>(height * scale);
             ncnn::Mat img_resized;
             ncnn::resize_bilinear(img_in, img_resized, new_w, new_h);
-            ncnn::Extractor ex = pnet_->create_extractor();
-            //ex.set_num_threads(2);
+            ncnn::Extractor ex = NewExtractor(pnet_);
             ex.set_light_mode(true);
-#if NCNN_VULKAN
-            if (this->gpu_mode_) {
-                ex.set_vulkan_compute(this->gpu_mode_);
-            }
-#endif
             ex.input("data", img_resized);
             ncnn::Mat score_mat, location_mat;
             ex.extract("prob1", score_mat);
             ex.extract("conv4-2", location_mat);
             const int stride = 2;
             const int cell_size = 12;
-            for (int h = 0; h < score_mat.h; ++h) {
-                for (int w = 0; w < score_mat.w; ++w) {
-                    int index = h * score_mat.w + w;
-                    // pnet output: 1x1x2  no-face && face
-                    // face score: channel(1)
-                    float score = score_mat.channel(1)[index];
-                    if (score < threshold_[0]) continue;
-
-                    // 1. generated bounding box
-                    int x1 = static_cast<int>(round((stride * w + 1) / scale));
-                    int y1 = static_cast<int>(round((stride * h + 1) / scale));
-                    int x2 = static_cast<int>(round((stride * w + 1 + cell_size) / scale));
-                    int y2 = static_cast<int>(round((stride * h + 1 + cell_size) / scale));
-
-                    // 2. regression bounding box
-                    float x1_reg = location_mat.channel(0)[index];
-                    float y1_reg = location_mat.channel(1)[index];
-                    float x2_reg = location_mat.channel(2)[index];
-                    float y2_reg = location_mat.channel(3)[index];
-
-                    int bbox_width = x2 - x1 + 1;
-                    int bbox_height = y2 - y1 + 1;
-
-                    FaceInfo face_info;
-                    face_info.score_ = score;
-                    face_info.location_.x = static_cast<int>(x1 + x1_reg * bbox_width);
-                    face_info.location_.y = static_cast<int>(y1 + y1_reg * bbox_height);
-                    face_info.location_.width = static_cast<int>(x2 + x2_reg * bbox_width - face_info.location_.x);
-                    face_info.location_.height = static_cast<int>(y2 + y2_reg * bbox_height - face_info.location_.y);
-                    face_info.location_ = face_info.location_ & cv::Rect(0, 0, width, height);
-                    first_bboxes.push_back(face_info);
-                }
+
+            // pnet output: 1x1x2  no-face && face
+            // face score: channel(1)
+            std::vector<int> &indices = ProposalIndices();
+            SelectScores(score_mat.channel(1), score_mat.w * score_mat.h, threshold_[0], indices);
+            const float *scores = score_mat.channel(1);
+            const float *regs[4] = {location_mat.channel(0), location_mat.channel(1),
+                                    location_mat.channel(2), location_mat.channel(3)};
+            std::vector<FaceInfo> &bboxes = level_bboxes[level];
+            bboxes.reserve(indices.size());
+            for (int index : indices) {
+                const int h = index / score_mat.w;
+                const int w = index - h * score_mat.w;
+
+                // 1. generated bounding box
+                int x1 = static_cast<int>(round((stride * w + 1) / scale));
+                int y1 = static_cast<int>(round((stride * h + 1) / scale));
+                int x2 = static_cast<int>(round((stride * w + 1 + cell_size) / scale));
+                int y2 = static_cast<int>(round((stride * h + 1 + cell_size) / scale));
+
+                // 2. regression bounding box
+                float x1_reg = regs[0][index];
+                float y1_reg = regs[1][index];
+                float x2_reg = regs[2][index];
+                float y2_reg = regs[3][index];
+
+                int bbox_width = x2 - x1 + 1;
+                int bbox_height = y2 - y1 + 1;
+
+                FaceInfo face_info;
+                face_info.score_ = scores[index];
+                face_info.mask_ = false;
+                face_info.location_.x = static_cast<int>(x1 + x1_reg * bbox_width);
+                face_info.location_.y = static_cast<int>(y1 + y1_reg * bbox_height);
+                face_info.location_.width = static_cast<int>(x2 + x2_reg * bbox_width - face_info.location_.x);
+                face_info.location_.height = static_cast<int>(y2 + y2_reg * bbox_height - face_info.location_.y);
+                face_info.location_ = face_info.location_ & cv::Rect(0, 0, width, height);
+                bboxes.push_back(face_info);
             }
+        });
+        for (const auto &bboxes : level_bboxes) {
+            first_bboxes.insert(first_bboxes.end(), bboxes.begin(), bboxes.end());
+        }
+        return 0;
+    }
+
+    int MtcnnFace::RunStage(const ncnn::Net *net, const ncnn::Mat &img_in, const std::vector<FaceInfo> &bboxes,
+                            int size, const char *const *blobs, int num_blobs, std::vector<cv::Rect> &faces,
+                            std::vector<ncnn::Mat> &outputs) const {
+        // the candidates of a stage are cut into one buffer of size x size tensors kept from frame to frame,
+        // and shared by workers that each reuse one extractor and one pair of allocators
+        static thread_local std::vector<float> tensors;
+        const int num_faces = static_cast<int>(bboxes.size());
+        const size_t step = 3 * FaceTensorStep(size);
+        if (tensors.size() < num_faces * step) {
+            tensors.resize(num_faces * step);
         }
+        faces.resize(num_faces);
+        outputs.assign(static_cast<size_t>(num_faces) * num_blobs, ncnn::Mat());
+
+        const int workers = ParallelWorkers(num_faces);
+        float *data = tensors.data();
+        RunParallel(workers, [&](int worker) {
+            ncnn::UnlockedPoolAllocator blob_allocator;
+            ncnn::PoolAllocator workspace_allocator;
+            ncnn::Extractor ex = NewExtractor(net);
+            ex.set_light_mode(true);
+            ex.set_blob_allocator(&blob_allocator);
+            ex.set_workspace_allocator(&workspace_allocator);
+            for (int i = worker; i < num_faces; i += workers) {
+                faces[i] = bboxes[i].location_ & cv::Rect(0, 0, img_in.w, img_in.h);
+                if (faces[i].width <= 0 || faces[i].height <= 0) continue;
+                CropResize(img_in, faces[i], size, data + i * step);
+                // the outputs are copied out of the allocators, which only live as long as the worker
+                ex.clear();
+                ex.input("data", ncnn::Mat(size, size, 3, data + i * step));
+                for (int b = 0; b < num_blobs; ++b) {
+                    ncnn::Mat blob;
+                    ex.extract(blobs[b], blob);
+                    outputs[i * num_blobs + b] = blob.clone();
+                }
+            }
+        });
         return 0;
     }
 
     int MtcnnFace::RDetect(const ncnn::Mat &img_in,
                            const std::vector<FaceInfo> &first_bboxes,
                            std::vector<FaceInfo> &second_bboxes) const {
+        static const char *kBlobs[2] = {"prob1", "conv5-2"};
         second_bboxes.clear();
-        for (const auto &first_bboxe : first_bboxes) {
-            cv::Rect face = first_bboxe.location_ & cv::Rect(0, 0, img_in.w, img_in.h);
-            ncnn::Mat img_face, img_resized;
-            ncnn::copy_cut_border(img_in, img_face, face.y, img_in.h - face.br().y,
-                                  face.x, img_in.w - face.br().x);
-            ncnn::resize_bilinear(img_face, img_resized, 24, 24);
-            ncnn::Extractor ex = rnet_->create_extractor();
-            ex.set_light_mode(true);
-            ex.set_num_threads(2);
-#if NCNN_VULKAN
-            if (this->gpu_mode_) {
-                ex.set_vulkan_compute(this->gpu_mode_);
-            }
-#endif
-            ex.input("data", img_resized);
-            ncnn::Mat score_mat, location_mat;
-            ex.extract("prob1", score_mat);
-            ex.extract("conv5-2", location_mat);
+        std::vector<cv::Rect> faces;
+        std::vector<ncnn::Mat> outputs;
+        RunStage(rnet_, img_in, first_bboxes, 24, kBlobs, 2, faces, outputs);
+        for (size_t i = 0; i < faces.size(); ++i) {
+            const cv::Rect &face = faces[i];
+            const ncnn::Mat &score_mat = outputs[i * 2];
+            const ncnn::Mat &location_mat = outputs[i * 2 + 1];
+            if (score_mat.empty()) continue;
             float score = score_mat[1];
             if (score < threshold_[1]) continue;
             float x_reg = location_mat[0];
@@ -230,6 +335,7 @@ namespace mirror {
 
             FaceInfo face_info;
             face_info.score_ = score;
+            face_info.mask_ = false;
             face_info.location_.x = static_cast<int>(face.x + x_reg * face.width);
             face_info.location_.y = static_cast<int>(face.y + y_reg * face.height);
             face_info.location_.width = static_cast<int>(face.x + face.width +
@@ -244,28 +350,17 @@ namespace mirror {
     int MtcnnFace::ODetect(const ncnn::Mat &img_in,
                            const std::vector<FaceInfo> &second_bboxes,
                            std::vector<FaceInfo> &third_bboxes) const {
+        static const char *kBlobs[3] = {"prob1", "conv6-2", "conv6-3"};
         third_bboxes.clear();
-        for (const auto &second_bboxe : second_bboxes) {
-            cv::Rect face = second_bboxe.location_ & cv::Rect(0, 0, img_in.w, img_in.h);
-            ncnn::Mat img_face, img_resized;
-            ncnn::copy_cut_border(img_in, img_face, face.y,
-                                  img_in.h - face.br().y, face.x,
-                                  img_in.w - face.br().x);
-            ncnn::resize_bilinear(img_face, img_resized, 48, 48);
-
-            ncnn::Extractor ex = onet_->create_extractor();
-            ex.set_light_mode(true);
-            ex.set_num_threads(2);
-#if NCNN_VULKAN
-            if (this->gpu_mode_) {
-                ex.set_vulkan_compute(this->gpu_mode_);
-            }
-#endif
-            ex.input("data", img_resized);
-            ncnn::Mat score_mat, location_mat, keypoints_mat;
-            ex.extract("prob1", score_mat);
-            ex.extract("conv6-2", location_mat);
-            ex.extract("conv6-3", keypoints_mat);
+        std::vector<cv::Rect> faces;
+        std::vector<ncnn::Mat> outputs;
+        RunStage(onet_, img_in, second_bboxes, 48, kBlobs, 3, faces, outputs);
+        for (size_t i = 0; i < faces.size(); ++i) {
+            const cv::Rect &face = faces[i];
+            const ncnn::Mat &score_mat = outputs[i * 3];
+            const ncnn::Mat &location_mat = outputs[i * 3 + 1];
+            const ncnn::Mat &keypoints_mat = outputs[i * 3 + 2];
+            if (score_mat.empty()) continue;
             float score = score_mat[1];
             if (score < threshold_[1]) continue;
             float x_reg = location_mat[0];
@@ -275,6 +370,7 @@ namespace mirror {
 
             FaceInfo face_info;
             face_info.score_ = score;
+            face_info.mask_ = false;
             face_info.location_.x = static_cast<int>(face.x + x_reg * face.width);
             face_info.location_.y = static_cast<int>(face.y + y_reg * face.height);
             face_info.location_.width = static_cast<int>(face.x + face.width +
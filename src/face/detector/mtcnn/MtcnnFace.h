@@ -4,6 +4,7 @@
 
 namespace ncnn {
     class Mat;
+    class Net;
 }
 
 namespace mirror {
@@ -21,7 +22,7 @@ namespace mirror {
         int loadModel(AAssetManager* mgr) override;
 #endif
 
-        int detectFace(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const override;
+        int detectFace(const cv::Mat &img_src, float scale, std::vector<FaceInfo> &faces) const override;
 
     private:
         ncnn::Net *pnet_ = nullptr;
@@ -45,6 +46,12 @@ namespace mirror {
                     const std::vector<FaceInfo> &second_bboxes,
                     std::vector<FaceInfo> &third_bboxes) const;
 
+        //! Run 'net' on every candidate of 'bboxes' resized to size x size, outputs[i * num_blobs + b] is 'blobs[b]'
+        //! of the candidate at faces[i], empty when it is out of the image
+        int RunStage(const ncnn::Net *net, const ncnn::Mat &img_in, const std::vector<FaceInfo> &bboxes,
+                     int size, const char *const *blobs, int num_blobs, std::vector<cv::Rect> &faces,
+                     std::vector<ncnn::Mat> &outputs) const;
+
         int Refine(std::vector<FaceInfo> &bboxes, const cv::Size &max_size) const;
     };
 
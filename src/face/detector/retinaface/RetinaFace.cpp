@@ -1,117 +1,101 @@
 #include "RetinaFace.h"
+#include "../Proposals.h"
 #include <iostream>
 
 #include <ncnn/net.h>
 
 namespace mirror {
+    static const char *kScoreBlobs[3] = {"face_rpn_cls_prob_reshape_stride32", "face_rpn_cls_prob_reshape_stride16",
+                                         "face_rpn_cls_prob_reshape_stride8"};
+    static const char *kBboxBlobs[3] = {"face_rpn_bbox_pred_stride32", "face_rpn_bbox_pred_stride16",
+                                        "face_rpn_bbox_pred_stride8"};
+    static const char *kLandmarkBlobs[3] = {"face_rpn_landmark_pred_stride32", "face_rpn_landmark_pred_stride16",
+                                            "face_rpn_landmark_pred_stride8"};
 
-    static ncnn::Mat generate_anchors(int base_size, const ncnn::Mat &ratios, const ncnn::Mat &scales) {
-        int num_ratio = ratios.w;
-        int num_scale = scales.w;
-
-        ncnn::Mat anchors;
-        anchors.create(4, num_ratio * num_scale);
+    static std::vector<cv::Rect2f> generate_anchors(int base_size, const std::vector<float> &ratios,
+                                                    const std::vector<float> &scales) {
+        std::vector<cv::Rect2f> anchors;
 
         const float cx = base_size * 0.5f;
         const float cy = base_size * 0.5f;
 
-        for (int i = 0; i < num_ratio; i++) {
-            float ar = ratios[i];
-
+        for (float ar : ratios) {
             int r_w = round(base_size / sqrt(ar));
             int r_h = round(r_w * ar); //round(base_size * sqrt(ar));
 
-            for (int j = 0; j < num_scale; j++) {
-                float scale = scales[j];
-
+            for (float scale : scales) {
                 float rs_w = r_w * scale;
                 float rs_h = r_h * scale;
-
-                float *anchor = anchors.row(i * num_scale + j);
-
-                anchor[0] = cx - rs_w * 0.5f;
-                anchor[1] = cy - rs_h * 0.5f;
-                anchor[2] = cx + rs_w * 0.5f;
-                anchor[3] = cy + rs_h * 0.5f;
+                anchors.push_back(cv::Rect2f(cx - rs_w * 0.5f, cy - rs_h * 0.5f, rs_w, rs_h));
             }
         }
 
         return anchors;
     }
 
-    static void generate_proposals(const ncnn::Mat &anchors, int feat_stride, const ncnn::Mat &score_blob,
-                                   const ncnn::Mat &bbox_blob, const ncnn::Mat &landmark_blob, float scoreThreshold_,
+    static void generate_proposals(const std::vector<cv::Rect2f> &anchors, int feat_stride,
+                                   const ncnn::Mat &score_blob, const ncnn::Mat &bbox_blob,
+                                   const ncnn::Mat &landmark_blob, float scoreThreshold_,
                                    std::vector<FaceInfo> &faceobjects) {
-        int w = score_blob.w;
-        int h = score_blob.h;
+        const int w = score_blob.w;
+        const int size = w * score_blob.h;
+        std::vector<int> &indices = ProposalIndices();
 
-        // generate face proposal from bbox deltas and shifted anchors
-        const int num_anchors = anchors.h;
+        // generate face proposal from bbox deltas and shifted anchors, for the cells over the threshold only
+        const int num_anchors = static_cast<int>(anchors.size());
 
         for (int q = 0; q < num_anchors; q++) {
-            const float *anchor = anchors.row(q);
-
-            const ncnn::Mat score = score_blob.channel(q + num_anchors);
-            const ncnn::Mat bbox = bbox_blob.channel_range(q * 4, 4);
-            const ncnn::Mat landmark = landmark_blob.channel_range(q * 10, 10);
-
-            // shifted anchor
-            float anchor_y = anchor[1];
-
-            float anchor_w = anchor[2] - anchor[0];
-            float anchor_h = anchor[3] - anchor[1];
-
-            for (int i = 0; i < h; i++) {
-                float anchor_x = anchor[0];
-
-                for (int j = 0; j < w; j++) {
-                    int index = i * w + j;
-
-                    float prob = score[index];
-
-                    if (prob >= scoreThreshold_) {
-                        // apply center size
-                        float dx = bbox.channel(0)[index];
-                        float dy = bbox.channel(1)[index];
-                        float dw = bbox.channel(2)[index];
-                        float dh = bbox.channel(3)[index];
-
-                        float cx = anchor_x + anchor_w * 0.5f;
-                        float cy = anchor_y + anchor_h * 0.5f;
-
-                        float pb_cx = cx + anchor_w * dx;
-                        float pb_cy = cy + anchor_h * dy;
-
-                        float pb_w = anchor_w * exp(dw);
-                        float pb_h = anchor_h * exp(dh);
-
-                        float x0 = pb_cx - pb_w * 0.5f;
-                        float y0 = pb_cy - pb_h * 0.5f;
-                        float x1 = pb_cx + pb_w * 0.5f;
-                        float y1 = pb_cy + pb_h * 0.5f;
-
-                        FaceInfo obj;
-                        obj.location_.x = x0;
-                        obj.location_.y = y0;
-                        obj.location_.width = (x1 - x0 + 1);
-                        obj.location_.height = (y1 - y0 + 1);
-                        obj.keypoints_[0].x = cx + (anchor_w + 1) * landmark.channel(0)[index];
-                        obj.keypoints_[0].y = cy + (anchor_h + 1) * landmark.channel(1)[index];
-                        obj.keypoints_[1].x = cx + (anchor_w + 1) * landmark.channel(2)[index];
-                        obj.keypoints_[1].y = cy + (anchor_h + 1) * landmark.channel(3)[index];
-                        obj.keypoints_[2].x = cx + (anchor_w + 1) * landmark.channel(4)[index];
-                        obj.keypoints_[2].y = cy + (anchor_h + 1) * landmark.channel(5)[index];
-                        obj.keypoints_[3].x = cx + (anchor_w + 1) * landmark.channel(6)[index];
-                        obj.keypoints_[3].y = cy + (anchor_h + 1) * landmark.channel(7)[index];
-                        obj.keypoints_[4].x = cx + (anchor_w + 1) * landmark.channel(8)[index];
-                        obj.keypoints_[4].y = cy + (anchor_h + 1) * landmark.channel(9)[index];
-                        obj.score_ = prob;
-
-                        faceobjects.push_back(obj);
-                    }
-                    anchor_x += feat_stride;
+            SelectScores(score_blob.channel(q + num_anchors), size, scoreThreshold_, indices);
+            if (indices.empty()) continue;
+
+            const float *score = score_blob.channel(q + num_anchors);
+            const float *bbox[4];
+            for (int k = 0; k < 4; ++k) {
+                bbox[k] = bbox_blob.channel(q * 4 + k);
+            }
+            const float *landmark[10];
+            for (int k = 0; k < 10; ++k) {
+                landmark[k] = landmark_blob.channel(q * 10 + k);
+            }
+
+            const float anchor_w = anchors[q].width;
+            const float anchor_h = anchors[q].height;
+            const float anchor_cx = anchors[q].x + anchor_w * 0.5f;
+            const float anchor_cy = anchors[q].y + anchor_h * 0.5f;
+
+            faceobjects.reserve(faceobjects.size() + indices.size());
+            for (int index : indices) {
+                const int i = index / w;
+                const int j = index - i * w;
+
+                // apply center size
+                float cx = anchor_cx + j * feat_stride;
+                float cy = anchor_cy + i * feat_stride;
+
+                float pb_cx = cx + anchor_w * bbox[0][index];
+                float pb_cy = cy + anchor_h * bbox[1][index];
+
+                float pb_w = anchor_w * exp(bbox[2][index]);
+                float pb_h = anchor_h * exp(bbox[3][index]);
+
+                float x0 = pb_cx - pb_w * 0.5f;
+                float y0 = pb_cy - pb_h * 0.5f;
+                float x1 = pb_cx + pb_w * 0.5f;
+                float y1 = pb_cy + pb_h * 0.5f;
+
+                FaceInfo obj;
+                obj.location_.x = x0;
+                obj.location_.y = y0;
+                obj.location_.width = (x1 - x0 + 1);
+                obj.location_.height = (y1 - y0 + 1);
+                for (int k = 0; k < 5; ++k) {
+                    obj.keypoints_[k].x = cx + (anchor_w + 1) * landmark[2 * k][index];
+                    obj.keypoints_[k].y = cy + (anchor_h + 1) * landmark[2 * k + 1][index];
                 }
-                anchor_y += feat_stride;
+                obj.score_ = score[index];
+                obj.mask_ = false;
+
+                faceobjects.push_back(obj);
             }
         }
     }
@@ -119,6 +103,10 @@ namespace mirror {
     RetinaFace::RetinaFace(FaceDetectorType type) : Detector(type) {
         iouThreshold_ = 0.4f;
         scoreThreshold_ = 0.7f;
+        // the anchors of a cell do not depend on the input size, the cells only shift them by the stride
+        anchors_[0] = generate_anchors(16, {1.f}, {32.f, 16.f});
+        anchors_[1] = generate_anchors(16, {1.f}, {8.f, 4.f});
+        anchors_[2] = generate_anchors(16, {1.f}, {2.f, 1.f});
     }
 
     int RetinaFace::loadModel(const char *root_path) {
@@ -136,111 +124,41 @@ namespace mirror {
     }
 #endif
 
-    int RetinaFace::detectFace(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const {
-        cv::Mat img_cpy = img_src.clone();
-        int img_width = img_cpy.cols;
-        int img_height = img_cpy.rows;
-
-        float factor_x = static_cast<float>(img_width) / inputSize_.width;
-        float factor_y = static_cast<float>(img_height) / inputSize_.height;
-
-        // pad to multiple of 32
-        int w = img_width;
-        int h = img_height;
-        if (w > h) {
-            w = inputSize_.width;
-            h = h / factor_x;
-            factor_y = factor_x;
-        } else {
-            h = inputSize_.height;
-            w = w / factor_y;
-            factor_x = factor_y;
+    int RetinaFace::detectFace(const cv::Mat &img_src, float scale, std::vector<FaceInfo> &faces) const {
+        int img_width = img_src.cols;
+        int img_height = img_src.rows;
+
+        // the long side fits the input size unless a scale is given
+        if (scale <= 0) {
+            scale = img_width > img_height ? static_cast<float>(inputSize_.width) / img_width :
+                    static_cast<float>(inputSize_.height) / img_height;
         }
+        int w = std::max(1, static_cast<int>(img_width * scale));
+        int h = std::max(1, static_cast<int>(img_height * scale));
+        float factor_x = 1.0f / scale;
+        float factor_y = factor_x;
 
-        ncnn::Mat in = ncnn::Mat::from_pixels_resize(img_cpy.data,
+        ncnn::Mat in = ncnn::Mat::from_pixels_resize(img_src.data,
                                                      ncnn::Mat::PIXEL_BGR2RGB,
                                                      img_width,
                                                      img_height,
+                                                     static_cast<int>(img_src.step),
                                                      w,
                                                      h);
 
-        ncnn::Extractor ex = net_->create_extractor();
-#if NCNN_VULKAN
-        if (this->gpu_mode_) {
-            ex.set_vulkan_compute(this->gpu_mode_);
-        }
-#endif
+        ncnn::Extractor ex = NewExtractor(net_);
 
         ex.input("data", in);
 
         faces.clear();
-        // stride 32
-        {
+        for (int i = 0; i < 3; ++i) {
             ncnn::Mat score_blob, bbox_blob, landmark_blob;
-            ex.extract("face_rpn_cls_prob_reshape_stride32", score_blob);
-            ex.extract("face_rpn_bbox_pred_stride32", bbox_blob);
-            ex.extract("face_rpn_landmark_pred_stride32", landmark_blob);
-
-            const int base_size = 16;
-            const int feat_stride = 32;
-            ncnn::Mat ratios(1);
-            ratios[0] = 1.f;
-            ncnn::Mat scales(2);
-            scales[0] = 32.f;
-            scales[1] = 16.f;
-            ncnn::Mat anchors = generate_anchors(base_size, ratios, scales);
-
-            std::vector<FaceInfo> faceobjects32;
-            generate_proposals(anchors, feat_stride, score_blob, bbox_blob, landmark_blob, scoreThreshold_,
-                               faceobjects32);
-
-            faces.insert(faces.end(), faceobjects32.begin(), faceobjects32.end());
-        }
+            ex.extract(kScoreBlobs[i], score_blob);
+            ex.extract(kBboxBlobs[i], bbox_blob);
+            ex.extract(kLandmarkBlobs[i], landmark_blob);
 
-        // stride 16
-        {
-            ncnn::Mat score_blob, bbox_blob, landmark_blob;
-            ex.extract("face_rpn_cls_prob_reshape_stride16", score_blob);
-            ex.extract("face_rpn_bbox_pred_stride16", bbox_blob);
-            ex.extract("face_rpn_landmark_pred_stride16", landmark_blob);
-
-            const int base_size = 16;
-            const int feat_stride = 16;
-            ncnn::Mat ratios(1);
-            ratios[0] = 1.f;
-            ncnn::Mat scales(2);
-            scales[0] = 8.f;
-            scales[1] = 4.f;
-            ncnn::Mat anchors = generate_anchors(base_size, ratios, scales);
-
-            std::vector<FaceInfo> faceobjects16;
-            generate_proposals(anchors, feat_stride, score_blob, bbox_blob, landmark_blob, scoreThreshold_,
-                               faceobjects16);
-
-            faces.insert(faces.end(), faceobjects16.begin(), faceobjects16.end());
-        }
-
-        // stride 8
-        {
-            ncnn::Mat score_blob, bbox_blob, landmark_blob;
-            ex.extract("face_rpn_cls_prob_reshape_stride8", score_blob);
-            ex.extract("face_rpn_bbox_pred_stride8", bbox_blob);
-            ex.extract("face_rpn_landmark_pred_stride8", landmark_blob);
-
-            const int base_size = 16;
-            const int feat_stride = 8;
-            ncnn::Mat ratios(1);
-            ratios[0] = 1.f;
-            ncnn::Mat scales(2);
-            scales[0] = 2.f;
-            scales[1] = 1.f;
-            ncnn::Mat anchors = generate_anchors(base_size, ratios, scales);
-
-            std::vector<FaceInfo> faceobjects8;
-            generate_proposals(anchors, feat_stride, score_blob, bbox_blob, landmark_blob, scoreThreshold_,
-                               faceobjects8);
-
-            faces.insert(faces.end(), faceobjects8.begin(), faceobjects8.end());
+            generate_proposals(anchors_[i], featStrides_[i], score_blob, bbox_blob, landmark_blob, scoreThreshold_,
+                               faces);
         }
 
         for (int i = 0; i < faces.size(); i++) {
@@ -16,10 +16,12 @@ namespace mirror {
         int loadModel(AAssetManager* mgr) override;
 #endif
 
-        int detectFace(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const override;
+        int detectFace(const cv::Mat &img_src, float scale, std::vector<FaceInfo> &faces) const override;
 
     private:
         const cv::Size inputSize_ = {640, 640};
+        const int featStrides_[3] = {32, 16, 8};
+        std::vector<cv::Rect2f> anchors_[3]; // anchors of a cell at the origin, per stride
     };
 
 }
\ No newline at end of file
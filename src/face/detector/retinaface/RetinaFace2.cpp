@@ -60,7 +60,8 @@ namespace mirror {
     }
 #endif
 
-    int RetinaFace::detectFace(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const {
+    int RetinaFace::detectFace(const cv::Mat &img_src, float scale, std::vector<FaceInfo> &faces) const {
+        // the anchors of this model are laid out for its fixed input size, 'scale' is unused
         cv::Mat img_cpy = img_src.clone();
         int img_width = img_cpy.cols;
         int img_height = img_cpy.rows;
@@ -13,128 +13,115 @@
 // specific language governing permissions and limitations under the License.
 
 #include "Scrfd.h"
+#include "../Proposals.h"
 
 #include <opencv2/core.hpp>
 #include <ncnn/net.h>
 
 namespace mirror {
-    // insightface/detection/scrfd/mmdet/core/anchor/anchor_generator.py gen_single_level_base_anchors()
-    static ncnn::Mat generate_anchors(int base_size, const ncnn::Mat &ratios, const ncnn::Mat &scales) {
-        int num_ratio = ratios.w;
-        int num_scale = scales.w;
+    static const char *kScoreBlobs[3] = {"score_8", "score_16", "score_32"};
+    static const char *kBboxBlobs[3] = {"bbox_8", "bbox_16", "bbox_32"};
+    static const char *kKpsBlobs[3] = {"kps_8", "kps_16", "kps_32"};
 
-        ncnn::Mat anchors;
-        anchors.create(4, num_ratio * num_scale);
+    // insightface/detection/scrfd/mmdet/core/anchor/anchor_generator.py gen_single_level_base_anchors()
+    static std::vector<cv::Rect2f> generate_anchors(int base_size, const std::vector<float> &ratios,
+                                                    const std::vector<float> &scales) {
+        std::vector<cv::Rect2f> anchors;
 
         const float cx = 0;
         const float cy = 0;
 
-        for (int i = 0; i < num_ratio; i++) {
-            float ar = ratios[i];
-
+        for (float ar : ratios) {
             int r_w = round(base_size / sqrt(ar));
             int r_h = round(r_w * ar); //round(base_size * sqrt(ar));
 
-            for (int j = 0; j < num_scale; j++) {
-                float scale = scales[j];
-
+            for (float scale : scales) {
                 float rs_w = r_w * scale;
                 float rs_h = r_h * scale;
-
-                float *anchor = anchors.row(i * num_scale + j);
-
-                anchor[0] = cx - rs_w * 0.5f;
-                anchor[1] = cy - rs_h * 0.5f;
-                anchor[2] = cx + rs_w * 0.5f;
-                anchor[3] = cy + rs_h * 0.5f;
+                anchors.push_back(cv::Rect2f(cx - rs_w * 0.5f, cy - rs_h * 0.5f, rs_w, rs_h));
             }
         }
 
         return anchors;
     }
 
-    static void generate_proposals(const ncnn::Mat &anchors, int feat_stride, const ncnn::Mat &score_blob,
-                                   const ncnn::Mat &bbox_blob, const ncnn::Mat &kps_blob, float prob_threshold,
+    static void generate_proposals(const std::vector<cv::Rect2f> &anchors, int feat_stride,
+                                   const ncnn::Mat &score_blob, const ncnn::Mat &bbox_blob,
+                                   const ncnn::Mat &kps_blob, float prob_threshold,
                                    std::vector<FaceInfo> &faces) {
-        int w = score_blob.w;
-        int h = score_blob.h;
+        const int w = score_blob.w;
+        const int size = w * score_blob.h;
+        std::vector<int> &indices = ProposalIndices();
 
-        // generate face proposal from bbox deltas and shifted anchors
-        const int num_anchors = anchors.h;
+        // generate face proposal from bbox deltas and shifted anchors, for the cells over the threshold only
+        const int num_anchors = static_cast<int>(anchors.size());
 
         for (int q = 0; q < num_anchors; q++) {
-            const float *anchor = anchors.row(q);
-
-            const ncnn::Mat score = score_blob.channel(q);
-            const ncnn::Mat bbox = bbox_blob.channel_range(q * 4, 4);
-
-            // shifted anchor
-            float anchor_y = anchor[1];
-
-            float anchor_w = anchor[2] - anchor[0];
-            float anchor_h = anchor[3] - anchor[1];
-
-            for (int i = 0; i < h; i++) {
-                float anchor_x = anchor[0];
-
-                for (int j = 0; j < w; j++) {
-                    int index = i * w + j;
-
-                    float prob = score[index];
-
-                    if (prob >= prob_threshold) {
-                        // insightface/detection/scrfd/mmdet/models/dense_heads/scrfd_head.py _get_bboxes_single()
-                        float dx = bbox.channel(0)[index] * feat_stride;
-                        float dy = bbox.channel(1)[index] * feat_stride;
-                        float dw = bbox.channel(2)[index] * feat_stride;
-                        float dh = bbox.channel(3)[index] * feat_stride;
-
-                        // insightface/detection/scrfd/mmdet/core/bbox/transforms.py distance2bbox()
-                        float cx = anchor_x + anchor_w * 0.5f;
-                        float cy = anchor_y + anchor_h * 0.5f;
-
-                        int x0 = static_cast<int>(cx - dx);
-                        int y0 = static_cast<int>(cy - dy);
-                        int x1 = static_cast<int>(cx + dw);
-                        int y1 = static_cast<int>(cy + dh);
-
-                        FaceInfo obj;
-                        obj.location_.x = x0;
-                        obj.location_.y = y0;
-                        obj.location_.width = x1 - x0 + 1;
-                        obj.location_.height = y1 - y0 + 1;
-                        obj.score_ = prob;
-
-                        if (!kps_blob.empty()) {
-                            const ncnn::Mat kps = kps_blob.channel_range(q * 10, 10);
-
-                            obj.keypoints_[0].x = cx + kps.channel(0)[index] * feat_stride;
-                            obj.keypoints_[0].y = cy + kps.channel(1)[index] * feat_stride;
-                            obj.keypoints_[1].x = cx + kps.channel(2)[index] * feat_stride;
-                            obj.keypoints_[1].y = cy + kps.channel(3)[index] * feat_stride;
-                            obj.keypoints_[2].x = cx + kps.channel(4)[index] * feat_stride;
-                            obj.keypoints_[2].y = cy + kps.channel(5)[index] * feat_stride;
-                            obj.keypoints_[3].x = cx + kps.channel(6)[index] * feat_stride;
-                            obj.keypoints_[3].y = cy + kps.channel(7)[index] * feat_stride;
-                            obj.keypoints_[4].x = cx + kps.channel(8)[index] * feat_stride;
-                            obj.keypoints_[4].y = cy + kps.channel(9)[index] * feat_stride;
-                        }
-
-                        faces.push_back(obj);
-                    }
+            SelectScores(score_blob.channel(q), size, prob_threshold, indices);
+            if (indices.empty()) continue;
+
+            const float *score = score_blob.channel(q);
+            const float *bbox[4];
+            for (int k = 0; k < 4; ++k) {
+                bbox[k] = bbox_blob.channel(q * 4 + k);
+            }
+            const float *kps[10] = {nullptr};
+            if (!kps_blob.empty()) {
+                for (int k = 0; k < 10; ++k) {
+                    kps[k] = kps_blob.channel(q * 10 + k);
+                }
+            }
 
-                    anchor_x += feat_stride;
+            const float anchor_cx = anchors[q].x + anchors[q].width * 0.5f;
+            const float anchor_cy = anchors[q].y + anchors[q].height * 0.5f;
+
+            faces.reserve(faces.size() + indices.size());
+            for (int index : indices) {
+                const int i = index / w;
+                const int j = index - i * w;
+
+                // insightface/detection/scrfd/mmdet/models/dense_heads/scrfd_head.py _get_bboxes_single()
+                float dx = bbox[0][index] * feat_stride;
+                float dy = bbox[1][index] * feat_stride;
+                float dw = bbox[2][index] * feat_stride;
+                float dh = bbox[3][index] * feat_stride;
+
+                // insightface/detection/scrfd/mmdet/core/bbox/transforms.py distance2bbox()
+                float cx = anchor_cx + j * feat_stride;
+                float cy = anchor_cy + i * feat_stride;
+
+                int x0 = static_cast<int>(cx - dx);
+                int y0 = static_cast<int>(cy - dy);
+                int x1 = static_cast<int>(cx + dw);
+                int y1 = static_cast<int>(cy + dh);
+
+                FaceInfo obj;
+                obj.location_.x = x0;
+                obj.location_.y = y0;
+                obj.location_.width = x1 - x0 + 1;
+                obj.location_.height = y1 - y0 + 1;
+                obj.score_ = score[index];
+                obj.mask_ = false;
+
+                if (kps[0]) {
+                    for (int k = 0; k < 5; ++k) {
+                        obj.keypoints_[k].x = cx + kps[2 * k][index] * feat_stride;
+                        obj.keypoints_[k].y = cy + kps[2 * k + 1][index] * feat_stride;
+                    }
                 }
 
-                anchor_y += feat_stride;
+                faces.push_back(obj);
             }
         }
     }
 
-
     Scrfd::Scrfd(FaceDetectorType type) : Detector(type) {
         iouThreshold_ = 0.45f;
         scoreThreshold_ = 0.5f;
+        // the anchors of a cell do not depend on the input size, the cells only shift them by the stride
+        anchors_[0] = generate_anchors(16, {1.f}, {1.f, 2.f});
+        anchors_[1] = generate_anchors(64, {1.f}, {1.f, 2.f});
+        anchors_[2] = generate_anchors(256, {1.f}, {1.f, 2.f});
     }
 
     int Scrfd::loadModel(const char *root_path) {
@@ -151,28 +138,22 @@ namespace mirror {
     }
 #endif
 
-    int Scrfd::detectFace(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const {
-        cv::Mat img_cpy = img_src.clone();
-        int img_width = img_cpy.cols;
-        int img_height = img_cpy.rows;
-
-        // pad to multiple of 32
-        int w = img_width;
-        int h = img_height;
-        float scale = 1.f;
-        if (w > h) {
-            scale = (float) inputSize_.width / w;
-            w = inputSize_.width;
-            h = h * scale;
-        } else {
-            scale = (float) inputSize_.height / h;
-            h = inputSize_.height;
-            w = w * scale;
+    int Scrfd::detectFace(const cv::Mat &img_src, float scale, std::vector<FaceInfo> &faces) const {
+        int img_width = img_src.cols;
+        int img_height = img_src.rows;
+
+        // the long side fits the input size unless a scale is given
+        if (scale <= 0) {
+            scale = img_width > img_height ? (float) inputSize_.width / img_width :
+                    (float) inputSize_.height / img_height;
         }
+        int w = std::max(1, static_cast<int>(img_width * scale));
+        int h = std::max(1, static_cast<int>(img_height * scale));
 
-        ncnn::Mat in = ncnn::Mat::from_pixels_resize(img_cpy.data,
+        ncnn::Mat in = ncnn::Mat::from_pixels_resize(img_src.data,
                                                      ncnn::Mat::PIXEL_BGR2RGB,
                                                      img_width, img_height,
+                                                     static_cast<int>(img_src.step),
                                                      w, h);
 
         // pad to target_size rectangle
@@ -185,85 +166,19 @@ namespace mirror {
 
         in_pad.substract_mean_normalize(mean_vals_, norm_vals_);
 
-        ncnn::Extractor ex = net_->create_extractor();
-#if NCNN_VULKAN
-        if (this->gpu_mode_) {
-            ex.set_vulkan_compute(this->gpu_mode_);
-        }
-#endif
+        ncnn::Extractor ex = NewExtractor(net_);
         ex.input("input.1", in_pad);
 
         faces.clear();
-        // stride 8
-        {
+        for (int i = 0; i < 3; ++i) {
             ncnn::Mat score_blob, bbox_blob, kps_blob;
-            ex.extract("score_8", score_blob);
-            ex.extract("bbox_8", bbox_blob);
+            ex.extract(kScoreBlobs[i], score_blob);
+            ex.extract(kBboxBlobs[i], bbox_blob);
             if (has_kps_)
-                ex.extract("kps_8", kps_blob);
-
-            const int base_size = 16;
-            const int feat_stride = 8;
-            ncnn::Mat ratios(1);
-            ratios[0] = 1.f;
-            ncnn::Mat scales(2);
-            scales[0] = 1.f;
-            scales[1] = 2.f;
-            ncnn::Mat anchors = generate_anchors(base_size, ratios, scales);
-
-            std::vector<FaceInfo> faceobjects32;
-            generate_proposals(anchors, feat_stride, score_blob, bbox_blob,
-                               kps_blob, scoreThreshold_, faceobjects32);
-
-            faces.insert(faces.end(), faceobjects32.begin(), faceobjects32.end());
-        }
+                ex.extract(kKpsBlobs[i], kps_blob);
 
-        // stride 16
-        {
-            ncnn::Mat score_blob, bbox_blob, kps_blob;
-            ex.extract("score_16", score_blob);
-            ex.extract("bbox_16", bbox_blob);
-            if (has_kps_)
-                ex.extract("kps_16", kps_blob);
-
-            const int base_size = 64;
-            const int feat_stride = 16;
-            ncnn::Mat ratios(1);
-            ratios[0] = 1.f;
-            ncnn::Mat scales(2);
-            scales[0] = 1.f;
-            scales[1] = 2.f;
-            ncnn::Mat anchors = generate_anchors(base_size, ratios, scales);
-
-            std::vector<FaceInfo> faceobjects16;
-            generate_proposals(anchors, feat_stride, score_blob, bbox_blob, kps_blob,
-                               scoreThreshold_, faceobjects16);
-
-            faces.insert(faces.end(), faceobjects16.begin(), faceobjects16.end());
-        }
-
-        // stride 32
-        {
-            ncnn::Mat score_blob, bbox_blob, kps_blob;
-            ex.extract("score_32", score_blob);
-            ex.extract("bbox_32", bbox_blob);
-            if (has_kps_)
-                ex.extract("kps_32", kps_blob);
-
-            const int base_size = 256;
-            const int feat_stride = 32;
-            ncnn::Mat ratios(1);
-            ratios[0] = 1.f;
-            ncnn::Mat scales(2);
-            scales[0] = 1.f;
-            scales[1] = 2.f;
-            ncnn::Mat anchors = generate_anchors(base_size, ratios, scales);
-
-            std::vector<FaceInfo> faceobjects8;
-            generate_proposals(anchors, feat_stride, score_blob, bbox_blob, kps_blob,
-                               scoreThreshold_, faceobjects8);
-
-            faces.insert(faces.end(), faceobjects8.begin(), faceobjects8.end());
+            generate_proposals(anchors_[i], featStrides_[i], score_blob, bbox_blob,
+                               kps_blob, scoreThreshold_, faces);
         }
 
         for (int i = 0; i < faces.size(); i++) {
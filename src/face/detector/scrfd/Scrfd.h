@@ -16,12 +16,14 @@ namespace mirror {
         int loadModel(AAssetManager* mgr) override;
 #endif
 
-        int detectFace(const cv::Mat &img_src, std::vector<FaceInfo> &faces) const override;
+        int detectFace(const cv::Mat &img_src, float scale, std::vector<FaceInfo> &faces) const override;
 
     private:
         const cv::Size inputSize_ = {640, 640};
         const float mean_vals_[3] = {127.5f, 127.5f, 127.5f};
         const float norm_vals_[3] = {1 / 128.f, 1 / 128.f, 1 / 128.f};
+        const int featStrides_[3] = {8, 16, 32};
+        std::vector<cv::Rect2f> anchors_[3]; // anchors of a cell at the origin, per stride
 
     };
 }
\ No newline at end of file
@@ -14,6 +14,7 @@ namespace mirror {
             verbose_(false),
             gpu_mode_(false),
             initialized_(false),
+            numThreads_(1),
             faceFaceFeatureDim_(kFaceFeatureDim),
             inputSize_(cv::Size(112, 112)),
             modelPath_("/face/recognizers") {
@@ -73,6 +74,7 @@ namespace mirror {
         }
         ncnn::set_omp_num_threads(num_threads);
         opt.num_threads = num_threads;
+        numThreads_ = num_threads;
 
 #if NCNN_VULKAN
         this->gpu_mode_ = params.gpuEnabled && ncnn::get_gpu_count() > 0;
@@ -108,6 +110,19 @@ namespace mirror {
         return flag;
     }
 
+    //    This is a normalize function before calculating the cosine distance. Experiment has proven it can destory the
+    //    original distribution in order to make two feature more distinguishable.
+    //    mean value is set to 0 and std is set to 1
+    static void StandardizeFeature(std::vector<float> &feature) {
+        float mean;
+        float variance;
+        ComputeMeanAndVariance<float>(feature, mean, &variance);
+        float stdDev = std::sqrt(variance);
+        for (std::size_t i = 0; i < feature.size(); ++i) {
+            feature.at(i) = (feature.at(i) - mean) / stdDev;
+        }
+    }
+
     int Recognizer::extract(const cv::Mat &img_face, std::vector<float> &feature) const {
         feature.clear();
         if (!initialized_) {
@@ -129,16 +144,7 @@ namespace mirror {
         if (flag != 0) {
             std::cout << "extract failed." << std::endl;
         } else {
-            //    This is a normalize function before calculating the cosine distance. Experiment has proven it can destory the
-            //    original distribution in order to make two feature more distinguishable.
-            //    mean value is set to 0 and std is set to 1
-            float mean;
-            float variance;
-            ComputeMeanAndVariance<float>(feature, mean, &variance);
-            float stdDev = std::sqrt(variance);
-            for (std::size_t i = 0; i < feature.size(); ++i) {
-                feature.at(i) = (feature.at(i) - mean) / stdDev;
-            }
+            StandardizeFeature(feature);
 
             if (verbose_) {
                 std::cout << "end extract feature." << std::endl;
@@ -147,6 +153,58 @@ namespace mirror {
         return flag;
     }
 
+    int Recognizer::extractFeatures(const std::vector<cv::Mat> &faces,
+                                    std::vector<std::vector<float>> &features) const {
+        features.clear();
+        if (!initialized_) {
+            std::cout << "face recognizer model: "
+                      << GetRecognizerTypeName(this->type_)
+                      << " uninitialized!" << std::endl;
+            return ErrorCode::UNINITIALIZED_ERROR;
+        }
+        if (faces.empty()) {
+            std::cout << "input empty." << std::endl;
+            return ErrorCode::EMPTY_INPUT_ERROR;
+        }
+        for (const auto &face : faces) {
+            if (face.empty()) {
+                std::cout << "input empty." << std::endl;
+                return ErrorCode::EMPTY_INPUT_ERROR;
+            }
+        }
+
+        if (verbose_) {
+            std::cout << "start extract " << faces.size() << " features." << std::endl;
+        }
+
+        int flag = this->extractFeatureBatch(faces, features);
+        if (flag != 0) {
+            std::cout << "extract failed." << std::endl;
+            features.clear();
+            return flag;
+        }
+        for (auto &feature : features) {
+            StandardizeFeature(feature);
+        }
+
+        if (verbose_) {
+            std::cout << "end extract features." << std::endl;
+        }
+        return 0;
+    }
+
+    int Recognizer::extractFeatureBatch(const std::vector<cv::Mat> &faces,
+                                        std::vector<std::vector<float>> &features) const {
+        features.resize(faces.size());
+        for (size_t i = 0; i < faces.size(); ++i) {
+            int flag = this->extractFeature(faces[i], features[i]);
+            if (flag != 0) {
+                return flag;
+            }
+        }
+        return 0;
+    }
+
     Recognizer *MobilefacenetRecognizerFactory::CreateRecognizer() const {
         return new MobileFacenet();
     }
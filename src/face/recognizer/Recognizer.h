@@ -20,8 +20,21 @@ namespace mirror {
 
         int extract(const cv::Mat &img_face, std::vector<float> &feature) const;
 
+        /// \brief Extract the features of several aligned faces in one call, features[i] belongs to faces[i].
+        /// The faces are shared out among extractors running side by side on the threads of the model.
+        int extractFeatures(const std::vector<cv::Mat> &faces, std::vector<std::vector<float>> &features) const;
+
         inline FaceRecognizerType getType() const { return type_; }
 
+        //! Dimension of the features the model extracts
+        inline int getFeatureDim() const { return faceFaceFeatureDim_; }
+
+        // input the model takes, an aligned face of this size whose RGB values are fed as (value - mean) * norm;
+        // FaceAligner::alignFaceTensor produces it straight from the frame, extract accepts it as the face
+        inline cv::Size getInputSize() const { return inputSize_; }
+        inline const float *getMeanVals() const { return meanVals_; }
+        inline const float *getNormVals() const { return normVals_; }
+
     protected:
 
 #if defined __ANDROID__
@@ -34,14 +47,21 @@ namespace mirror {
 
         virtual int extractFeature(const cv::Mat &img_face, std::vector<float> &feature) const = 0;
 
+        //! Raw features of a batch of faces, one face after the other unless the model does better
+        virtual int extractFeatureBatch(const std::vector<cv::Mat> &faces,
+                                        std::vector<std::vector<float>> &features) const;
+
     protected:
         FaceRecognizerType type_;
         ncnn::Net *net_ = nullptr;
         bool verbose_ = false;
         bool gpu_mode_ = false;
         bool initialized_ = false;
+        int numThreads_ = 1;
         int faceFaceFeatureDim_ = kFaceFeatureDim;
         cv::Size inputSize_ = {112, 112};
+        float meanVals_[3] = {0.0f, 0.0f, 0.0f};
+        float normVals_[3] = {1.0f, 1.0f, 1.0f};
         std::string modelPath_;
 
     };
@@ -1,9 +1,45 @@
 #include "MobileFacenet.h"
+#include <algorithm>
+#include <atomic>
 #include <string>
 #include <iostream>
+#include <thread>
 #include <ncnn/net.h>
 
 namespace mirror {
+    /// \brief Input blob of an aligned BGR face, or of the planar RGB tensor of FaceAligner::alignFaceTensor, which
+    /// is already normalized and is used in place where ncnn can read it as is.
+    static int MakeInput(const cv::Mat &face, const cv::Size &input_size, const float *mean_vals,
+                         const float *norm_vals, ncnn::Allocator *allocator, ncnn::Mat &in) {
+        if (face.type() == CV_32FC1) {
+            if (face.cols != input_size.width || face.rows != 3 * input_size.height || !face.isContinuous()) {
+                std::cout << "face tensor size mismatch." << std::endl;
+                return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+            }
+            const size_t plane = static_cast<size_t>(input_size.width) * input_size.height;
+            in = ncnn::Mat(input_size.width, input_size.height, 3, const_cast<float *>(face.ptr<float>(0)), 4u);
+            if (in.cstep != plane) {
+                // ncnn pads the channels of this size, the planes are copied to their padded place
+                in.create(input_size.width, input_size.height, 3, 4u, allocator);
+                for (int c = 0; c < 3; ++c) {
+                    const float *src = face.ptr<float>(0) + c * plane;
+                    std::copy(src, src + plane, static_cast<float *>(in.channel(c)));
+                }
+            }
+            return 0;
+        }
+
+        if (face.type() != CV_8UC3) {
+            std::cout << "unsupported face type, a BGR face or a face tensor is expected." << std::endl;
+            return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+        }
+        in = ncnn::Mat::from_pixels_resize(face.data, ncnn::Mat::PIXEL_BGR2RGB, face.cols, face.rows,
+                                           static_cast<int>(face.step), input_size.width, input_size.height,
+                                           allocator);
+        in.substract_mean_normalize(mean_vals, norm_vals);
+        return 0;
+    }
+
     MobileFacenet::MobileFacenet(FaceRecognizerType type) : Recognizer(type) {
         faceFaceFeatureDim_ = 128;
         inputSize_.width = 112;
@@ -26,10 +62,11 @@ namespace mirror {
 #endif
 
     int MobileFacenet::extractFeature(const cv::Mat &img_face, std::vector<float> &feature) const {
-        cv::Mat face_cpy = img_face.clone();
-        ncnn::Mat in = ncnn::Mat::from_pixels_resize(face_cpy.data,
-                                                     ncnn::Mat::PIXEL_BGR2RGB, face_cpy.cols,
-                                                     face_cpy.rows, inputSize_.width, inputSize_.height);
+        ncnn::Mat in;
+        int flag = MakeInput(img_face, inputSize_, meanVals_, normVals_, nullptr, in);
+        if (flag != 0) {
+            return flag;
+        }
         feature.resize(faceFaceFeatureDim_);
         ncnn::Extractor ex = this->net_->create_extractor();
 #if NCNN_VULKAN
@@ -40,6 +77,12 @@ namespace mirror {
         ex.input("data", in);
         ncnn::Mat out;
         ex.extract("fc1", out);
+        if (static_cast<int>(out.total()) != faceFaceFeatureDim_) {
+            std::cout << "feature dimension of the model: " << out.total()
+                      << " mismatch: " << faceFaceFeatureDim_ << std::endl;
+            feature.clear();
+            return ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+        }
 
 #if defined(_OPENMP)
 #pragma omp parallel for num_threads(CUSTOM_THREAD_NUMBER)
@@ -51,6 +94,63 @@ namespace mirror {
         return 0;
     }
 
+    int MobileFacenet::extractFeatureBatch(const std::vector<cv::Mat> &faces,
+                                           std::vector<std::vector<float>> &features) const {
+        const int num_faces = static_cast<int>(faces.size());
+        features.resize(faces.size());
+        // the threads of the model are shared out among extractors running side by side, a face per extractor
+        // keeps every thread busy where the layers of a 112x112 face are too small to split well
+        const int num_workers = this->gpu_mode_ ? 1 : std::max(1, std::min(num_faces, numThreads_));
+        const int worker_threads = std::max(1, numThreads_ / num_workers);
+        std::atomic<int> next(0);
+        std::atomic<int> status(0);
+        auto work = [&]() {
+            // the blobs of a face are recycled for the next one, a worker allocates once for the whole batch;
+            // declared before the blobs, so that these are released first
+            ncnn::UnlockedPoolAllocator blob_allocator;
+            ncnn::UnlockedPoolAllocator workspace_allocator;
+            ncnn::Mat in;
+            ncnn::Mat out;
+            for (int i = next.fetch_add(1); i < num_faces && status == 0; i = next.fetch_add(1)) {
+                int flag = MakeInput(faces[i], inputSize_, meanVals_, normVals_, &blob_allocator, in);
+                if (flag != 0) {
+                    status = flag;
+                    break;
+                }
+                ncnn::Extractor ex = this->net_->create_extractor();
+                ex.set_light_mode(true);
+                ex.set_num_threads(worker_threads);
+                ex.set_blob_allocator(&blob_allocator);
+                ex.set_workspace_allocator(&workspace_allocator);
+#if NCNN_VULKAN
+                if (this->gpu_mode_) {
+                    ex.set_vulkan_compute(this->gpu_mode_);
+                }
+#endif
+                ex.input("data", in);
+                ex.extract("fc1", out);
+                if (static_cast<int>(out.total()) != faceFaceFeatureDim_) {
+                    std::cout << "feature dimension of the model: " << out.total()
+                              << " mismatch: " << faceFaceFeatureDim_ << std::endl;
+                    status = ErrorCode::DIMENSION_MISS_MATCH_ERROR;
+                    break;
+                }
+                const float *data = out;
+                features[i].assign(data, data + faceFaceFeatureDim_);
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (int w = 1; w < num_workers; ++w) {
+            workers.emplace_back(work);
+        }
+        work();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        return status;
+    }
+
 }
 
 
@@ -19,6 +19,9 @@ namespace mirror {
 #endif
 
         int extractFeature(const cv::Mat &img_face, std::vector<float> &feature) const override;
+
+        int extractFeatureBatch(const std::vector<cv::Mat> &faces,
+                                std::vector<std::vector<float>> &features) const override;
     };
 
 }
\ No newline at end of file
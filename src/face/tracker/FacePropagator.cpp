@@ -0,0 +1,90 @@
+#include "FacePropagator.h"
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+
+namespace mirror {
+    // width the faces are matched at, larger faces are scaled down to it
+    static const int kTemplateWidth = 32;
+    // the search window reaches this fraction of the face size beyond the predicted box
+    static const float kSearchMargin = 0.25f;
+    // weakest normalized correlation still taken for the same face
+    static const float kMinResponse = 0.6f;
+
+    static void ToGray(const cv::Mat &src, cv::Mat &dst) {
+        if (src.channels() == 1) {
+            src.copyTo(dst);
+        } else {
+            cv::cvtColor(src, dst, src.channels() == 4 ? cv::COLOR_BGRA2GRAY : cv::COLOR_BGR2GRAY);
+        }
+    }
+
+    int FacePropagator::reset(const cv::Mat &frame, const std::vector<FaceInfo> &faces) {
+        targets_.clear();
+        if (frame.empty()) {
+            return ErrorCode::EMPTY_INPUT_ERROR;
+        }
+        const cv::Rect bounds(0, 0, frame.cols, frame.rows);
+        for (const auto &face : faces) {
+            const cv::Rect box = face.location_ & bounds;
+            // a face cut by the border would be matched on part of itself only
+            if (box != face.location_ || box.width < 4 || box.height < 4) continue;
+            Target target;
+            target.face = face;
+            target.scale = std::min(1.0f, static_cast<float>(kTemplateWidth) / box.width);
+            ToGray(frame(box), gray_);
+            cv::resize(gray_, target.templ, cv::Size(), target.scale, target.scale, cv::INTER_AREA);
+            target.velocity = cv::Point2f(0.0f, 0.0f);
+            targets_.push_back(target);
+        }
+        return 0;
+    }
+
+    bool FacePropagator::propagate(const cv::Mat &frame, std::vector<FaceInfo> &faces, float &motion) {
+        faces.clear();
+        motion = 0.0f;
+        if (frame.empty()) return false;
+        const cv::Rect bounds(0, 0, frame.cols, frame.rows);
+        for (auto &target : targets_) {
+            // search around where the face goes if it keeps its last motion
+            const cv::Rect &box = target.face.location_;
+            const float margin = kSearchMargin * std::max(box.width, box.height);
+            const float reach_x = margin + std::abs(target.velocity.x);
+            const float reach_y = margin + std::abs(target.velocity.y);
+            const int x0 = cvFloor(box.x + target.velocity.x - reach_x);
+            const int y0 = cvFloor(box.y + target.velocity.y - reach_y);
+            const int x1 = cvCeil(box.x + box.width + target.velocity.x + reach_x);
+            const int y1 = cvCeil(box.y + box.height + target.velocity.y + reach_y);
+            const cv::Rect window = cv::Rect(x0, y0, x1 - x0, y1 - y0) & bounds;
+
+            const cv::Size size(cvRound(window.width * target.scale), cvRound(window.height * target.scale));
+            if (size.width < target.templ.cols || size.height < target.templ.rows) {
+                return false;
+            }
+            ToGray(frame(window), gray_);
+            cv::resize(gray_, window_, size, 0, 0, cv::INTER_AREA);
+            cv::matchTemplate(window_, target.templ, response_, cv::TM_CCOEFF_NORMED);
+            double response = 0.0;
+            cv::Point best;
+            cv::minMaxLoc(response_, nullptr, &response, nullptr, &best);
+            if (response < kMinResponse) {
+                return false;
+            }
+
+            const float dx = window.x + best.x / target.scale - box.x;
+            const float dy = window.y + best.y / target.scale - box.y;
+            const int shift_x = cvRound(dx);
+            const int shift_y = cvRound(dy);
+            target.velocity = cv::Point2f(dx, dy);
+            target.face.location_.x += shift_x;
+            target.face.location_.y += shift_y;
+            for (auto &keypoint : target.face.keypoints_) {
+                keypoint += cv::Point2f(dx, dy);
+            }
+            motion = std::max(motion, std::sqrt(dx * dx + dy * dy) / std::max(box.width, 1));
+            faces.push_back(target.face);
+        }
+        return true;
+    }
+
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <opencv2/core.hpp>
+#include "../common/common.h"
+
+namespace mirror {
+/// \brief Follows the faces of a keyframe through the next frames without the detector. Every face keeps a small
+/// gray template of its keyframe look, and is searched for around where its last motion carries it by normalized
+/// cross correlation; the box and keypoints move with the best match. The templates are only taken from
+/// detections, so the drift is bounded by the distance between keyframes.
+class FacePropagator {
+public:
+    FacePropagator() = default;
+    ~FacePropagator() = default;
+
+    //! Follow 'faces', detected in 'frame', from now on
+    int reset(const cv::Mat& frame, const std::vector<FaceInfo>& faces);
+
+    /// \brief Move the followed faces into 'frame'.
+    /// \param faces [out] The faces at their new place.
+    /// \param motion [out] Largest displacement of a face, relative to its width.
+    /// \return false once a face cannot be found again, the detector should take over.
+    bool propagate(const cv::Mat& frame, std::vector<FaceInfo>& faces, float& motion);
+
+private:
+    struct Target {
+        FaceInfo face;
+        cv::Mat templ; // gray face, scaled by 'scale'
+        float scale = 1.0f;
+        cv::Point2f velocity; // displacement of the last frame
+    };
+
+    std::vector<Target> targets_;
+    // buffers of the search, reused from face to face
+    cv::Mat gray_;
+    cv::Mat window_;
+    cv::Mat response_;
+};
+
+}
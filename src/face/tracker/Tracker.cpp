@@ -1,54 +1,287 @@
 #include "Tracker.h"
-#include <iostream>
-#include <queue>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 namespace mirror {
-    int Tracker::track(const std::vector<FaceInfo> &curr_faces, std::vector<TrackedFaceInfo> &faces) {
-        std::cout << "start track face." << std::endl;
-        faces.clear();
-        int num_faces = static_cast<int>(curr_faces.size());
-
-        std::deque<TrackedFaceInfo> scored_tracked_faces(pre_tracked_faces_.begin(), pre_tracked_faces_.end());
-        std::vector<TrackedFaceInfo> curr_tracked_faces;
-        for (int i = 0; i < num_faces; ++i) {
-            auto &face = curr_faces.at(i);
-            for (auto scored_tracked_face : scored_tracked_faces) {
-                ComputeIOU(scored_tracked_face.face_info_.location_,
-                           face.location_, &scored_tracked_face.iou_score_);
+    // noise of the box coordinates relative to the face height, as in DeepSORT
+    static const float kStdPosition = 1.0f / 20;
+    static const float kStdVelocity = 1.0f / 160;
+    // weight of the center distance, in face sizes, next to 1 - IoU in the assignment cost
+    static const float kDistanceWeight = 0.5f;
+    // cost of the pairs out of the gate, larger than any pair in it
+    static const float kInfeasible = 1e4f;
+
+    void Tracker::KalmanAxis::Init(float z, float std_pos, float std_vel) {
+        x = z;
+        v = 0.0f;
+        p00 = 4 * std_pos * std_pos;
+        p01 = 0.0f;
+        p11 = 100 * std_vel * std_vel;
+    }
+
+    void Tracker::KalmanAxis::Predict(float q_pos, float q_vel) {
+        // x' = F x, P' = F P F^T + Q with F = [1 1; 0 1]
+        x += v;
+        p00 += 2 * p01 + p11 + q_pos;
+        p01 += p11;
+        p11 += q_vel;
+    }
+
+    void Tracker::KalmanAxis::Update(float z, float r) {
+        // the position alone is measured, H = [1 0]
+        const float s = p00 + r;
+        const float k0 = p00 / s;
+        const float k1 = p01 / s;
+        const float y = z - x;
+        x += k0 * y;
+        v += k1 * y;
+        p11 -= k1 * p01;
+        p01 -= k0 * p01;
+        p00 -= k0 * p00;
+    }
+
+    int Tracker::update(const FaceEngineParams &params) {
+        max_age_ = std::max(0, params.trackMaxAge);
+        min_hits_ = std::max(1, params.trackMinHits);
+        return 0;
+    }
+
+    int Tracker::Find(int node) {
+        while (parents_[node] != node) {
+            parents_[node] = parents_[parents_[node]];
+            node = parents_[node];
+        }
+        return node;
+    }
+
+    void Tracker::Predict() {
+        for (auto &track : tracks_) {
+            const float h = track.axes[3].x;
+            const float q_pos = (kStdPosition * h) * (kStdPosition * h);
+            const float q_vel = (kStdVelocity * h) * (kStdVelocity * h);
+            for (auto &axis : track.axes) {
+                axis.Predict(q_pos, q_vel);
             }
-            if (!scored_tracked_faces.empty()) {
-                std::partial_sort(scored_tracked_faces.begin(),
-                                  scored_tracked_faces.begin() + 1,
-                                  scored_tracked_faces.end(),
-                                  [](const TrackedFaceInfo &a, const TrackedFaceInfo &b) {
-                                      return a.iou_score_ > b.iou_score_;
-                                  });
+            track.axes[2].x = std::max(track.axes[2].x, 1.0f);
+            track.axes[3].x = std::max(track.axes[3].x, 1.0f);
+            ++track.misses;
+        }
+    }
+
+    void Tracker::Solve(int rows, int cols) {
+        // shortest augmenting path Hungarian method on the rows x cols costs_, O(min^2 * max)
+        const bool transposed = rows > cols;
+        const int n = transposed ? cols : rows;
+        const int m = transposed ? rows : cols;
+        const float infinity = std::numeric_limits<float>::max();
+        u_.assign(n + 1, 0.0f);
+        v_.assign(m + 1, 0.0f);
+        p_.assign(m + 1, 0);
+        way_.assign(m + 1, 0);
+        for (int i = 1; i <= n; ++i) {
+            p_[0] = i;
+            int j0 = 0;
+            minv_.assign(m + 1, infinity);
+            used_.assign(m + 1, 0);
+            do {
+                used_[j0] = 1;
+                const int i0 = p_[j0];
+                float delta = infinity;
+                int j1 = 0;
+                for (int j = 1; j <= m; ++j) {
+                    if (used_[j]) continue;
+                    const float cost = transposed ? costs_[(j - 1) * cols + i0 - 1] : costs_[(i0 - 1) * cols + j - 1];
+                    const float cur = cost - u_[i0] - v_[j];
+                    if (cur < minv_[j]) {
+                        minv_[j] = cur;
+                        way_[j] = j0;
+                    }
+                    if (minv_[j] < delta) {
+                        delta = minv_[j];
+                        j1 = j;
+                    }
+                }
+                for (int j = 0; j <= m; ++j) {
+                    if (used_[j]) {
+                        u_[p_[j]] += delta;
+                        v_[j] -= delta;
+                    } else {
+                        minv_[j] -= delta;
+                    }
+                }
+                j0 = j1;
+            } while (p_[j0] != 0);
+            do {
+                const int j1 = way_[j0];
+                p_[j0] = p_[j1];
+                j0 = j1;
+            } while (j0 != 0);
+        }
+
+        assigned_.assign(rows, -1);
+        for (int j = 1; j <= m; ++j) {
+            if (p_[j] == 0) continue;
+            if (transposed) {
+                assigned_[j - 1] = p_[j] - 1;
+            } else {
+                assigned_[p_[j] - 1] = j - 1;
             }
-            if (!scored_tracked_faces.empty() && scored_tracked_faces.front().iou_score_ > minScore_) {
-                TrackedFaceInfo matched_face = scored_tracked_faces.front();
-                scored_tracked_faces.pop_front();
-                TrackedFaceInfo &tracked_face = matched_face;
-                if (matched_face.iou_score_ < maxScore_) {
-                    tracked_face.face_info_.location_.x = (tracked_face.face_info_.location_.x + face.location_.x) / 2;
-                    tracked_face.face_info_.location_.y = (tracked_face.face_info_.location_.y + face.location_.y) / 2;
-                    tracked_face.face_info_.location_.width =
-                            (tracked_face.face_info_.location_.width + face.location_.width) / 2;
-                    tracked_face.face_info_.location_.height =
-                            (tracked_face.face_info_.location_.height + face.location_.height) / 2;
-                } else {
-                    tracked_face.face_info_ = face;
+        }
+    }
+
+    void Tracker::Associate(const std::vector<FaceInfo> &curr_faces) {
+        const int num_tracks = static_cast<int>(tracks_.size());
+        const int num_faces = static_cast<int>(curr_faces.size());
+        track_match_.assign(num_tracks, -1);
+        face_match_.assign(num_faces, -1);
+        match_iou_.assign(num_faces, 0.0f);
+
+        // gate the pairs, a face may only go to a track it overlaps or is at most a face size away from
+        edges_.clear();
+        for (int t = 0; t < num_tracks; ++t) {
+            const KalmanAxis *axes = tracks_[t].axes;
+            const float tw = axes[2].x, th = axes[3].x;
+            const float tx0 = axes[0].x - tw / 2, ty0 = axes[1].x - th / 2;
+            const float size = std::sqrt(tw * th);
+            for (int f = 0; f < num_faces; ++f) {
+                const cv::Rect &box = curr_faces[f].location_;
+                const float dx = box.x + box.width / 2.0f - axes[0].x;
+                const float dy = box.y + box.height / 2.0f - axes[1].x;
+                if (std::abs(dx) > size + box.width || std::abs(dy) > size + box.height) continue;
+                const float iw = std::min(tx0 + tw, static_cast<float>(box.x + box.width)) -
+                                 std::max(tx0, static_cast<float>(box.x));
+                const float ih = std::min(ty0 + th, static_cast<float>(box.y + box.height)) -
+                                 std::max(ty0, static_cast<float>(box.y));
+                const float inter = iw > 0 && ih > 0 ? iw * ih : 0.0f;
+                const float iou = inter / (tw * th + static_cast<float>(box.area()) - inter);
+                const float distance = std::sqrt(dx * dx + dy * dy) / size;
+                if (iou <= 0.0f && distance > 1.0f) continue;
+                Edge edge;
+                edge.track = t;
+                edge.face = f;
+                edge.iou = iou;
+                edge.cost = 1.0f - iou + kDistanceWeight * std::min(1.0f, distance);
+                edges_.push_back(edge);
+            }
+        }
+        if (edges_.empty()) return;
+
+        // faces far apart do not compete for the same tracks, every group of connected pairs is solved alone,
+        // which keeps hundreds of faces per frame to many small problems
+        parents_.resize(num_tracks + num_faces);
+        for (int i = 0; i < num_tracks + num_faces; ++i) {
+            parents_[i] = i;
+        }
+        for (const auto &edge : edges_) {
+            const int a = Find(edge.track);
+            const int b = Find(num_tracks + edge.face);
+            if (a != b) parents_[a] = b;
+        }
+        for (auto &edge : edges_) {
+            edge.group = Find(edge.track);
+        }
+        std::sort(edges_.begin(), edges_.end(), [](const Edge &a, const Edge &b) {
+            return a.group < b.group;
+        });
+
+        local_.assign(num_tracks + num_faces, -1);
+        for (size_t begin = 0, end = 0; begin < edges_.size(); begin = end) {
+            rows_.clear();
+            cols_.clear();
+            for (end = begin; end < edges_.size() && edges_[end].group == edges_[begin].group; ++end) {
+                const Edge &edge = edges_[end];
+                if (local_[edge.track] < 0) {
+                    local_[edge.track] = static_cast<int>(rows_.size());
+                    rows_.push_back(edge.track);
                 }
-                curr_tracked_faces.push_back(tracked_face);
+                if (local_[num_tracks + edge.face] < 0) {
+                    local_[num_tracks + edge.face] = static_cast<int>(cols_.size());
+                    cols_.push_back(edge.face);
+                }
+            }
+
+            const int rows = static_cast<int>(rows_.size());
+            const int cols = static_cast<int>(cols_.size());
+            if (rows == 1 && cols == 1) {
+                track_match_[rows_[0]] = cols_[0];
+                face_match_[cols_[0]] = rows_[0];
+                match_iou_[cols_[0]] = edges_[begin].iou;
             } else {
-                TrackedFaceInfo tracked_face;
-                tracked_face.face_info_ = face;
-                curr_tracked_faces.push_back(tracked_face);
+                costs_.assign(static_cast<size_t>(rows) * cols, kInfeasible);
+                for (size_t e = begin; e < end; ++e) {
+                    costs_[local_[edges_[e].track] * cols + local_[num_tracks + edges_[e].face]] = edges_[e].cost;
+                }
+                Solve(rows, cols);
+                for (size_t e = begin; e < end; ++e) {
+                    const Edge &edge = edges_[e];
+                    if (assigned_[local_[edge.track]] == local_[num_tracks + edge.face]) {
+                        track_match_[edge.track] = edge.face;
+                        face_match_[edge.face] = edge.track;
+                        match_iou_[edge.face] = edge.iou;
+                    }
+                }
             }
+            for (int track : rows_) local_[track] = -1;
+            for (int face : cols_) local_[num_tracks + face] = -1;
+        }
+    }
+
+    int Tracker::track(const std::vector<FaceInfo> &curr_faces, std::vector<TrackedFaceInfo> &faces) {
+        faces.clear();
+        Predict();
+        Associate(curr_faces);
+
+        const int num_tracks = static_cast<int>(tracks_.size());
+        for (int t = 0; t < num_tracks; ++t) {
+            const int f = track_match_[t];
+            if (f < 0) continue;
+            Track &track = tracks_[t];
+            const cv::Rect &box = curr_faces[f].location_;
+            const float r = (kStdPosition * track.axes[3].x) * (kStdPosition * track.axes[3].x);
+            track.axes[0].Update(box.x + box.width / 2.0f, r);
+            track.axes[1].Update(box.y + box.height / 2.0f, r);
+            track.axes[2].Update(static_cast<float>(box.width), r);
+            track.axes[3].Update(static_cast<float>(box.height), r);
+            track.face = curr_faces[f];
+            track.misses = 0;
+            ++track.hits;
+            track.confirmed = track.confirmed || track.hits >= min_hits_;
+        }
+
+        // faces no track took start tentative tracks
+        for (size_t f = 0; f < curr_faces.size(); ++f) {
+            if (face_match_[f] >= 0) continue;
+            const cv::Rect &box = curr_faces[f].location_;
+            Track track;
+            const float h = static_cast<float>(std::max(box.height, 1));
+            track.axes[0].Init(box.x + box.width / 2.0f, kStdPosition * h, kStdVelocity * h);
+            track.axes[1].Init(box.y + box.height / 2.0f, kStdPosition * h, kStdVelocity * h);
+            track.axes[2].Init(static_cast<float>(std::max(box.width, 1)), kStdPosition * h, kStdVelocity * h);
+            track.axes[3].Init(h, kStdPosition * h, kStdVelocity * h);
+            track.face = curr_faces[f];
+            track.id = next_track_id_++;
+            track.hits = 1;
+            track.confirmed = min_hits_ <= 1;
+            face_match_[f] = static_cast<int>(tracks_.size());
+            tracks_.push_back(track);
+        }
+
+        for (size_t f = 0; f < curr_faces.size(); ++f) {
+            const Track &track = tracks_[face_match_[f]];
+            if (!track.confirmed) continue;
+            TrackedFaceInfo tracked_face;
+            tracked_face.face_info_ = curr_faces[f];
+            tracked_face.iou_score_ = match_iou_[f];
+            tracked_face.track_id_ = track.id;
+            faces.push_back(tracked_face);
         }
 
-        pre_tracked_faces_ = curr_tracked_faces;
-        faces = curr_tracked_faces;
-        std::cout << "end track face." << std::endl;
+        // a tentative track missed once is a false detection, a confirmed one waits max_age_ frames
+        const int max_age = max_age_;
+        tracks_.erase(std::remove_if(tracks_.begin(), tracks_.end(), [max_age](const Track &track) {
+            return track.misses > (track.confirmed ? max_age : 0);
+        }), tracks_.end());
         return 0;
     }
 
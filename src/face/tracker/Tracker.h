@@ -5,16 +5,74 @@
 #include "../common/common.h"
 
 namespace mirror {
+/// \brief Multi face tracker: a constant velocity Kalman filter per track predicts where its face moved, the
+/// detections are assigned to the predictions by minimum cost (Hungarian) over IoU and center distance.
+/// A track is reported once it has been matched trackMinHits times and is kept trackMaxAge frames without
+/// a match before it is dropped, so a face missed by the detector for a few frames keeps its track id.
+/// The buffers are kept across frames, a steady scene tracks without allocating.
 class Tracker {
 public:
     Tracker() = default;
     ~Tracker() = default;
+
+    //! Take the track lifecycle parameters, trackMaxAge and trackMinHits
+    int update(const FaceEngineParams &params);
+
+    //! Faces of the confirmed tracks matched in 'curr_faces', in the order of 'curr_faces'
     int track(const std::vector<FaceInfo>& curr_faces, std::vector<TrackedFaceInfo>& faces);
 
 private:
-    std::vector<TrackedFaceInfo> pre_tracked_faces_;
-    const float minScore_ = 0.3f;
-    const float maxScore_ = 0.5f;
+    //! Kalman filter of one box coordinate with its velocity, the four coordinates of a box move independently
+    struct KalmanAxis {
+        float x = 0.0f, v = 0.0f;
+        float p00 = 0.0f, p01 = 0.0f, p11 = 0.0f;
+
+        void Init(float z, float std_pos, float std_vel);
+        void Predict(float q_pos, float q_vel);
+        void Update(float z, float r);
+    };
+
+    struct Track {
+        KalmanAxis axes[4]; // center x, center y, width, height
+        FaceInfo face; // last matched detection
+        int id = -1;
+        int hits = 0;
+        int misses = 0; // frames since the last match
+        bool confirmed = false;
+    };
+
+    //! Pair of a track and a face in the gate
+    struct Edge {
+        int track;
+        int face;
+        int group; // connected pairs share a group
+        float iou;
+        float cost;
+    };
+
+    void Predict();
+    void Associate(const std::vector<FaceInfo>& curr_faces);
+    void Solve(int rows, int cols);
+    int Find(int node);
+
+    std::vector<Track> tracks_;
+    int next_track_id_ = 0;
+    int max_age_ = 30;
+    int min_hits_ = 3;
+
+    // association buffers, reused from frame to frame
+    std::vector<Edge> edges_;
+    std::vector<int> track_match_;
+    std::vector<int> face_match_;
+    std::vector<float> match_iou_;
+    std::vector<int> parents_;
+    std::vector<int> local_;
+    std::vector<int> rows_;
+    std::vector<int> cols_;
+    std::vector<float> costs_;
+    std::vector<float> u_, v_, minv_;
+    std::vector<int> p_, way_, assigned_;
+    std::vector<char> used_;
 };
 
-}
\ No newline at end of file
+}